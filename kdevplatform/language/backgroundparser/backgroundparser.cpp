@@ -24,14 +24,18 @@
 #include "backgroundparser.h"
 
 #include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QList>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QPointer>
+#include <QRunnable>
 #include <QTimer>
 #include <QThread>
+#include <QThreadPool>
 
 #include <KConfigGroup>
+#include <KFormat>
 #include <KSharedConfig>
 #include <KLocalizedString>
 
@@ -47,14 +51,45 @@
 #include <interfaces/iproject.h>
 #include <interfaces/iprojectcontroller.h>
 
+#include <language/duchain/duchain.h>
+#include <language/duchain/duchainlock.h>
+#include <language/duchain/parsingenvironment.h>
+#include <serialization/itemrepositoryregistry.h>
+
 #include <debug.h>
 
+#include "parsecostmodel.h"
 #include "parsejob.h"
 
+#include <functional>
+#include <map>
+
 using namespace KDevelop;
 
 namespace {
 const bool separateThreadForHighPriority = true;
+// How long a single call to parseDocuments() may spend creating parse jobs, in milliseconds
+const int jobCreationBudget = 20;
+// How many queued documents get their imports looked up at once
+const int dependencyBatchSize = 500;
+
+/// QThreadPool::start() only takes functions since Qt 5.15
+class FunctionRunnable : public QRunnable
+{
+public:
+    explicit FunctionRunnable(const std::function<void()>& function)
+        : m_function(function)
+    {
+    }
+
+    void run() override
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
 
 /**
  * Elides string in @p path, e.g. "VEEERY/LONG/PATH" -> ".../LONG/PATH"
@@ -130,6 +165,10 @@ inline uint qHash(const DocumentParseTarget& target)
 struct DocumentParsePlan
 {
     QSet<DocumentParseTarget> targets;
+    // When the document was queued, in milliseconds of BackgroundParserPrivate::m_clock
+    qint64 queuedSince = 0;
+    // How long parsing the document is expected to take, in milliseconds
+    qint64 expectedDuration = 0;
 
     ParseJob::SequentialProcessingFlags sequentialProcessingFlags() const
     {
@@ -182,6 +221,90 @@ struct DocumentParsePlan
 Q_DECLARE_TYPEINFO(DocumentParseTarget, Q_MOVABLE_TYPE);
 Q_DECLARE_TYPEINFO(DocumentParsePlan, Q_MOVABLE_TYPE);
 
+/**
+ * The documents queued with one priority, ordered by their expected parse duration.
+ *
+ * The longest ones come first, so they do not end up running alone while the other threads are idle.
+ */
+class PriorityBand
+{
+public:
+    using Order = std::multimap<qint64, IndexedString, std::greater<qint64>>;
+
+    PriorityBand() = default;
+
+    // QMap copies its values when detaching, the positions must refer to the copied order then
+    PriorityBand(const PriorityBand& other)
+        : m_order(other.m_order)
+        , m_expectedDuration(other.m_expectedDuration)
+    {
+        updatePositions();
+    }
+
+    PriorityBand& operator=(const PriorityBand& other)
+    {
+        if (this != &other) {
+            m_order = other.m_order;
+            m_expectedDuration = other.m_expectedDuration;
+            updatePositions();
+        }
+        return *this;
+    }
+
+    void insert(const IndexedString& url, qint64 expectedDuration)
+    {
+        remove(url);
+        m_positions.insert(url, m_order.emplace(expectedDuration, url));
+        m_expectedDuration += expectedDuration;
+    }
+
+    void remove(const IndexedString& url)
+    {
+        const auto it = m_positions.find(url);
+        if (it == m_positions.end()) {
+            return;
+        }
+        m_expectedDuration -= (*it)->first;
+        m_order.erase(*it);
+        m_positions.erase(it);
+    }
+
+    bool isEmpty() const
+    {
+        return m_order.empty();
+    }
+
+    /// The sum of the expected parse durations of all documents in this band
+    qint64 expectedDuration() const
+    {
+        return m_expectedDuration;
+    }
+
+    Order::const_iterator begin() const
+    {
+        return m_order.begin();
+    }
+
+    Order::const_iterator end() const
+    {
+        return m_order.end();
+    }
+
+private:
+    void updatePositions()
+    {
+        m_positions.clear();
+        m_positions.reserve(static_cast<int>(m_order.size()));
+        for (auto it = m_order.begin(); it != m_order.end(); ++it) {
+            m_positions.insert(it->second, it);
+        }
+    }
+
+    Order m_order;
+    QHash<IndexedString, Order::iterator> m_positions;
+    qint64 m_expectedDuration = 0;
+};
+
 class KDevelop::BackgroundParserPrivate
 {
 public:
@@ -193,6 +316,8 @@ public:
     {
         parser->d = this; //Set this so we can safely call back BackgroundParser from within loadSettings()
 
+        m_clock.start();
+
         m_timer.setSingleShot(true);
         m_progressTimer.setSingleShot(true);
         m_progressTimer.setInterval(500);
@@ -201,6 +326,9 @@ public:
 
         QObject::connect(&m_timer, &QTimer::timeout, m_parser, &BackgroundParser::parseDocuments);
         QObject::connect(&m_progressTimer, &QTimer::timeout, m_parser, &BackgroundParser::updateProgressBar);
+
+        // Looking up the imports must not take one of the parse threads
+        m_dependencyPool.setMaxThreadCount(1);
     }
 
     void startTimerThreadSafe(int delay)
@@ -210,6 +338,7 @@ public:
 
     ~BackgroundParserPrivate()
     {
+        m_dependencyPool.waitForDone();
         m_weaver.resume();
         m_weaver.finish();
     }
@@ -230,12 +359,47 @@ public:
         return bestRunningPriority;
     }
 
+    enum DependencyState {
+        NoDependencyQueued,
+        WaitsForQueuedDependency,
+        WaitsForRunningDependency
+    };
+
+    /**
+     * Checks whether one of the imports @p url had when it was parsed last time is still to be parsed.
+     * Imports queued with a worse priority than @p priority are not waited for.
+     */
+    DependencyState dependencyState(const IndexedString& url, int priority) const
+    {
+        const auto dependenciesIt = m_dependencies.constFind(url);
+        if (dependenciesIt == m_dependencies.constEnd()) {
+            return NoDependencyQueued;
+        }
+
+        DependencyState ret = NoDependencyQueued;
+        for (const auto& dependency : *dependenciesIt) {
+            if (m_parseJobs.contains(dependency)) {
+                return WaitsForRunningDependency;
+            }
+
+            const auto documentIt = m_documents.constFind(dependency);
+            if (documentIt != m_documents.constEnd() && documentIt->priority() <= priority) {
+                ret = WaitsForQueuedDependency;
+            }
+        }
+
+        return ret;
+    }
+
     IndexedString nextDocumentToParse() const
     {
         // Before starting a new job, first wait for all higher-priority ones to finish.
         // That way, parse job priorities can be used for dependency handling.
         const int bestRunningPriority = currentBestRunningPriority();
 
+        // A document that only waits for queued imports, in case all queued documents wait for each other
+        IndexedString cyclicDependency;
+
         for (auto it1 = m_documentsForPriority.begin();
              it1 != m_documentsForPriority.end(); ++it1) {
             const auto priority = it1.key();
@@ -246,7 +410,8 @@ public:
                 break; //The additional parsing thread is reserved for higher priority parsing
             }
 
-            for (const auto& url : it1.value()) {
+            for (const auto& entry : it1.value()) {
+                const auto& url = entry.second;
                 // When a document is scheduled for parsing while it is being parsed, it will be parsed
                 // again once the job finished, but not now.
                 if (m_parseJobs.contains(url)) {
@@ -262,15 +427,144 @@ public:
                     continue;
                 }
 
-                return url;
+                // Parse the imports first, so this document can use their fresh top-contexts.
+                switch (dependencyState(url, priority)) {
+                case NoDependencyQueued:
+                    return url;
+                case WaitsForQueuedDependency:
+                    if (cyclicDependency.isEmpty()) {
+                        cyclicDependency = url;
+                    }
+                    break;
+                case WaitsForRunningDependency:
+                    break;
+                }
             }
         }
 
+        // When nothing is running, nothing will ever unblock the waiting documents
+        if (m_parseJobs.isEmpty()) {
+            return cyclicDependency;
+        }
+
         return {};
     }
 
+    /// Calls BackgroundParser::parseDocuments() from the event loop, this may be called from any thread
+    void parseDocumentsQueued()
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        QMetaObject::invokeMethod(m_parser, &BackgroundParser::parseDocuments, Qt::QueuedConnection);
+#else
+        QMetaObject::invokeMethod(m_parser, "parseDocuments", Qt::QueuedConnection);
+#endif
+    }
+
+    /**
+     * Looks up the imports of queued documents from their environment files in the background,
+     * so nextDocumentToParse() can parse them in dependency order.
+     */
+    void resolveDependencies()
+    {
+        if (m_resolvingDependencies || m_unresolvedDependencies.isEmpty() || m_shuttingDown) {
+            return;
+        }
+
+        m_resolvingDependencies = true;
+
+        QVector<IndexedString> urls;
+        urls.reserve(qMin(m_unresolvedDependencies.size(), dependencyBatchSize));
+        for (const auto& url : qAsConst(m_unresolvedDependencies)) {
+            if (urls.size() == dependencyBatchSize) {
+                break;
+            }
+            urls << url;
+        }
+
+        m_dependencyPool.start(new FunctionRunnable([this, urls]() {
+            // Documents that were never parsed are estimated by their size
+            QVector<qint64> sizes(urls.size(), -1);
+            QVector<bool> known(urls.size());
+            {
+                QMutexLocker lock(&m_statisticsMutex);
+                for (int i = 0; i < urls.size(); ++i) {
+                    known[i] = m_costs.isKnown(urls[i]);
+                }
+            }
+            for (int i = 0; i < urls.size(); ++i) {
+                if (!known[i]) {
+                    sizes[i] = ParseCostModel::documentSize(urls[i]);
+                }
+            }
+
+            QVector<QVector<IndexedString>> dependencies(urls.size());
+            if (!m_shuttingDown) {
+                DUChainReadLocker lock;
+                for (int i = 0; i < urls.size(); ++i) {
+                    const auto file = DUChain::self()->environmentFileForDocument(urls[i]);
+                    if (!file) {
+                        continue;
+                    }
+                    const auto imports = file->imports();
+                    for (const auto& import : imports) {
+                        if (import && import->url() != urls[i]) {
+                            dependencies[i] << import->url();
+                        }
+                    }
+                }
+            }
+
+            QMutexLocker lock(&m_mutex);
+            for (int i = 0; i < urls.size(); ++i) {
+                // The document may have been parsed or removed in the meantime
+                if (!m_unresolvedDependencies.remove(urls[i])) {
+                    continue;
+                }
+                if (!dependencies[i].isEmpty()) {
+                    m_dependencies.insert(urls[i], dependencies[i]);
+                }
+                if (sizes[i] >= 0) {
+                    auto& parsePlan = m_documents[urls[i]];
+                    parsePlan.expectedDuration = expectedDuration(urls[i], sizes[i]);
+                    m_documentsForPriority[parsePlan.priority()].insert(urls[i], parsePlan.expectedDuration);
+                }
+            }
+
+            m_resolvingDependencies = false;
+            parseDocumentsQueued();
+        }));
+    }
+
+    /// Drops everything that was known about the queued document @p url, except for its parse plan
+    void forgetDocument(const IndexedString& url)
+    {
+        m_dependencies.remove(url);
+        m_unresolvedDependencies.remove(url);
+    }
+
+    qint64 expectedDuration(const IndexedString& url, qint64 size = -1)
+    {
+        QMutexLocker lock(&m_statisticsMutex);
+        return m_costs.expectedDuration(url, size);
+    }
+
+    qint64 estimatedRemainingTime() const
+    {
+        qint64 ret = 0;
+        for (const auto& band : m_documentsForPriority) {
+            ret += band.expectedDuration();
+        }
+        return ret / qMax(m_threads, 1);
+    }
+
+    bool hasFreeParseJobSlot() const
+    {
+        return m_parseJobs.count() < m_threads
+               || (m_parseJobs.count() < m_threads + 1 && separateThreadForHighPriority);
+    }
+
     /**
-     * Create a single delayed parse job
+     * Create delayed parse jobs for all free parse threads
      *
      * E.g. jobs for documents which have been changed by the user, but also to
      * handle initial startup where we parse all project files.
@@ -280,76 +574,160 @@ public:
         if (m_shuttingDown)
             return;
 
-        //Only create parse-jobs for up to thread-count * 2 documents, so we don't fill the memory unnecessarily
-        if (m_parseJobs.count() >= m_threads + 1
-            || (m_parseJobs.count() >= m_threads && !separateThreadForHighPriority)) {
-            return;
+        resolveDependencies();
+
+        // Only spend a bounded time per call, else we might iterate through thousands of files
+        // without finding a language-support, and block the UI for a long time.
+        QElapsedTimer budget;
+        budget.start();
+
+        //Only create parse-jobs for up to thread-count + 1 documents, so we don't fill the memory unnecessarily
+        while (hasFreeParseJobSlot() && !budget.hasExpired(jobCreationBudget)) {
+            const auto url = nextDocumentToParse();
+            if (url.isEmpty()) {
+                break;
+            }
+
+            createParseJobInternal(url);
         }
 
-        const auto& url = nextDocumentToParse();
-        if (!url.isEmpty()) {
-            qCDebug(LANGUAGE) << "creating parse-job" << url << "new count of active parse-jobs:" <<
-                m_parseJobs.count() + 1;
+        if (!m_documents.isEmpty()) {
+            if (hasFreeParseJobSlot() && budget.hasExpired(jobCreationBudget)) {
+                // Continue in the next event loop iteration
+                parseDocumentsQueued();
+            }
+        } else {
+            // make sure we cleaned up properly
+            // TODO: also empty m_documentsForPriority when m_documents is empty? or do we want to keep capacity?
+            Q_ASSERT(std::none_of(m_documentsForPriority.constBegin(), m_documentsForPriority.constEnd(),
+                                  [](const PriorityBand& band) {
+                return !band.isEmpty();
+            }));
+        }
 
-            const QString elidedPathString = elidedPathLeft(url.str(), 70);
+        m_parser->updateProgressData();
+    }
+
+    void createParseJobInternal(const IndexedString& url)
+    {
+        qCDebug(LANGUAGE) << "creating parse-job" << url << "new count of active parse-jobs:" <<
+            m_parseJobs.count() + 1;
+
+        const QString elidedPathString = elidedPathLeft(url.str(), 70);
+        const qint64 remainingTime = estimatedRemainingTime();
+        if (remainingTime >= 1000) {
+            emit m_parser->showMessage(m_parser, i18nc("%1: file path, %2: duration", "Parsing: %1 (%2 remaining)",
+                                                       elidedPathString,
+                                                       KFormat().formatSpelloutDuration(remainingTime)));
+        } else {
             emit m_parser->showMessage(m_parser, i18n("Parsing: %1", elidedPathString));
+        }
 
-            ThreadWeaver::QObjectDecorator* decorator = nullptr;
-            {
-                // copy shared data before unlocking the mutex
-                const auto parsePlanConstIt = m_documents.constFind(url);
-                const DocumentParsePlan parsePlan = *parsePlanConstIt;
-
-                // we must not lock the mutex while creating a parse job
-                // this could in turn lock e.g. the DUChain and then
-                // we have a classic lock order inversion (since, usually,
-                // we lock first the duchain and then our background parser
-                // mutex)
-                // see also: https://bugs.kde.org/show_bug.cgi?id=355100
-                m_mutex.unlock();
-                decorator = createParseJob(url, parsePlan);
-                m_mutex.lock();
+        ThreadWeaver::QObjectDecorator* decorator = nullptr;
+        {
+            // copy shared data before unlocking the mutex
+            const auto parsePlanConstIt = m_documents.constFind(url);
+            const DocumentParsePlan parsePlan = *parsePlanConstIt;
+
+            // we must not lock the mutex while creating a parse job
+            // this could in turn lock e.g. the DUChain and then
+            // we have a classic lock order inversion (since, usually,
+            // we lock first the duchain and then our background parser
+            // mutex)
+            // see also: https://bugs.kde.org/show_bug.cgi?id=355100
+            m_mutex.unlock();
+            decorator = createParseJob(url, parsePlan);
+            m_mutex.lock();
+        }
+
+        // iterator might get invalid during the time we didn't have the lock
+        // search again
+        const auto parsePlanIt = m_documents.find(url);
+        if (parsePlanIt != m_documents.end()) {
+            // Remove all mentions of this document.
+            for (const auto& target : qAsConst(parsePlanIt->targets)) {
+                m_documentsForPriority[target.priority].remove(url);
             }
 
-            // iterator might get invalid during the time we didn't have the lock
-            // search again
-            const auto parsePlanIt = m_documents.find(url);
-            if (parsePlanIt != m_documents.end()) {
-                // Remove all mentions of this document.
-                for (const auto& target : qAsConst(parsePlanIt->targets)) {
-                    m_documentsForPriority[target.priority].remove(url);
-                }
+            const qint64 waitTime = m_clock.elapsed() - parsePlanIt->queuedSince;
+            m_totalWaitTime += waitTime;
+            m_maximumWaitTime = qMax(m_maximumWaitTime, waitTime);
+            ++m_waitedDocuments;
 
-                m_documents.erase(parsePlanIt);
-            } else {
-                qCWarning(LANGUAGE) << "Document got removed during parse job creation:" << url;
-            }
+            m_documents.erase(parsePlanIt);
+            forgetDocument(url);
+        } else {
+            qCWarning(LANGUAGE) << "Document got removed during parse job creation:" << url;
+        }
 
-            if (decorator) {
-                if (m_parseJobs.count() == m_threads + 1 && !specialParseJob)
-                    specialParseJob = decorator; //This parse-job is allocated into the reserved thread
+        if (decorator) {
+            if (m_parseJobs.count() == m_threads + 1 && !specialParseJob)
+                specialParseJob = decorator; //This parse-job is allocated into the reserved thread
 
-                m_parseJobs.insert(url, decorator);
-                m_weaver.enqueue(ThreadWeaver::JobPointer(decorator));
-            } else {
-                --m_maxParseJobs;
-            }
+            m_parseJobs.insert(url, decorator);
+            m_weaver.enqueue(ThreadWeaver::JobPointer(decorator));
+        } else {
+            --m_maxParseJobs;
+        }
+    }
 
-            if (!m_documents.isEmpty()) {
-                // Only try creating one parse-job at a time, else we might iterate through thousands of files
-                // without finding a language-support, and block the UI for a long time.
-                QMetaObject::invokeMethod(m_parser, "parseDocuments", Qt::QueuedConnection);
-            } else {
-                // make sure we cleaned up properly
-                // TODO: also empty m_documentsForPriority when m_documents is empty? or do we want to keep capacity?
-                Q_ASSERT(std::none_of(m_documentsForPriority.constBegin(), m_documentsForPriority.constEnd(),
-                                      [](const QSet<IndexedString>& docs) {
-                    return !docs.isEmpty();
-                }));
-            }
+    /// Called from the parse threads when they start and finish running a job
+    void jobStarted(const ThreadWeaver::JobPointer& job)
+    {
+        QMutexLocker lock(&m_statisticsMutex);
+        m_runningJobs.insert(job.data(), qMakePair(QThread::currentThread(), m_clock.elapsed()));
+    }
+
+    void jobFinished(const ThreadWeaver::JobPointer& job)
+    {
+        // Aborted jobs tell nothing about how long parsing takes
+        const auto* decorator = dynamic_cast<const ThreadWeaver::QObjectDecorator*>(job.data());
+        const auto* parseJob = decorator ? dynamic_cast<const ParseJob*>(decorator->job()) : nullptr;
+        const bool recordCost = parseJob && job->success() && !parseJob->abortRequested();
+        // look up the size before locking, it touches the file system
+        const qint64 size = recordCost ? ParseCostModel::documentSize(parseJob->document()) : -1;
+
+        QMutexLocker lock(&m_statisticsMutex);
+        const auto runningIt = m_runningJobs.find(job.data());
+        if (runningIt == m_runningJobs.end()) {
+            return;
         }
+        const qint64 now = m_clock.elapsed();
+        m_threadBusyTime[runningIt->first] += busyTimeSince(runningIt->second, now);
+        if (recordCost) {
+            m_costs.record(parseJob->document(), now - runningIt->second, size);
+        }
+        m_runningJobs.erase(runningIt);
+    }
 
-        m_parser->updateProgressData();
+    static QString costsFileName()
+    {
+        const QString path = globalItemRepositoryRegistry().path();
+        return path.isEmpty() ? QString() : path + QLatin1String("/parse_costs");
+    }
+
+    void loadCosts()
+    {
+        const QString fileName = costsFileName();
+        if (!fileName.isEmpty()) {
+            QMutexLocker lock(&m_statisticsMutex);
+            m_costs.load(fileName);
+        }
+    }
+
+    void storeCosts()
+    {
+        const QString fileName = costsFileName();
+        if (!fileName.isEmpty()) {
+            QMutexLocker lock(&m_statisticsMutex);
+            m_costs.store(fileName);
+        }
+    }
+
+    /// Jobs that started before the statistics were reset only count from then on
+    qint64 busyTimeSince(qint64 start, qint64 now) const
+    {
+        return now - qMax(start, m_statisticsSince);
     }
 
     // NOTE: you must not access any of the data structures that are protected by any of the
@@ -383,6 +761,15 @@ public:
                              m_parser, &BackgroundParser::parseComplete);
             QObject::connect(decorator, &ThreadWeaver::QObjectDecorator::failed,
                              m_parser, &BackgroundParser::parseComplete);
+            // track the thread utilization directly in the parse threads, done is emitted for failed jobs as well
+            QObject::connect(decorator, &ThreadWeaver::QObjectDecorator::started,
+                             m_parser, [this](const ThreadWeaver::JobPointer& job) {
+                jobStarted(job);
+            }, Qt::DirectConnection);
+            QObject::connect(decorator, &ThreadWeaver::QObjectDecorator::done,
+                             m_parser, [this](const ThreadWeaver::JobPointer& job) {
+                jobFinished(job);
+            }, Qt::DirectConnection);
             QObject::connect(job, &ParseJob::progress,
                              m_parser, &BackgroundParser::parseProgress, Qt::QueuedConnection);
 
@@ -420,6 +807,8 @@ public:
 #define BACKWARDS_COMPATIBLE_ENTRY(entry, default) \
     config.readEntry(entry, oldConfig.readEntry(entry, default))
 
+        loadCosts();
+
         m_delay = BACKWARDS_COMPATIBLE_ENTRY("Delay", 500);
         m_timer.setInterval(m_delay);
         m_threads = 0;
@@ -485,8 +874,16 @@ public:
 
     // A list of documents that are planned to be parsed, and their priority
     QHash<IndexedString, DocumentParsePlan> m_documents;
-    // The documents ordered by priority
-    QMap<int, QSet<IndexedString>> m_documentsForPriority;
+    // The documents ordered by priority, and by expected parse duration within each priority
+    QMap<int, PriorityBand> m_documentsForPriority;
+    // The imports queued documents had when they were parsed last time, to parse imports before their importers
+    QHash<IndexedString, QVector<IndexedString>> m_dependencies;
+    // Queued documents whose imports were not looked up yet
+    QSet<IndexedString> m_unresolvedDependencies;
+    // Whether a job looking up the imports of m_unresolvedDependencies is queued
+    bool m_resolvingDependencies = false;
+    // Runs the jobs looking up imports, separate from the parse jobs in m_weaver
+    QThreadPool m_dependencyPool;
     // Currently running parse jobs
     QHash<IndexedString, ThreadWeaver::QObjectDecorator*> m_parseJobs;
     // The url for each managed document. Those may temporarily differ from the real url.
@@ -512,6 +909,21 @@ public:
     int m_progressMax = 0;
     int m_progressDone = 0;
     QTimer m_progressTimer;
+
+    // Time base for the scheduling statistics
+    QElapsedTimer m_clock;
+    qint64 m_statisticsSince = 0;
+    qint64 m_totalWaitTime = 0;
+    qint64 m_maximumWaitTime = 0;
+    int m_waitedDocuments = 0;
+
+    // local mutex only protecting the statistics and parse costs updated from the parse threads
+    QMutex m_statisticsMutex;
+    // How long documents took to parse, stored in the session
+    ParseCostModel m_costs;
+    // The thread and start time of each running parse job
+    QHash<const ThreadWeaver::JobInterface*, QPair<QThread*, qint64>> m_runningJobs;
+    QHash<QThread*, qint64> m_threadBusyTime;
 };
 
 BackgroundParser::BackgroundParser(ILanguageController* languageController)
@@ -544,6 +956,7 @@ BackgroundParser::BackgroundParser(ILanguageController* languageController)
 void BackgroundParser::aboutToQuit()
 {
     d->m_shuttingDown = true;
+    d->storeCosts();
 }
 
 BackgroundParser::~BackgroundParser()
@@ -581,13 +994,14 @@ void BackgroundParser::revertAllRequests(QObject* notifyWhenReady)
         }
 
         if ((*it).targets.isEmpty()) {
+            d->forgetDocument(it.key());
             it = d->m_documents.erase(it);
             --d->m_maxParseJobs;
 
             continue;
         }
 
-        d->m_documentsForPriority[it.value().priority()].insert(it.key());
+        d->m_documentsForPriority[it.value().priority()].insert(it.key(), it.value().expectedDuration);
         ++it;
     }
 }
@@ -612,11 +1026,15 @@ void BackgroundParser::addDocument(const IndexedString& url, TopDUContext::Featu
 
             d->m_documentsForPriority[it.value().priority()].remove(url);
             it.value().targets << target;
-            d->m_documentsForPriority[it.value().priority()].insert(url);
+            d->m_documentsForPriority[it.value().priority()].insert(url, it.value().expectedDuration);
         } else {
 //             qCDebug(LANGUAGE) << "BackgroundParser::addDocument: queuing" << cleanedUrl;
-            d->m_documents[url].targets << target;
-            d->m_documentsForPriority[d->m_documents[url].priority()].insert(url);
+            DocumentParsePlan& parsePlan = d->m_documents[url];
+            parsePlan.targets << target;
+            parsePlan.queuedSince = d->m_clock.elapsed();
+            parsePlan.expectedDuration = d->expectedDuration(url);
+            d->m_documentsForPriority[parsePlan.priority()].insert(url, parsePlan.expectedDuration);
+            d->m_unresolvedDependencies.insert(url);
             ++d->m_maxParseJobs; //So the progress-bar waits for this document
         }
 
@@ -646,10 +1064,11 @@ void BackgroundParser::removeDocument(const IndexedString& url, QObject* notifyW
 
         if (documentParsePlan.targets.isEmpty()) {
             d->m_documents.erase(documentParsePlanIt);
+            d->forgetDocument(url);
             --d->m_maxParseJobs;
         } else {
             //Insert with an eventually different priority
-            d->m_documentsForPriority[documentParsePlan.priority()].insert(url);
+            d->m_documentsForPriority[documentParsePlan.priority()].insert(url, documentParsePlan.expectedDuration);
         }
     }
 }
@@ -718,6 +1137,67 @@ int BackgroundParser::queuedCount() const
     return d->m_documents.count();
 }
 
+BackgroundParser::SchedulingStatistics BackgroundParser::schedulingStatistics() const
+{
+    SchedulingStatistics ret;
+
+    {
+        QMutexLocker lock(&d->m_mutex);
+
+        ret.queueDepth = d->m_documents.count();
+        ret.activeJobs = d->m_parseJobs.count();
+        for (auto it = d->m_documents.constBegin(); it != d->m_documents.constEnd(); ++it) {
+            if (d->dependencyState(it.key(), it->priority()) != BackgroundParserPrivate::NoDependencyQueued) {
+                ++ret.blockedDocuments;
+            }
+        }
+
+        if (d->m_waitedDocuments) {
+            ret.averageWaitTime = d->m_totalWaitTime / d->m_waitedDocuments;
+        }
+        ret.maximumWaitTime = d->m_maximumWaitTime;
+    }
+
+    QMutexLocker lock(&d->m_statisticsMutex);
+    const qint64 now = d->m_clock.elapsed();
+    const qint64 elapsed = now - d->m_statisticsSince;
+    if (elapsed <= 0) {
+        return ret;
+    }
+
+    QHash<QThread*, qint64> busyTime = d->m_threadBusyTime;
+    for (const auto& running : qAsConst(d->m_runningJobs)) {
+        busyTime[running.first] += d->busyTimeSince(running.second, now);
+    }
+
+    ret.threadUtilization.reserve(busyTime.size());
+    for (qint64 busy : qAsConst(busyTime)) {
+        ret.threadUtilization << float(busy) / elapsed;
+    }
+
+    return ret;
+}
+
+qint64 BackgroundParser::estimatedRemainingTime() const
+{
+    QMutexLocker lock(&d->m_mutex);
+    return d->estimatedRemainingTime();
+}
+
+void BackgroundParser::resetSchedulingStatistics()
+{
+    {
+        QMutexLocker lock(&d->m_mutex);
+        d->m_totalWaitTime = 0;
+        d->m_maximumWaitTime = 0;
+        d->m_waitedDocuments = 0;
+    }
+
+    QMutexLocker lock(&d->m_statisticsMutex);
+    d->m_statisticsSince = d->m_clock.elapsed();
+    d->m_threadBusyTime.clear();
+}
+
 bool BackgroundParser::isIdle() const
 {
     QMutexLocker lock(&d->m_mutex);
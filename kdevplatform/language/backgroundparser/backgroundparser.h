@@ -111,6 +111,39 @@ public:
 
     bool waitForIdle() const;
 
+    /**
+     * Statistics about how well the queued documents keep the parse threads busy.
+     */
+    struct SchedulingStatistics
+    {
+        /// Count of queued documents that have no parse job yet
+        int queueDepth = 0;
+        /// Count of queued documents that wait for one of their imports to be parsed first
+        int blockedDocuments = 0;
+        /// Count of parse jobs that are created, but not finished yet
+        int activeJobs = 0;
+        /// Average time in milliseconds a document was queued before its parse job was created
+        qint64 averageWaitTime = 0;
+        /// Longest time in milliseconds a document was queued before its parse job was created
+        qint64 maximumWaitTime = 0;
+        /// For each thread that ran parse jobs, the fraction of time it spent doing so
+        QVector<float> threadUtilization;
+    };
+
+    /**
+     * Returns the scheduling statistics gathered since the last resetSchedulingStatistics().
+     */
+    SchedulingStatistics schedulingStatistics() const;
+
+    void resetSchedulingStatistics();
+
+    /**
+     * Returns an estimate of how long it takes to parse all queued documents, in milliseconds.
+     *
+     * The estimate is based on how long the documents took to parse in earlier runs of this session.
+     */
+    qint64 estimatedRemainingTime() const;
+
 Q_SIGNALS:
     /**
      * Emitted whenever a document parse-job has finished.
@@ -0,0 +1,138 @@
+/*
+ * This file is part of KDevelop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "parsecostmodel.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <debug.h>
+
+using namespace KDevelop;
+
+namespace {
+// Bump this whenever the stored format changes
+const quint32 formatVersion = 1;
+// Assumed duration of a document when nothing was parsed yet, in milliseconds
+const qint64 defaultDuration = 100;
+}
+
+void ParseCostModel::record(const IndexedString& url, qint64 duration, qint64 size)
+{
+    if (duration < 0) {
+        return;
+    }
+
+    auto it = m_costs.find(url);
+    if (it != m_costs.end()) {
+        m_totalDuration -= it->duration;
+        m_totalSize -= it->size;
+        // smooth out outliers, e.g. when the machine was busy with something else
+        it->duration = (it->duration + duration) / 2;
+        it->size = qMax<qint64>(size, 0);
+    } else {
+        it = m_costs.insert(url, {duration, qMax<qint64>(size, 0)});
+    }
+
+    m_totalDuration += it->duration;
+    m_totalSize += it->size;
+}
+
+bool ParseCostModel::isKnown(const IndexedString& url) const
+{
+    return m_costs.contains(url);
+}
+
+qint64 ParseCostModel::expectedDuration(const IndexedString& url, qint64 size) const
+{
+    const auto it = m_costs.constFind(url);
+    if (it != m_costs.constEnd()) {
+        return it->duration;
+    }
+
+    if (m_costs.isEmpty()) {
+        return defaultDuration;
+    }
+
+    if (size >= 0 && m_totalSize > 0) {
+        return size * m_totalDuration / m_totalSize;
+    }
+
+    return m_totalDuration / m_costs.size();
+}
+
+void ParseCostModel::load(const QString& fileName)
+{
+    m_costs.clear();
+    m_totalDuration = 0;
+    m_totalSize = 0;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    QDataStream stream(&file);
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> version >> count;
+    if (version != formatVersion) {
+        qCDebug(LANGUAGE) << "ignoring parse costs with version" << version << "in" << fileName;
+        return;
+    }
+
+    m_costs.reserve(count);
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString url;
+        qint64 duration;
+        qint64 size;
+        stream >> url >> duration >> size;
+        if (stream.status() == QDataStream::Ok) {
+            record(IndexedString(url), duration, size);
+        }
+    }
+}
+
+void ParseCostModel::store(const QString& fileName) const
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(LANGUAGE) << "failed to store the parse costs in" << fileName << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << formatVersion << quint32(m_costs.size());
+    for (auto it = m_costs.constBegin(); it != m_costs.constEnd(); ++it) {
+        stream << it.key().str() << it->duration << it->size;
+    }
+
+    file.commit();
+}
+
+qint64 ParseCostModel::documentSize(const IndexedString& url)
+{
+    const QFileInfo info(url.str());
+    if (!info.isFile()) {
+        return -1;
+    }
+    return info.size();
+}
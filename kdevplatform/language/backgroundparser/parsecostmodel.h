@@ -0,0 +1,72 @@
+/*
+ * This file is part of KDevelop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KDEVPLATFORM_PARSECOSTMODEL_H
+#define KDEVPLATFORM_PARSECOSTMODEL_H
+
+#include <QHash>
+#include <QString>
+
+#include <serialization/indexedstring.h>
+
+namespace KDevelop {
+/**
+ * Remembers how long documents took to parse, so the background parser can predict
+ * how long they take the next time. Documents that were never parsed are estimated
+ * from their size.
+ *
+ * This class is not thread-safe.
+ */
+class ParseCostModel
+{
+public:
+    /// Records that parsing @p url took @p duration milliseconds, when it had @p size bytes
+    void record(const IndexedString& url, qint64 duration, qint64 size);
+
+    /// @return Whether @p url was parsed before
+    bool isKnown(const IndexedString& url) const;
+
+    /**
+     * @return The expected parse duration of @p url in milliseconds.
+     * @p size is used for documents that were never parsed, pass -1 if it is unknown.
+     */
+    qint64 expectedDuration(const IndexedString& url, qint64 size = -1) const;
+
+    /// Loads the costs stored in @p fileName, replacing the current ones
+    void load(const QString& fileName);
+    void store(const QString& fileName) const;
+
+    /// @return The size of the local file @p url in bytes, or -1 if it does not exist
+    static qint64 documentSize(const IndexedString& url);
+
+private:
+    struct Cost
+    {
+        qint64 duration;
+        qint64 size;
+    };
+
+    QHash<IndexedString, Cost> m_costs;
+    // Sums over all recorded documents, for documents that were never parsed
+    qint64 m_totalDuration = 0;
+    qint64 m_totalSize = 0;
+};
+}
+
+#endif // KDEVPLATFORM_PARSECOSTMODEL_H
@@ -37,6 +37,7 @@
 
 #include <language/duchain/duchain.h>
 #include <language/duchain/duchainlock.h>
+#include <language/duchain/parsingenvironment.h>
 #include <language/backgroundparser/backgroundparser.h>
 
 #include <interfaces/ilanguagecontroller.h>
@@ -271,6 +272,98 @@ void TestBackgroundparser::testParseOrdering_noSequentialProcessing()
     QVERIFY(m_jobPlan.runJobs(1000));
 }
 
+void TestBackgroundparser::testParseOrdering_dependencies()
+{
+    auto parser = ICore::self()->languageController()->backgroundParser();
+
+    m_jobPlan.clear();
+
+    const auto headerUrl = QUrl::fromLocalFile(QStringLiteral("/test_dep_header.txt"));
+    const auto sourceUrl = QUrl::fromLocalFile(QStringLiteral("/test_dep_source.txt"));
+
+    // the source imported the header when it was parsed last time
+    QVector<ReferencedTopDUContext> contexts;
+    {
+        DUChainWriteLocker lock;
+        for (const auto& url : {headerUrl, sourceUrl}) {
+            const IndexedString indexedUrl(url);
+            auto* top = new TopDUContext(indexedUrl, RangeInRevision(), new ParsingEnvironmentFile(indexedUrl));
+            DUChain::self()->addDocumentChain(top);
+            contexts << ReferencedTopDUContext(top);
+        }
+        contexts[1]->addImportedParentContext(contexts[0].data());
+    }
+
+    // both have the same priority, and the source is queued first
+    m_jobPlan.addJob(JobPrototype(sourceUrl, BackgroundParser::NormalPriority,
+                                  ParseJob::IgnoresSequentialProcessing, 50));
+    m_jobPlan.addJob(JobPrototype(headerUrl, BackgroundParser::NormalPriority,
+                                  ParseJob::IgnoresSequentialProcessing, 100));
+
+    // give the background parser time to look up the imports before creating any job
+    parser->disableProcessing();
+    m_jobPlan.addJobsToParser();
+    parser->parseDocuments();
+    QTest::qWait(200);
+    QCOMPARE(m_jobPlan.numCreatedJobs(), 0);
+
+    parser->resetSchedulingStatistics();
+    parser->enableProcessing();
+    QVERIFY(m_jobPlan.runJobs(1000));
+
+    // the source waited for the header to be parsed, although there were free threads
+    QCOMPARE(m_jobPlan.m_createdJobs, QVector<IndexedString>({IndexedString(headerUrl), IndexedString(sourceUrl)}));
+    QCOMPARE(m_jobPlan.m_finishedJobs, QVector<IndexedString>({IndexedString(headerUrl), IndexedString(sourceUrl)}));
+
+    const auto statistics = parser->schedulingStatistics();
+    QCOMPARE(statistics.queueDepth, 0);
+    QCOMPARE(statistics.blockedDocuments, 0);
+    QVERIFY(statistics.maximumWaitTime >= 100);
+    QVERIFY(!statistics.threadUtilization.isEmpty());
+    for (float utilization : statistics.threadUtilization) {
+        QVERIFY(utilization > 0 && utilization <= 1);
+    }
+
+    DUChainWriteLocker lock;
+    for (const auto& top : qAsConst(contexts)) {
+        DUChain::self()->removeDocumentChain(top.data());
+    }
+}
+
+void TestBackgroundparser::testParseOrdering_expectedDuration()
+{
+    auto parser = ICore::self()->languageController()->backgroundParser();
+
+    const auto slowUrl = QUrl::fromLocalFile(QStringLiteral("/test_cost_slow.txt"));
+    const auto addJobs = [&]() {
+        // the fast documents are queued first
+        for (int i = 0; i < 3; ++i) {
+            m_jobPlan.addJob(JobPrototype(QUrl::fromLocalFile("/test_cost_fast" + QString::number(i) + ".txt"),
+                                          BackgroundParser::NormalPriority, ParseJob::IgnoresSequentialProcessing));
+        }
+        m_jobPlan.addJob(JobPrototype(slowUrl, BackgroundParser::NormalPriority,
+                                      ParseJob::IgnoresSequentialProcessing, 300));
+    };
+
+    // parse everything once, so the background parser learns how long each document takes
+    m_jobPlan.clear();
+    addJobs();
+    QVERIFY(m_jobPlan.runJobs(1000));
+
+    m_jobPlan.clear();
+    addJobs();
+    parser->disableProcessing();
+    m_jobPlan.addJobsToParser();
+    QVERIFY(parser->estimatedRemainingTime() >= 300 / parser->threadCount());
+
+    parser->enableProcessing();
+    QVERIFY(m_jobPlan.runJobs(1000));
+
+    // the longest document is started first
+    QCOMPARE(m_jobPlan.m_createdJobs.first(), IndexedString(slowUrl));
+    QCOMPARE(parser->estimatedRemainingTime(), qint64(0));
+}
+
 void TestBackgroundparser::testParseOrdering_lockup()
 {
     m_jobPlan.clear();
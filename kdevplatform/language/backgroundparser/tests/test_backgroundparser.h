@@ -108,6 +108,8 @@ private Q_SLOTS:
     void testParseOrdering_lockup();
     void testParseOrdering_foregroundThread();
     void testParseOrdering_noSequentialProcessing();
+    void testParseOrdering_dependencies();
+    void testParseOrdering_expectedDuration();
 
     void testNoDeadlockInJobCreation();
     void testSuspendResume();
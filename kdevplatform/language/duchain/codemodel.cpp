@@ -22,6 +22,7 @@
 #include <debug.h>
 #include <serialization/itemrepository.h>
 #include "identifier.h"
+#include "symbolnameindex.h"
 #include <serialization/indexedstring.h>
 #include <serialization/referencecounting.h>
 #include <util/embeddedfreetree.h>
@@ -224,6 +225,8 @@ void CodeModel::addItem(const IndexedString& file, const IndexedQualifiedIdentif
             items[listIndex].kind = kind;
             return;
         } else {
+            SymbolNameIndex::self().addName(id);
+
             //Add the item to the list
             EmbeddedTreeAddItem<CodeModelItem, CodeModelItemHandler> add(items,
                 editableItem->itemsSize(), editableItem->centralFreeItem, newItem);
@@ -243,6 +246,7 @@ void CodeModel::addItem(const IndexedString& file, const IndexedQualifiedIdentif
     } else {
         //We're creating a new index
         item.itemsList().append(newItem);
+        SymbolNameIndex::self().addName(id);
     }
 
     Q_ASSERT(!d->m_repository.findIndex(request));
@@ -329,6 +333,7 @@ void CodeModel::removeItem(const IndexedString& file, const IndexedQualifiedIden
             return; //Nothing to remove, there's still a reference-count left
 
         //We have reduced the reference-count to zero, so remove the item from the list
+        SymbolNameIndex::self().removeName(id);
 
         EmbeddedTreeRemoveItem<CodeModelItem, CodeModelItemHandler> remove(items,
             oldItem->itemsSize(), oldItem->centralFreeItem, searchItem);
@@ -21,6 +21,7 @@
 #include "duchainlock.h"
 
 #include <QApplication>
+#include <QFileInfo>
 #include <QHash>
 #include <QMultiMap>
 #include <QProcessEnvironment>
@@ -49,14 +50,17 @@
 #include "declaration.h"
 #include "definitions.h"
 #include "duchainutils.h"
+#include "duchaincachearchive.h"
 #include "use.h"
 #include "uses.h"
 #include "abstractfunctiondeclaration.h"
 #include "duchainregister.h"
 #include "persistentsymboltable.h"
+#include "symbolnameindex.h"
 #include "serialization/itemrepository.h"
 #include "waitforupdate.h"
 #include "importers.h"
+#include "topducontextindex.h"
 
 #if HAVE_MALLOC_TRIM
 #include "malloc.h"
@@ -319,6 +323,8 @@ private:
                     ModificationRevisionSet::clearCache();
 
                     m_data->doMoreCleanup(SOFT_CLEANUP_STEPS, TryLock);
+                    //Runs without any lock held, so loading top-contexts is not blocked by it
+                    TopDUContextDynamicData::compactStorage();
                 });
             timer.start(cleanupEverySeconds * 1000);
             exec();
@@ -403,7 +409,7 @@ public:
 
         QMutexLocker l(&m_chainsMutex);
 
-        foreach (TopDUContext* top, m_chainsByUrl)
+        foreach (TopDUContext* top, m_chainsByUrl.values())
             removeDocumentChainFromMemory(top);
 
         m_indexEnvironmentInformations.clear();
@@ -417,17 +423,16 @@ public:
     ///Also removes from the environment-manager if the top-context is not on disk
     void removeDocumentChainFromMemory(TopDUContext* context)
     {
-        QMutexLocker l(&m_chainsMutex);
-
         {
-            QMutexLocker l(&m_referenceCountsMutex);
+            ReferenceCountShard& shard = referenceCountShard(context);
+            QMutexLocker l(&shard.mutex);
 
-            auto countIt = m_referenceCounts.constFind(context);
-            if (countIt != m_referenceCounts.constEnd()) {
+            auto countIt = shard.counts.constFind(context);
+            if (countIt != shard.counts.constEnd()) {
                 //This happens during shutdown, since everything is unloaded
                 qCDebug(LANGUAGE) << "removed a top-context that was reference-counted:" << context->url().str() <<
                     context->ownIndex();
-                m_referenceCounts.erase(countIt);
+                shard.counts.erase(countIt);
             }
         }
 
@@ -435,17 +440,16 @@ public:
 
         // qCDebug(LANGUAGE) << "duchain: removing document" << context->url().str();
         Q_ASSERT(hasChainForIndex(index));
-        Q_ASSERT(m_chainsByUrl.contains(context->url(), context));
 
-        m_chainsByUrl.remove(context->url(), context);
+        bool removed = m_chainsByUrl.remove(context->url(), context);
+        Q_ASSERT(removed);
+        Q_UNUSED(removed);
 
         if (!context->isOnDisk())
             instance->removeFromEnvironmentManager(context);
 
-        l.unlock();
         //DUChain is write-locked, so we can do whatever we want on the top-context, including deleting it
         context->deleteSelf();
-        l.relock();
 
         Q_ASSERT(hasChainForIndex(index));
 
@@ -463,11 +467,41 @@ public:
 
     DUChain* instance;
     DUChainLock lock;
-    QMultiMap<IndexedString, TopDUContext*> m_chainsByUrl;
+    ///Does its own locking, m_chainsMutex does not need to be locked
+    TopDUContextIndex m_chainsByUrl;
 
-    //Must be locked before accessing m_referenceCounts
-    QMutex m_referenceCountsMutex;
-    QHash<TopDUContext*, uint> m_referenceCounts;
+    ///Reference-counts of the top-contexts, sharded by their address so ReferencedTopDUContext
+    ///copies in different threads rarely contend for the same mutex
+    struct ReferenceCountShard
+    {
+        //Must be locked before accessing counts
+        QMutex mutex;
+        QHash<TopDUContext*, uint> counts;
+    };
+    enum {
+        ReferenceCountShards = 16
+    };
+    ReferenceCountShard m_referenceCounts[ReferenceCountShards];
+
+    ReferenceCountShard& referenceCountShard(TopDUContext* top)
+    {
+        //The low bits of heap addresses are always the same due to alignment
+        return m_referenceCounts[(reinterpret_cast<quintptr>(top) >> 6) % ReferenceCountShards];
+    }
+
+    ///Returns the top-contexts that currently have a reference-count
+    QVector<TopDUContext*> referencedContexts()
+    {
+        QVector<TopDUContext*> ret;
+        for (ReferenceCountShard& shard : m_referenceCounts) {
+            QMutexLocker l(&shard.mutex);
+            for (auto it = shard.counts.constBegin(), end = shard.counts.constEnd(); it != end; ++it) {
+                ret << it.key();
+            }
+        }
+
+        return ret;
+    }
 
     Definitions m_definitions;
     Uses m_uses;
@@ -801,10 +835,9 @@ public:
         QSet<TopDUContext*> workOnContexts;
 
         {
-            QMutexLocker l(&m_chainsMutex);
-
-            workOnContexts.reserve(m_chainsByUrl.size());
-            foreach (TopDUContext* top, m_chainsByUrl) {
+            const QList<TopDUContext*> chains = m_chainsByUrl.values();
+            workOnContexts.reserve(chains.size());
+            for (TopDUContext* top : chains) {
                 workOnContexts << top;
                 Q_ASSERT(hasChainForIndex(top->ownIndex()));
             }
@@ -842,16 +875,11 @@ unloadContexts:
             foreach (TopDUContext * unload, workOnContexts) {
                 bool hasReference = false;
 
-                {
-                    QMutexLocker l(&m_referenceCountsMutex);
-                    //Test if the context is imported by a referenced one
-                    for (auto it = m_referenceCounts.constBegin(), end = m_referenceCounts.constEnd(); it != end;
-                         ++it) {
-                        auto* context = it.key();
-                        if (context == unload || context->imports(unload, CursorInRevision())) {
-                            workOnContexts.remove(unload);
-                            hasReference = true;
-                        }
+                //Test if the context is imported by a referenced one
+                foreach (TopDUContext* context, referencedContexts()) {
+                    if (context == unload || context->imports(unload, CursorInRevision())) {
+                        workOnContexts.remove(unload);
+                        hasReference = true;
                     }
                 }
 
@@ -918,8 +946,12 @@ unloadContexts:
         if (retries)
             writeLock.unlock();
 
+        TopDUContextDynamicData::flushStorage();
+        SymbolNameIndex::self().applyPendingChanges();
+
         //This must be the last step, due to the on-disk reference counting
-        globalItemRepositoryRegistry().store(); //Stores all repositories
+        //Only a snapshot is taken here, the repositories are written to disk by the registry's store thread
+        globalItemRepositoryRegistry().storeInBackground();
 
         {
             //Store the static parsing-environment file data
@@ -1232,7 +1264,18 @@ void DUChain::initialize()
     Q_ASSERT(ICore::self());
     Q_ASSERT(ICore::self()->activeSession());
 
-    ItemRepositoryRegistry::initialize(repositoryPathForSession(ICore::self()->activeSessionLock()));
+    const QString repositoryPath = repositoryPathForSession(ICore::self()->activeSessionLock());
+    const QString cacheArchive = QProcessEnvironment::systemEnvironment().value(QStringLiteral("KDEV_DUCHAIN_CACHE_ARCHIVE"));
+    if (!cacheArchive.isEmpty() && !QFileInfo::exists(repositoryPath)) {
+        QString errorMessage;
+        if (DUChainCacheArchive::extract(cacheArchive, repositoryPath, &errorMessage)) {
+            qCDebug(LANGUAGE) << "seeded the DUChain cache from" << cacheArchive;
+        } else {
+            qCWarning(LANGUAGE) << "not using the DUChain cache archive:" << errorMessage;
+        }
+    }
+
+    ItemRepositoryRegistry::initialize(repositoryPath);
 
     initReferenceCounting();
 
@@ -1266,7 +1309,6 @@ DUChainLock* DUChain::lock()
 
 QList<TopDUContext*> DUChain::allChains() const
 {
-    QMutexLocker l(&sdDUChainPrivate->m_chainsMutex);
     return sdDUChainPrivate->m_chainsByUrl.values();
 }
 
@@ -1298,8 +1340,6 @@ void DUChain::removeDocumentChain(TopDUContext* context)
 
 void DUChain::addDocumentChain(TopDUContext* chain)
 {
-    QMutexLocker l(&sdDUChainPrivate->m_chainsMutex);
-
 //   qCDebug(LANGUAGE) << "duchain: adding document" << chain->url().str() << " " << chain;
     Q_ASSERT(chain);
 
@@ -1323,8 +1363,6 @@ void DUChain::addDocumentChain(TopDUContext* chain)
 
     chain->setInDuChain(true);
 
-    l.unlock();
-
     addToEnvironmentManager(chain);
 
     // This function might be called during shutdown by stale parse jobs
@@ -1442,23 +1480,11 @@ QList<TopDUContext*> DUChain::chainsForDocument(const QUrl& document) const
 
 QList<TopDUContext*> DUChain::chainsForDocument(const IndexedString& document) const
 {
-    QList<TopDUContext*> chains;
-
     if (sdDUChainPrivate->m_destroyed)
-        return chains;
-
-    QMutexLocker l(&sdDUChainPrivate->m_chainsMutex);
+        return QList<TopDUContext*>();
 
     // Match all parsed versions of this document
-    for (auto it = sdDUChainPrivate->m_chainsByUrl.lowerBound(document); it != sdDUChainPrivate->m_chainsByUrl.end();
-         ++it) {
-        if (it.key() == document)
-            chains << it.value();
-        else
-            break;
-    }
-
-    return chains;
+    return sdDUChainPrivate->m_chainsByUrl.values(document);
 }
 
 TopDUContext* DUChain::chainForDocument(const QUrl& document, const KDevelop::ParsingEnvironment* environment,
@@ -1521,11 +1547,11 @@ TopDUContext* DUChain::chainForDocument(const IndexedString& document, const Par
 
 QList<QUrl> DUChain::documents() const
 {
-    QMutexLocker l(&sdDUChainPrivate->m_chainsMutex);
+    const QList<TopDUContext*> chains = sdDUChainPrivate->m_chainsByUrl.values();
 
     QList<QUrl> ret;
-    ret.reserve(sdDUChainPrivate->m_chainsByUrl.count());
-    foreach (TopDUContext* top, sdDUChainPrivate->m_chainsByUrl) {
+    ret.reserve(chains.size());
+    for (TopDUContext* top : chains) {
         ret << top->url().toUrl();
     }
 
@@ -1534,11 +1560,11 @@ QList<QUrl> DUChain::documents() const
 
 QList<IndexedString> DUChain::indexedDocuments() const
 {
-    QMutexLocker l(&sdDUChainPrivate->m_chainsMutex);
+    const QList<TopDUContext*> chains = sdDUChainPrivate->m_chainsByUrl.values();
 
     QList<IndexedString> ret;
-    ret.reserve(sdDUChainPrivate->m_chainsByUrl.count());
-    foreach (TopDUContext* top, sdDUChainPrivate->m_chainsByUrl) {
+    ret.reserve(chains.size());
+    for (TopDUContext* top : chains) {
         ret << top->url();
     }
 
@@ -1725,6 +1751,7 @@ void DUChain::shutdown()
         //Crashes here may happen in an inconsistent state, thus this makes sense, to protect the user from more crashes
         globalItemRepositoryRegistry().lockForWriting();
         finalCleanup();
+        TopDUContextDynamicData::closeStorage();
         globalItemRepositoryRegistry().unlockForWriting();
     }
 
@@ -1752,9 +1779,10 @@ uint DUChain::newTopContextIndex()
 
 void DUChain::refCountUp(TopDUContext* top)
 {
-    QMutexLocker l(&sdDUChainPrivate->m_referenceCountsMutex);
+    DUChainPrivate::ReferenceCountShard& shard = sdDUChainPrivate->referenceCountShard(top);
+    QMutexLocker l(&shard.mutex);
     // note: value is default-constructed to zero if it does not exist
-    ++sdDUChainPrivate->m_referenceCounts[top];
+    ++shard.counts[top];
 }
 
 bool DUChain::deleted()
@@ -1764,16 +1792,17 @@ bool DUChain::deleted()
 
 void DUChain::refCountDown(TopDUContext* top)
 {
-    QMutexLocker l(&sdDUChainPrivate->m_referenceCountsMutex);
-    auto it = sdDUChainPrivate->m_referenceCounts.find(top);
-    if (it == sdDUChainPrivate->m_referenceCounts.end()) {
+    DUChainPrivate::ReferenceCountShard& shard = sdDUChainPrivate->referenceCountShard(top);
+    QMutexLocker l(&shard.mutex);
+    auto it = shard.counts.find(top);
+    if (it == shard.counts.end()) {
         //qCWarning(LANGUAGE) << "tried to decrease reference-count for" << top->url().str() << "but this top-context is not referenced";
         return;
     }
     auto& refCount = *it;
     --refCount;
     if (!refCount) {
-        sdDUChainPrivate->m_referenceCounts.erase(it);
+        shard.counts.erase(it);
     }
 }
 
@@ -1845,12 +1874,33 @@ void DUChain::disablePersistentStorage(bool disable)
     sdDUChainPrivate->m_cleanupDisabled = disable;
 }
 
+void DUChain::setCompressTopContexts(bool compress)
+{
+    TopDUContextDynamicData::setCompressedStorage(compress);
+}
+
+bool DUChain::compressTopContexts() const
+{
+    return TopDUContextDynamicData::compressedStorage();
+}
+
+void DUChain::setPackTopContexts(bool pack)
+{
+    TopDUContextDynamicData::setPackedStorage(pack);
+}
+
+bool DUChain::packTopContexts() const
+{
+    return TopDUContextDynamicData::packedStorage();
+}
+
 void DUChain::storeToDisk()
 {
     bool wasDisabled = sdDUChainPrivate->m_cleanupDisabled;
     sdDUChainPrivate->m_cleanupDisabled = false;
 
     sdDUChainPrivate->doMoreCleanup();
+    globalItemRepositoryRegistry().waitForPendingStore();
 
     sdDUChainPrivate->m_cleanupDisabled = wasDisabled;
 }
@@ -249,6 +249,19 @@ public:
     ///Call this from within tests.
     void disablePersistentStorage(bool disable = true);
 
+    ///Whether top-contexts are stored to disk compressed. Compressed files are smaller, but their data has to
+    ///be decompressed into memory instead of being mapped. Files are always loaded in the format they were stored in.
+    ///Enabled by default if the KDEV_DUCHAIN_COMPRESS environment variable is set.
+    void setCompressTopContexts(bool compress);
+    bool compressTopContexts() const;
+
+    ///Whether top-contexts are stored into a few shared pack files instead of one file each. Top-contexts are found
+    ///in both places, and are moved over when they are stored the next time.
+    ///Enabled by default if the KDEV_DUCHAIN_PACK_TOPCONTEXTS environment variable is set. It is only supported
+    ///where the files can be mapped, everywhere else the top-contexts are still stored one file each.
+    void setPackTopContexts(bool pack);
+    bool packTopContexts() const;
+
     ///Stores the whole duchain and all its repositories in the current state to disk
     ///The duchain must not be locked in any way
     void storeToDisk();
@@ -0,0 +1,144 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#include "duchaincachearchive.h"
+
+#include <serialization/abstractitemrepository.h>
+
+#include <KArchiveDirectory>
+#include <KArchiveFile>
+#include <KTar>
+
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+const QString manifestFileName = QStringLiteral("manifest.json");
+const QString cacheDirectoryName = QStringLiteral("cache");
+
+/// Files in the cache that belong to the session that used it
+bool isSessionFile(const QString& relativePath)
+{
+    return relativePath == QLatin1String("is_writing") || relativePath == QLatin1String("crash_counter");
+}
+}
+
+namespace KDevelop {
+bool DUChainCacheArchive::write(const QString& archivePath, const QString& repositoryPath,
+                                const QStringList& sourceDirectories, QString* errorMessage)
+{
+    const QDir repository(repositoryPath);
+    if (!repository.exists(QStringLiteral("version_%1").arg(staticItemRepositoryVersion()))) {
+        *errorMessage = QStringLiteral("%1 is not a stored DUChain cache").arg(repositoryPath);
+        return false;
+    }
+    if (repository.exists(QStringLiteral("is_writing"))) {
+        *errorMessage = QStringLiteral("the DUChain cache in %1 is being written").arg(repositoryPath);
+        return false;
+    }
+
+    KTar archive(archivePath, QStringLiteral("application/x-gzip"));
+    if (!archive.open(QIODevice::WriteOnly)) {
+        *errorMessage = QStringLiteral("cannot write %1: %2").arg(archivePath, archive.errorString());
+        return false;
+    }
+
+    QJsonObject manifest;
+    manifest.insert(QStringLiteral("formatVersion"), static_cast<int>(FormatVersion));
+    manifest.insert(QStringLiteral("itemRepositoryVersion"), static_cast<qint64>(staticItemRepositoryVersion()));
+    manifest.insert(QStringLiteral("sourceDirectories"), QJsonArray::fromStringList(sourceDirectories));
+    manifest.insert(QStringLiteral("created"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    if (!archive.writeFile(manifestFileName, QJsonDocument(manifest).toJson())) {
+        *errorMessage = QStringLiteral("cannot write %1: %2").arg(archivePath, archive.errorString());
+        return false;
+    }
+
+    QDirIterator it(repositoryPath, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        const QString relativePath = repository.relativeFilePath(path);
+        if (isSessionFile(relativePath)) {
+            continue;
+        }
+        if (!archive.addLocalFile(path, cacheDirectoryName + QLatin1Char('/') + relativePath)) {
+            *errorMessage = QStringLiteral("cannot add %1 to %2: %3").arg(path, archivePath, archive.errorString());
+            return false;
+        }
+    }
+
+    if (!archive.close()) {
+        *errorMessage = QStringLiteral("cannot write %1: %2").arg(archivePath, archive.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool DUChainCacheArchive::extract(const QString& archivePath, const QString& repositoryPath, QString* errorMessage)
+{
+    if (QFileInfo::exists(repositoryPath)) {
+        *errorMessage = QStringLiteral("%1 already exists").arg(repositoryPath);
+        return false;
+    }
+
+    KTar archive(archivePath);
+    if (!archive.open(QIODevice::ReadOnly)) {
+        *errorMessage = QStringLiteral("cannot read %1: %2").arg(archivePath, archive.errorString());
+        return false;
+    }
+
+    const auto* manifestEntry = archive.directory()->entry(manifestFileName);
+    const auto* cacheEntry = archive.directory()->entry(cacheDirectoryName);
+    if (!manifestEntry || !manifestEntry->isFile() || !cacheEntry || !cacheEntry->isDirectory()) {
+        *errorMessage = QStringLiteral("%1 is not a DUChain cache archive").arg(archivePath);
+        return false;
+    }
+
+    const auto manifest = QJsonDocument::fromJson(static_cast<const KArchiveFile*>(manifestEntry)->data()).object();
+    if (manifest.value(QStringLiteral("formatVersion")).toInt() != FormatVersion
+        || manifest.value(QStringLiteral("itemRepositoryVersion")).toDouble() != staticItemRepositoryVersion()) {
+        *errorMessage = QStringLiteral("%1 was written by another version").arg(archivePath);
+        return false;
+    }
+
+    const auto sourceDirectories = manifest.value(QStringLiteral("sourceDirectories")).toArray();
+    for (const auto& sourceDirectory : sourceDirectories) {
+        if (!QFileInfo(sourceDirectory.toString()).isDir()) {
+            *errorMessage = QStringLiteral("%1 was created from %2, which does not exist")
+                            .arg(archivePath, sourceDirectory.toString());
+            return false;
+        }
+    }
+
+    // extract next to the final location first, so an interrupted import never leaves a partial cache behind
+    const QString importPath = repositoryPath + QLatin1String(".import");
+    QDir(importPath).removeRecursively();
+    if (!QDir().mkpath(importPath)
+        || !static_cast<const KArchiveDirectory*>(cacheEntry)->copyTo(importPath, true)
+        || !QDir().rename(importPath, repositoryPath)) {
+        QDir(importPath).removeRecursively();
+        *errorMessage = QStringLiteral("cannot extract %1 to %2").arg(archivePath, repositoryPath);
+        return false;
+    }
+    return true;
+}
+}
@@ -0,0 +1,63 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KDEVPLATFORM_DUCHAINCACHEARCHIVE_H
+#define KDEVPLATFORM_DUCHAINCACHEARCHIVE_H
+
+#include <language/languageexport.h>
+
+#include <QStringList>
+
+namespace KDevelop {
+/**
+ * An archive of the DUChain cache of a session, used to seed the cache of new sessions.
+ *
+ * It is created with duchainify --export-cache, e.g. on a build server. When the DUChain of a session
+ * without a cache is initialized and the environment variable KDEV_DUCHAIN_CACHE_ARCHIVE names an archive,
+ * the archive becomes the cache of that session. Files that changed since the archive was created are
+ * parsed again as usual.
+ *
+ * The cache refers to files by their absolute paths, so an archive is only extracted when all
+ * the source directories it was created from exist at the same paths.
+ */
+class KDEVPLATFORMLANGUAGE_EXPORT DUChainCacheArchive
+{
+public:
+    enum {
+        /// Increase when the layout of the archive changes
+        FormatVersion = 1
+    };
+
+    /**
+     * Writes the stored cache in @p repositoryPath to the archive @p archivePath.
+     *
+     * @param sourceDirectories The absolute paths of the directories the cached files were parsed from
+     */
+    static bool write(const QString& archivePath, const QString& repositoryPath,
+                      const QStringList& sourceDirectories, QString* errorMessage);
+
+    /**
+     * Extracts the archive @p archivePath as the cache in @p repositoryPath, which must not exist yet.
+     *
+     * Fails when the archive was written by another version or its source directories do not exist.
+     */
+    static bool extract(const QString& archivePath, const QString& repositoryPath, QString* errorMessage);
+};
+}
+
+#endif
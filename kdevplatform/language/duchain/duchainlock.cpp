@@ -22,15 +22,21 @@
 #include "duchainlock.h"
 #include "duchain.h"
 
+#include <QCoreApplication>
+#include <QMutex>
 #include <QThread>
 #include <QThreadStorage>
+#include <QVector>
+#include <QWaitCondition>
 #include <QElapsedTimer>
 
-///@todo Always prefer exactly that lock that is requested by the thread that has the foreground mutex,
-///           to reduce the amount of UI blocking.
-
-//Microseconds to sleep when waiting for a lock
-const uint uSleepTime = 500;
+namespace {
+QThread* foregroundThread()
+{
+    auto* app = QCoreApplication::instance();
+    return app ? app->thread() : nullptr;
+}
+}
 
 namespace KDevelop {
 class DUChainLockPrivate
@@ -40,6 +46,8 @@ public:
         : m_writer(nullptr)
         , m_writerRecursion(0)
         , m_totalReaderRecursion(0)
+        , m_waiters(0)
+        , m_parkedWriters(0)
     { }
 
     int ownReaderRecursion() const
@@ -51,7 +59,157 @@ public:
     {
         m_readerRecursion.localData() += difference;
         Q_ASSERT(m_readerRecursion.localData() >= 0);
-        m_totalReaderRecursion.fetchAndAddOrdered(difference);
+        if (m_totalReaderRecursion.fetchAndAddOrdered(difference) + difference == 0) {
+            //The last reader is gone, a parked writer may be able to continue now
+            wakeWaiters();
+        }
+    }
+
+    ///Wakes up all threads that are parked in waitForReadLock() or waitForWriteLock().
+    ///Must be called after every change that can allow a parked thread to continue.
+    void wakeWaiters()
+    {
+        //The ordered read pairs with the ordered increment done by a parking thread before it checks
+        //the lock state: Either that thread sees our change, or we see the thread and wake it up.
+        if (m_waiters.fetchAndAddOrdered(0)) {
+            QMutexLocker lock(&m_waitMutex);
+            m_waitCondition.wakeAll();
+        }
+    }
+
+    ///Tries to take the write-lock without waiting. Must only be called by threads that hold no lock.
+    ///@param waitMutexHeld Whether the caller already holds m_waitMutex
+    bool tryClaimWriteLock(QThread* thread, bool waitMutexHeld)
+    {
+        if (m_totalReaderRecursion.load() == 0 && m_writerRecursion.testAndSetOrdered(0, 1)) {
+            //Now we can be sure that there is no other writer, as we have increased m_writerRecursion from 0 to 1
+            m_writer = thread;
+            if (m_totalReaderRecursion.fetchAndAddOrdered(0) == 0) {
+                //There is still no readers, we have successfully acquired a write-lock
+                return true;
+            }
+            //There may be readers.. back off. Readers that have seen us in the meantime went to sleep,
+            //so they have to be woken up again.
+            m_writer = nullptr;
+            m_writerRecursion.fetchAndStoreOrdered(0);
+            if (waitMutexHeld) {
+                m_waitCondition.wakeAll();
+            } else {
+                wakeWaiters();
+            }
+        }
+        return false;
+    }
+
+    ///Whether a write-lock may be taken by @p thread without queuing up behind parked writers
+    bool mayBypassParkedWriters(QThread* thread) const
+    {
+        return m_parkedWriters.load() == 0 || thread == foregroundThread();
+    }
+
+    ///Parks the calling thread on m_waitCondition until it is woken up.
+    ///@return false if @p timeout milliseconds since the start of @p timer have passed already
+    bool park(const QElapsedTimer& timer, uint timeout)
+    {
+        if (!timeout) {
+            m_waitCondition.wait(&m_waitMutex);
+            return true;
+        }
+        const qint64 remaining = timeout - timer.elapsed();
+        if (remaining <= 0) {
+            return false;
+        }
+        m_waitCondition.wait(&m_waitMutex, remaining);
+        return true;
+    }
+
+    ///Called with m_waitMutex held, after a thread stopped waiting for a lock
+    void recordWait(const QElapsedTimer& timer, bool write, bool acquired, bool foreground)
+    {
+        const quint64 waited = timer.nsecsElapsed() / 1000;
+        DUChainLock::Statistics& s = m_statistics;
+        if (!acquired) {
+            ++s.timedOutLocks;
+        } else if (write) {
+            ++s.contendedWriteLocks;
+            s.totalWriteWaitMicroseconds += waited;
+            s.maxWriteWaitMicroseconds = qMax(s.maxWriteWaitMicroseconds, waited);
+        } else {
+            ++s.contendedReadLocks;
+            s.totalReadWaitMicroseconds += waited;
+            s.maxReadWaitMicroseconds = qMax(s.maxReadWaitMicroseconds, waited);
+        }
+        if (foreground) {
+            ++s.foregroundWaits;
+            s.totalForegroundWaitMicroseconds += waited;
+            s.maxForegroundWaitMicroseconds = qMax(s.maxForegroundWaitMicroseconds, waited);
+        }
+    }
+
+    ///Slow path of lockForRead(): The own reader-recursion has already been increased, wait until the writer is gone
+    bool waitForReadLock(uint timeout)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        QMutexLocker lock(&m_waitMutex);
+        m_waiters.fetchAndAddOrdered(1);
+
+        bool acquired = true;
+        while (m_writer.loadAcquire()) {
+            if (!park(timer, timeout)) {
+                acquired = false;
+                break;
+            }
+        }
+
+        m_waiters.fetchAndAddOrdered(-1);
+        recordWait(timer, false, acquired, QThread::currentThread() == foregroundThread());
+        return acquired;
+    }
+
+    ///Slow path of lockForWrite(): Queue up behind the other parked writers and wait for our turn.
+    ///The foreground thread does not queue up, it takes the lock as soon as it becomes free.
+    bool waitForWriteLock(QThread* thread, uint timeout)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        const bool foreground = thread == foregroundThread();
+
+        QMutexLocker lock(&m_waitMutex);
+        m_waiters.fetchAndAddOrdered(1);
+        m_parkedWriters.fetchAndAddOrdered(1);
+        if (foreground) {
+            m_foregroundWriterParked = true;
+        } else {
+            m_writerQueue.append(thread);
+        }
+
+        bool acquired = false;
+        while (true) {
+            const bool myTurn = foreground || (!m_foregroundWriterParked && m_writerQueue.first() == thread);
+            if (myTurn && tryClaimWriteLock(thread, true)) {
+                acquired = true;
+                break;
+            }
+            if (!park(timer, timeout)) {
+                break;
+            }
+        }
+
+        if (foreground) {
+            m_foregroundWriterParked = false;
+        } else {
+            m_writerQueue.removeOne(thread);
+        }
+        m_parkedWriters.fetchAndAddOrdered(-1);
+        m_waiters.fetchAndAddOrdered(-1);
+        //Leaving the queue may make another parked writer the next one in turn
+        m_waitCondition.wakeAll();
+
+        recordWait(timer, true, acquired, foreground);
+        return acquired;
     }
 
     ///Holds the writer that currently has the write-lock, or zero. Is protected by m_writerRecursion.
@@ -64,6 +222,21 @@ public:
     QAtomicInt m_totalReaderRecursion;
 
     QThreadStorage<int> m_readerRecursion;
+
+    ///Count of threads that are parked (or about to be parked) on m_waitCondition
+    QAtomicInt m_waiters;
+    ///Count of writers that are parked, new writers queue up behind them instead of overtaking them
+    QAtomicInt m_parkedWriters;
+
+    ///Protects the members below, and is the mutex used with m_waitCondition
+    QMutex m_waitMutex;
+    QWaitCondition m_waitCondition;
+    ///Parked background writers, in the order in which they get the lock
+    QVector<QThread*> m_writerQueue;
+    ///Whether the foreground thread is parked waiting for the write-lock. Parked background writers
+    ///don't take the lock while this is set.
+    bool m_foregroundWriterParked = false;
+    DUChainLock::Statistics m_statistics;
 };
 
 DUChainLock::DUChainLock()
@@ -81,23 +254,14 @@ bool DUChainLock::lockForRead(unsigned int timeout)
     QThread* w = d->m_writer.loadAcquire();
     if (w == nullptr || w == QThread::currentThread()) {
         //Successful lock: Either there is no writer, or we hold the write-lock by ourselves
-    } else {
-        ///Step 2: Start spinning until there is no writer any more
-
-        QElapsedTimer t;
-        if (timeout) {
-            t.start();
-        }
+        return true;
+    }
 
-        while (d->m_writer.loadAcquire()) {
-            if (!timeout || t.elapsed() < timeout) {
-                QThread::usleep(uSleepTime);
-            } else {
-                //Fail!
-                d->changeOwnReaderRecursion(-1);
-                return false;
-            }
-        }
+    ///Step 2: Sleep until there is no writer any more
+    if (!d->waitForReadLock(timeout)) {
+        //Fail!
+        d->changeOwnReaderRecursion(-1);
+        return false;
     }
 
     return true;
@@ -119,41 +283,19 @@ bool DUChainLock::lockForWrite(uint timeout)
 
     Q_ASSERT(d->ownReaderRecursion() == 0);
 
-    if (d->m_writer.load() == QThread::currentThread()) {
+    QThread* current = QThread::currentThread();
+    if (d->m_writer.load() == current) {
         //We already hold the write lock, just increase the recursion count and return
         d->m_writerRecursion.fetchAndAddRelaxed(1);
         return true;
     }
 
-    QElapsedTimer t;
-    if (timeout) {
-        t.start();
-    }
-
-    while (1) {
-        //Try acquiring the write-lcok
-        if (d->m_totalReaderRecursion.load() == 0 && d->m_writerRecursion.testAndSetOrdered(0, 1)) {
-            //Now we can be sure that there is no other writer, as we have increased m_writerRecursion from 0 to 1
-            d->m_writer = QThread::currentThread();
-            if (d->m_totalReaderRecursion.load() == 0) {
-                //There is still no readers, we have successfully acquired a write-lock
-                return true;
-            } else {
-                //There may be readers.. we have to continue spinning
-                d->m_writer = nullptr;
-                d->m_writerRecursion = 0;
-            }
-        }
-
-        if (!timeout || t.elapsed() < timeout) {
-            QThread::usleep(uSleepTime);
-        } else {
-            //Fail!
-            return false;
-        }
+    //Fast path: Try taking the lock directly, unless that would overtake parked writers
+    if (d->mayBypassParkedWriters(current) && d->tryClaimWriteLock(current, false)) {
+        return true;
     }
 
-    return false;
+    return d->waitForWriteLock(current, timeout);
 }
 
 void DUChainLock::releaseWriteLock()
@@ -162,10 +304,10 @@ void DUChainLock::releaseWriteLock()
 
     //The order is important here, m_writerRecursion protects m_writer
 
-    //TODO: could testAndSet here
     if (d->m_writerRecursion.load() == 1) {
         d->m_writer = nullptr;
-        d->m_writerRecursion = 0;
+        d->m_writerRecursion.fetchAndStoreOrdered(0);
+        d->wakeWaiters();
     } else {
         d->m_writerRecursion.fetchAndAddOrdered(-1);
     }
@@ -176,6 +318,18 @@ bool DUChainLock::currentThreadHasWriteLock()
     return d->m_writer.load() == QThread::currentThread();
 }
 
+DUChainLock::Statistics DUChainLock::statistics() const
+{
+    QMutexLocker lock(&d->m_waitMutex);
+    return d->m_statistics;
+}
+
+void DUChainLock::resetStatistics()
+{
+    QMutexLocker lock(&d->m_waitMutex);
+    d->m_statistics = Statistics();
+}
+
 DUChainReadLocker::DUChainReadLocker(DUChainLock* duChainLock, uint timeout)
     : m_lock(duChainLock ? duChainLock : DUChain::lock())
     , m_locked(false)
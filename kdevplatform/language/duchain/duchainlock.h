@@ -21,6 +21,7 @@
 
 #include <language/languageexport.h>
 #include <QScopedPointer>
+#include <QtGlobal>
 
 namespace KDevelop {
 // #define NO_DUCHAIN_LOCK_TESTING
@@ -48,10 +49,42 @@ namespace KDevelop {
 
 /**
  * Customized read/write locker for the definition-use chain.
+ *
+ * Uncontended locking only touches a few atomics. Threads that have to wait are put to sleep
+ * and woken up as soon as the lock may be available.
+ *
+ * Readers are only blocked by an active writer, never by waiting writers, so a thread may rely
+ * on other readers making progress while it holds a read-lock. Waiting writers get the lock in
+ * the order in which they started to wait, except for the foreground (UI) thread, which is always
+ * served first.
  */
 class KDEVPLATFORMLANGUAGE_EXPORT DUChainLock
 {
 public:
+    /**
+     * Lock latency statistics, see statistics().
+     *
+     * Only acquisitions that had to wait are recorded, uncontended locking is not counted.
+     * All times are in microseconds.
+     */
+    struct Statistics
+    {
+        /// Count of read-locks that had to wait for a writer
+        quint64 contendedReadLocks = 0;
+        quint64 totalReadWaitMicroseconds = 0;
+        quint64 maxReadWaitMicroseconds = 0;
+        /// Count of write-locks that had to wait for readers or other writers
+        quint64 contendedWriteLocks = 0;
+        quint64 totalWriteWaitMicroseconds = 0;
+        quint64 maxWriteWaitMicroseconds = 0;
+        /// Count of waits done by the foreground thread, for reading or writing, including timeouts
+        quint64 foregroundWaits = 0;
+        quint64 totalForegroundWaitMicroseconds = 0;
+        quint64 maxForegroundWaitMicroseconds = 0;
+        /// Count of lock requests that failed because the timeout was reached
+        quint64 timedOutLocks = 0;
+    };
+
     /// Constructor.
     DUChainLock();
     /// Destructor.
@@ -102,6 +135,16 @@ public:
      */
     bool currentThreadHasWriteLock();
 
+    /**
+     * Returns the lock latency statistics collected since construction or the last resetStatistics().
+     */
+    Statistics statistics() const;
+
+    /**
+     * Clears the lock latency statistics.
+     */
+    void resetStatistics();
+
 private:
     const QScopedPointer<class DUChainLockPrivate> d;
 };
@@ -157,7 +157,11 @@ struct IdentifierItemRequest
     const DynamicIdentifierPrivate& m_identifier;
 };
 
-using IdentifierRepository = RepositoryManager<ItemRepository<ConstantIdentifierPrivate, IdentifierItemRequest>, false>;
+// Identifiers are looked up from all parse threads at once, so let the lookups run concurrently.
+// mutex() does not keep out these lookups, reference counts are changed with an ExclusiveLocker instead.
+using IdentifierItemRepository = ItemRepository<ConstantIdentifierPrivate, IdentifierItemRequest, true,
+        true, 0, 524288 * 2, true>;
+using IdentifierRepository = RepositoryManager<IdentifierItemRepository, false>;
 static IdentifierRepository& identifierRepository()
 {
     static IdentifierRepository identifierRepositoryObject(QStringLiteral("Identifier Repository"));
@@ -325,8 +329,9 @@ struct QualifiedIdentifierItemRequest
     const DynamicQualifiedIdentifierPrivate& m_identifier;
 };
 
-using QualifiedIdentifierRepository = RepositoryManager<ItemRepository<ConstantQualifiedIdentifierPrivate,
-        QualifiedIdentifierItemRequest>, false>;
+using QualifiedIdentifierItemRepository = ItemRepository<ConstantQualifiedIdentifierPrivate,
+        QualifiedIdentifierItemRequest>;
+using QualifiedIdentifierRepository = RepositoryManager<QualifiedIdentifierItemRepository, false>;
 
 static QualifiedIdentifierRepository& qualifiedidentifierRepository()
 {
@@ -1284,7 +1289,7 @@ IndexedIdentifier::IndexedIdentifier()
     : m_index(emptyConstantIdentifierPrivateIndex())
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         increase(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -1293,7 +1298,7 @@ IndexedIdentifier::IndexedIdentifier(const Identifier& id)
     : m_index(id.index())
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         increase(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -1302,7 +1307,7 @@ IndexedIdentifier::IndexedIdentifier(const IndexedIdentifier& rhs)
     : m_index(rhs.m_index)
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         increase(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -1316,7 +1321,7 @@ IndexedIdentifier::IndexedIdentifier(IndexedIdentifier&& rhs) Q_DECL_NOEXCEPT
 IndexedIdentifier::~IndexedIdentifier()
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         decrease(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -1324,14 +1329,14 @@ IndexedIdentifier::~IndexedIdentifier()
 IndexedIdentifier& IndexedIdentifier::operator=(const Identifier& id)
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         decrease(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 
     m_index = id.index();
 
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         increase(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
     return *this;
@@ -1340,12 +1345,12 @@ IndexedIdentifier& IndexedIdentifier::operator=(const Identifier& id)
 IndexedIdentifier& IndexedIdentifier::operator=(IndexedIdentifier&& rhs) Q_DECL_NOEXCEPT
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         ifDebug(qCDebug(LANGUAGE) << "decreasing"; )
 
         decrease(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     } else if (shouldDoDUChainReferenceCounting(&rhs)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         ifDebug(qCDebug(LANGUAGE) << "decreasing"; )
 
         decrease(identifierRepository()->dynamicItemFromIndexSimple(rhs.m_index)->m_refCount, rhs.m_index);
@@ -1355,7 +1360,7 @@ IndexedIdentifier& IndexedIdentifier::operator=(IndexedIdentifier&& rhs) Q_DECL_
     rhs.m_index = emptyConstantIdentifierPrivateIndex();
 
     if (shouldDoDUChainReferenceCounting(this) && !(shouldDoDUChainReferenceCounting(&rhs))) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         ifDebug(qCDebug(LANGUAGE) << "increasing"; )
 
         increase(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
@@ -1367,14 +1372,14 @@ IndexedIdentifier& IndexedIdentifier::operator=(IndexedIdentifier&& rhs) Q_DECL_
 IndexedIdentifier& IndexedIdentifier::operator=(const IndexedIdentifier& id)
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         decrease(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 
     m_index = id.m_index;
 
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(identifierRepository()->mutex());
+        IdentifierItemRepository::ExclusiveLocker lock(identifierRepository().repository());
         increase(identifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
     return *this;
@@ -1436,7 +1441,7 @@ IndexedQualifiedIdentifier::IndexedQualifiedIdentifier()
         ifDebug(qCDebug(LANGUAGE) << "increasing"; )
 
         //qCDebug(LANGUAGE) << "(" << ++cnt << ")" << this << identifier().toString() << "inc" << index;
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         increase(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -1448,7 +1453,7 @@ IndexedQualifiedIdentifier::IndexedQualifiedIdentifier(const QualifiedIdentifier
 
     if (shouldDoDUChainReferenceCounting(this)) {
         ifDebug(qCDebug(LANGUAGE) << "increasing"; )
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         increase(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -1461,7 +1466,7 @@ IndexedQualifiedIdentifier::IndexedQualifiedIdentifier(const IndexedQualifiedIde
     if (shouldDoDUChainReferenceCounting(this)) {
         ifDebug(qCDebug(LANGUAGE) << "increasing"; )
 
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         increase(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -1477,7 +1482,7 @@ IndexedQualifiedIdentifier& IndexedQualifiedIdentifier::operator=(const Qualifie
     ifDebug(qCDebug(LANGUAGE) << "(" << ++cnt << ")" << identifier().toString() << m_index; )
 
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
 
         ifDebug(qCDebug(LANGUAGE) << "decreasing"; )
         decrease(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
@@ -1498,7 +1503,7 @@ IndexedQualifiedIdentifier& IndexedQualifiedIdentifier::operator=(const IndexedQ
     ifDebug(qCDebug(LANGUAGE) << "(" << ++cnt << ")" << identifier().toString() << m_index; )
 
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         ifDebug(qCDebug(LANGUAGE) << "decreasing"; )
 
         decrease(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
@@ -1517,12 +1522,12 @@ IndexedQualifiedIdentifier& IndexedQualifiedIdentifier::operator=(const IndexedQ
 IndexedQualifiedIdentifier& IndexedQualifiedIdentifier::operator=(IndexedQualifiedIdentifier&& rhs) Q_DECL_NOEXCEPT
 {
     if (shouldDoDUChainReferenceCounting(this)) {
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         ifDebug(qCDebug(LANGUAGE) << "decreasing"; )
 
         decrease(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     } else if (shouldDoDUChainReferenceCounting(&rhs)) {
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         ifDebug(qCDebug(LANGUAGE) << "decreasing"; )
 
         decrease(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(rhs.m_index)->m_refCount, rhs.m_index);
@@ -1532,7 +1537,7 @@ IndexedQualifiedIdentifier& IndexedQualifiedIdentifier::operator=(IndexedQualifi
     rhs.m_index = emptyConstantQualifiedIdentifierPrivateIndex();
 
     if (shouldDoDUChainReferenceCounting(this) && !(shouldDoDUChainReferenceCounting(&rhs))) {
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         ifDebug(qCDebug(LANGUAGE) << "increasing"; )
 
         increase(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
@@ -1546,7 +1551,7 @@ IndexedQualifiedIdentifier::~IndexedQualifiedIdentifier()
     ifDebug(qCDebug(LANGUAGE) << "(" << ++cnt << ")" << identifier().toString() << index; )
     if (shouldDoDUChainReferenceCounting(this)) {
         ifDebug(qCDebug(LANGUAGE) << index << "decreasing"; )
-        QMutexLocker lock(qualifiedidentifierRepository()->mutex());
+        QualifiedIdentifierItemRepository::ExclusiveLocker lock(qualifiedidentifierRepository().repository());
         decrease(qualifiedidentifierRepository()->dynamicItemFromIndexSimple(m_index)->m_refCount, m_index);
     }
 }
@@ -29,6 +29,7 @@
 #include "topducontext.h"
 #include "duchain.h"
 #include "duchainlock.h"
+#include "symbolnameindex.h"
 #include <util/embeddedfreetree.h>
 
 //For now, just _always_ use the cache
@@ -234,6 +235,7 @@ void PersistentSymbolTable::addDeclaration(const IndexedQualifiedIdentifier& id,
         }
     } else {
         item.declarationsList().append(declaration);
+        SymbolNameIndex::self().addName(id);
     }
 
     //This inserts the changed item
@@ -288,6 +290,8 @@ void PersistentSymbolTable::removeDeclaration(const IndexedQualifiedIdentifier&
     //This inserts the changed item
     if (item.declarationsSize())
         d->m_declarations.index(request);
+    else if (index)
+        SymbolNameIndex::self().removeName(id); //The last declaration was removed
 }
 
 struct DeclarationCacheVisitor
@@ -320,7 +324,7 @@ PersistentSymbolTable::FilteredDeclarationIterator PersistentSymbolTable::filter
     if (it != d->m_importsCache.constEnd()) {
         cachedImports = *it;
     } else {
-        cachedImports = CachedIndexedRecursiveImports(visibility.set().stdSet());
+        cachedImports = CachedIndexedRecursiveImports(visibility.set().flatSet());
         d->m_importsCache.insert(visibility, cachedImports);
     }
 
@@ -0,0 +1,540 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#include "symbolnameindex.h"
+
+#include "appendedlist.h"
+#include <serialization/itemrepository.h>
+#include <serialization/indexedstring.h>
+#include <util/embeddedfreetree.h>
+
+#include <QMutex>
+#include <QVarLengthArray>
+
+#include <algorithm>
+
+namespace KDevelop {
+namespace {
+enum MatchTier {
+    ExactMatch,
+    PrefixMatch,
+    SubstringMatch,
+    ScopeMatch
+};
+
+const uint NoMatch = 0xffffffff;
+
+//Only the lowest 10 bits of each character are used. Non-latin characters may collide,
+//which only adds candidates that are sorted out when they are ranked.
+inline uint trigram(const QChar* chars)
+{
+    return ((chars[0].toCaseFolded().unicode() & 0x3ffu) << 20)
+           | ((chars[1].toCaseFolded().unicode() & 0x3ffu) << 10)
+           | (chars[2].toCaseFolded().unicode() & 0x3ffu);
+}
+
+void appendTrigrams(const QString& str, QVector<uint>& trigrams)
+{
+    for (int a = 0; a + 2 < str.size(); ++a) {
+        trigrams.append(trigram(str.constData() + a));
+    }
+}
+
+void makeUnique(QVector<uint>& trigrams)
+{
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+QVector<uint> trigramsOf(const IndexedQualifiedIdentifier& id)
+{
+    QVector<uint> ret;
+    const QualifiedIdentifier qid = id.identifier();
+    for (int a = 0; a < qid.count(); ++a) {
+        appendTrigrams(qid.at(a).identifier().str(), ret);
+    }
+
+    makeUnique(ret);
+    return ret;
+}
+
+uint matchRank(const QualifiedIdentifier& id, const QString& text)
+{
+    //Check the last component first, it is the name the user is most likely looking for
+    for (int a = id.count() - 1; a >= 0; --a) {
+        const QString name = id.at(a).identifier().str();
+        const int pos = name.indexOf(text, 0, Qt::CaseInsensitive);
+        if (pos == -1)
+            continue;
+
+        MatchTier tier;
+        if (a != id.count() - 1)
+            tier = ScopeMatch;
+        else if (pos == 0 && name.size() == text.size())
+            tier = ExactMatch;
+        else if (pos == 0)
+            tier = PrefixMatch;
+        else
+            tier = SubstringMatch;
+
+        return (uint(tier) << 24) | qMin(uint(name.size()), 0xffffffu);
+    }
+
+    return NoMatch;
+}
+}
+
+struct SymbolNameIndexEntry
+{
+    IndexedQualifiedIdentifier id;
+    //Count of addName() calls that were not matched by a removeName() yet.
+    //While the entry is free, this is used as its left child.
+    uint referenceCount = 0;
+    //Only used as right child while the entry is free
+    uint rightChild = 0;
+
+    bool operator<(const SymbolNameIndexEntry& rhs) const
+    {
+        return id < rhs.id;
+    }
+};
+
+class SymbolNameIndexEntryHandler
+{
+public:
+    static int leftChild(const SymbolNameIndexEntry& m_data)
+    {
+        return ( int )m_data.referenceCount;
+    }
+    static void setLeftChild(SymbolNameIndexEntry& m_data, int child)
+    {
+        m_data.referenceCount = ( uint )child;
+    }
+    static int rightChild(const SymbolNameIndexEntry& m_data)
+    {
+        return ( int )m_data.rightChild;
+    }
+    static void setRightChild(SymbolNameIndexEntry& m_data, int child)
+    {
+        m_data.rightChild = ( uint )child;
+    }
+    //Copies this item into the given one
+    static void copyTo(const SymbolNameIndexEntry& m_data, SymbolNameIndexEntry& data)
+    {
+        data = m_data;
+    }
+
+    static void createFreeItem(SymbolNameIndexEntry& data)
+    {
+        data = SymbolNameIndexEntry();
+        data.referenceCount = (uint) - 1;
+        data.rightChild = (uint) - 1;
+    }
+
+    static bool isFree(const SymbolNameIndexEntry& m_data)
+    {
+        return !m_data.id.isValid();
+    }
+
+    static bool equals(const SymbolNameIndexEntry& m_data, const SymbolNameIndexEntry& rhs)
+    {
+        return m_data.id == rhs.id;
+    }
+};
+
+DEFINE_LIST_MEMBER_HASH(SymbolNameIndexItem, entries, SymbolNameIndexEntry)
+
+class SymbolNameIndexItem
+{
+public:
+    SymbolNameIndexItem()
+    {
+        initializeAppendedLists();
+    }
+    SymbolNameIndexItem(const SymbolNameIndexItem& rhs, bool dynamic = true) : trigram(rhs.trigram)
+        , centralFreeItem(rhs.centralFreeItem)
+    {
+        initializeAppendedLists(dynamic);
+        copyListsFrom(rhs);
+    }
+
+    ~SymbolNameIndexItem()
+    {
+        freeAppendedLists();
+    }
+
+    unsigned int hash() const
+    {
+        //Only the trigram is compared, so the repository can be used as a map from trigrams to identifiers
+        return trigram;
+    }
+
+    uint itemSize() const
+    {
+        return dynamicSize();
+    }
+
+    uint classSize() const
+    {
+        return sizeof(SymbolNameIndexItem);
+    }
+
+    uint trigram = 0;
+    int centralFreeItem = -1;
+
+    START_APPENDED_LISTS(SymbolNameIndexItem);
+    APPENDED_LIST_FIRST(SymbolNameIndexItem, SymbolNameIndexEntry, entries);
+    END_APPENDED_LISTS(SymbolNameIndexItem, entries);
+};
+
+class SymbolNameIndexRequestItem
+{
+public:
+
+    SymbolNameIndexRequestItem(const SymbolNameIndexItem& item) : m_item(item)
+    {
+    }
+    enum {
+        AverageSize = 60 //This should be the approximate average size of an Item
+    };
+
+    unsigned int hash() const
+    {
+        return m_item.hash();
+    }
+
+    uint itemSize() const
+    {
+        return m_item.itemSize();
+    }
+
+    void createItem(SymbolNameIndexItem* item) const
+    {
+        new (item) SymbolNameIndexItem(m_item, false);
+    }
+
+    static void destroy(SymbolNameIndexItem* item, KDevelop::AbstractItemRepository&)
+    {
+        item->~SymbolNameIndexItem();
+    }
+
+    static bool persistent(const SymbolNameIndexItem*)
+    {
+        return true;
+    }
+
+    bool equals(const SymbolNameIndexItem* item) const
+    {
+        return m_item.trigram == item->trigram;
+    }
+
+    const SymbolNameIndexItem& m_item;
+};
+
+class SymbolNameIndexPrivate
+{
+public:
+
+    SymbolNameIndexPrivate() : m_repository(QStringLiteral("Symbol Name Index"))
+    {
+    }
+
+    struct PendingChange
+    {
+        IndexedQualifiedIdentifier id;
+        bool add;
+    };
+
+    void queueChange(const IndexedQualifiedIdentifier& id, bool add);
+
+    //The mutex of the repository must be locked when calling these
+    void applyPendingChanges();
+    void addEntry(uint trigram, const IndexedQualifiedIdentifier& id);
+    void removeEntry(uint trigram, const IndexedQualifiedIdentifier& id);
+    //Returns the identifiers that contain all @p trigrams
+    QVector<IndexedQualifiedIdentifier> findIds(const QVector<uint>& trigrams);
+
+    //Maps trigrams to the identifiers that contain them
+    ItemRepository<SymbolNameIndexItem, SymbolNameIndexRequestItem> m_repository;
+
+    //Protects m_pendingChanges only, so queueing never waits for the repository
+    QMutex m_pendingMutex;
+    //Changes that were not applied to the repository yet, in the order they were made
+    QVector<PendingChange> m_pendingChanges;
+};
+
+void SymbolNameIndexPrivate::queueChange(const IndexedQualifiedIdentifier& id, bool add)
+{
+    QMutexLocker lock(&m_pendingMutex);
+    m_pendingChanges.append({id, add});
+}
+
+void SymbolNameIndexPrivate::applyPendingChanges()
+{
+    QVector<PendingChange> changes;
+    {
+        QMutexLocker lock(&m_pendingMutex);
+        changes.swap(m_pendingChanges);
+    }
+
+    for (const PendingChange& change : qAsConst(changes)) {
+        const QVector<uint> trigrams = trigramsOf(change.id);
+        for (uint trigram : trigrams) {
+            if (change.add)
+                addEntry(trigram, change.id);
+            else
+                removeEntry(trigram, change.id);
+        }
+    }
+}
+
+void SymbolNameIndexPrivate::addEntry(uint trigram, const IndexedQualifiedIdentifier& id)
+{
+    SymbolNameIndexItem item;
+    item.trigram = trigram;
+    SymbolNameIndexRequestItem request(item);
+
+    SymbolNameIndexEntry newEntry;
+    newEntry.id = id;
+    newEntry.referenceCount = 1;
+
+    const uint index = m_repository.findIndex(request);
+
+    if (index) {
+        DynamicItem<SymbolNameIndexItem, true> editableItem = m_repository.dynamicItemFromIndex(index);
+        auto* entries = const_cast<SymbolNameIndexEntry*>(editableItem->entries());
+
+        EmbeddedTreeAlgorithms<SymbolNameIndexEntry, SymbolNameIndexEntryHandler> alg(entries,
+            editableItem->entriesSize(), editableItem->centralFreeItem);
+
+        const int listIndex = alg.indexOf(newEntry);
+        if (listIndex != -1) {
+            ++entries[listIndex].referenceCount;
+            return;
+        }
+
+        EmbeddedTreeAddItem<SymbolNameIndexEntry, SymbolNameIndexEntryHandler> add(entries,
+            editableItem->entriesSize(), editableItem->centralFreeItem, newEntry);
+
+        const uint newSize = add.newItemCount();
+        if (newSize == editableItem->entriesSize()) {
+            //The entry fit into a free slot of the existing list
+            return;
+        }
+
+        //The entries need to be transferred into a bigger list, which replaces the old item
+        item.entriesList().resize(newSize);
+        add.transferData(item.entriesList().data(), newSize, &item.centralFreeItem);
+
+        m_repository.deleteItem(index);
+    } else {
+        item.entriesList().append(newEntry);
+    }
+
+    m_repository.index(request);
+}
+
+void SymbolNameIndexPrivate::removeEntry(uint trigram, const IndexedQualifiedIdentifier& id)
+{
+    SymbolNameIndexItem item;
+    item.trigram = trigram;
+    SymbolNameIndexRequestItem request(item);
+
+    const uint index = m_repository.findIndex(request);
+    if (!index)
+        return;
+
+    SymbolNameIndexEntry searchEntry;
+    searchEntry.id = id;
+
+    DynamicItem<SymbolNameIndexItem, true> editableItem = m_repository.dynamicItemFromIndex(index);
+    auto* entries = const_cast<SymbolNameIndexEntry*>(editableItem->entries());
+
+    EmbeddedTreeAlgorithms<SymbolNameIndexEntry, SymbolNameIndexEntryHandler> alg(entries,
+        editableItem->entriesSize(), editableItem->centralFreeItem);
+
+    const int listIndex = alg.indexOf(searchEntry);
+    if (listIndex == -1)
+        return;
+
+    if (--entries[listIndex].referenceCount)
+        return; //The identifier is still referenced
+
+    EmbeddedTreeRemoveItem<SymbolNameIndexEntry, SymbolNameIndexEntryHandler> remove(entries,
+        editableItem->entriesSize(), editableItem->centralFreeItem, searchEntry);
+
+    const uint newSize = remove.newItemCount();
+    if (newSize == editableItem->entriesSize())
+        return;
+
+    if (newSize) {
+        //Make smaller
+        item.entriesList().resize(newSize);
+        remove.transferData(item.entriesList().data(), newSize, &item.centralFreeItem);
+    }
+
+    m_repository.deleteItem(index);
+
+    if (newSize)
+        m_repository.index(request);
+}
+
+QVector<IndexedQualifiedIdentifier> SymbolNameIndexPrivate::findIds(const QVector<uint>& trigrams)
+{
+    QVector<IndexedQualifiedIdentifier> ret;
+
+    QVarLengthArray<const SymbolNameIndexItem*, 16> items;
+    for (uint trigram : trigrams) {
+        SymbolNameIndexItem item;
+        item.trigram = trigram;
+
+        const uint index = m_repository.findIndex(SymbolNameIndexRequestItem(item));
+        if (!index)
+            return ret; //No identifier contains this trigram
+        items.append(m_repository.itemFromIndex(index));
+    }
+
+    //Walk the shortest list, and look up its entries in the others
+    std::sort(items.begin(), items.end(), [](const SymbolNameIndexItem* lhs, const SymbolNameIndexItem* rhs) {
+        return lhs->entriesSize() < rhs->entriesSize();
+    });
+
+    const SymbolNameIndexItem* shortest = items[0];
+    for (uint a = 0; a < shortest->entriesSize(); ++a) {
+        const SymbolNameIndexEntry& entry = shortest->entries()[a];
+        if (SymbolNameIndexEntryHandler::isFree(entry))
+            continue;
+
+        bool containsAll = true;
+        for (int b = 1; b < items.size() && containsAll; ++b) {
+            EmbeddedTreeAlgorithms<SymbolNameIndexEntry, SymbolNameIndexEntryHandler> alg(items[b]->entries(),
+                items[b]->entriesSize(), items[b]->centralFreeItem);
+            containsAll = alg.indexOf(entry) != -1;
+        }
+
+        if (containsAll)
+            ret.append(entry.id);
+    }
+
+    return ret;
+}
+
+SymbolNameIndex::SymbolNameIndex() : d(new SymbolNameIndexPrivate())
+{
+}
+
+SymbolNameIndex::~SymbolNameIndex() = default;
+
+void SymbolNameIndex::addName(const IndexedQualifiedIdentifier& id)
+{
+    if (id.isValid())
+        d->queueChange(id, true);
+}
+
+void SymbolNameIndex::removeName(const IndexedQualifiedIdentifier& id)
+{
+    if (id.isValid())
+        d->queueChange(id, false);
+}
+
+void SymbolNameIndex::applyPendingChanges()
+{
+    //The repository mutex is locked before the queue is taken, so concurrent calls apply the changes in order
+    QMutexLocker lock(d->m_repository.mutex());
+    d->applyPendingChanges();
+}
+
+bool SymbolNameIndex::canFind(const QString& text)
+{
+    return text.size() >= MinimumSearchLength;
+}
+
+QVector<SymbolNameIndex::Match> SymbolNameIndex::findNames(const QString& text) const
+{
+    QVector<Match> ret;
+
+    QVector<uint> trigrams;
+    appendTrigrams(text, trigrams);
+    makeUnique(trigrams);
+    if (trigrams.isEmpty())
+        return ret;
+
+    QVector<IndexedQualifiedIdentifier> candidates;
+    {
+        QMutexLocker lock(d->m_repository.mutex());
+        d->applyPendingChanges();
+        candidates = d->findIds(trigrams);
+    }
+
+    //The trigrams may have been found in different components, or in a different order,
+    //so the candidates still have to be checked against the whole text
+    ret.reserve(candidates.size());
+    for (const IndexedQualifiedIdentifier& id : qAsConst(candidates)) {
+        const uint rank = matchRank(id.identifier(), text);
+        if (rank != NoMatch)
+            ret.append({id, rank});
+    }
+
+    std::sort(ret.begin(), ret.end(), [](const Match& lhs, const Match& rhs) {
+        if (lhs.rank != rhs.rank)
+            return lhs.rank < rhs.rank;
+        return lhs.id.index() < rhs.id.index();
+    });
+
+    return ret;
+}
+
+QVector<IndexedQualifiedIdentifier> SymbolNameIndex::findCandidates(const QString& text) const
+{
+    QVector<uint> trigrams;
+    appendTrigrams(text, trigrams);
+    makeUnique(trigrams);
+    if (trigrams.isEmpty())
+        return {};
+
+    QVector<IndexedQualifiedIdentifier> ret;
+    {
+        QMutexLocker lock(d->m_repository.mutex());
+        ret = d->findIds(trigrams);
+    }
+
+    //The names that were not indexed yet may match as well
+    bool pendingAdditions = false;
+    {
+        QMutexLocker lock(&d->m_pendingMutex);
+        for (const SymbolNameIndexPrivate::PendingChange& change : qAsConst(d->m_pendingChanges)) {
+            if (change.add) {
+                ret.append(change.id);
+                pendingAdditions = true;
+            }
+        }
+    }
+    if (pendingAdditions) {
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    }
+
+    return ret;
+}
+
+SymbolNameIndex& SymbolNameIndex::self()
+{
+    static SymbolNameIndex ret;
+    return ret;
+}
+}
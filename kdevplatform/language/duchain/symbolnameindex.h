@@ -0,0 +1,89 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KDEVPLATFORM_SYMBOLNAMEINDEX_H
+#define KDEVPLATFORM_SYMBOLNAMEINDEX_H
+
+#include "identifier.h"
+
+#include <QScopedPointer>
+#include <QVector>
+
+namespace KDevelop {
+/**
+ * Persistent index over the names of all qualified identifiers in the PersistentSymbolTable and the CodeModel,
+ * which allows finding identifiers by a part of their name without iterating all of them.
+ *
+ * Every component of an identifier is split into overlapping case-folded trigrams, and for every trigram
+ * the identifiers containing it are stored. A search intersects the lists of the trigrams of the searched text,
+ * so the text needs at least MinimumSearchLength characters.
+ *
+ * The index is kept up to date by PersistentSymbolTable and CodeModel, an identifier is indexed as long as
+ * any of them references it. Since they change while the DUChain is write-locked, the changes are only queued
+ * there, and applied by the next findNames() or by applyPendingChanges().
+ */
+class KDEVPLATFORMLANGUAGE_EXPORT SymbolNameIndex
+{
+public:
+    enum {
+        MinimumSearchLength = 3
+    };
+
+    struct Match
+    {
+        IndexedQualifiedIdentifier id;
+        ///Lower is better: Exact matches of the last component come first, then prefix matches, then other
+        ///matches in the last component, and then matches in one of the scopes. Shorter names win ties.
+        uint rank;
+    };
+
+    SymbolNameIndex();
+    ~SymbolNameIndex();
+
+    ///Adds a reference to @p id, its name is indexed while it is referenced
+    void addName(const IndexedQualifiedIdentifier& id);
+    ///Removes a reference added through addName()
+    void removeName(const IndexedQualifiedIdentifier& id);
+
+    ///Indexes the names added and removed since the last call. Must be called before the repositories are stored.
+    void applyPendingChanges();
+
+    ///@return whether findNames() can be used for @p text
+    static bool canFind(const QString& text);
+
+    ///Returns all indexed identifiers that contain @p text in one of their components, ignoring case.
+    ///The best matches come first.
+    ///@param text At least MinimumSearchLength characters, @see canFind()
+    QVector<Match> findNames(const QString& text) const;
+
+    ///Returns the identifiers that may contain @p text in one of their components, in no particular order.
+    ///Unlike findNames(), the candidates are not checked against @p text and not ranked, and the pending
+    ///changes are not applied: the names added since then are all returned as candidates.
+    ///@param text At least MinimumSearchLength characters, @see canFind()
+    QVector<IndexedQualifiedIdentifier> findCandidates(const QString& text) const;
+
+    static SymbolNameIndex& self();
+
+private:
+    const QScopedPointer<class SymbolNameIndexPrivate> d;
+};
+}
+
+Q_DECLARE_TYPEINFO(KDevelop::SymbolNameIndex::Match, Q_MOVABLE_TYPE);
+
+#endif
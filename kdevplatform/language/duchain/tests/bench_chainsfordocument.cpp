@@ -0,0 +1,211 @@
+/*
+ * This file is part of KDevelop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "bench_chainsfordocument.h"
+
+#include <language/duchain/duchain.h>
+#include <language/duchain/duchainlock.h>
+#include <language/duchain/topducontext.h>
+#include <serialization/indexedstring.h>
+
+#include <tests/testcore.h>
+#include <tests/autotestshell.h>
+
+#include <QAtomicInt>
+#include <QTest>
+#include <QThread>
+
+QTEST_GUILESS_MAIN(BenchChainsForDocument)
+
+using namespace KDevelop;
+
+namespace {
+// every document gets two top-contexts, like a proxy- and a content-context
+const int documentCount = 10000;
+const int lookupsPerThread = 50000;
+
+IndexedString documentUrl(int number)
+{
+    return IndexedString(QStringLiteral("/bench/document%1.cpp").arg(number));
+}
+
+/// Looks up random documents, optionally with the DUChain read-locked like most callers do
+class LookupThread
+    : public QThread
+{
+public:
+    LookupThread(const QVector<IndexedString>& urls, int seed, bool readLock)
+        : m_urls(urls)
+        , m_seed(seed)
+        , m_readLock(readLock)
+    {
+    }
+
+    void run() override
+    {
+        uint state = m_seed;
+        for (int i = 0; i < lookupsPerThread; ++i) {
+            // linear congruential generator, so the threads don't share any state
+            state = state * 1103515245u + 12345u;
+            const IndexedString& url = m_urls[(state >> 8) % m_urls.size()];
+            if (m_readLock) {
+                DUChainReadLocker lock;
+                if (DUChain::self()->chainForDocument(url))
+                    ++m_found;
+            } else {
+                m_found += DUChain::self()->chainsForDocument(url).size();
+            }
+        }
+    }
+
+    int m_found = 0;
+
+private:
+    const QVector<IndexedString>& m_urls;
+    int m_seed;
+    bool m_readLock;
+};
+
+/// Simulates parse jobs that keep adding and removing top-contexts while the lookups are running
+class ParseLoadThread
+    : public QThread
+{
+public:
+    void run() override
+    {
+        QVector<TopDUContext*> added;
+        int number = 0;
+        while (!m_stop.load()) {
+            {
+                DUChainWriteLocker lock;
+                auto* top = new TopDUContext(IndexedString(QStringLiteral("/bench/parsed%1.cpp").arg(number++)),
+                                             RangeInRevision());
+                DUChain::self()->addDocumentChain(top);
+                added << top;
+            }
+            if (added.size() > 100) {
+                DUChainWriteLocker lock;
+                DUChain::self()->removeDocumentChain(added.takeFirst());
+            }
+            usleep(100);
+        }
+
+        DUChainWriteLocker lock;
+        for (TopDUContext* top : qAsConst(added)) {
+            DUChain::self()->removeDocumentChain(top);
+        }
+    }
+
+    QAtomicInt m_stop;
+};
+
+void runLookups(bool readLock)
+{
+    QFETCH(int, threadCount);
+    QFETCH(bool, parseLoad);
+
+    QVector<IndexedString> urls;
+    urls.reserve(documentCount);
+    for (int i = 0; i < documentCount; ++i) {
+        urls << documentUrl(i);
+    }
+
+    ParseLoadThread load;
+    if (parseLoad) {
+        load.start();
+    }
+
+    QBENCHMARK {
+        QVector<LookupThread*> threads;
+        for (int i = 0; i < threadCount; ++i) {
+            threads << new LookupThread(urls, i + 1, readLock);
+            threads.last()->start();
+        }
+
+        for (LookupThread* thread : qAsConst(threads)) {
+            thread->wait();
+            QCOMPARE(thread->m_found, readLock ? lookupsPerThread : 2 * lookupsPerThread);
+        }
+        qDeleteAll(threads);
+    }
+
+    load.m_stop.store(1);
+    load.wait();
+}
+}
+
+void BenchChainsForDocument::initTestCase()
+{
+    AutoTestShell::init();
+    TestCore::initialize(Core::NoUi);
+
+    DUChain::self()->disablePersistentStorage();
+
+    DUChainWriteLocker lock;
+    m_contexts.reserve(2 * documentCount);
+    for (int i = 0; i < 2 * documentCount; ++i) {
+        auto* top = new TopDUContext(documentUrl(i % documentCount), RangeInRevision());
+        DUChain::self()->addDocumentChain(top);
+        m_contexts << top;
+    }
+}
+
+void BenchChainsForDocument::cleanupTestCase()
+{
+    {
+        DUChainWriteLocker lock;
+        for (TopDUContext* top : qAsConst(m_contexts)) {
+            DUChain::self()->removeDocumentChain(top);
+        }
+        m_contexts.clear();
+    }
+
+    TestCore::shutdown();
+}
+
+void BenchChainsForDocument::feedData()
+{
+    QTest::addColumn<int>("threadCount");
+    QTest::addColumn<bool>("parseLoad");
+
+    for (int threadCount : {1, 4, 8}) {
+        QTest::newRow(qPrintable(QStringLiteral("%1-threads").arg(threadCount))) << threadCount << false;
+        QTest::newRow(qPrintable(QStringLiteral("%1-threads-parsing").arg(threadCount))) << threadCount << true;
+    }
+}
+
+void BenchChainsForDocument::chainsForDocument()
+{
+    runLookups(false);
+}
+
+void BenchChainsForDocument::chainsForDocument_data()
+{
+    feedData();
+}
+
+void BenchChainsForDocument::chainForDocument()
+{
+    runLookups(true);
+}
+
+void BenchChainsForDocument::chainForDocument_data()
+{
+    feedData();
+}
@@ -0,0 +1,201 @@
+/*
+ * This file is part of KDevelop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "bench_setrepository.h"
+
+#include <language/util/basicsetrepository.h>
+
+#include <tests/testcore.h>
+#include <tests/autotestshell.h>
+
+#include <QTest>
+
+#include <set>
+
+QTEST_GUILESS_MAIN(BenchSetRepository)
+
+using namespace KDevelop;
+using namespace Utils;
+
+using Index = BasicSetRepository::Index;
+
+Q_DECLARE_METATYPE(Utils::Set)
+
+namespace {
+/// Creates a set that looks like the recursive imports of a file: Mostly contiguous runs of
+/// context indices, which are shared with the other set, plus some scattered ones of its own
+Set createImportSet(BasicSetRepository& repository, uint seed, int size)
+{
+    std::set<Index> indices;
+    uint state = seed;
+    Index current = 1;
+    while (indices.size() < uint(size)) {
+        // linear congruential generator, so the sets are the same in every run
+        state = state * 1103515245u + 12345u;
+        if ((state >> 16) % 4) {
+            indices.insert(current);
+        }
+        current += 1 + (state >> 8) % 3;
+    }
+
+    return repository.createSet(indices);
+}
+
+BasicSetRepository& repository()
+{
+    static BasicSetRepository ret(QStringLiteral("bench set repository"), nullptr);
+    return ret;
+}
+
+enum Operation {
+    Union,
+    Intersection,
+    Difference
+};
+
+void runTree(Operation operation)
+{
+    QFETCH(Set, first);
+    QFETCH(Set, second);
+
+    Set result;
+    QBENCHMARK {
+        switch (operation) {
+        case Union:
+            result = first + second;
+            break;
+        case Intersection:
+            result = first & second;
+            break;
+        case Difference:
+            result = first - second;
+            break;
+        }
+    }
+    QVERIFY(result.count() <= first.count() + second.count());
+}
+
+void runFlat(Operation operation)
+{
+    QFETCH(Set, first);
+    QFETCH(Set, second);
+
+    // flattening is cached by the repository, so only the first call pays for it, like for hot sets
+    const FlatSet firstFlat = first.flatSet();
+    const FlatSet secondFlat = second.flatSet();
+
+    FlatSet result;
+    QBENCHMARK {
+        switch (operation) {
+        case Union:
+            result = first.flatSet() + second.flatSet();
+            break;
+        case Intersection:
+            result = first.flatSet() & second.flatSet();
+            break;
+        case Difference:
+            result = first.flatSet() - second.flatSet();
+            break;
+        }
+    }
+    QVERIFY(result.count() <= firstFlat.count() + secondFlat.count());
+}
+}
+
+void BenchSetRepository::initTestCase()
+{
+    AutoTestShell::init();
+    TestCore::initialize(Core::NoUi);
+}
+
+void BenchSetRepository::cleanupTestCase()
+{
+    TestCore::shutdown();
+}
+
+void BenchSetRepository::feedData()
+{
+    QTest::addColumn<Set>("first");
+    QTest::addColumn<Set>("second");
+
+    for (int size : {100, 1000, 10000, 100000}) {
+        QTest::newRow(qPrintable(QStringLiteral("%1-items").arg(size)))
+            << createImportSet(repository(), 1, size) << createImportSet(repository(), 2, size);
+    }
+}
+
+void BenchSetRepository::treeUnion()
+{
+    runTree(Union);
+}
+
+void BenchSetRepository::treeUnion_data()
+{
+    feedData();
+}
+
+void BenchSetRepository::flatUnion()
+{
+    runFlat(Union);
+}
+
+void BenchSetRepository::flatUnion_data()
+{
+    feedData();
+}
+
+void BenchSetRepository::treeIntersection()
+{
+    runTree(Intersection);
+}
+
+void BenchSetRepository::treeIntersection_data()
+{
+    feedData();
+}
+
+void BenchSetRepository::flatIntersection()
+{
+    runFlat(Intersection);
+}
+
+void BenchSetRepository::flatIntersection_data()
+{
+    feedData();
+}
+
+void BenchSetRepository::treeDifference()
+{
+    runTree(Difference);
+}
+
+void BenchSetRepository::treeDifference_data()
+{
+    feedData();
+}
+
+void BenchSetRepository::flatDifference()
+{
+    runFlat(Difference);
+}
+
+void BenchSetRepository::flatDifference_data()
+{
+    feedData();
+}
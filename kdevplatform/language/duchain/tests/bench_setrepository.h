@@ -0,0 +1,52 @@
+/*
+ * This file is part of KDevelop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef KDEVPLATFORM_BENCH_SETREPOSITORY_H
+#define KDEVPLATFORM_BENCH_SETREPOSITORY_H
+
+#include <QObject>
+
+class BenchSetRepository
+    : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void treeUnion();
+    void treeUnion_data();
+    void flatUnion();
+    void flatUnion_data();
+    void treeIntersection();
+    void treeIntersection_data();
+    void flatIntersection();
+    void flatIntersection_data();
+    void treeDifference();
+    void treeDifference_data();
+    void flatDifference();
+    void flatDifference_data();
+
+private:
+    void feedData();
+};
+
+#endif // KDEVPLATFORM_BENCH_SETREPOSITORY_H
@@ -0,0 +1,201 @@
+/*
+ * This file is part of KDevelop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "bench_topcontextstorage.h"
+
+#include <language/duchain/declaration.h>
+#include <language/duchain/duchain.h>
+#include <language/duchain/duchainlock.h>
+#include <language/duchain/ducontext.h>
+#include <language/duchain/indexedtopducontext.h>
+#include <language/duchain/topducontext.h>
+#include <serialization/indexedstring.h>
+#include <serialization/itemrepositoryregistry.h>
+
+#include <tests/testcore.h>
+#include <tests/autotestshell.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QTest>
+
+QTEST_GUILESS_MAIN(BenchTopContextStorage)
+
+using namespace KDevelop;
+
+namespace {
+const int topContextCount = 50;
+const int declarationsPerContext = 2000;
+
+uint createTopContext(int number)
+{
+    DUChainWriteLocker lock;
+    auto* top = new TopDUContext(IndexedString(QStringLiteral("/bench/storage%1.cpp").arg(number)),
+                                 RangeInRevision(0, 0, declarationsPerContext, 0));
+    DUChain::self()->addDocumentChain(top);
+
+    for (int i = 0; i < declarationsPerContext; ++i) {
+        auto* declaration = new Declaration(RangeInRevision(i, 0, i, 10), top);
+        declaration->setIdentifier(Identifier(QStringLiteral("declaration%1").arg(i)));
+
+        if (i % 10 == 0) {
+            // like a function body with a local variable
+            auto* context = new DUContext(RangeInRevision(i, 11, i, 50), top);
+            auto* local = new Declaration(RangeInRevision(i, 12, i, 20), context);
+            local->setIdentifier(Identifier(QStringLiteral("local%1").arg(i)));
+        }
+    }
+
+    return top->ownIndex();
+}
+
+qint64 storageSize()
+{
+    qint64 size = 0;
+    const auto files = QDir(globalItemRepositoryRegistry().path() + QLatin1String("/topcontexts/"))
+                           .entryInfoList(QDir::Files);
+    for (const QFileInfo& file : files) {
+        size += file.size();
+    }
+
+    return size;
+}
+
+/// Creates the top-contexts in the given format, and unloads them from memory again
+QVector<uint> createStoredTopContexts(qint64* storedSize)
+{
+    QFETCH(bool, compress);
+    QFETCH(bool, pack);
+    DUChain::self()->setCompressTopContexts(compress);
+    DUChain::self()->setPackTopContexts(pack);
+
+    QVector<uint> indices;
+    for (int i = 0; i < topContextCount; ++i) {
+        indices << createTopContext(i);
+    }
+
+    // nothing references the top-contexts, so they are unloaded after being stored
+    const qint64 sizeBefore = storageSize();
+    DUChain::self()->storeToDisk();
+
+    for (uint index : qAsConst(indices)) {
+        Q_ASSERT(!DUChain::self()->isInMemory(index));
+        Q_UNUSED(index);
+    }
+    *storedSize = storageSize() - sizeBefore;
+
+    return indices;
+}
+
+/// Checks that compression shrinks the stored top-contexts, compared to the preceding raw row
+void verifyStoredSize(qint64 storedSize)
+{
+    static qint64 rawSize = -1;
+
+    QFETCH(bool, compress);
+    QFETCH(bool, pack);
+    if (pack) {
+        // the pack files grow in steps, so their size is only approximate
+        return;
+    }
+    if (!compress) {
+        rawSize = storedSize;
+    } else if (rawSize != -1) {
+        QVERIFY2(storedSize < rawSize, qPrintable(QStringLiteral("compressed: %1 bytes, raw: %2 bytes")
+                                                      .arg(storedSize).arg(rawSize)));
+    }
+}
+
+void removeTopContexts(const QVector<uint>& indices)
+{
+    DUChainWriteLocker lock;
+    for (uint index : indices) {
+        DUChain::self()->removeDocumentChain(IndexedTopDUContext(index).data());
+    }
+}
+
+void feedData()
+{
+    QTest::addColumn<bool>("compress");
+    QTest::addColumn<bool>("pack");
+
+    QTest::newRow("files-raw") << false << false;
+    QTest::newRow("files-compressed") << true << false;
+    QTest::newRow("pack-raw") << false << true;
+    QTest::newRow("pack-compressed") << true << true;
+}
+}
+
+void BenchTopContextStorage::initTestCase()
+{
+    AutoTestShell::init();
+    TestCore::initialize(Core::NoUi);
+}
+
+void BenchTopContextStorage::cleanupTestCase()
+{
+    TestCore::shutdown();
+}
+
+void BenchTopContextStorage::load()
+{
+    qint64 storedSize = 0;
+    const QVector<uint> indices = createStoredTopContexts(&storedSize);
+    verifyStoredSize(storedSize);
+
+    // the files are still in the page cache, so this measures reading and decoding them
+    QBENCHMARK_ONCE {
+        DUChainReadLocker lock;
+        for (uint index : indices) {
+            TopDUContext* top = IndexedTopDUContext(index).data();
+            QVERIFY(top);
+            // accessing the declarations loads the item data
+            QCOMPARE(top->localDeclarations().size(), declarationsPerContext);
+            QCOMPARE(top->childContexts().size(), declarationsPerContext / 10);
+        }
+    }
+
+    removeTopContexts(indices);
+}
+
+void BenchTopContextStorage::load_data()
+{
+    feedData();
+}
+
+void BenchTopContextStorage::loadUrl()
+{
+    qint64 storedSize = 0;
+    const QVector<uint> indices = createStoredTopContexts(&storedSize);
+    verifyStoredSize(storedSize);
+
+    // only the top-context data is read, the declarations stay on disk
+    QBENCHMARK {
+        for (uint index : indices) {
+            QVERIFY(!DUChain::self()->urlForIndex(index).isEmpty());
+        }
+    }
+
+    removeTopContexts(indices);
+}
+
+void BenchTopContextStorage::loadUrl_data()
+{
+    feedData();
+}
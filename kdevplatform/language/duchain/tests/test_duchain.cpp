@@ -33,6 +33,7 @@
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/persistentsymboltable.h>
 #include <language/duchain/codemodel.h>
+#include <language/duchain/symbolnameindex.h>
 #include <language/duchain/types/typesystemdata.h>
 #include <language/duchain/types/integraltype.h>
 #include <language/duchain/types/typeregister.h>
@@ -51,6 +52,7 @@
 #include <algorithm>
 #include <iterator> // needed for std::insert_iterator on windows
 #include <QThread>
+#include <QSemaphore>
 
 //Extremely slow
 // #define TEST_NORMAL_IMPORTS
@@ -384,6 +386,49 @@ void TestDUChain::testStringSets()
 }
 #endif
 
+void TestDUChain::testFlatSets()
+{
+    BasicSetRepository rep(QStringLiteral("test flat repository"));
+
+    auto toVector = [](const std::set<Index>& set) {
+        return std::vector<Index>(set.begin(), set.end());
+    };
+
+    for (int round = 0; round < 200; ++round) {
+        std::set<Index> first, second;
+        //Use dense ranges, so the blocks of the vectorized merges overlap in all possible ways
+        const int range = 1 + rand() % 300;
+        for (int a = rand() % 100; a > 0; --a)
+            first.insert(1 + rand() % range);
+        for (int a = rand() % 100; a > 0; --a)
+            second.insert(1 + rand() % range);
+
+        const Set firstSet = rep.createSet(first), secondSet = rep.createSet(second);
+        const FlatSet firstFlat = firstSet.flatSet(), secondFlat = secondSet.flatSet();
+        QCOMPARE(firstFlat.indices(), toVector(first));
+        QCOMPARE(secondFlat.indices(), toVector(second));
+        QCOMPARE(firstSet.flatSet(), firstFlat);
+
+        QCOMPARE((firstFlat + secondFlat).indices(), toVector((firstSet + secondSet).stdSet()));
+        QCOMPARE((firstFlat & secondFlat).indices(), toVector((firstSet & secondSet).stdSet()));
+        QCOMPARE((firstFlat - secondFlat).indices(), toVector((firstSet - secondSet).stdSet()));
+        QCOMPARE((secondFlat - firstFlat).indices(), toVector((secondSet - firstSet).stdSet()));
+
+        QCOMPARE(rep.createSet(firstFlat & secondFlat).setIndex(), (firstSet & secondSet).setIndex());
+        if (!first.empty())
+            QVERIFY(firstFlat.contains(*first.begin()));
+        QVERIFY(!firstFlat.contains(range + 1));
+    }
+
+    //The cached flat set must be dropped together with its node, since the node index may be re-used
+    Set refCounted = rep.createSet(std::set<Index>{1, 2, 3});
+    refCounted.staticRef();
+    QCOMPARE(refCounted.flatSet().count(), 3u);
+    refCounted.staticUnref();
+    Set reused = rep.createSet(std::set<Index>{4, 5});
+    QCOMPARE(reused.flatSet().indices(), std::vector<Index>({4, 5}));
+}
+
 void TestDUChain::testSymbolTableValid()
 {
     DUChainReadLocker lock(DUChain::lock());
@@ -761,6 +806,85 @@ void TestDUChain::testLockForReadWrite()
     QVERIFY(threads.join(1000));
 }
 
+class WriteLockHolder
+    : public QThread
+{
+public:
+    WriteLockHolder(DUChainLock* lock, int holdTime)
+        : m_lock(lock)
+        , m_holdTime(holdTime)
+    {
+    }
+
+    void run() override
+    {
+        DUChainWriteLocker lock(m_lock);
+        m_locked.release();
+        msleep(m_holdTime);
+    }
+
+    QSemaphore m_locked;
+
+private:
+    DUChainLock* m_lock;
+    int m_holdTime;
+};
+
+void TestDUChain::testLockStatistics()
+{
+    DUChainLock lock;
+    QCOMPARE(lock.statistics().contendedReadLocks, quint64(0));
+
+    // uncontended locking is not recorded
+    {
+        DUChainWriteLocker writeLock(&lock);
+    }
+    {
+        DUChainReadLocker readLock(&lock);
+    }
+    QCOMPARE(lock.statistics().contendedReadLocks, quint64(0));
+    QCOMPARE(lock.statistics().contendedWriteLocks, quint64(0));
+
+    // time out while another thread holds the write-lock
+    WriteLockHolder holder(&lock, 200);
+    holder.start();
+    holder.m_locked.acquire();
+    QVERIFY(!lock.lockForRead(10));
+    QVERIFY(!lock.currentThreadHasReadLock());
+    QCOMPARE(lock.statistics().timedOutLocks, quint64(1));
+
+    // wait until the writer is done
+    QVERIFY(lock.lockForRead());
+    QVERIFY(lock.currentThreadHasReadLock());
+    lock.releaseReadLock();
+    QVERIFY(holder.wait());
+
+    auto statistics = lock.statistics();
+    QCOMPARE(statistics.contendedReadLocks, quint64(1));
+    QVERIFY(statistics.maxReadWaitMicroseconds > 0);
+    QVERIFY(statistics.totalReadWaitMicroseconds >= statistics.maxReadWaitMicroseconds);
+    // the test runs in the foreground thread
+    QCOMPARE(statistics.foregroundWaits, quint64(2));
+
+    // the same for writers
+    WriteLockHolder writeHolder(&lock, 50);
+    writeHolder.start();
+    writeHolder.m_locked.acquire();
+    QVERIFY(lock.lockForWrite());
+    lock.releaseWriteLock();
+    QVERIFY(writeHolder.wait());
+    statistics = lock.statistics();
+    QCOMPARE(statistics.contendedWriteLocks, quint64(1));
+    QVERIFY(statistics.maxWriteWaitMicroseconds > 0);
+
+    lock.resetStatistics();
+    statistics = lock.statistics();
+    QCOMPARE(statistics.contendedReadLocks, quint64(0));
+    QCOMPARE(statistics.contendedWriteLocks, quint64(0));
+    QCOMPARE(statistics.timedOutLocks, quint64(0));
+    QCOMPARE(statistics.foregroundWaits, quint64(0));
+}
+
 void TestDUChain::testProblemSerialization()
 {
     DUChain::self()->disablePersistentStorage(false);
@@ -909,6 +1033,60 @@ void TestDUChain::testIdentifiers()
     ///@todo create a big randomized test for the identifier repository(check that indices are the same)
 }
 
+void TestDUChain::testSymbolNameIndex()
+{
+    const IndexedString file("testSymbolNameIndexFile");
+    const IndexedQualifiedIdentifier exact(QualifiedIdentifier(QStringLiteral("symbolScope::Indexed")));
+    const IndexedQualifiedIdentifier prefix(QualifiedIdentifier(QStringLiteral("symbolScope::indexedName")));
+    const IndexedQualifiedIdentifier substring(QualifiedIdentifier(QStringLiteral("symbolScope::someIndexedName")));
+    const IndexedQualifiedIdentifier scope(QualifiedIdentifier(QStringLiteral("IndexedScope::foo")));
+    const IndexedQualifiedIdentifier other(QualifiedIdentifier(QStringLiteral("symbolScope::Indexe")));
+
+    auto findNames = [](const QString& text) {
+        QVector<IndexedQualifiedIdentifier> ret;
+        foreach (const SymbolNameIndex::Match& match, SymbolNameIndex::self().findNames(text)) {
+            ret << match.id;
+        }
+
+        return ret;
+    };
+
+    QVERIFY(!SymbolNameIndex::canFind(QStringLiteral("in")));
+    QVERIFY(SymbolNameIndex::canFind(QStringLiteral("ind")));
+
+    for (const auto& id : {substring, scope, other, prefix, exact}) {
+        CodeModel::self().addItem(file, id, CodeModelItem::Class);
+    }
+
+    //Names that were not indexed yet are candidates of every search
+    QVERIFY(SymbolNameIndex::self().findCandidates(QStringLiteral("xyzzy")).contains(other));
+
+    QCOMPARE(findNames(QStringLiteral("indexed")),
+             QVector<IndexedQualifiedIdentifier>({exact, prefix, substring, scope}));
+    QCOMPARE(findNames(QStringLiteral("dexedna")), QVector<IndexedQualifiedIdentifier>({prefix, substring}));
+
+    const auto candidates = SymbolNameIndex::self().findCandidates(QStringLiteral("dexedna"));
+    QVERIFY(candidates.contains(prefix));
+    QVERIFY(candidates.contains(substring));
+    QVERIFY(!candidates.contains(other));
+    QVERIFY(SymbolNameIndex::self().findCandidates(QStringLiteral("xyzzy")).isEmpty());
+    QCOMPARE(findNames(QStringLiteral("symbolscope::")), QVector<IndexedQualifiedIdentifier>());
+    QVERIFY(findNames(QStringLiteral("xyzzy")).isEmpty());
+
+    //Names stay indexed as long as any file or declaration references them
+    CodeModel::self().addItem(IndexedString("testSymbolNameIndexFile2"), exact, CodeModelItem::Class);
+    CodeModel::self().removeItem(file, exact);
+    QCOMPARE(findNames(QStringLiteral("indexed")).first(), exact);
+    CodeModel::self().removeItem(IndexedString("testSymbolNameIndexFile2"), exact);
+    QCOMPARE(findNames(QStringLiteral("indexed")), QVector<IndexedQualifiedIdentifier>({prefix, substring, scope}));
+
+    for (const auto& id : {substring, scope, other, prefix}) {
+        CodeModel::self().removeItem(file, id);
+    }
+
+    QVERIFY(findNames(QStringLiteral("indexed")).isEmpty());
+}
+
 #if 0
 
 ///NOTE: the "unit tests" below are not automated, they - so far - require
@@ -969,6 +1147,22 @@ void TestDUChain::benchCodeModel()
     }
 }
 
+void TestDUChain::benchSymbolNameIndex()
+{
+    const IndexedString file("benchSymbolNameIndexFile");
+
+    for (int i = 0; i < 100000; ++i) {
+        const QualifiedIdentifier id(QStringLiteral("benchScope::benchName") + QString::number(i));
+        CodeModel::self().addItem(file, id, KDevelop::CodeModelItem::Class);
+    }
+
+    QVector<SymbolNameIndex::Match> matches;
+    QBENCHMARK {
+        matches = SymbolNameIndex::self().findNames(QStringLiteral("Name4242"));
+    }
+    QCOMPARE(matches.size(), 11);
+}
+
 void TestDUChain::benchTypeRegistry()
 {
     IntegralTypeData data;
@@ -39,18 +39,22 @@ private Q_SLOTS:
     // Causes stack overflow on Windows (MSVC2015)
     void testStringSets();
 #endif
+    void testFlatSets();
     void testSymbolTableValid();
     void testIndexedStrings();
     void testImportStructure();
     void testLockForWrite();
     void testLockForRead();
     void testLockForReadWrite();
+    void testLockStatistics();
     void testProblemSerialization();
     void testIdentifiers();
+    void testSymbolNameIndex();
     ///NOTE: these are not "automated"!
 //     void testImportCache();
 
     void benchCodeModel();
+    void benchSymbolNameIndex();
     void benchTypeRegistry();
     void benchTypeRegistry_data();
     void benchDuchainWriteLocker();
@@ -0,0 +1,147 @@
+/*
+ * This file is part of KDevelop
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Library General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "test_duchaincachearchive.h"
+
+#include <language/duchain/declaration.h>
+#include <language/duchain/duchain.h>
+#include <language/duchain/duchaincachearchive.h>
+#include <language/duchain/duchainlock.h>
+#include <language/duchain/topducontext.h>
+#include <serialization/abstractitemrepository.h>
+#include <serialization/indexedstring.h>
+#include <serialization/itemrepositoryregistry.h>
+
+#include <tests/testcore.h>
+#include <tests/autotestshell.h>
+
+#include <QDir>
+#include <QFile>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QTest>
+
+QTEST_GUILESS_MAIN(TestDUChainCacheArchive)
+
+using namespace KDevelop;
+
+namespace {
+/// @return the relative paths and sizes of all files in @p path
+QMap<QString, qint64> files(const QString& path)
+{
+    QMap<QString, qint64> ret;
+    const QDir dir(path);
+    QDirIterator it(path, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        ret.insert(dir.relativeFilePath(it.filePath()), it.fileInfo().size());
+    }
+    ret.remove(QStringLiteral("crash_counter"));
+    return ret;
+}
+}
+
+void TestDUChainCacheArchive::initTestCase()
+{
+    AutoTestShell::init();
+    TestCore::initialize(Core::NoUi);
+
+    QVERIFY(m_dir.isValid());
+
+    {
+        DUChainWriteLocker lock;
+        for (int i = 0; i < 20; ++i) {
+            auto* top = new TopDUContext(IndexedString(m_dir.path() + QStringLiteral("/archived%1.cpp").arg(i)),
+                                         RangeInRevision(0, 0, 1000, 0));
+            DUChain::self()->addDocumentChain(top);
+            for (int j = 0; j < 1000; ++j) {
+                auto* declaration = new Declaration(RangeInRevision(j, 0, j, 10), top);
+                declaration->setIdentifier(Identifier(QStringLiteral("declaration%1").arg(j)));
+            }
+        }
+    }
+    DUChain::self()->storeToDisk();
+
+    m_archive = m_dir.filePath(QStringLiteral("cache.tar.gz"));
+    QString errorMessage;
+    QVERIFY2(DUChainCacheArchive::write(m_archive, globalItemRepositoryRegistry().path(), {m_dir.path()}, &errorMessage),
+             qPrintable(errorMessage));
+    m_archivedFiles = files(globalItemRepositoryRegistry().path());
+}
+
+void TestDUChainCacheArchive::cleanupTestCase()
+{
+    TestCore::shutdown();
+}
+
+void TestDUChainCacheArchive::testWriteAndExtract()
+{
+    const QString repositoryPath = m_dir.filePath(QStringLiteral("extracted"));
+    QString errorMessage;
+    QVERIFY2(DUChainCacheArchive::extract(m_archive, repositoryPath, &errorMessage), qPrintable(errorMessage));
+
+    const auto extracted = files(repositoryPath);
+    QVERIFY(extracted.contains(QStringLiteral("version_%1").arg(staticItemRepositoryVersion())));
+    QVERIFY(!extracted.contains(QStringLiteral("is_writing")));
+    QCOMPARE(extracted, m_archivedFiles);
+    QVERIFY(!QFileInfo::exists(repositoryPath + QLatin1String(".import")));
+
+    // an existing cache is never overwritten
+    QVERIFY(!DUChainCacheArchive::extract(m_archive, repositoryPath, &errorMessage));
+    QVERIFY(!errorMessage.isEmpty());
+
+    QVERIFY(QDir(repositoryPath).removeRecursively());
+}
+
+void TestDUChainCacheArchive::testExtractChecks()
+{
+    QString errorMessage;
+
+    // the source directories must exist at the same paths
+    const QString movedArchive = m_dir.filePath(QStringLiteral("moved.tar.gz"));
+    QVERIFY2(DUChainCacheArchive::write(movedArchive, globalItemRepositoryRegistry().path(),
+                                        {m_dir.filePath(QStringLiteral("does-not-exist"))}, &errorMessage),
+             qPrintable(errorMessage));
+    const QString repositoryPath = m_dir.filePath(QStringLiteral("rejected"));
+    QVERIFY(!DUChainCacheArchive::extract(movedArchive, repositoryPath, &errorMessage));
+    QVERIFY(!QFileInfo::exists(repositoryPath));
+
+    // not an archive at all
+    const QString text = m_dir.filePath(QStringLiteral("text.txt"));
+    QFile textFile(text);
+    QVERIFY(textFile.open(QIODevice::WriteOnly));
+    textFile.write("no archive");
+    textFile.close();
+    QVERIFY(!DUChainCacheArchive::extract(text, repositoryPath, &errorMessage));
+    QVERIFY(!QFileInfo::exists(repositoryPath));
+
+    // a directory without a stored cache
+    QVERIFY(!DUChainCacheArchive::write(movedArchive, m_dir.path(), {m_dir.path()}, &errorMessage));
+}
+
+void TestDUChainCacheArchive::benchExtract()
+{
+    // the time a new session needs to get its cache, instead of parsing all files
+    int run = 0;
+    QBENCHMARK {
+        const QString repositoryPath = m_dir.filePath(QStringLiteral("bench%1").arg(run++));
+        QString errorMessage;
+        QVERIFY2(DUChainCacheArchive::extract(m_archive, repositoryPath, &errorMessage), qPrintable(errorMessage));
+    }
+}
@@ -21,8 +21,10 @@
 #include "topducontextdynamicdata.h"
 
 #include <typeinfo>
+#include <QBuffer>
 #include <QFile>
 #include <QByteArray>
+#include <QScopedPointer>
 
 #include "declaration.h"
 #include "declarationdata.h"
@@ -34,6 +36,7 @@
 #include "duchainregister.h"
 #include "serialization/itemrepository.h"
 #include "problem.h"
+#include "topducontextpack.h"
 #include <debug.h>
 
 //#define DEBUG_DATA_INFO
@@ -168,23 +171,171 @@ QString pathForTopContext(const uint topContextIndex)
     return basePath() + QString::number(topContextIndex);
 }
 
+Q_GLOBAL_STATIC(TopDUContextPack, globalTopContextPack)
+
+TopDUContextPack& topContextPack()
+{
+    TopDUContextPack* pack = globalTopContextPack();
+    pack->open(basePath(), globalItemRepositoryRegistry().dataDirectoryGeneration());
+    return *pack;
+}
+
+QAtomicInt& packedStorageFlag()
+{
+    static QAtomicInt flag(qEnvironmentVariableIsSet("KDEV_DUCHAIN_PACK_TOPCONTEXTS"));
+    return flag;
+}
+
+///Reads a top-context from the pack like from a file. The data stays acquired as long as the buffer exists.
+class PackedTopContextBuffer
+    : public QBuffer
+{
+public:
+    explicit PackedTopContextBuffer(const TopDUContextPack::Record& record)
+        : m_record(record)
+    {
+        setData(QByteArray::fromRawData(record.data, record.size));
+    }
+
+    ~PackedTopContextBuffer() override
+    {
+        close();
+        if (!globalTopContextPack.isDestroyed())
+            globalTopContextPack()->release(m_record);
+    }
+
+    const char* mappedData() const
+    {
+        return m_record.data;
+    }
+
+private:
+    TopDUContextPack::Record m_record;
+};
+
+///Opens the stored data of a top-context for reading, wherever it is stored. Returns nullptr if it is not stored.
+QIODevice* openTopContext(uint topContextIndex)
+{
+    const TopDUContextPack::Record record = topContextPack().acquire(topContextIndex);
+    if (record.data) {
+        auto* buffer = new PackedTopContextBuffer(record);
+        buffer->open(QIODevice::ReadOnly);
+        return buffer;
+    }
+
+    auto* file = new QFile(pathForTopContext(topContextIndex));
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        return nullptr;
+    }
+    return file;
+}
+
+QAtomicInt& compressedStorageFlag()
+{
+    static QAtomicInt flag(qEnvironmentVariableIsSet("KDEV_DUCHAIN_COMPRESS"));
+    return flag;
+}
+
+///A compressed top-context file starts with this value instead of the size of the top-context data.
+///The highest bit is set, so it can never be confused with a valid size.
+const uint compressedMagic = 0x8a4b4443;
+const uint compressedVersion = 1;
+//Favor speed over size, top-contexts are stored while the duchain is write-locked
+const int compressionLevel = 1;
+
+///The parts of a compressed top-context file. Each one is compressed on its own, so it can be read
+///without decompressing the rest of the file.
+enum CompressedBlock {
+    TopContextBlock,
+    ContextOffsetsBlock,
+    DeclarationOffsetsBlock,
+    ProblemOffsetsBlock,
+    ItemDataBlock,
+    CompressedBlockCount
+};
+
+struct CompressedBlockInfo
+{
+    uint fileOffset;
+    uint size; ///< Size after decompression
+    uint compressedSize;
+};
+
+struct CompressedHeader
+{
+    uint magic;
+    uint version;
+    CompressedBlockInfo blocks[CompressedBlockCount];
+};
+
+bool isCompressed(QIODevice* file)
+{
+    uint magic = 0;
+    return file->peek(( char* )&magic, sizeof(uint)) == sizeof(uint) && magic == compressedMagic;
+}
+
+bool readCompressedHeader(QIODevice* file, CompressedHeader* header)
+{
+    if (!file->seek(0) || file->read(( char* )header, sizeof(CompressedHeader)) != sizeof(CompressedHeader))
+        return false;
+
+    if (header->version != compressedVersion) {
+        qCWarning(LANGUAGE) << "Unsupported version of compressed top-context file:" << header->version;
+        return false;
+    }
+    return true;
+}
+
+QByteArray readCompressedBlock(QIODevice* file, const CompressedHeader& header, CompressedBlock block)
+{
+    const CompressedBlockInfo& info = header.blocks[block];
+    if (!file->seek(info.fileOffset))
+        return QByteArray();
+
+    const QByteArray data = qUncompress(file->read(info.compressedSize));
+    if (( uint )data.size() != info.size) {
+        qCWarning(LANGUAGE) << "Corrupted block" << block << "in compressed top-context file";
+        return QByteArray();
+    }
+    return data;
+}
+
 enum LoadType {
     PartialLoad, ///< Only load the direct member data
     FullLoad   ///< Load everything, including appended lists
 };
-template <typename F>
-void loadTopDUContextData(const uint topContextIndex, LoadType loadType, F callback)
+
+QByteArray readTopContextData(QIODevice* file, LoadType loadType)
 {
-    QFile file(pathForTopContext(topContextIndex));
-    if (!file.open(QIODevice::ReadOnly)) {
-        return;
+    if (isCompressed(file)) {
+        //The top-context data has a block of its own, so only that one is decompressed
+        CompressedHeader header;
+        if (!readCompressedHeader(file, &header))
+            return QByteArray();
+        return readCompressedBlock(file, header, TopContextBlock);
     }
 
     uint readValue;
-    file.read(( char* )&readValue, sizeof(uint));
+    file->read(( char* )&readValue, sizeof(uint));
     // now readValue is filled with the top-context data size
     Q_ASSERT(readValue >= sizeof(TopDUContextData));
-    const QByteArray data = file.read(loadType == FullLoad ? readValue : sizeof(TopDUContextData));
+    return file->read(loadType == FullLoad ? readValue : sizeof(TopDUContextData));
+}
+
+template <typename F>
+void loadTopDUContextData(const uint topContextIndex, LoadType loadType, F callback)
+{
+    QScopedPointer<QIODevice> file(openTopContext(topContextIndex));
+    if (!file) {
+        return;
+    }
+
+    const QByteArray data = readTopContextData(file.data(), loadType);
+    if (( uint )data.size() < sizeof(TopDUContextData)) {
+        qCWarning(LANGUAGE) << "Cannot read the data of top-context" << topContextIndex;
+        return;
+    }
     const auto* topData = reinterpret_cast<const TopDUContextData*>(data.constData());
     callback(topData);
 }
@@ -436,12 +587,12 @@ void TopDUContextDynamicData::DUChainItemStorage<Item>::deleteOnDisk()
 }
 
 template <class Item>
-void TopDUContextDynamicData::DUChainItemStorage<Item>::loadData(QFile* file) const
+void TopDUContextDynamicData::DUChainItemStorage<Item>::loadData(QIODevice* file) const
 {
     Q_ASSERT(offsets.isEmpty());
     Q_ASSERT(items.isEmpty());
 
-    uint readValue;
+    uint readValue = 0;
     file->read(( char* )&readValue, sizeof(uint));
     offsets.resize(readValue);
 
@@ -452,7 +603,7 @@ void TopDUContextDynamicData::DUChainItemStorage<Item>::loadData(QFile* file) co
 }
 
 template <class Item>
-void TopDUContextDynamicData::DUChainItemStorage<Item>::writeData(QFile* file)
+void TopDUContextDynamicData::DUChainItemStorage<Item>::writeData(QIODevice* file)
 {
     uint writeValue = offsets.size();
     file->write(( char* )&writeValue, sizeof(uint));
@@ -506,9 +657,44 @@ void KDevelop::TopDUContextDynamicData::unmap()
     m_mappedDataSize = 0;
 }
 
+bool TopDUContextDynamicData::compressedStorage()
+{
+    return compressedStorageFlag().load();
+}
+
+void TopDUContextDynamicData::setCompressedStorage(bool compress)
+{
+    compressedStorageFlag().store(compress);
+}
+
+bool TopDUContextDynamicData::packedStorage()
+{
+    return packedStorageFlag().load();
+}
+
+void TopDUContextDynamicData::setPackedStorage(bool pack)
+{
+    packedStorageFlag().store(pack);
+}
+
+void TopDUContextDynamicData::flushStorage()
+{
+    topContextPack().flush();
+}
+
+void TopDUContextDynamicData::compactStorage()
+{
+    topContextPack().compact();
+}
+
+void TopDUContextDynamicData::closeStorage()
+{
+    globalTopContextPack()->close();
+}
+
 bool TopDUContextDynamicData::fileExists(uint topContextIndex)
 {
-    return QFile::exists(pathForTopContext(topContextIndex));
+    return topContextPack().contains(topContextIndex) || QFile::exists(pathForTopContext(topContextIndex));
 }
 
 QList<IndexedDUContext> TopDUContextDynamicData::loadImporters(uint topContextIndex)
@@ -554,12 +740,18 @@ void TopDUContextDynamicData::loadData() const
     Q_ASSERT(!m_dataLoaded);
     Q_ASSERT(m_data.isEmpty());
 
-    QFile* file = new QFile(pathForTopContext(m_topContext->ownIndex()));
-    bool open = file->open(QIODevice::ReadOnly);
-    Q_UNUSED(open);
-    Q_ASSERT(open);
+    QIODevice* file = openTopContext(m_topContext->ownIndex());
+    Q_ASSERT(file);
     Q_ASSERT(file->size());
 
+    if (isCompressed(file)) {
+        //The item data has to be decompressed into memory, so it cannot be mapped
+        loadCompressedData(file);
+        delete file;
+        m_dataLoaded = true;
+        return;
+    }
+
     //Skip the offsets, we're already read them
     //Skip top-context data
     uint readValue;
@@ -572,13 +764,21 @@ void TopDUContextDynamicData::loadData() const
 
 #ifdef USE_MMAP
 
-    m_mappedData = file->map(file->pos(), file->size() - file->pos());
-    if (m_mappedData) {
-        m_mappedFile = file;
-        m_mappedDataSize = file->size() - file->pos();
-        file->close(); //Close the file, so there is less open file descriptors(May be problematic)
+    if (auto* buffer = dynamic_cast<PackedTopContextBuffer*>(file)) {
+        //The pack is mapped already, so the data can be used in place
+        m_mappedData = reinterpret_cast<uchar*>(const_cast<char*>(buffer->mappedData())) + buffer->pos();
+        m_mappedDataSize = buffer->size() - buffer->pos();
+        m_mappedFile = buffer;
     } else {
-        qCDebug(LANGUAGE) << "Failed to map" << file->fileName();
+        auto* mappedFile = static_cast<QFile*>(file);
+        m_mappedData = mappedFile->map(mappedFile->pos(), mappedFile->size() - mappedFile->pos());
+        if (m_mappedData) {
+            m_mappedFile = mappedFile;
+            m_mappedDataSize = mappedFile->size() - mappedFile->pos();
+            mappedFile->close(); //Close the file, so there is less open file descriptors(May be problematic)
+        } else {
+            qCDebug(LANGUAGE) << "Failed to map" << mappedFile->fileName();
+        }
     }
 
 #endif
@@ -592,24 +792,52 @@ void TopDUContextDynamicData::loadData() const
     m_dataLoaded = true;
 }
 
+void TopDUContextDynamicData::loadCompressedData(QIODevice* file) const
+{
+    CompressedHeader header;
+    bool valid = readCompressedHeader(file, &header);
+    Q_UNUSED(valid);
+    Q_ASSERT(valid);
+
+    QBuffer buffer;
+    buffer.setData(readCompressedBlock(file, header, ContextOffsetsBlock));
+    buffer.open(QIODevice::ReadOnly);
+    m_contexts.loadData(&buffer);
+    buffer.close();
+
+    buffer.setData(readCompressedBlock(file, header, DeclarationOffsetsBlock));
+    buffer.open(QIODevice::ReadOnly);
+    m_declarations.loadData(&buffer);
+    buffer.close();
+
+    buffer.setData(readCompressedBlock(file, header, ProblemOffsetsBlock));
+    buffer.open(QIODevice::ReadOnly);
+    m_problems.loadData(&buffer);
+    buffer.close();
+
+    const QByteArray data = readCompressedBlock(file, header, ItemDataBlock);
+    m_data.append({data, ( uint )data.size()});
+}
+
 TopDUContext* TopDUContextDynamicData::load(uint topContextIndex)
 {
-    QFile file(pathForTopContext(topContextIndex));
-    if (file.open(QIODevice::ReadOnly)) {
-        if (file.size() == 0) {
-            qCWarning(LANGUAGE) << "Top-context file is empty" << file.fileName();
+    QScopedPointer<QIODevice> file(openTopContext(topContextIndex));
+    if (file) {
+        if (file->size() == 0) {
+            qCWarning(LANGUAGE) << "Top-context data is empty" << topContextIndex;
             return nullptr;
         }
 
-        uint readValue;
-        file.read(( char* )&readValue, sizeof(uint));
-        //now readValue is filled with the top-context data size
-        QByteArray topContextData = file.read(readValue);
+        QByteArray topContextData = readTopContextData(file.data(), FullLoad);
+        if (( uint )topContextData.size() < sizeof(TopDUContextData)) {
+            qCWarning(LANGUAGE) << "Cannot read the data of top-context" << topContextIndex;
+            return nullptr;
+        }
 
         auto* topData = reinterpret_cast<DUChainBaseData*>(topContextData.data());
         auto* ret = dynamic_cast<TopDUContext*>(DUChainItemSystem::self().create(topData));
         if (!ret) {
-            qCWarning(LANGUAGE) << "Cannot load a top-context from file" << file.fileName() <<
+            qCWarning(LANGUAGE) << "Cannot load top-context" << topContextIndex <<
                 "- the required language-support for handling ID" << topData->classId << "is probably not loaded";
             return nullptr;
         }
@@ -649,9 +877,11 @@ void TopDUContextDynamicData::deleteOnDisk()
 
     m_onDisk = false;
 
-    bool successfullyRemoved = QFile::remove(filePath());
-    Q_UNUSED(successfullyRemoved);
-    Q_ASSERT(successfullyRemoved);
+    const bool removedFromPack = topContextPack().remove(m_topContext->ownIndex());
+    const bool removedFile = QFile::remove(filePath());
+    Q_UNUSED(removedFromPack);
+    Q_UNUSED(removedFile);
+    Q_ASSERT(removedFromPack || removedFile);
     qCDebug(LANGUAGE) << "deletion ready";
 }
 
@@ -736,20 +966,25 @@ void TopDUContextDynamicData::store()
 
     QDir().mkpath(basePath());
 
+    if (packedStorage()) {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        write(&buffer, topContextDataSize);
+        if (topContextPack().write(m_topContext->ownIndex(), buffer.data())) {
+            //Drop the copy from before the migration to the pack, if there is one
+            QFile::remove(filePath());
+            m_onDisk = true;
+            return;
+        }
+        qCDebug(LANGUAGE) << "Cannot put top-context into the pack, storing it into its own file";
+    }
+
     QFile file(filePath());
     if (file.open(QIODevice::WriteOnly)) {
         file.resize(0);
 
-        file.write(( char* )&topContextDataSize, sizeof(uint));
-        foreach (const ArrayWithPosition& pos, m_topContextData)
-            file.write(pos.array.constData(), pos.position);
-
-        m_contexts.writeData(&file);
-        m_declarations.writeData(&file);
-        m_problems.writeData(&file);
-
-        foreach (const ArrayWithPosition& pos, m_data)
-            file.write(pos.array.constData(), pos.position);
+        write(&file, topContextDataSize);
+        topContextPack().remove(m_topContext->ownIndex());
 
         m_onDisk = true;
 
@@ -763,6 +998,73 @@ void TopDUContextDynamicData::store()
 //   qCDebug(LANGUAGE) << "stored" << m_topContext->url().str() << m_topContext->ownIndex() << "import-count:" << m_topContext->importedParentContexts().size();
 }
 
+void TopDUContextDynamicData::write(QIODevice* file, uint topContextDataSize)
+{
+    if (compressedStorage()) {
+        writeCompressed(file);
+        return;
+    }
+
+    file->write(( char* )&topContextDataSize, sizeof(uint));
+    foreach (const ArrayWithPosition& pos, m_topContextData)
+        file->write(pos.array.constData(), pos.position);
+
+    m_contexts.writeData(file);
+    m_declarations.writeData(file);
+    m_problems.writeData(file);
+
+    foreach (const ArrayWithPosition& pos, m_data)
+        file->write(pos.array.constData(), pos.position);
+}
+
+void TopDUContextDynamicData::writeCompressed(QIODevice* file)
+{
+    QByteArray blocks[CompressedBlockCount];
+
+    foreach (const ArrayWithPosition& pos, m_topContextData)
+        blocks[TopContextBlock].append(pos.array.constData(), pos.position);
+
+    QBuffer buffer;
+    buffer.setBuffer(&blocks[ContextOffsetsBlock]);
+    buffer.open(QIODevice::WriteOnly);
+    m_contexts.writeData(&buffer);
+    buffer.close();
+
+    buffer.setBuffer(&blocks[DeclarationOffsetsBlock]);
+    buffer.open(QIODevice::WriteOnly);
+    m_declarations.writeData(&buffer);
+    buffer.close();
+
+    buffer.setBuffer(&blocks[ProblemOffsetsBlock]);
+    buffer.open(QIODevice::WriteOnly);
+    m_problems.writeData(&buffer);
+    buffer.close();
+
+    //Loading needs the item data in one piece anyway, so it is compressed as a whole
+    uint itemDataSize = 0;
+    foreach (const ArrayWithPosition& pos, m_data)
+        itemDataSize += pos.position;
+    blocks[ItemDataBlock].reserve(itemDataSize);
+    foreach (const ArrayWithPosition& pos, m_data)
+        blocks[ItemDataBlock].append(pos.array.constData(), pos.position);
+
+    CompressedHeader header;
+    header.magic = compressedMagic;
+    header.version = compressedVersion;
+
+    uint fileOffset = sizeof(CompressedHeader);
+    for (int block = 0; block < CompressedBlockCount; ++block) {
+        const uint size = blocks[block].size();
+        blocks[block] = qCompress(blocks[block], compressionLevel);
+        header.blocks[block] = {fileOffset, size, ( uint )blocks[block].size()};
+        fileOffset += blocks[block].size();
+    }
+
+    file->write(( char* )&header, sizeof(CompressedHeader));
+    for (const QByteArray& block : blocks)
+        file->write(block);
+}
+
 TopDUContextDynamicData::ItemDataInfo TopDUContextDynamicData::writeDataInfo(const ItemDataInfo& info,
                                                                              const DUChainBaseData* data,
                                                                              uint& totalDataOffset)
@@ -23,7 +23,7 @@
 #include <QByteArray>
 #include "problem.h"
 
-class QFile;
+class QIODevice;
 
 namespace KDevelop {
 class TopDUContext;
@@ -101,6 +101,21 @@ public:
 
     static QList<IndexedDUContext> loadImports(uint topContextIndex);
 
+    ///Whether store() writes the compressed format. load() always detects the format of the file.
+    static bool compressedStorage();
+    static void setCompressedStorage(bool compress);
+
+    ///Whether store() puts the top-contexts into the shared pack instead of one file each.
+    ///load() always finds top-contexts in both places, the next store() moves them over.
+    static bool packedStorage();
+    static void setPackedStorage(bool pack);
+    ///Makes the stored top-contexts persistent
+    static void flushStorage();
+    ///Reclaims the space of outdated top-contexts in the pack, may be called from any thread
+    static void compactStorage();
+    ///Flushes and closes the pack, no top-context may be loaded any more afterwards
+    static void closeStorage();
+
     bool isTemporaryContextIndex(uint index) const;
     bool isTemporaryDeclarationIndex(uint index) const;
 
@@ -127,6 +142,10 @@ private:
     QString filePath() const;
 
     void loadData() const;
+    void loadCompressedData(QIODevice* file) const;
+
+    void write(QIODevice* file, uint topContextDataSize);
+    void writeCompressed(QIODevice* file);
 
     const char* pointerInData(uint offset) const;
 
@@ -153,8 +172,8 @@ private:
         void deleteOnDisk();
         bool isItemForIndexLoaded(uint index) const;
 
-        void loadData(QFile* file) const;
-        void writeData(QFile* file);
+        void loadData(QIODevice* file) const;
+        void writeData(QIODevice* file);
 
         //May contain zero items if they were deleted
         mutable QVector<Item> items;
@@ -174,7 +193,7 @@ private:
     bool m_onDisk;
     mutable bool m_dataLoaded;
 
-    mutable QFile* m_mappedFile;
+    mutable QIODevice* m_mappedFile;
     mutable uchar* m_mappedData;
     mutable size_t m_mappedDataSize;
     mutable bool m_itemRetrievalForbidden;
@@ -0,0 +1,280 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#include "topducontextindex.h"
+
+#include <serialization/indexedstring.h>
+
+using namespace KDevelop;
+
+namespace {
+//Not a valid IndexedString index, the largest one is used by single-character strings (0xffff00ff)
+const uint EmptyKey = 0xffffffff;
+}
+
+TopDUContextIndex::Table::Table(uint capacity)
+    : mask(capacity - 1)
+    , slots(new Slot[capacity])
+{
+    Q_ASSERT((capacity & mask) == 0);
+    for (uint i = 0; i < capacity; ++i) {
+        slots[i].key.store(EmptyKey);
+    }
+}
+
+TopDUContextIndex::Table::~Table()
+{
+    delete[] slots;
+}
+
+TopDUContextIndex::TopDUContextIndex()
+{
+    for (Shard& shard : m_shards) {
+        shard.table.store(new Table(MinimumCapacity));
+    }
+}
+
+TopDUContextIndex::~TopDUContextIndex()
+{
+    for (Shard& shard : m_shards) {
+        Q_ASSERT(!shard.readers.load());
+        delete shard.table.load();
+        qDeleteAll(shard.retired);
+    }
+}
+
+uint TopDUContextIndex::hash(uint key)
+{
+    //IndexedString indices are mostly sequential, so spread them over all shards and slots
+    key ^= key >> 16;
+    key *= 0x45d9f3bu;
+    key ^= key >> 16;
+    key *= 0x45d9f3bu;
+    key ^= key >> 16;
+    return key;
+}
+
+TopDUContextIndex::Shard& TopDUContextIndex::shardFor(uint hash) const
+{
+    return m_shards[hash & (ShardCount - 1)];
+}
+
+void TopDUContextIndex::insert(const IndexedString& url, TopDUContext* top)
+{
+    Q_ASSERT(top);
+
+    const uint key = url.index();
+    Q_ASSERT(key != EmptyKey);
+    const uint h = hash(key);
+    Shard& shard = shardFor(h);
+
+    QMutexLocker lock(&shard.mutex);
+
+    //Keep at least half of the slots empty, so probing stays short and always terminates
+    Table* table = shard.table.load();
+    if ((shard.used + 1) * 2 > table->mask + 1) {
+        rehash(shard);
+        table = shard.table.load();
+    }
+
+    //Removed slots are not reused, so the new entry ends up behind all other entries for the same url
+    for (uint i = h >> ShardBits;; ++i) {
+        Slot& slot = table->slots[i & table->mask];
+        if (slot.key.load() == EmptyKey) {
+            slot.value.store(top);
+            //Publish the key last, so a lookup that sees the key also sees the value
+            slot.key.storeRelease(key);
+            break;
+        }
+    }
+
+    ++shard.used;
+    shard.size.ref();
+
+    freeRetired(shard);
+}
+
+bool TopDUContextIndex::remove(const IndexedString& url, TopDUContext* top)
+{
+    const uint key = url.index();
+    const uint h = hash(key);
+    Shard& shard = shardFor(h);
+
+    QMutexLocker lock(&shard.mutex);
+
+    Table* table = shard.table.load();
+    for (uint i = h >> ShardBits;; ++i) {
+        Slot& slot = table->slots[i & table->mask];
+        const uint slotKey = slot.key.load();
+        if (slotKey == EmptyKey) {
+            return false;
+        }
+        if (slotKey == key && slot.value.load() == top) {
+            //Leave the key as tombstone, the slot is only reclaimed by the next rehash
+            slot.value.storeRelease(nullptr);
+            shard.size.deref();
+            freeRetired(shard);
+            return true;
+        }
+    }
+}
+
+bool TopDUContextIndex::contains(const IndexedString& url, TopDUContext* top) const
+{
+    const uint key = url.index();
+    const uint h = hash(key);
+    Shard& shard = shardFor(h);
+
+    bool found = false;
+
+    shard.readers.ref();
+    const Table* table = shard.table.loadAcquire();
+    for (uint i = h >> ShardBits;; ++i) {
+        const Slot& slot = table->slots[i & table->mask];
+        const uint slotKey = slot.key.loadAcquire();
+        if (slotKey == EmptyKey) {
+            break;
+        }
+        if (slotKey == key && slot.value.loadAcquire() == top) {
+            found = true;
+            break;
+        }
+    }
+    shard.readers.deref();
+
+    return found;
+}
+
+QList<TopDUContext*> TopDUContextIndex::values(const IndexedString& url) const
+{
+    const uint key = url.index();
+    const uint h = hash(key);
+    Shard& shard = shardFor(h);
+
+    QList<TopDUContext*> ret;
+
+    shard.readers.ref();
+    const Table* table = shard.table.loadAcquire();
+    for (uint i = h >> ShardBits;; ++i) {
+        const Slot& slot = table->slots[i & table->mask];
+        const uint slotKey = slot.key.loadAcquire();
+        if (slotKey == EmptyKey) {
+            break;
+        }
+        if (slotKey == key) {
+            if (TopDUContext* top = slot.value.loadAcquire()) {
+                ret.prepend(top);
+            }
+        }
+    }
+    shard.readers.deref();
+
+    return ret;
+}
+
+QList<TopDUContext*> TopDUContextIndex::values() const
+{
+    QList<TopDUContext*> ret;
+    ret.reserve(size());
+
+    for (Shard& shard : m_shards) {
+        shard.readers.ref();
+        const Table* table = shard.table.loadAcquire();
+        for (uint i = 0; i <= table->mask; ++i) {
+            const Slot& slot = table->slots[i];
+            if (slot.key.loadAcquire() == EmptyKey) {
+                continue;
+            }
+            if (TopDUContext* top = slot.value.loadAcquire()) {
+                ret.append(top);
+            }
+        }
+        shard.readers.deref();
+    }
+
+    return ret;
+}
+
+int TopDUContextIndex::size() const
+{
+    int ret = 0;
+    for (const Shard& shard : m_shards) {
+        ret += shard.size.load();
+    }
+
+    return ret;
+}
+
+bool TopDUContextIndex::isEmpty() const
+{
+    return size() == 0;
+}
+
+void TopDUContextIndex::rehash(Shard& shard)
+{
+    Table* oldTable = shard.table.load();
+    const uint oldCapacity = oldTable->mask + 1;
+
+    //Grow so that the table is at most a quarter full afterwards, tombstones are dropped
+    uint capacity = MinimumCapacity;
+    while (capacity < ( uint )(shard.size.load() + 1) * 4) {
+        capacity *= 2;
+    }
+
+    auto* newTable = new Table(capacity);
+    uint used = 0;
+
+    //Start behind an empty slot: A probe sequence never crosses one, so all entries of a url are
+    //visited in the order they were inserted, and are inserted into the new table in that order.
+    uint start = 0;
+    while (oldTable->slots[start].key.load() != EmptyKey) {
+        ++start;
+    }
+
+    for (uint n = 1; n <= oldCapacity; ++n) {
+        const Slot& oldSlot = oldTable->slots[(start + n) & oldTable->mask];
+        const uint key = oldSlot.key.load();
+        TopDUContext* top = oldSlot.value.load();
+        if (key == EmptyKey || !top) {
+            continue;
+        }
+
+        for (uint i = hash(key) >> ShardBits;; ++i) {
+            Slot& slot = newTable->slots[i & newTable->mask];
+            if (slot.key.load() == EmptyKey) {
+                slot.value.store(top);
+                slot.key.store(key);
+                break;
+            }
+        }
+        ++used;
+    }
+
+    //Lookups that already loaded the old table continue on it, so it is only freed once they are done
+    shard.retired.append(shard.table.fetchAndStoreOrdered(newTable));
+    shard.used = used;
+}
+
+void TopDUContextIndex::freeRetired(Shard& shard)
+{
+    //A lookup that starts after this check already sees the new table
+    if (!shard.retired.isEmpty() && shard.readers.fetchAndAddOrdered(0) == 0) {
+        qDeleteAll(shard.retired);
+        shard.retired.clear();
+    }
+}
@@ -0,0 +1,110 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KDEVPLATFORM_TOPDUCONTEXTINDEX_H
+#define KDEVPLATFORM_TOPDUCONTEXTINDEX_H
+
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QList>
+#include <QMutex>
+#include <QVector>
+
+namespace KDevelop {
+class IndexedString;
+class TopDUContext;
+
+/**
+ * Maps document urls to the top-contexts that are currently loaded for them.
+ *
+ * The index is split into shards by the hash of the url's IndexedString index. Modifications lock only the
+ * affected shard, lookups lock nothing. Every shard is an open-addressing table whose slots are filled and
+ * cleared atomically. Removed entries stay in the table as tombstones until the next rehash, so the entries
+ * for one url are always found in the order they were inserted.
+ *
+ * A rehash publishes a new table; the replaced one is freed as soon as no lookup is running on the shard.
+ *
+ * The returned top-contexts may only be used while the DUChain is locked, as they may be unloaded otherwise.
+ */
+class TopDUContextIndex
+{
+public:
+    TopDUContextIndex();
+    ~TopDUContextIndex();
+
+    void insert(const IndexedString& url, TopDUContext* top);
+    ///@return whether the top-context was registered for the url
+    bool remove(const IndexedString& url, TopDUContext* top);
+
+    bool contains(const IndexedString& url, TopDUContext* top) const;
+
+    ///Returns the top-contexts registered for @p url, the most recently inserted one first.
+    QList<TopDUContext*> values(const IndexedString& url) const;
+    ///Returns all registered top-contexts, in no particular order.
+    QList<TopDUContext*> values() const;
+
+    int size() const;
+    bool isEmpty() const;
+
+private:
+    struct Slot
+    {
+        QAtomicInteger<uint> key;
+        QAtomicPointer<TopDUContext> value;
+    };
+
+    struct Table
+    {
+        explicit Table(uint capacity);
+        ~Table();
+
+        const uint mask;
+        Slot* const slots;
+    };
+
+    struct Shard
+    {
+        //Protects all modifications of the shard
+        QMutex mutex;
+        QAtomicPointer<Table> table;
+        //Count of lookups currently walking one of the tables of this shard
+        QAtomicInt readers;
+        //Count of live entries
+        QAtomicInt size;
+        //Count of occupied slots, including tombstones. Protected by mutex.
+        uint used = 0;
+        //Tables replaced by a rehash that may still be walked by a lookup. Protected by mutex.
+        QVector<Table*> retired;
+    };
+
+    enum {
+        ShardCount = 64,
+        ShardBits = 6,
+        MinimumCapacity = 16
+    };
+
+    static uint hash(uint key);
+    Shard& shardFor(uint hash) const;
+    void rehash(Shard& shard);
+    void freeRetired(Shard& shard);
+
+    mutable Shard m_shards[ShardCount];
+};
+}
+
+#endif
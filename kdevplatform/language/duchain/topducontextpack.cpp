@@ -0,0 +1,511 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#include "topducontextpack.h"
+
+#include <serialization/itemrepositoryfilemap.h>
+#include <debug.h>
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QVector>
+
+#include <algorithm>
+
+using namespace KDevelop;
+
+namespace {
+const quint32 recordMagic = 0x4b445450;
+const quint32 indexMagic = 0x4b445049;
+const quint32 indexVersion = 1;
+
+///Address space reserved for each segment. A new segment is started when the current one is full.
+const size_t segmentCapacity = 256 * 1024 * 1024;
+///The segment files are grown in steps of this size, so they are not truncated for every record
+const size_t segmentGrowth = 1024 * 1024;
+///Segments are compacted when less than this percentage of their data is still used
+const size_t compactBelowPercentage = 50;
+
+struct RecordHeader
+{
+    quint32 magic;
+    quint32 topContextIndex;
+    quint32 size;
+    //Used to detect records that were only partially written before a crash
+    quint16 checksum;
+    quint16 removal;
+};
+
+size_t recordSize(uint dataSize)
+{
+    //Keep the records 8-byte aligned, the data is used in place
+    return (sizeof(RecordHeader) + dataSize + 7) & ~size_t(7);
+}
+
+QString indexFileName()
+{
+    return QStringLiteral("pack.index");
+}
+}
+
+struct TopDUContextPack::Segment
+{
+    int number = 0;
+    ItemRepositoryFileMap map;
+    //Bytes of records appended so far
+    size_t used = 0;
+    //Bytes of records that are still referenced by the index
+    size_t liveBytes = 0;
+    //Count of acquired records in this segment that were not released yet
+    int leases = 0;
+    //Set by compact(), the segment is deleted as soon as the last lease is released
+    bool retired = false;
+};
+
+TopDUContextPack::TopDUContextPack()
+{
+}
+
+TopDUContextPack::~TopDUContextPack()
+{
+    close();
+}
+
+QString TopDUContextPack::segmentFileName(int number) const
+{
+    return QDir(m_directory).filePath(QStringLiteral("pack.%1").arg(number));
+}
+
+void TopDUContextPack::open(const QString& directory, int generation)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_open && m_directory == directory && m_generation == generation)
+        return;
+
+    if (m_open) {
+        //Nothing may be stored if the files of the pack were deleted underneath it
+        closeLocked(m_directory != directory);
+    }
+
+    m_open = true;
+    m_directory = directory;
+    m_generation = generation;
+    QDir().mkpath(directory);
+
+    const QStringList files = QDir(directory).entryList({QStringLiteral("pack.*")}, QDir::Files);
+    for (const QString& file : files) {
+        bool isSegment = false;
+        const int number = file.midRef(5).toInt(&isSegment);
+        if (isSegment)
+            openSegment(number, false);
+    }
+
+    if (!loadIndex() && !m_segments.isEmpty()) {
+        //Records that were removed before a segment was compacted would come back when replaying everything
+        qCWarning(LANGUAGE) << "discarding the top-context pack in" << directory << "since it has no valid index";
+        const QList<int> numbers = m_segments.keys();
+        for (int number : numbers) {
+            deleteSegment(number);
+        }
+    }
+
+    //Replay everything that was appended since the index was saved, in the order it was written
+    for (Segment* segment : qAsConst(m_segments)) {
+        scanSegment(segment);
+    }
+
+    for (const Location& location : qAsConst(m_index)) {
+        m_segments[location.segment]->liveBytes += recordSize(location.size);
+    }
+
+    qCDebug(LANGUAGE) << "opened top-context pack with" << m_segments.size() << "segments and" << m_index.size() <<
+        "top-contexts";
+}
+
+void TopDUContextPack::close()
+{
+    QMutexLocker lock(&m_mutex);
+    closeLocked();
+}
+
+void TopDUContextPack::closeLocked(bool store)
+{
+    if (!m_open)
+        return;
+
+    if (store)
+        flushLocked();
+
+    for (Segment* segment : qAsConst(m_segments)) {
+        if (segment->leases) {
+            qCWarning(LANGUAGE) << "closing top-context pack segment" << segment->number << "that is still in use";
+        }
+    }
+    qDeleteAll(m_segments);
+    m_segments.clear();
+    m_index.clear();
+    m_indexChanged = false;
+    m_open = false;
+}
+
+TopDUContextPack::Segment* TopDUContextPack::openSegment(int number, bool create)
+{
+    const QString fileName = segmentFileName(number);
+    if (create) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly))
+            return nullptr;
+    }
+
+    auto* segment = new Segment;
+    segment->number = number;
+    if (!segment->map.open(fileName, 0, segmentCapacity)) {
+        delete segment;
+        if (create)
+            QFile::remove(fileName);
+        return nullptr;
+    }
+
+    m_segments.insert(number, segment);
+    return segment;
+}
+
+void TopDUContextPack::scanSegment(Segment* segment)
+{
+    const char* data = segment->map.data();
+    const size_t size = segment->map.size();
+
+    size_t offset = segment->used;
+    while (offset + sizeof(RecordHeader) <= size) {
+        RecordHeader header;
+        memcpy(&header, data + offset, sizeof(RecordHeader));
+        //The unused rest of the file is zero, which stops the scan
+        if (header.magic != recordMagic || offset + recordSize(header.size) > size)
+            break;
+        if (header.checksum != qChecksum(data + offset + sizeof(RecordHeader), header.size)) {
+            qCWarning(LANGUAGE) << "dropping partially written top-context record" << header.topContextIndex;
+            break;
+        }
+
+        if (header.removal) {
+            m_index.remove(header.topContextIndex);
+        } else {
+            m_index.insert(header.topContextIndex, {segment->number, offset, header.size});
+        }
+        offset += recordSize(header.size);
+        m_indexChanged = true;
+    }
+
+    //Anything behind the last valid record is overwritten by the next write
+    segment->used = offset;
+}
+
+TopDUContextPack::Segment* TopDUContextPack::segmentForWriting(size_t recordSize)
+{
+    if (recordSize > segmentCapacity)
+        return nullptr;
+
+    if (!m_segments.isEmpty()) {
+        Segment* last = m_segments.last();
+        if (last->used + recordSize <= segmentCapacity)
+            return last;
+    }
+
+    return openSegment(m_segments.isEmpty() ? 0 : m_segments.lastKey() + 1, true);
+}
+
+bool TopDUContextPack::append(uint topContextIndex, const char* data, uint size, bool removal)
+{
+    const size_t total = recordSize(size);
+    Segment* segment = segmentForWriting(total);
+    if (!segment)
+        return false;
+
+    const size_t offset = segment->used;
+    const size_t reserved = (offset + total + segmentGrowth - 1) / segmentGrowth * segmentGrowth;
+    if (!segment->map.reserve(std::min(reserved, segmentCapacity)))
+        return false;
+
+    const RecordHeader header = {recordMagic, topContextIndex, size, qChecksum(data, size), removal};
+    char* target = segment->map.beginWrite(offset, total);
+    memcpy(target, &header, sizeof(RecordHeader));
+    if (size)
+        memcpy(target + sizeof(RecordHeader), data, size);
+    segment->map.endWrite(offset, total);
+    segment->used += total;
+
+    forget(topContextIndex);
+    if (!removal) {
+        m_index.insert(topContextIndex, {segment->number, offset, size});
+        segment->liveBytes += total;
+    }
+    m_indexChanged = true;
+    return true;
+}
+
+void TopDUContextPack::forget(uint topContextIndex)
+{
+    auto it = m_index.find(topContextIndex);
+    if (it == m_index.end())
+        return;
+
+    m_segments[it->segment]->liveBytes -= recordSize(it->size);
+    m_index.erase(it);
+}
+
+bool TopDUContextPack::contains(uint topContextIndex) const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_index.contains(topContextIndex);
+}
+
+TopDUContextPack::Record TopDUContextPack::acquire(uint topContextIndex)
+{
+    QMutexLocker lock(&m_mutex);
+
+    Record record;
+    auto it = m_index.constFind(topContextIndex);
+    if (it == m_index.constEnd())
+        return record;
+
+    Segment* segment = m_segments[it->segment];
+    ++segment->leases;
+    record.data = segment->map.data() + it->offset + sizeof(RecordHeader);
+    record.size = it->size;
+    record.segment = it->segment;
+    return record;
+}
+
+void TopDUContextPack::release(const Record& record)
+{
+    if (!record.data)
+        return;
+
+    QMutexLocker lock(&m_mutex);
+
+    //The segment is gone if the pack was closed in the meantime
+    Segment* segment = m_segments.value(record.segment);
+    if (!segment)
+        return;
+    Q_ASSERT(segment->leases > 0);
+
+    if (--segment->leases == 0 && segment->retired)
+        deleteSegment(segment->number);
+}
+
+bool TopDUContextPack::write(uint topContextIndex, const QByteArray& data)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_open)
+        return false;
+
+    return append(topContextIndex, data.constData(), data.size(), false);
+}
+
+bool TopDUContextPack::remove(uint topContextIndex)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_index.contains(topContextIndex))
+        return false;
+
+    //The removal has to be recorded as well, else the record would come back when the segment is replayed
+    if (!append(topContextIndex, nullptr, 0, true))
+        forget(topContextIndex);
+    return true;
+}
+
+void TopDUContextPack::flush()
+{
+    QMutexLocker lock(&m_mutex);
+    flushLocked();
+}
+
+void TopDUContextPack::flushLocked()
+{
+    for (Segment* segment : qAsConst(m_segments)) {
+        if (!segment->map.sync())
+            qCWarning(LANGUAGE) << "failed to sync top-context pack segment" << segment->number;
+    }
+
+    if (m_indexChanged)
+        saveIndex();
+}
+
+void TopDUContextPack::deleteSegment(int number)
+{
+    Segment* segment = m_segments.take(number);
+    Q_ASSERT(segment && !segment->leases);
+    delete segment;
+    QFile::remove(segmentFileName(number));
+    m_indexChanged = true;
+}
+
+void TopDUContextPack::compact()
+{
+    QVector<int> sparseSegments;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (!m_open || m_segments.size() < 2)
+            return;
+
+        //The newest segment is still being written to
+        const int current = m_segments.lastKey();
+        for (Segment* segment : qAsConst(m_segments)) {
+            if (segment->number != current && !segment->retired &&
+                segment->liveBytes * 100 < segment->used * compactBelowPercentage) {
+                sparseSegments << segment->number;
+            }
+        }
+    }
+
+    for (int number : qAsConst(sparseSegments)) {
+        QVector<uint> remaining;
+        {
+            QMutexLocker lock(&m_mutex);
+            for (auto it = m_index.constBegin(); it != m_index.constEnd(); ++it) {
+                if (it->segment == number)
+                    remaining << it.key();
+            }
+        }
+
+        qCDebug(LANGUAGE) << "compacting top-context pack segment" << number << "with" << remaining.size() <<
+            "remaining top-contexts";
+
+        //Move the records one by one, so loading and storing top-contexts is not blocked for long
+        bool moved = true;
+        for (uint topContextIndex : qAsConst(remaining)) {
+            QMutexLocker lock(&m_mutex);
+            auto it = m_index.constFind(topContextIndex);
+            //It may have been written again or removed in the meantime
+            if (it == m_index.constEnd() || it->segment != number)
+                continue;
+
+            const Segment* segment = m_segments[number];
+            const char* data = segment->map.data() + it->offset + sizeof(RecordHeader);
+            if (!append(topContextIndex, data, it->size, false)) {
+                moved = false;
+                break;
+            }
+        }
+
+        QMutexLocker lock(&m_mutex);
+        if (!moved || !m_open)
+            return;
+
+        //The moved records must be on disk before the only other copy is deleted
+        flushLocked();
+
+        Segment* segment = m_segments[number];
+        Q_ASSERT(!segment->liveBytes);
+        segment->retired = true;
+        if (!segment->leases)
+            deleteSegment(number);
+    }
+}
+
+bool TopDUContextPack::loadIndex()
+{
+    QFile file(QDir(m_directory).filePath(indexFileName()));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != indexMagic || version != indexVersion) {
+        qCWarning(LANGUAGE) << "ignoring top-context pack index with unsupported version" << version;
+        return false;
+    }
+
+    quint32 segmentCount = 0;
+    stream >> segmentCount;
+    QHash<int, quint64> used;
+    for (quint32 i = 0; i < segmentCount && stream.status() == QDataStream::Ok; ++i) {
+        qint32 number;
+        quint64 segmentUsed;
+        stream >> number >> segmentUsed;
+        used.insert(number, segmentUsed);
+    }
+
+    quint32 entryCount = 0;
+    stream >> entryCount;
+    QHash<uint, Location> index;
+    index.reserve(entryCount);
+    for (quint32 i = 0; i < entryCount && stream.status() == QDataStream::Ok; ++i) {
+        quint32 topContextIndex;
+        qint32 segment;
+        quint64 offset;
+        quint32 size;
+        stream >> topContextIndex >> segment >> offset >> size;
+        index.insert(topContextIndex, {segment, size_t(offset), size});
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(LANGUAGE) << "ignoring corrupted top-context pack index";
+        return false;
+    }
+
+    for (auto it = used.constBegin(); it != used.constEnd(); ++it) {
+        if (Segment* segment = m_segments.value(it.key()))
+            segment->used = std::min<size_t>(it.value(), segment->map.size());
+    }
+
+    //Only trust entries that point to a matching record in a segment that still exists
+    for (auto it = index.constBegin(); it != index.constEnd(); ++it) {
+        const Segment* segment = m_segments.value(it->segment);
+        if (!segment || it->offset + recordSize(it->size) > segment->used)
+            continue;
+
+        RecordHeader header;
+        memcpy(&header, segment->map.data() + it->offset, sizeof(RecordHeader));
+        if (header.magic == recordMagic && header.topContextIndex == it.key() && header.size == it->size &&
+            !header.removal) {
+            m_index.insert(it.key(), *it);
+        }
+    }
+    return true;
+}
+
+void TopDUContextPack::saveIndex()
+{
+    QSaveFile file(QDir(m_directory).filePath(indexFileName()));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(LANGUAGE) << "failed to save the top-context pack index";
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << indexMagic << indexVersion;
+
+    stream << quint32(m_segments.size());
+    for (const Segment* segment : qAsConst(m_segments)) {
+        stream << qint32(segment->number) << quint64(segment->used);
+    }
+
+    stream << quint32(m_index.size());
+    for (auto it = m_index.constBegin(); it != m_index.constEnd(); ++it) {
+        stream << quint32(it.key()) << qint32(it->segment) << quint64(it->offset) << quint32(it->size);
+    }
+
+    if (stream.status() == QDataStream::Ok && file.commit())
+        m_indexChanged = false;
+}
@@ -0,0 +1,117 @@
+/*
+   This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KDEVPLATFORM_TOPDUCONTEXTPACK_H
+#define KDEVPLATFORM_TOPDUCONTEXTPACK_H
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+
+class QByteArray;
+
+namespace KDevelop {
+class ItemRepositoryFileMap;
+
+/**
+ * Stores the data of all top-contexts in a few large segment files, instead of one file per top-context.
+ *
+ * The segments are a log: every write and removal is appended to the newest segment as a record.
+ * An index maps top-context indices to their latest record. It is saved by flush(), and records that were
+ * appended after the last flush are replayed from the segments when opening. Since the segments are only
+ * replayed from where the saved index ends, the removal records of compacted segments do not have to be kept.
+ * Without a valid index the segments cannot be trusted, so the whole pack is discarded then.
+ *
+ * Every segment is mapped once for its whole lifetime, so loaded top-contexts can use the stored data in place.
+ * They have to acquire() it, which keeps the segment alive even if compact() moved the record elsewhere.
+ *
+ * The segments are mapped through ItemRepositoryFileMap, so the pack is only available where that is.
+ * Everywhere else write() fails, and the per-file storage has to be used.
+ */
+class TopDUContextPack
+{
+public:
+    struct Record
+    {
+        const char* data = nullptr;
+        uint size = 0;
+        int segment = -1;
+    };
+
+    TopDUContextPack();
+    ~TopDUContextPack();
+
+    ///Opens the pack in @p directory, unless it is open already. A different @p generation means that
+    ///the directory was cleared since the pack was opened, then the pack is reset without storing anything.
+    void open(const QString& directory, int generation);
+    ///Flushes and closes the pack. No records may be acquired any more.
+    void close();
+
+    bool contains(uint topContextIndex) const;
+
+    ///Returns the stored data of the top-context, or an empty record if it is not in the pack.
+    ///The data stays valid until release() is called for the record.
+    Record acquire(uint topContextIndex);
+    void release(const Record& record);
+
+    ///Appends a new version of the top-context data. Returns false if the pack cannot store it.
+    bool write(uint topContextIndex, const QByteArray& data);
+    ///Returns whether the top-context was in the pack
+    bool remove(uint topContextIndex);
+
+    ///Makes everything written so far persistent, and saves the index
+    void flush();
+
+    ///Moves the remaining records out of segments that contain mostly outdated ones, and deletes
+    ///segments that are not used any more. Only blocks writers and readers for single records at a time.
+    void compact();
+
+private:
+    struct Segment;
+    struct Location
+    {
+        int segment;
+        size_t offset;
+        uint size;
+    };
+
+    //The mutex must be locked when calling these
+    void closeLocked(bool store = true);
+    void flushLocked();
+    Segment* openSegment(int number, bool create);
+    Segment* segmentForWriting(size_t recordSize);
+    void scanSegment(Segment* segment);
+    bool append(uint topContextIndex, const char* data, uint size, bool removal);
+    void forget(uint topContextIndex);
+    void deleteSegment(int number);
+    bool loadIndex();
+    void saveIndex();
+    QString segmentFileName(int number) const;
+
+    mutable QMutex m_mutex;
+    bool m_open = false;
+    QString m_directory;
+    int m_generation = 0;
+    QMap<int, Segment*> m_segments;
+    QHash<uint, Location> m_index;
+    bool m_indexChanged = false;
+};
+}
+
+#endif
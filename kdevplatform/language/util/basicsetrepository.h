@@ -14,8 +14,10 @@
 #ifndef KDEVPLATFORM_BASICSETREPOSITORY_H
 #define KDEVPLATFORM_BASICSETREPOSITORY_H
 
+#include <memory>
 #include <set>
 #include <vector>
+#include <QHash>
 #include <language/languageexport.h>
 #include <language/util/kdevhash.h>
 #include <serialization/itemrepository.h>
@@ -194,6 +196,44 @@ struct KDEVPLATFORMLANGUAGE_EXPORT SetDataRepository
     BasicSetRepository* setRepository;
 };
 
+/**
+ * A set flattened into a sorted array of its indices. It is immutable, and cheap to copy.
+ *
+ * Unions, intersections and differences of flat sets merge the arrays directly. They neither need
+ * the repository nor its mutex, which makes them the faster choice for sets that are combined over and over.
+ * */
+class KDEVPLATFORMLANGUAGE_EXPORT FlatSet
+{
+public:
+    using Index = unsigned int;
+
+    FlatSet();
+    ///@param sortedIndices Must be sorted, and must not contain duplicates
+    explicit FlatSet(std::vector<Index> sortedIndices);
+
+    const std::vector<Index>& indices() const;
+
+    unsigned int count() const;
+
+    bool isEmpty() const;
+
+    bool contains(Index index) const;
+
+    ///Set union
+    FlatSet operator +(const FlatSet& rhs) const;
+
+    ///Set intersection
+    FlatSet operator &(const FlatSet& rhs) const;
+
+    ///Set subtraction
+    FlatSet operator -(const FlatSet& rhs) const;
+
+    bool operator==(const FlatSet& rhs) const;
+
+private:
+    std::shared_ptr<const std::vector<Index>> m_indices;
+};
+
 /**
  * This object is copyable. It represents a set, and allows iterating through the represented indices.
  * */
@@ -218,6 +258,10 @@ public:
     //Returns this set converted to a standard set that contains all indices contained by this set.
     std::set<unsigned int> stdSet() const;
 
+    ///Returns this set flattened into a sorted array.
+    ///The result is cached by the repository, so a set is only flattened once as long as it exists.
+    FlatSet flatSet() const;
+
     ///Returns the count of items in the set
     unsigned int count() const;
 
@@ -293,6 +337,11 @@ public:
      * */
     Set createSet(const std::set<Index>& indices);
 
+    /**
+     * Takes a flat set of indices
+     * */
+    Set createSet(const FlatSet& indices);
+
     /**
      * Creates a set that only contains that single index.
      * For better performance, you should create bigger sets than this.
@@ -343,9 +392,21 @@ public:
 private:
     friend class Set;
     friend class Set::Iterator;
+    friend class SetNodeDataRequest;
+
+    enum {
+        //Count of indices in all cached flat sets, after which the cache is cleared
+        MaximumFlatSetCacheSize = 1 << 20
+    };
+
     SetDataRepository m_dataRepository;
     QMutex* m_mutex;
     bool m_delayedDeletion;
+    //Maps set indices to their flattened representation, protected by m_mutex
+    QHash<uint, FlatSet> m_flatSets;
+    uint m_flatSetCacheSize = 0;
+    //The node Set::unrefNode() is currently deleting, its flat set was already dropped
+    uint m_deletingNode = 0;
 
 //   SetNode
 };
@@ -22,6 +22,12 @@
 #include <QString>
 #include <QMutex>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 //#define DEBUG_SETREPOSITORY
 
@@ -103,6 +109,9 @@ struct SetRepositoryAlgorithms
     ///Expensive
     Index count(const SetNodeData* node) const;
 
+    ///Appends all indices contained by @p node to @p indices, in sorted order
+    void collectIndices(const SetNodeData* node, std::vector<Index>& indices) const;
+
     void localCheck(const SetNodeData* node);
 
     void check(uint node);
@@ -166,6 +175,14 @@ void SetNodeDataRequest::destroy(SetNodeData* data, KDevelop::AbstractItemReposi
 {
     auto& repository(static_cast<SetDataRepository&>(_repository));
 
+    //Set::unrefNode() already dropped the flat set of the node it deletes. Nodes deleted any other way
+    //are not known by index here, so their index may be re-used by a different set: drop all flat sets.
+    BasicSetRepository* setRepository = repository.setRepository;
+    if (!setRepository->m_deletingNode && !setRepository->m_flatSets.isEmpty()) {
+        setRepository->m_flatSets.clear();
+        setRepository->m_flatSetCacheSize = 0;
+    }
+
     if (repository.setRepository->delayedDeletion()) {
         if (data->leftNode()) {
             SetDataRepositoryBase::MyDynamicItem left = repository.dynamicItemFromIndex(data->leftNode());
@@ -294,6 +311,17 @@ Index SetRepositoryAlgorithms::count(const SetNodeData* node) const
         return node->end() - node->start();
 }
 
+void SetRepositoryAlgorithms::collectIndices(const SetNodeData* node, std::vector<Index>& indices) const
+{
+    if (node->leftNode() && node->rightNode()) {
+        collectIndices(getLeftNode(node), indices);
+        collectIndices(getRightNode(node), indices);
+    } else {
+        for (Index a = node->start(); a < node->end(); ++a)
+            indices.push_back(a);
+    }
+}
+
 void SetRepositoryAlgorithms::localCheck(const SetNodeData* ifDebug(node))
 {
 //   Q_ASSERT(node->start() > 0);
@@ -444,6 +472,36 @@ std::set<Index> Set::stdSet() const
     return ret;
 }
 
+FlatSet Set::flatSet() const
+{
+    if (!m_tree || !m_repository)
+        return FlatSet();
+
+    QMutexLocker lock(m_repository->m_mutex);
+
+    QHash<uint, FlatSet>::const_iterator it = m_repository->m_flatSets.constFind(m_tree);
+    if (it != m_repository->m_flatSets.constEnd())
+        return *it;
+
+    SetRepositoryAlgorithms alg(m_repository->m_dataRepository, m_repository);
+    const SetNodeData* node = m_repository->m_dataRepository.itemFromIndex(m_tree);
+
+    std::vector<Index> indices;
+    indices.reserve(alg.count(node));
+    alg.collectIndices(node, indices);
+    FlatSet ret(std::move(indices));
+
+    if (m_repository->m_flatSetCacheSize + ret.count() > BasicSetRepository::MaximumFlatSetCacheSize) {
+        m_repository->m_flatSets.clear();
+        m_repository->m_flatSetCacheSize = 0;
+    }
+
+    m_repository->m_flatSets.insert(m_tree, ret);
+    m_repository->m_flatSetCacheSize += ret.count();
+
+    return ret;
+}
+
 Set::Iterator::Iterator(const Iterator& rhs)
     : d(new SetIteratorPrivate(*rhs.d))
 {
@@ -941,6 +999,11 @@ Set BasicSetRepository::createSet(const std::set<Index>& indices)
     return createSetFromIndices(indicesVector);
 }
 
+Set BasicSetRepository::createSet(const FlatSet& indices)
+{
+    return createSetFromIndices(indices.indices());
+}
+
 BasicSetRepository::BasicSetRepository(const QString& name, KDevelop::ItemRepositoryRegistry* registry,
                                        bool delayedDeletion)
     : m_dataRepository(this, name, registry)
@@ -1155,7 +1218,15 @@ void Set::unrefNode(uint current)
                 m_repository->itemRemovedFromSets(data->start());
             }
 
+            QHash<uint, FlatSet>::iterator flat = m_repository->m_flatSets.find(current);
+            if (flat != m_repository->m_flatSets.end()) {
+                m_repository->m_flatSetCacheSize -= flat->count();
+                m_repository->m_flatSets.erase(flat);
+            }
+
+            m_repository->m_deletingNode = current;
             m_repository->m_dataRepository.deleteItem(current);
+            m_repository->m_deletingNode = 0;
         }
     }
 }
@@ -1173,6 +1244,202 @@ void Set::staticUnref()
     unrefNode(m_tree);
 }
 
+////////////FlatSet//////////////////
+
+namespace {
+using IndexVector = std::vector<Index>;
+
+#if defined(__SSE2__)
+inline uint blockMatches(__m128i lhs, __m128i rhs)
+{
+    //Compare each item of lhs with all items of rhs by rotating rhs through all positions
+    __m128i cmp = _mm_cmpeq_epi32(lhs, rhs);
+    rhs = _mm_shuffle_epi32(rhs, _MM_SHUFFLE(0, 3, 2, 1));
+    cmp = _mm_or_si128(cmp, _mm_cmpeq_epi32(lhs, rhs));
+    rhs = _mm_shuffle_epi32(rhs, _MM_SHUFFLE(0, 3, 2, 1));
+    cmp = _mm_or_si128(cmp, _mm_cmpeq_epi32(lhs, rhs));
+    rhs = _mm_shuffle_epi32(rhs, _MM_SHUFFLE(0, 3, 2, 1));
+    cmp = _mm_or_si128(cmp, _mm_cmpeq_epi32(lhs, rhs));
+    return _mm_movemask_ps(_mm_castsi128_ps(cmp));
+}
+#endif
+
+void flatIntersect(const IndexVector& lhs, const IndexVector& rhs, IndexVector& ret)
+{
+    const size_t lhsSize = lhs.size(), rhsSize = rhs.size();
+    size_t a = 0, b = 0;
+
+#if defined(__SSE2__)
+    //Compare blocks of 4 items at once, and advance the block that ends first
+    while (a + 4 <= lhsSize && b + 4 <= rhsSize) {
+        const uint mask = blockMatches(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs.data() + a)),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs.data() + b)));
+        for (uint k = 0; k < 4; ++k) {
+            if (mask & (1u << k))
+                ret.push_back(lhs[a + k]);
+        }
+
+        const Index lhsLast = lhs[a + 3], rhsLast = rhs[b + 3];
+        if (lhsLast <= rhsLast)
+            a += 4;
+        if (rhsLast <= lhsLast)
+            b += 4;
+    }
+#endif
+
+    while (a < lhsSize && b < rhsSize) {
+        if (lhs[a] < rhs[b]) {
+            ++a;
+        } else if (rhs[b] < lhs[a]) {
+            ++b;
+        } else {
+            ret.push_back(lhs[a]);
+            ++a;
+            ++b;
+        }
+    }
+}
+
+void flatSubtract(const IndexVector& lhs, const IndexVector& rhs, IndexVector& ret)
+{
+    const size_t lhsSize = lhs.size(), rhsSize = rhs.size();
+    size_t a = 0, b = 0;
+    //Items of the current lhs block that were found in one of the rhs blocks
+    uint found = 0;
+
+#if defined(__SSE2__)
+    while (a + 4 <= lhsSize && b + 4 <= rhsSize) {
+        found |= blockMatches(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs.data() + a)),
+                              _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs.data() + b)));
+
+        const Index lhsLast = lhs[a + 3], rhsLast = rhs[b + 3];
+        if (lhsLast <= rhsLast) {
+            //No later rhs block can contain items of this block
+            for (uint k = 0; k < 4; ++k) {
+                if (!(found & (1u << k)))
+                    ret.push_back(lhs[a + k]);
+            }
+
+            a += 4;
+            found = 0;
+        }
+        if (rhsLast <= lhsLast)
+            b += 4;
+    }
+#endif
+
+    //The first items from a on may belong to a block that was partially matched already
+    const size_t blockStart = a;
+    while (a < lhsSize) {
+        if (a - blockStart < 4 && (found & (1u << (a - blockStart)))) {
+            ++a;
+            continue;
+        }
+
+        while (b < rhsSize && rhs[b] < lhs[a])
+            ++b;
+
+        if (b == rhsSize || rhs[b] != lhs[a])
+            ret.push_back(lhs[a]);
+        else
+            ++b;
+        ++a;
+    }
+}
+
+void flatUnite(const IndexVector& lhs, const IndexVector& rhs, IndexVector& ret)
+{
+    //A vectorized merge does not pay off here: The result has to be written item by item anyway
+    std::set_union(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), std::back_inserter(ret));
+}
+
+const IndexVector& emptyIndices()
+{
+    static const IndexVector ret;
+    return ret;
+}
+}
+
+FlatSet::FlatSet()
+{
+}
+
+FlatSet::FlatSet(std::vector<Index> sortedIndices)
+{
+    Q_ASSERT(std::adjacent_find(sortedIndices.begin(), sortedIndices.end(), std::greater_equal<Index>())
+             == sortedIndices.end());
+
+    if (!sortedIndices.empty())
+        m_indices = std::make_shared<const IndexVector>(std::move(sortedIndices));
+}
+
+const std::vector<Index>& FlatSet::indices() const
+{
+    return m_indices ? *m_indices : emptyIndices();
+}
+
+unsigned int FlatSet::count() const
+{
+    return m_indices ? m_indices->size() : 0;
+}
+
+bool FlatSet::isEmpty() const
+{
+    return !m_indices;
+}
+
+bool FlatSet::contains(Index index) const
+{
+    if (!m_indices)
+        return false;
+
+    return std::binary_search(m_indices->begin(), m_indices->end(), index);
+}
+
+FlatSet FlatSet::operator +(const FlatSet& rhs) const
+{
+    if (rhs.isEmpty() || m_indices == rhs.m_indices)
+        return *this;
+    else if (isEmpty())
+        return rhs;
+
+    IndexVector ret;
+    ret.reserve(count() + rhs.count());
+    flatUnite(*m_indices, *rhs.m_indices, ret);
+    return FlatSet(std::move(ret));
+}
+
+FlatSet FlatSet::operator &(const FlatSet& rhs) const
+{
+    if (isEmpty() || rhs.isEmpty())
+        return FlatSet();
+    else if (m_indices == rhs.m_indices)
+        return *this;
+
+    IndexVector ret;
+    ret.reserve(std::min(count(), rhs.count()));
+    flatIntersect(*m_indices, *rhs.m_indices, ret);
+    return FlatSet(std::move(ret));
+}
+
+FlatSet FlatSet::operator -(const FlatSet& rhs) const
+{
+    if (isEmpty() || rhs.isEmpty())
+        return *this;
+    else if (m_indices == rhs.m_indices)
+        return FlatSet();
+
+    IndexVector ret;
+    ret.reserve(count());
+    flatSubtract(*m_indices, *rhs.m_indices, ret);
+    return FlatSet(std::move(ret));
+}
+
+bool FlatSet::operator==(const FlatSet& rhs) const
+{
+    return m_indices == rhs.m_indices || indices() == rhs.indices();
+}
+
 StringSetRepository::StringSetRepository(const QString& name) : Utils::BasicSetRepository(name)
 {
 }
@@ -182,6 +182,15 @@ public:
             set().staticRef();
     }
 
+    explicit StorableSet(const FlatSet& indices)
+    {
+        StaticAccessLocker lock;
+        Q_UNUSED(lock);
+        m_setIndex = StaticRepository::repository()->createSet(indices).setIndex();
+        if (doReferenceCounting)
+            set().staticRef();
+    }
+
     StorableSet()
     {
     }
@@ -25,6 +25,7 @@
 #include "helper.h"
 
 #include <QHashIterator>
+#include <QSet>
 #include <QFileInfo>
 #include <QApplication>
 #include <QTimer>
@@ -64,6 +65,16 @@ ProjectFolderItem* parentFolder(ProjectBaseItem* item)
     }
 }
 
+QSet<Path> toSet(const Path::List& paths)
+{
+    QSet<Path> ret;
+    ret.reserve(paths.size());
+    for (const Path& path : paths) {
+        ret.insert(path);
+    }
+    return ret;
+}
+
 }
 
 //END Helper
@@ -87,7 +98,10 @@ public:
     Q_REQUIRED_RESULT KIO::Job* eventuallyReadFolder(ProjectFolderItem* item);
     void addJobItems(FileManagerListJob* job,
                      ProjectFolderItem* baseItem,
-                     const KIO::UDSEntryList& entries);
+                     const Path::List& files,
+                     const Path::List& folders);
+    /// Checks an entry that already passed the project filters while its folder was listed.
+    bool isValidListedEntry(const Path& path, bool isFolder, IProject* project);
 
     void deleted(const QString &path);
     void created(const QString &path);
@@ -106,6 +120,8 @@ public:
     QHash<IProject*, QList<FileManagerListJob*> > m_projectJobs;
     QVector<QString> m_stoppedFolders;
     ProjectFilterManager m_filters;
+    // set while AbstractFileManagerPlugin::isValid does not need to check the project filters again
+    bool m_filtersChecked = false;
 };
 
 void AbstractFileManagerPluginPrivate::projectClosing(IProject* project)
@@ -137,7 +153,7 @@ void AbstractFileManagerPluginPrivate::projectClosing(IProject* project)
 
 KIO::Job* AbstractFileManagerPluginPrivate::eventuallyReadFolder(ProjectFolderItem* item)
 {
-    auto* listJob = new FileManagerListJob( item );
+    auto* listJob = new FileManagerListJob( item, m_filters.filtersForProject(item->project()) );
     m_projectJobs[ item->project() ] << listJob;
     qCDebug(FILEMANAGER) << "adding job" << listJob << item << item->path() << "for project" << item->project();
 
@@ -145,8 +161,9 @@ KIO::Job* AbstractFileManagerPluginPrivate::eventuallyReadFolder(ProjectFolderIt
                 q, [&] (KJob* job) { jobFinished(job); } );
 
     q->connect( listJob, &FileManagerListJob::entries,
-                q, [&] (FileManagerListJob* job, ProjectFolderItem* baseItem, const KIO::UDSEntryList& entries) {
-                    addJobItems(job, baseItem, entries); } );
+                q, [&] (FileManagerListJob* job, ProjectFolderItem* baseItem,
+                        const Path::List& files, const Path::List& folders) {
+                    addJobItems(job, baseItem, files, folders); } );
 
     return listJob;
 }
@@ -163,87 +180,91 @@ void AbstractFileManagerPluginPrivate::jobFinished(KJob* job)
     }
 }
 
+bool AbstractFileManagerPluginPrivate::isValidListedEntry(const Path& path, bool isFolder, IProject* project)
+{
+    // subclasses may hide more items, but running the project filters twice is wasted effort
+    m_filtersChecked = true;
+    const bool valid = q->isValid(path, isFolder, project);
+    m_filtersChecked = false;
+    return valid;
+}
+
 void AbstractFileManagerPluginPrivate::addJobItems(FileManagerListJob* job,
                                                      ProjectFolderItem* baseItem,
-                                                     const KIO::UDSEntryList& entries)
+                                                     const Path::List& listedFiles,
+                                                     const Path::List& listedFolders)
 {
     qCDebug(FILEMANAGER) << "reading entries of" << baseItem->path();
 
-    // build lists of valid files and folders with paths relative to the project folder
+    // the job already dropped the entries hidden by the project filters
     Path::List files;
-    Path::List folders;
-    for (const KIO::UDSEntry& entry : entries) {
-        QString name = entry.stringValue( KIO::UDSEntry::UDS_NAME );
-        if (name == QLatin1String(".") || name == QLatin1String("..")) {
-            continue;
+    files.reserve(listedFiles.size());
+    for (const Path& path : listedFiles) {
+        if (isValidListedEntry(path, false, baseItem->project())) {
+            files << path;
         }
-
-        Path path(baseItem->path(), name);
-
-        if ( !q->isValid( path, entry.isDir(), baseItem->project() ) ) {
-            continue;
-        } else {
-            if ( entry.isDir() ) {
-                if( entry.isLink() ) {
-                    const Path linkedPath = baseItem->path().cd(entry.stringValue( KIO::UDSEntry::UDS_LINK_DEST ));
-                    // make sure we don't end in an infinite loop
-                    if( linkedPath.isParentOf( baseItem->project()->path() ) ||
-                        baseItem->project()->path().isParentOf( linkedPath ) ||
-                        linkedPath == baseItem->project()->path() )
-                    {
-                        continue;
-                    }
-                }
-                folders << path;
-            } else {
-                files << path;
-            }
+    }
+    Path::List folders;
+    folders.reserve(listedFolders.size());
+    for (const Path& path : listedFolders) {
+        if (isValidListedEntry(path, true, baseItem->project())) {
+            folders << path;
         }
     }
 
     ifDebug(qCDebug(FILEMANAGER) << "valid folders:" << folders;)
     ifDebug(qCDebug(FILEMANAGER) << "valid files:" << files;)
 
-    // remove obsolete rows
-    for ( int j = 0; j < baseItem->rowCount(); ++j ) {
-        if ( ProjectFolderItem* f = baseItem->child(j)->folder() ) {
-            // check if this is still a valid folder
-            int index = folders.indexOf( f->path() );
-            if ( index == -1 ) {
-                // folder got removed or is now invalid
-                delete f;
-                --j;
-            } else {
-                // this folder already exists in the view
-                folders.remove( index );
-                // no need to add this item, but we still want to recurse into it
-                job->addSubDir( f );
-                emit q->reloadedFolderItem( f );
-            }
-        } else if ( ProjectFileItem* f =  baseItem->child(j)->file() ) {
-            // check if this is still a valid file
-            int index = files.indexOf( f->path() );
-            if ( index == -1 ) {
-                // file got removed or is now invalid
-                ifDebug(qCDebug(FILEMANAGER) << "removing file:" << f << f->path();)
-                delete f;
-                --j;
-            } else {
-                // this file already exists in the view
-                files.remove( index );
-                emit q->reloadedFileItem( f );
+    // remove obsolete rows, there are none while importing
+    QSet<Path> existingFiles;
+    QSet<Path> existingFolders;
+    if (baseItem->rowCount()) {
+        const QSet<Path> validFiles = toSet(files);
+        const QSet<Path> validFolders = toSet(folders);
+        for ( int j = 0; j < baseItem->rowCount(); ++j ) {
+            if ( ProjectFolderItem* f = baseItem->child(j)->folder() ) {
+                // check if this is still a valid folder
+                if ( !validFolders.contains( f->path() ) ) {
+                    // folder got removed or is now invalid
+                    delete f;
+                    --j;
+                } else {
+                    // this folder already exists in the view
+                    existingFolders.insert( f->path() );
+                    // no need to add this item, but we still want to recurse into it
+                    job->addSubDir( f );
+                    emit q->reloadedFolderItem( f );
+                }
+            } else if ( ProjectFileItem* f =  baseItem->child(j)->file() ) {
+                // check if this is still a valid file
+                if ( !validFiles.contains( f->path() ) ) {
+                    // file got removed or is now invalid
+                    ifDebug(qCDebug(FILEMANAGER) << "removing file:" << f << f->path();)
+                    delete f;
+                    --j;
+                } else {
+                    // this file already exists in the view
+                    existingFiles.insert( f->path() );
+                    emit q->reloadedFileItem( f );
+                }
             }
         }
     }
 
     // add new rows
-    foreach ( const Path& path, files ) {
+    for ( const Path& path : qAsConst(files) ) {
+        if ( existingFiles.contains( path ) ) {
+            continue;
+        }
         ProjectFileItem* file = q->createFileItem( baseItem->project(), path, baseItem );
         if (file) {
             emit q->fileAdded( file );
         }
     }
-    foreach ( const Path& path, folders ) {
+    for ( const Path& path : qAsConst(folders) ) {
+        if ( existingFolders.contains( path ) ) {
+            continue;
+        }
         ProjectFolderItem* folder = q->createFolderItem( baseItem->project(), path, baseItem );
         if (folder) {
             emit q->folderAdded( folder );
@@ -648,6 +669,9 @@ bool AbstractFileManagerPlugin::copyFilesAndFolders(const Path::List& items, Pro
 bool AbstractFileManagerPlugin::isValid( const Path& path, const bool isFolder,
                                          IProject* project ) const
 {
+    if (d->m_filtersChecked) {
+        return true;
+    }
     return d->m_filters.isValid( path, isFolder, project );
 }
 
@@ -77,7 +77,9 @@ protected:
      * Filter interface making it possible to hide files and folders from a project.
      *
      * The default implementation will query all IProjectFilter plugins and ask them
-     * whether a given url should be included or not.
+     * whether a given url should be included or not. While importing, the filters are
+     * applied in the background already, so the default implementation then accepts
+     * all paths it is asked about.
      *
      * @return True when @p path should belong to @p project, false otherwise.
      */
@@ -21,14 +21,14 @@
 
 #include <interfaces/iproject.h>
 #include <project/projectmodel.h>
+#include <project/interfaces/iprojectfilter.h>
 
 #include "path.h"
 #include "debug.h"
-// KF
-#include <kio_version.h>
 // Qt
 #include <QtConcurrentRun>
 #include <QDir>
+#include <QThreadPool>
 
 using namespace KDevelop;
 
@@ -45,8 +45,11 @@ bool isChildItem(ProjectBaseItem* parent, ProjectBaseItem* child)
 }
 }
 
-FileManagerListJob::FileManagerListJob(ProjectFolderItem* item)
-    : KIO::Job(), m_item(item), m_aborted(false)
+FileManagerListJob::FileManagerListJob(ProjectFolderItem* item, const Filters& filters)
+    : KIO::Job()
+    , m_filters(filters)
+    , m_projectPath(item->project()->path())
+    , m_aborted(false)
 {
     qRegisterMetaType<KIO::UDSEntryList>("KIO::UDSEntryList");
     qRegisterMetaType<KIO::Job*>();
@@ -66,15 +69,17 @@ FileManagerListJob::FileManagerListJob(ProjectFolderItem* item)
 
 FileManagerListJob::~FileManagerListJob()
 {
-    // lock and abort to ensure our background list job is stopped
-    std::lock_guard<std::recursive_mutex> lock(m_listing);
+    // ensure our background list jobs are stopped, they access this job until they are done
     m_aborted = true;
+    QMutexLocker lock(&m_resultsMutex);
+    while (m_runningListings) {
+        m_listingDone.wait(&m_resultsMutex);
+    }
 }
 
 void FileManagerListJob::addSubDir( ProjectFolderItem* item )
 {
     Q_ASSERT(!m_listQueue.contains(item));
-    Q_ASSERT(!m_item || m_item == item || m_item->path().isDirectParentOf(item->path()));
 
     m_listQueue.enqueue(item);
 }
@@ -86,8 +91,15 @@ void FileManagerListJob::handleRemovedItem(ProjectBaseItem* item)
     auto *folder = reinterpret_cast<ProjectFolderItem*>(item);
     m_listQueue.removeAll(folder);
 
-    if (isChildItem(item, m_item)) {
+    if (m_item && isChildItem(item, m_item)) {
         abort();
+        return;
+    }
+    for (ProjectFolderItem* localItem : qAsConst(m_localItems)) {
+        if (isChildItem(item, localItem)) {
+            abort();
+            return;
+        }
     }
 }
 
@@ -99,63 +111,91 @@ void FileManagerListJob::slotEntries(KIO::Job* job, const KIO::UDSEntryList& ent
 
 void FileManagerListJob::startNextJob()
 {
-    if ( m_listQueue.isEmpty() || m_aborted ) {
-        return;
+    // the thread pool is shared with others, thus only take our share of it
+    const int maxLocalListings = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+
+    while (!m_listQueue.isEmpty() && !m_aborted && !m_item) {
+        ProjectFolderItem* item = m_listQueue.head();
+        if (item->path().isLocalFile()) {
+            // optimized version for local projects using QDir directly
+            if (m_localItems.size() >= maxLocalListings) {
+                return;
+            }
+            m_listQueue.dequeue();
+            m_localItems.insert(item);
+            listLocalFolder(item, item->path());
+        } else {
+            if (!m_localItems.isEmpty()) {
+                return;
+            }
+            m_item = m_listQueue.dequeue();
+            KIO::ListJob* job = KIO::listDir( m_item->path().toUrl(), KIO::HideProgressInfo );
+            job->addMetaData(QStringLiteral("details"), QStringLiteral("0"));
+            job->setParentJob( this );
+            connect( job, &KIO::ListJob::entries,
+                    this, &FileManagerListJob::slotEntries );
+            connect( job, &KIO::ListJob::result, this, &FileManagerListJob::slotResult );
+        }
     }
+}
 
-#ifdef TIME_IMPORT_JOB
-    m_subTimer.start();
-#endif
+void FileManagerListJob::listLocalFolder(ProjectFolderItem* item, const Path& path)
+{
+    {
+        QMutexLocker lock(&m_resultsMutex);
+        ++m_runningListings;
+    }
 
-    m_item = m_listQueue.dequeue();
-    if (m_item->path().isLocalFile()) {
-        // optimized version for local projects using QDir directly
-        // start locking to ensure we don't get destroyed while waiting for the list to finish
-        m_listing.lock();
-        QtConcurrent::run([this] (const Path& path) {
-            std::lock_guard<std::recursive_mutex> lock(m_listing, std::adopt_lock);
-            if (m_aborted) {
-                return;
-            }
+    QtConcurrent::run([this, item, path] () {
+        if (!m_aborted) {
             QDir dir(path.toLocalFile());
             const auto entries = dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries | QDir::Hidden);
-            if (m_aborted) {
-                return;
-            }
-            KIO::UDSEntryList results;
-            std::transform(entries.begin(), entries.end(), std::back_inserter(results), [] (const QFileInfo& info) -> KIO::UDSEntry {
-                KIO::UDSEntry entry;
-#if KIO_VERSION < QT_VERSION_CHECK(5,48,0)
-                entry.insert(KIO::UDSEntry::UDS_NAME, info.fileName());
-#else
-                entry.fastInsert(KIO::UDSEntry::UDS_NAME, info.fileName());
-#endif
-                if (info.isDir()) {
-#if KIO_VERSION < QT_VERSION_CHECK(5,48,0)
-                    entry.insert(KIO::UDSEntry::UDS_FILE_TYPE, QT_STAT_DIR);
-#else
-                    entry.fastInsert(KIO::UDSEntry::UDS_FILE_TYPE, QT_STAT_DIR);
-#endif
-                }
-                if (info.isSymLink()) {
-#if KIO_VERSION < QT_VERSION_CHECK(5,48,0)
-                    entry.insert(KIO::UDSEntry::UDS_LINK_DEST, info.symLinkTarget());
-#else
-                    entry.fastInsert(KIO::UDSEntry::UDS_LINK_DEST, info.symLinkTarget());
-#endif
+
+            Listing listing{item, {}, {}};
+            for (const QFileInfo& info : entries) {
+                if (m_aborted) {
+                    break;
                 }
-                return entry;
-            });
-            QMetaObject::invokeMethod(this, "handleResults", Q_ARG(KIO::UDSEntryList, results));
-        }, m_item->path());
-    } else {
-        KIO::ListJob* job = KIO::listDir( m_item->path().toUrl(), KIO::HideProgressInfo );
-        job->addMetaData(QStringLiteral("details"), QStringLiteral("0"));
-        job->setParentJob( this );
-        connect( job, &KIO::ListJob::entries,
-                this, &FileManagerListJob::slotEntries );
-        connect( job, &KIO::ListJob::result, this, &FileManagerListJob::slotResult );
+                addEntry(&listing, Path(path, info.fileName()), info.isDir(),
+                         info.isSymLink() ? info.symLinkTarget() : QString());
+            }
+
+            QMutexLocker lock(&m_resultsMutex);
+            m_results.append(listing);
+            // the results of several folders are handled at once when the GUI thread is busy
+            if (m_results.size() == 1) {
+                QMetaObject::invokeMethod(this, "handleLocalResults", Qt::QueuedConnection);
+            }
+        }
+
+        QMutexLocker lock(&m_resultsMutex);
+        --m_runningListings;
+        m_listingDone.wakeAll();
+    });
+}
+
+void FileManagerListJob::addEntry(Listing* listing, const Path& path, bool isDir, const QString& linkDest) const
+{
+    for (const auto& filter : m_filters) {
+        if (!filter->isValid(path, isDir)) {
+            return;
+        }
+    }
+
+    if (!isDir) {
+        listing->files << path;
+        return;
     }
+
+    if (!linkDest.isEmpty()) {
+        const Path linkedPath = path.parent().cd(linkDest);
+        // make sure we don't end in an infinite loop
+        if (linkedPath.isParentOf(m_projectPath) || m_projectPath.isParentOf(linkedPath)
+            || linkedPath == m_projectPath) {
+            return;
+        }
+    }
+    listing->folders << path;
 }
 
 void FileManagerListJob::slotResult(KJob* job)
@@ -168,35 +208,61 @@ void FileManagerListJob::slotResult(KJob* job)
         qCDebug(FILEMANAGER) << "error in list job:" << job->error() << job->errorString();
     }
 
-    handleResults(entryList);
+    Listing listing{m_item, {}, {}};
+    const Path basePath = m_item->path();
+    for (const KIO::UDSEntry& entry : qAsConst(entryList)) {
+        const QString name = entry.stringValue(KIO::UDSEntry::UDS_NAME);
+        if (name == QLatin1String(".") || name == QLatin1String("..")) {
+            continue;
+        }
+        addEntry(&listing, Path(basePath, name), entry.isDir(),
+                 entry.isLink() ? entry.stringValue(KIO::UDSEntry::UDS_LINK_DEST) : QString());
+    }
     entryList.clear();
+    m_item = nullptr;
+
+    handleResults(listing);
 }
 
+void FileManagerListJob::handleLocalResults()
+{
+    QVector<Listing> results;
+    {
+        QMutexLocker lock(&m_resultsMutex);
+        results.swap(m_results);
+    }
 
-void FileManagerListJob::handleResults(const KIO::UDSEntryList& entriesIn)
+    for (const Listing& listing : qAsConst(results)) {
+        if (m_aborted) {
+            return;
+        }
+        m_localItems.remove(listing.item);
+        handleResults(listing);
+    }
+}
+
+void FileManagerListJob::handleResults(const Listing& listing)
 {
     if (m_aborted) {
         return;
     }
 
-#ifdef TIME_IMPORT_JOB
-    {
-        auto waited = m_subTimer.elapsed();
-        m_subWaited += waited;
-        qCDebug(PROJECT) << "TIME FOR SUB JOB:" << waited << m_subWaited;
+    const bool isLocal = listing.item->path().isLocalFile();
+    emit entries(this, listing.item, listing.files, listing.folders);
+    if (m_aborted) {
+        return;
     }
-#endif
 
-    emit entries(this, m_item, entriesIn);
-
-    if( m_listQueue.isEmpty() ) {
+    if (m_listQueue.isEmpty() && m_localItems.isEmpty() && !m_item) {
         emitResult();
 
 #ifdef TIME_IMPORT_JOB
         qCDebug(PROJECT) << "TIME FOR LISTJOB:" << m_timer.elapsed();
 #endif
-    } else {
+    } else if (!isLocal) {
         emit nextJob();
+    } else {
+        startNextJob();
     }
 }
 
@@ -21,9 +21,13 @@
 #define KDEVPLATFORM_FILEMANAGERLISTJOB_H
 
 #include <KIO/Job>
+#include <QMutex>
 #include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QWaitCondition>
 
-#include <mutex>
+#include <util/path.h>
 
 // uncomment to time import jobs
 // #define TIME_IMPORT_JOB
@@ -34,15 +38,24 @@
 
 namespace KDevelop
 {
+class IProjectFilter;
 class ProjectFolderItem;
 class ProjectBaseItem;
 
+/**
+ * Lists a folder and all its sub folders added through addSubDir().
+ *
+ * Local folders are listed concurrently in the background, where the entries are also checked
+ * against the project filters. Remote folders are listed one after the other through KIO.
+ */
 class FileManagerListJob : public KIO::Job
 {
     Q_OBJECT
 
 public:
-    explicit FileManagerListJob(ProjectFolderItem* item);
+    using Filters = QVector<QSharedPointer<IProjectFilter>>;
+
+    FileManagerListJob(ProjectFolderItem* item, const Filters& filters);
     virtual ~FileManagerListJob();
 
     void addSubDir(ProjectFolderItem* item);
@@ -52,30 +65,50 @@ public:
     void start() override;
 
 Q_SIGNALS:
+    /**
+     * The contents of @p baseItem that are not hidden by the project filters.
+     */
     void entries(FileManagerListJob* job, ProjectFolderItem* baseItem,
-                 const KIO::UDSEntryList& entries);
+                 const KDevelop::Path::List& files, const KDevelop::Path::List& folders);
     void nextJob();
 
 private Q_SLOTS:
     void slotEntries(KIO::Job* job, const KIO::UDSEntryList& entriesIn );
     void slotResult(KJob* job) override;
-    void handleResults(const KIO::UDSEntryList& entries);
+    void handleLocalResults();
     void startNextJob();
 
 private:
-
+    struct Listing
+    {
+        ProjectFolderItem* item;
+        Path::List files;
+        Path::List folders;
+    };
+
+    void listLocalFolder(ProjectFolderItem* item, const Path& path);
+    void handleResults(const Listing& listing);
+    void addEntry(Listing* listing, const Path& path, bool isDir, const QString& linkDest) const;
+
+    const Filters m_filters;
+    const Path m_projectPath;
     QQueue<ProjectFolderItem*> m_listQueue;
-    /// current base dir
-    ProjectFolderItem* m_item;
+    /// folder that is listed through KIO
+    ProjectFolderItem* m_item = nullptr;
     KIO::UDSEntryList entryList;
+    /// local folders that are listed in the background, or whose results are not yet handled
+    QSet<ProjectFolderItem*> m_localItems;
     // kill does not delete the job instantaneously
     QAtomicInt m_aborted;
-    std::recursive_mutex m_listing;
+
+    QMutex m_resultsMutex;
+    QWaitCondition m_listingDone;
+    /// count of background listings that may still access this job
+    int m_runningListings = 0;
+    QVector<Listing> m_results;
 
 #ifdef TIME_IMPORT_JOB
     QElapsedTimer m_timer;
-    QElapsedTimer m_subTimer;
-    qint64 m_subWaited = 0;
 #endif
 };
 
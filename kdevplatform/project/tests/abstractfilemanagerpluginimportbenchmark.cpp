@@ -37,11 +37,14 @@
 #include <KDirWatch>
 
 #include <QApplication>
+#include <QDir>
 #include <QList>
+#include <QFile>
 #include <QFileInfo>
 #include <QElapsedTimer>
 #include <QMap>
 #include <QDebug>
+#include <QTemporaryDir>
 #include <QTextStream>
 
 using namespace KDevelop;
@@ -124,14 +127,80 @@ private Q_SLOTS:
 int AbstractFileManagerPluginImportBenchmark::s_numBenchmarksRunning = 0;
 }
 
+namespace {
+
+/**
+ * Creates a tree of @p fileCount empty files below @p base.
+ *
+ * Each folder holds 100 files, a tenth of which are hidden by the default project filters,
+ * and up to 10 sub folders.
+ */
+bool createSyntheticTree(const QString& base, int fileCount)
+{
+    const int filesPerFolder = 100;
+    const int foldersPerFolder = 10;
+    const int folderCount = (fileCount + filesPerFolder - 1) / filesPerFolder;
+
+    int created = 0;
+    for (int folder = 0; folder < folderCount; ++folder) {
+        // folder n is the sub folder n % 10 of folder n / 10 - 1, the first ten are in the base folder
+        QString relativePath;
+        for (int n = folder; ; n = n / foldersPerFolder - 1) {
+            relativePath.prepend(QLatin1String("/folder") + QString::number(n % foldersPerFolder));
+            if (n < foldersPerFolder) {
+                break;
+            }
+        }
+        const QString path = base + relativePath;
+        if (!QDir().mkpath(path)) {
+            qWarning() << "failed to create" << path;
+            return false;
+        }
+        for (int i = 0; i < filesPerFolder && created < fileCount; ++i, ++created) {
+            const QString suffix = i % 10 ? QStringLiteral(".cpp") : QStringLiteral(".o");
+            QFile file(path + QLatin1String("/file") + QString::number(i) + suffix);
+            if (!file.open(QIODevice::WriteOnly)) {
+                qWarning() << "failed to create" << file.fileName();
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 2) {
         qWarning() << "Usage:" << argv[0] << "projectDir1 [...projectDirN]";
+        qWarning() << "       " << argv[0] << "--synthetic [fileCount]";
+        qWarning() << "The latter imports a generated project, with 1000000 files by default.";
         return 1;
     }
     QApplication app(argc, argv);
     QTextStream qout(stdout);
+
+    QStringList paths;
+    QTemporaryDir syntheticProject;
+    if (qstrcmp(argv[1], "--synthetic") == 0) {
+        const int fileCount = argc > 2 ? QByteArray(argv[2]).toInt() : 1000000;
+        if (fileCount <= 0 || !syntheticProject.isValid()) {
+            qWarning() << "cannot create a synthetic project with" << fileCount << "files";
+            return 1;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        if (!createSyntheticTree(syntheticProject.path(), fileCount)) {
+            return 1;
+        }
+        qout << "Creating " << fileCount << " files took " << timer.elapsed() / 1000.0 << " seconds" << endl;
+        paths << syntheticProject.path();
+    } else {
+        for (int i = 1 ; i < argc ; ++i) {
+            paths << QString::fromUtf8(argv[i]);
+        }
+    }
     // measure the total test time, this provides an indication
     // of overhead and how well multiple projects are imported in parallel
     // (= how different is the total time from the import time of the largest
@@ -154,8 +223,7 @@ int main(int argc, char** argv)
 
     QList<AbstractFileManagerPluginImportBenchmark*> benchmarks;
 
-    for (int i = 1 ; i < argc ; ++i) {
-        const QString path = QString::fromUtf8(argv[i]);
+    for (const QString& path : qAsConst(paths)) {
         if (QFileInfo(path).isDir()) {
             const auto benchmark = new AbstractFileManagerPluginImportBenchmark(manager, path, core);
             benchmarks << benchmark;
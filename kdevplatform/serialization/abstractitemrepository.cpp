@@ -30,6 +30,11 @@ AbstractItemRepository::~AbstractItemRepository()
 {
 }
 
+void AbstractItemRepository::snapshot(ItemRepositoryJournal& /*journal*/)
+{
+    store();
+}
+
 AbstractRepositoryManager::AbstractRepositoryManager()
 {
 }
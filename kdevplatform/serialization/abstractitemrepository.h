@@ -26,6 +26,8 @@
 class QString;
 
 namespace KDevelop {
+class ItemRepositoryJournal;
+
 /// Returns a version-number that is used to reset the item-repository after incompatible layout changes.
 KDEVPLATFORMSERIALIZATION_EXPORT uint staticItemRepositoryVersion();
 
@@ -40,6 +42,10 @@ public:
     virtual void close(bool doStore = false) = 0;
     /// Stores the repository contents to disk, eventually unloading unused data to save memory.
     virtual void store() = 0;
+    /// Records the changes since the last store into @p journal instead of writing them, and eventually
+    /// unloads unused data. The journal is written to disk later.
+    /// The default implementation stores synchronously.
+    virtual void snapshot(ItemRepositoryJournal& journal);
     /// Does a big cleanup, removing all non-persistent items in the repositories.
     /// @returns Count of bytes of data that have been removed.
     virtual int finalCleanup() = 0;
@@ -150,8 +150,10 @@ inline char indexToChar(uint index)
     return static_cast<char>(index & 0xff);
 }
 
-using IndexedStringRepository = ItemRepository<IndexedStringData, IndexedStringRepositoryItemRequest, false, false>;
-using IndexedStringRepositoryManagerBase = RepositoryManager<IndexedStringRepository, true, false>;
+using IndexedStringRepository = ItemRepository<IndexedStringData, IndexedStringRepositoryItemRequest, false, true, 0,
+        524288 * 2, true>;
+// Unloading is disabled, so the string data stays at a stable address and can be read without locking
+using IndexedStringRepositoryManagerBase = RepositoryManager<IndexedStringRepository, false, false>;
 class IndexedStringRepositoryManager
     : public IndexedStringRepositoryManagerBase
 {
@@ -173,19 +175,17 @@ IndexedStringRepository* globalIndexedStringRepository()
     return manager.repository();
 }
 
-template <typename ReadAction>
-auto readRepo(ReadAction action)->decltype(action(globalIndexedStringRepository()))
+/// Strings are never changed once they are created, so this does not need to lock the repository
+inline const IndexedStringData* itemFromIndex(uint index)
 {
-    const auto* repo = globalIndexedStringRepository();
-    QMutexLocker lock(repo->mutex());
-    return action(repo);
+    return globalIndexedStringRepository()->itemFromIndexLockFree(index);
 }
 
 template <typename EditAction>
 auto editRepo(EditAction action)->decltype(action(globalIndexedStringRepository()))
 {
     auto* repo = globalIndexedStringRepository();
-    QMutexLocker lock(repo->mutex());
+    IndexedStringRepository::ExclusiveLocker lock(repo);
     return action(repo);
 }
 
@@ -228,14 +228,16 @@ IndexedString::IndexedString(const char* str, unsigned short length, uint hash)
         m_index = charToIndex(str[0]);
     } else {
         const auto request = IndexedStringRepositoryItemRequest(str, hash ? hash : hashString(str, length), length);
-        bool refcount = shouldDoDUChainReferenceCounting(this);
-        m_index = editRepo([request, refcount](IndexedStringRepository* repo) {
-            auto index = repo->index(request);
-            if (refcount) {
+        if (shouldDoDUChainReferenceCounting(this)) {
+            m_index = editRepo([request](IndexedStringRepository* repo) {
+                auto index = repo->index(request);
                 increase(repo->dynamicItemFromIndexSimple(index)->refCount);
-            }
-            return index;
-        });
+                return index;
+            });
+        } else {
+            // the repository locks by itself, and only takes the shared lock when the string exists already
+            m_index = globalIndexedStringRepository()->index(request);
+        }
     }
 }
 
@@ -310,10 +312,7 @@ QString IndexedString::str() const
     } else if (isSingleCharIndex(m_index)) {
         return QString(QLatin1Char(indexToChar(m_index)));
     } else {
-        const uint index = m_index;
-        return readRepo([index](const IndexedStringRepository* repo) {
-            return stringFromItem(repo->itemFromIndex(index));
-        });
+        return stringFromItem(itemFromIndex(m_index));
     }
 }
 
@@ -329,9 +328,7 @@ int IndexedString::lengthFromIndex(uint index)
     } else if (isSingleCharIndex(index)) {
         return 1;
     } else {
-        return readRepo([index](const IndexedStringRepository* repo) {
-            return repo->itemFromIndex(index)->length;
-        });
+        return itemFromIndex(index)->length;
     }
 }
 
@@ -347,10 +344,7 @@ const char* IndexedString::c_str() const
 #endif
         return reinterpret_cast<const char*>(&m_index) + offset;
     } else {
-        const uint index = m_index;
-        return readRepo([index](const IndexedStringRepository* repo) {
-            return c_strFromItem(repo->itemFromIndex(index));
-        });
+        return c_strFromItem(itemFromIndex(m_index));
     }
 }
 
@@ -361,10 +355,7 @@ QByteArray IndexedString::byteArray() const
     } else if (isSingleCharIndex(m_index)) {
         return QByteArray(1, indexToChar(m_index));
     } else {
-        const uint index = m_index;
-        return readRepo([index](const IndexedStringRepository* repo) {
-            return arrayFromItem(repo->itemFromIndex(index));
-        });
+        return arrayFromItem(itemFromIndex(m_index));
     }
 }
 
@@ -387,9 +378,7 @@ uint IndexedString::indexForString(const char* str, short unsigned length, uint
         return charToIndex(str[0]);
     } else {
         const auto request = IndexedStringRepositoryItemRequest(str, hash ? hash : hashString(str, length), length);
-        return editRepo([request](IndexedStringRepository* repo) {
-            return repo->index(request);
-        });
+        return globalIndexedStringRepository()->index(request);
     }
 }
 
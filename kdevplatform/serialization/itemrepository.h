@@ -22,6 +22,9 @@
 #include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QThread>
 
 #include <KMessageBox>
 #include <KLocalizedString>
@@ -30,6 +33,8 @@
 #include "abstractitemrepository.h"
 #include "repositorymanager.h"
 #include "itemrepositoryregistry.h"
+#include "itemrepositoryfilemap.h"
+#include "itemrepositoryjournal.h"
 
 //#define DEBUG_MONSTERBUCKETS
 
@@ -56,6 +61,12 @@
 
 #define ITEMREPOSITORY_USE_MMAP_LOADING
 
+///Use a shared writable mapping of the whole repository file as storage, see ItemRepositoryFileMap.
+///Needs enough address space to reserve the maximum size of every repository, so it is only used on 64-bit systems.
+#if defined(Q_OS_UNIX) && QT_POINTER_SIZE == 8
+#define ITEMREPOSITORY_USE_MMAP_STORAGE
+#endif
+
 //Assertion macro that prevents warnings if debugging is disabled
 //Only use it to verify values, it should not call any functions, since else the function will even be called in release mode
 #ifdef QT_NO_DEBUG
@@ -190,6 +201,62 @@ public:
         }
     }
 
+    template <class T>
+    void writeValue(char*& to, const T& from)
+    {
+        *reinterpret_cast<T*>(to) = from;
+        to += sizeof(T);
+    }
+
+    ///Writes the bucket in the same layout as store(QFile*, size_t) to memory, which must be
+    ///storedSize() bytes large. Used to store into a repository file mapping.
+    void store(char* current)
+    {
+        if (!m_data)
+            return;
+        //Only changed buckets are stored, and those always have a private copy of the data
+        Q_ASSERT(m_data != m_mappedData);
+
+        char* start = current;
+        writeValue(current, m_monsterBucketExtent);
+        writeValue(current, m_available);
+        memcpy(current, m_objectMap, sizeof(short unsigned int) * ObjectMapSize);
+        current += sizeof(short unsigned int) * ObjectMapSize;
+        memcpy(current, m_nextBucketHash, sizeof(short unsigned int) * NextBucketHashSize);
+        current += sizeof(short unsigned int) * NextBucketHashSize;
+        writeValue(current, m_largestFreeItem);
+        writeValue(current, m_freeItemCount);
+        writeValue(current, m_dirty);
+        Q_ASSERT(current - start == (DataSize - ItemRepositoryBucketSize));
+        memcpy(current, m_data, ItemRepositoryBucketSize + m_monsterBucketExtent * DataSize);
+
+        m_changed = false;
+    }
+
+    ///Count of bytes store() writes
+    size_t storedSize() const
+    {
+        return static_cast<size_t>(1 + m_monsterBucketExtent) * DataSize;
+    }
+
+    ///Frees the private copy of the data, and uses the given memory-mapped data again, which must have just been
+    ///written by store(char*). Invalidates all pointers to items in this bucket.
+    void dropPrivateData(char* current)
+    {
+        Q_ASSERT(!m_changed);
+        if (m_data == m_mappedData)
+            return;
+
+        delete[] m_data;
+        delete[] m_nextBucketHash;
+        delete[] m_objectMap;
+        m_data = nullptr;
+
+        const int lastUsed = m_lastUsed;
+        initializeFromMap(current);
+        m_lastUsed = lastUsed;
+    }
+
     void store(QFile* file, size_t offset)
     {
         if (!m_data)
@@ -1029,6 +1096,43 @@ struct Locker<true>
     QMutex* m_mutex;
 };
 
+///Entry of the bucket list of an ItemRepository. Readers of a concurrent repository load buckets on demand
+///while others look at the list, so the pointers are published with release and read with acquire semantics.
+template <class Bucket>
+class BucketPointer
+{
+public:
+    BucketPointer(Bucket* bucket = nullptr)
+        : m_bucket(bucket)
+    {
+    }
+    BucketPointer(const BucketPointer& other)
+        : m_bucket(other.m_bucket.loadAcquire())
+    {
+    }
+    BucketPointer& operator=(const BucketPointer& other)
+    {
+        m_bucket.storeRelease(other.m_bucket.loadAcquire());
+        return *this;
+    }
+    BucketPointer& operator=(Bucket* bucket)
+    {
+        m_bucket.storeRelease(bucket);
+        return *this;
+    }
+    operator Bucket*() const
+    {
+        return m_bucket.loadAcquire();
+    }
+    Bucket* operator->() const
+    {
+        return m_bucket.loadAcquire();
+    }
+
+private:
+    QAtomicPointer<Bucket> m_bucket;
+};
+
 ///This object needs to be kept alive as long as you change the contents of an item
 ///stored in the repository. It is needed to correctly track the reference counting
 ///within disk-storage.
@@ -1084,13 +1188,17 @@ private:
 ///                                that does on-disk reference counting, like IndexedString, IndexedIdentifier, etc.
 ///@tparam threadSafe Whether class access should be thread-safe. Disabling this is dangerous when you do multi-threading.
 ///                  You have to make sure that mutex() is locked whenever the repository is accessed.
+///@tparam concurrent Whether multiple readers may access the repository at the same time. Lookups through index(),
+///                   findIndex() and itemFromIndex() then only take a shared lock, while everything that changes the
+///                   repository additionally takes it exclusively. mutex() is still locked by all writers, so holding
+///                   it keeps out other writers just like before, but it does not keep out readers any more.
+///                   A concurrent repository always does its own locking, independently of @p threadSafe.
+///                   Use ExclusiveLocker to keep items valid across multiple calls, and to change items.
 template <class Item, class ItemRequest, bool markForReferenceCounting = true, bool threadSafe = true,
-    uint fixedItemSize = 0, unsigned int targetBucketHashSize = 524288 * 2>
+    uint fixedItemSize = 0, unsigned int targetBucketHashSize = 524288 * 2, bool concurrent = false>
 class ItemRepository
     : public AbstractItemRepository
 {
-    using ThisLocker = Locker<threadSafe>;
-
     using MyBucket = Bucket<Item, ItemRequest, markForReferenceCounting, fixedItemSize>;
 
     enum {
@@ -1099,6 +1207,52 @@ class ItemRepository
         bucketHashSize = (targetBucketHashSize / MyBucket::ObjectMapSize) * MyBucket::ObjectMapSize
     };
 
+    enum {
+        //Count of independently locked stripes that guard on-demand loading of buckets in concurrent mode
+        BucketLoadStripes = concurrent ? 64 : 1,
+        //Count of slots in the table of published bucket data used by itemFromIndexLockFree()
+        PublishedBucketSlots = concurrent ? ItemRepositoryBucketLimit : 1
+    };
+
+    enum LockMode {
+        SharedAccess,
+        ExclusiveAccess
+    };
+
+    ///Guards the internal accesses. Does nothing if the repository is neither thread-safe nor concurrent.
+    class ThisLocker
+    {
+    public:
+        ThisLocker(const ItemRepository* repository, LockMode mode)
+            : m_repository((threadSafe || concurrent) ? repository : nullptr)
+            , m_mode(mode)
+        {
+            if (m_repository) {
+                if (m_mode == SharedAccess) {
+                    m_locked = m_repository->lockShared();
+                } else {
+                    m_repository->lockExclusive();
+                    m_locked = true;
+                }
+            }
+        }
+        ~ThisLocker()
+        {
+            if (m_locked) {
+                if (m_mode == SharedAccess)
+                    m_repository->unlockShared();
+                else
+                    m_repository->unlockExclusive();
+            }
+        }
+
+    private:
+        const ItemRepository* m_repository;
+        LockMode m_mode;
+        bool m_locked = false;
+        Q_DISABLE_COPY(ThisLocker)
+    };
+
     enum {
         BucketStartOffset = sizeof(uint) * 7 + sizeof(short unsigned int) * bucketHashSize //Position in the data where the bucket array starts
     };
@@ -1146,12 +1300,39 @@ public:
         m_unloadingEnabled = enabled;
     }
 
+    ///Locks the repository exclusively while it is alive. Can be nested within one thread, also around
+    ///calls to the repository itself. For repositories that are not concurrent, this just locks mutex().
+    class ExclusiveLocker
+    {
+    public:
+        explicit ExclusiveLocker(const ItemRepository* repository)
+            : m_repository(repository)
+        {
+            m_repository->lockExclusive();
+        }
+        ~ExclusiveLocker()
+        {
+            m_repository->unlockExclusive();
+        }
+
+    private:
+        const ItemRepository* m_repository;
+        Q_DISABLE_COPY(ExclusiveLocker)
+    };
+
     ///Returns the index for the given item. If the item is not in the repository yet, it is inserted.
     ///The index can never be zero. Zero is reserved for your own usage as invalid
     ///@param request Item to retrieve the index from
     unsigned int index(const ItemRequest& request)
     {
-        ThisLocker lock(m_mutex);
+        if (concurrent) {
+            //Most requests are for items that already exist, so first look for them with only the shared lock held.
+            //If the item is not found, the chain is walked again below, so items inserted in between are found there.
+            if (const uint existingIndex = findIndex(request))
+                return existingIndex;
+        }
+
+        ThisLocker lock(this, ExclusiveAccess);
 
         const uint hash = request.hash();
         const uint size = request.itemSize();
@@ -1388,6 +1569,9 @@ public:
                 if (reOrderFreeSpaceBucketIndex != -1)
                     updateFreeSpaceOrder(reOrderFreeSpaceBucketIndex);
 
+                //Creating the item may have made the bucket data private, so lock-free readers need the new address
+                publishBucketData(useBucket);
+
                 return createIndex(useBucket, indexInBucket);
             } else {
                 //This should never happen when we picked a bucket for re-use
@@ -1412,7 +1596,7 @@ public:
     ///Returns zero if the item is not in the repository yet
     unsigned int findIndex(const ItemRequest& request)
     {
-        ThisLocker lock(m_mutex);
+        ThisLocker lock(this, SharedAccess);
 
         return walkBucketChain(request.hash(), [this, &request](ushort bucketIdx, const MyBucket* bucketPtr) {
                 const ushort indexInBucket = bucketPtr->findIndex(request);
@@ -1424,7 +1608,7 @@ public:
     void deleteItem(unsigned int index)
     {
         verifyIndex(index);
-        ThisLocker lock(m_mutex);
+        ThisLocker lock(this, ExclusiveAccess);
 
         m_metaDataChanged = true;
 
@@ -1507,11 +1691,12 @@ public:
     ///@param index The index. It must be valid(match an existing item), and nonzero.
     ///@warning If you use this, make sure you lock mutex() before calling,
     ///         and hold it until you're ready using/changing the data..
+    ///         For concurrent repositories, use an ExclusiveLocker instead if readers may access the changed data.
     MyDynamicItem dynamicItemFromIndex(unsigned int index)
     {
         verifyIndex(index);
 
-        ThisLocker lock(m_mutex);
+        ThisLocker lock(this, ExclusiveAccess);
 
         unsigned short bucket = (index >> 16);
 
@@ -1521,6 +1706,7 @@ public:
             bucketPtr = m_buckets.at(bucket);
         }
         bucketPtr->prepareChange();
+        publishBucketData(bucket);
         unsigned short indexInBucket = index & 0xffff;
         return MyDynamicItem(const_cast<Item*>(bucketPtr->itemFromIndex(indexInBucket)),
                              bucketPtr->data(), bucketPtr->dataSize());
@@ -1531,13 +1717,14 @@ public:
     ///@param index The index. It must be valid(match an existing item), and nonzero.
     ///@warning If you use this, make sure you lock mutex() before calling,
     ///         and hold it until you're ready using/changing the data..
+    ///         For concurrent repositories, use an ExclusiveLocker instead if readers may access the changed data.
     ///@warning If you change contained complex items that depend on reference-counting, you
     ///         must use dynamicItemFromIndex(..) instead of dynamicItemFromIndexSimple(..)
     Item* dynamicItemFromIndexSimple(unsigned int index)
     {
         verifyIndex(index);
 
-        ThisLocker lock(m_mutex);
+        ThisLocker lock(this, ExclusiveAccess);
 
         unsigned short bucket = (index >> 16);
 
@@ -1547,6 +1734,7 @@ public:
             bucketPtr = m_buckets.at(bucket);
         }
         bucketPtr->prepareChange();
+        publishBucketData(bucket);
         unsigned short indexInBucket = index & 0xffff;
         return const_cast<Item*>(bucketPtr->itemFromIndex(indexInBucket));
     }
@@ -1556,19 +1744,34 @@ public:
     {
         verifyIndex(index);
 
-        ThisLocker lock(m_mutex);
+        ThisLocker lock(this, SharedAccess);
 
         unsigned short bucket = (index >> 16);
 
-        const MyBucket* bucketPtr = m_buckets.at(bucket);
-        if (!bucketPtr) {
-            initializeBucket(bucket);
-            bucketPtr = m_buckets.at(bucket);
-        }
+        const MyBucket* bucketPtr = bucketForIndex(bucket);
         unsigned short indexInBucket = index & 0xffff;
         return bucketPtr->itemFromIndex(indexInBucket);
     }
 
+    ///Same as itemFromIndex(), but without taking any lock once the bucket of the item has been loaded.
+    ///Buckets that were mapped from disk stay mapped until the repository is closed, and buckets that were
+    ///copied into memory are only freed when they are deleted or unloaded. So as long as unloading is disabled
+    ///and the item is referenced, the returned data is stable, even while other threads change the repository.
+    ///@warning Only available for concurrent repositories with disabled unloading, @see setUnloadingEnabled()
+    ///@warning Only use this for data of the item that is never changed after creation.
+    const Item* itemFromIndexLockFree(unsigned int index) const
+    {
+        Q_ASSERT(concurrent && !m_unloadingEnabled);
+        verifyIndex(index);
+
+        const unsigned short bucket = (index >> 16);
+        if (const char* data = m_publishedBucketData[bucket].loadAcquire())
+            return reinterpret_cast<const Item*>(data + (index & 0xffff));
+
+        //The bucket has not been loaded yet, loading it also publishes its data
+        return itemFromIndex(index);
+    }
+
     struct Statistics
     {
         Statistics()
@@ -1759,7 +1962,7 @@ public:
     template <class Visitor>
     void visitAllItems(Visitor& visitor, bool onlyInMemory = false) const
     {
-        ThisLocker lock(m_mutex);
+        ThisLocker lock(this, ExclusiveAccess);
         for (int a = 1; a <= m_currentBucket; ++a) {
             if (!onlyInMemory || m_buckets.at(a)) {
                 if (bucketForIndex(a) && !bucketForIndex(a)->visitAllItems(visitor))
@@ -1772,8 +1975,13 @@ public:
     ///Should be called on a regular basis. Can be called centrally from the global item repository registry.
     void store() override
     {
-        QMutexLocker lock(m_mutex);
+        ExclusiveLocker lock(this);
         if (m_file) {
+            //Snapshots that are still being written must not overwrite the newer data written here
+            if (m_registry)
+                m_registry->waitForPendingStore();
+            m_pendingBuckets.clear();
+
             if (!m_file->open(QFile::ReadWrite) || !m_dynamicFile->open(QFile::ReadWrite)) {
                 qFatal("cannot re-open repository file for storing");
                 return;
@@ -1784,40 +1992,24 @@ public:
                     if (m_buckets[a]->changed()) {
                         storeBucket(a);
                     }
-                    if (m_unloadingEnabled) {
-                        const int unloadAfterTicks = 2;
-                        if (m_buckets[a]->lastUsed() > unloadAfterTicks) {
-                            delete m_buckets[a];
-                            m_buckets[a] = nullptr;
-                        } else {
-                            m_buckets[a]->tick();
-                        }
-                    }
+                    unloadOrTick(a);
                 }
             }
 
+            if (m_fileStorage.isOpen() && !m_fileStorage.sync()) {
+                KMessageBox::error(nullptr, i18n("Failed writing to %1, probably the disk is full", m_file->fileName()));
+                abort();
+            }
+
             if (m_metaDataChanged) {
                 Q_ASSERT(m_dynamicFile);
 
                 m_file->seek(0);
-                m_file->write(( char* )&m_repositoryVersion, sizeof(uint));
-                uint hashSize = bucketHashSize;
-                m_file->write(( char* )&hashSize, sizeof(uint));
-                uint itemRepositoryVersion  = staticItemRepositoryVersion();
-                m_file->write(( char* )&itemRepositoryVersion, sizeof(uint));
-                m_file->write(( char* )&m_statBucketHashClashes, sizeof(uint));
-                m_file->write(( char* )&m_statItemCount, sizeof(uint));
-
-                const uint bucketCount = static_cast<uint>(m_buckets.size());
-                m_file->write(( char* )&bucketCount, sizeof(uint));
-                m_file->write(( char* )&m_currentBucket, sizeof(uint));
-                m_file->write(( char* )m_firstBucketForHash, sizeof(short unsigned int) * bucketHashSize);
+                m_file->write(metaData());
                 Q_ASSERT(m_file->pos() == BucketStartOffset);
 
                 m_dynamicFile->seek(0);
-                const uint freeSpaceBucketsSize = static_cast<uint>(m_freeSpaceBuckets.size());
-                m_dynamicFile->write(( char* )&freeSpaceBucketsSize, sizeof(uint));
-                m_dynamicFile->write(( char* )m_freeSpaceBuckets.data(), sizeof(uint) * freeSpaceBucketsSize);
+                m_dynamicFile->write(dynamicData());
             }
             //To protect us from inconsistency due to crashes. flush() is not enough. We need to close.
             m_file->close();
@@ -1827,12 +2019,59 @@ public:
         }
     }
 
+    ///Like store(), but only copies the changed data into @p journal, which is written to disk later.
+    ///Buckets stay loaded until the journal that contains them is completely written.
+    void snapshot(ItemRepositoryJournal& journal) override
+    {
+        ExclusiveLocker lock(this);
+        if (!m_file)
+            return;
+
+        for (auto it = m_pendingBuckets.begin(); it != m_pendingBuckets.end();) {
+            if (*it <= journal.completedGeneration())
+                it = m_pendingBuckets.erase(it);
+            else
+                ++it;
+        }
+
+        for (int a = 0; a < m_buckets.size(); ++a) {
+            if (m_buckets[a]) {
+                MyBucket* bucketPtr = m_buckets[a];
+                if (bucketPtr->changed()) {
+                    const size_t offset = static_cast<size_t>(a - 1) * MyBucket::DataSize;
+                    QByteArray data(static_cast<int>(bucketPtr->storedSize()), Qt::Uninitialized);
+                    bucketPtr->store(data.data());
+                    journal.addWrite(m_repositoryName, BucketStartOffset + offset, data);
+                    m_pendingBuckets[a] = journal.generation();
+
+                    //Grow the file right away, so the mapping covers the bucket once the journal is applied
+                    if (m_fileStorage.isOpen()) {
+                        if (!m_fileStorage.reserve(offset + data.size())) {
+                            KMessageBox::error(nullptr, i18n("Failed writing to %1, probably the disk is full",
+                                                             m_file->fileName()));
+                            abort();
+                        }
+                        m_fileMapSize = m_fileStorage.size();
+                    }
+                }
+                unloadOrTick(a);
+            }
+        }
+
+        if (m_metaDataChanged) {
+            journal.addWrite(m_repositoryName, 0, metaData());
+            journal.addWrite(m_repositoryName + QLatin1String("_dynamic"), 0, dynamicData(), true);
+        }
+    }
+
     ///This mutex is used for the thread-safe locking when threadSafe is true. Even if threadSafe is false, it is
     ///always locked before storing to or loading from disk.
     ///@warning If threadSafe is false, and you sometimes call store() from within another thread(As happens in duchain),
     ///         you must always make sure that this mutex is locked before you access this repository.
     ///         Else you will get crashes and inconsistencies.
     ///         In KDevelop This means: Make sure you _always_ lock this mutex before accessing the repository.
+    ///@note For concurrent repositories, this mutex only serializes the writers. Readers are not blocked by it,
+    ///      use an ExclusiveLocker when readers need to be kept out as well.
     QMutex* mutex() const
     {
         return m_mutex;
@@ -1851,6 +2090,64 @@ public:
 
 private:
 
+    ///Returns whether the lock was actually taken. It is not when the current thread already holds the exclusive lock.
+    bool lockShared() const
+    {
+        if (!concurrent) {
+            m_mutex->lock();
+            return true;
+        }
+
+        if (m_exclusiveOwner.loadAcquire() == QThread::currentThread())
+            return false;
+
+        m_concurrentLock.lockForRead();
+        return true;
+    }
+
+    void unlockShared() const
+    {
+        if (!concurrent)
+            m_mutex->unlock();
+        else
+            m_concurrentLock.unlock();
+    }
+
+    void lockExclusive() const
+    {
+        if (!concurrent) {
+            m_mutex->lock();
+            return;
+        }
+
+        QThread* const currentThread = QThread::currentThread();
+        if (m_exclusiveOwner.loadAcquire() == currentThread) {
+            ++m_exclusiveRecursion;
+            return;
+        }
+
+        //The mutex is always locked first, so this cannot dead-lock with repositories that share the mutex
+        m_mutex->lock();
+        m_concurrentLock.lockForWrite();
+        m_exclusiveOwner.storeRelease(currentThread);
+        m_exclusiveRecursion = 1;
+    }
+
+    void unlockExclusive() const
+    {
+        if (!concurrent) {
+            m_mutex->unlock();
+            return;
+        }
+
+        Q_ASSERT(m_exclusiveOwner.loadAcquire() == QThread::currentThread());
+        if (--m_exclusiveRecursion == 0) {
+            m_exclusiveOwner.storeRelease(nullptr);
+            m_concurrentLock.unlock();
+            m_mutex->unlock();
+        }
+    }
+
     uint createIndex(ushort bucketIndex, ushort indexInBucket)
     {
         //Combine the index in the bucket, and the bucket number into one index
@@ -1870,11 +2167,7 @@ private:
         unsigned short bucketIndex = m_firstBucketForHash[hash % bucketHashSize];
 
         while (bucketIndex) {
-            auto* bucketPtr = m_buckets.at(bucketIndex);
-            if (!bucketPtr) {
-                initializeBucket(bucketIndex);
-                bucketPtr = m_buckets.at(bucketIndex);
-            }
+            auto* bucketPtr = bucketForIndex(bucketIndex);
 
             if (auto visitResult = visitor(bucketIndex, bucketPtr)) {
                 return visitResult;
@@ -1966,6 +2259,7 @@ private:
             m_buckets[bucketNumber] = new MyBucket();
 
             m_buckets[bucketNumber]->initialize(extent);
+            publishBucketData(bucketNumber);
 
 #ifdef DEBUG_MONSTERBUCKETS
 
@@ -1985,6 +2279,7 @@ private:
                 m_buckets[index] = new MyBucket();
 
                 m_buckets[index]->initialize(0);
+                publishBucketData(index);
                 Q_ASSERT(!m_buckets[index]->monsterBucketExtent());
             }
         }
@@ -1995,7 +2290,13 @@ private:
     {
         MyBucket* bucketPtr = m_buckets.at(index);
         if (!bucketPtr) {
-            initializeBucket(index);
+            if (concurrent) {
+                //Readers only hold the shared lock, so loading is serialized per lock stripe
+                QMutexLocker lock(&m_bucketLoadStripes[index % BucketLoadStripes]);
+                initializeBucket(index);
+            } else {
+                initializeBucket(index);
+            }
             bucketPtr = m_buckets.at(index);
         }
         return bucketPtr;
@@ -2003,7 +2304,7 @@ private:
 
     bool open(const QString& path) override
     {
-        QMutexLocker lock(m_mutex);
+        ExclusiveLocker lock(this);
 
         close();
         //qDebug() << "opening repository" << m_repositoryName << "at" << path;
@@ -2097,8 +2398,16 @@ private:
         m_fileMapSize = 0;
         m_fileMap = nullptr;
 
+#ifdef ITEMREPOSITORY_USE_MMAP_STORAGE
+        m_file->flush();
+        if (m_fileStorage.open(m_file->fileName(), BucketStartOffset,
+                               static_cast<size_t>(ItemRepositoryBucketLimit) * MyBucket::DataSize)) {
+            m_fileMap = reinterpret_cast<uchar*>(m_fileStorage.data());
+            m_fileMapSize = m_fileStorage.size();
+        }
+#endif
 #ifdef ITEMREPOSITORY_USE_MMAP_LOADING
-        if (m_file->size() > BucketStartOffset) {
+        if (!m_fileMap && m_file->size() > BucketStartOffset) {
             m_fileMap = m_file->map(BucketStartOffset, m_file->size() - BucketStartOffset);
             Q_ASSERT(m_file->isOpen());
             Q_ASSERT(m_file->size() >= BucketStartOffset);
@@ -2134,8 +2443,13 @@ private:
         delete m_dynamicFile;
         m_dynamicFile = nullptr;
 
+        for (int a = 0; a < m_buckets.size(); ++a)
+            unpublishBucketData(a);
         qDeleteAll(m_buckets);
         m_buckets.clear();
+        m_pendingBuckets.clear();
+        //Only after the buckets are gone, since they may point into the mapping
+        m_fileStorage.close();
 
         memset(m_firstBucketForHash, 0, bucketHashSize * sizeof(short unsigned int));
     }
@@ -2178,7 +2492,7 @@ private:
 
     int finalCleanup() override
     {
-        ThisLocker lock(m_mutex);
+        ThisLocker lock(this, ExclusiveAccess);
 
         int changed = 0;
         for (int a = 1; a <= m_currentBucket; ++a) {
@@ -2206,18 +2520,24 @@ private:
 #endif
 
         if (!m_buckets[bucketNumber]) {
-            m_buckets[bucketNumber] = new MyBucket();
+            //The bucket is only published once it is completely initialized, since concurrent readers
+            //look at m_buckets without holding the lock stripe of the bucket.
+            auto* bucketPtr = new MyBucket();
 
             bool doMMapLoading = ( bool )m_fileMap;
 
             uint offset = ((bucketNumber - 1) * MyBucket::DataSize);
             if (m_file && offset < m_fileMapSize && doMMapLoading &&
-                *reinterpret_cast<uint*>(m_fileMap + offset) == 0) {
+                (*reinterpret_cast<uint*>(m_fileMap + offset) == 0 || mappedMonsterBucket(bucketNumber))) {
 //         qDebug() << "loading bucket mmap:" << bucketNumber;
-                m_buckets[bucketNumber]->initializeFromMap(reinterpret_cast<char*>(m_fileMap + offset));
+                bucketPtr->initializeFromMap(reinterpret_cast<char*>(m_fileMap + offset));
+            } else if (m_fileStorage.isOpen()) {
+                //The whole file is mapped, so the bucket is not stored yet
+                bucketPtr->initialize(0);
             } else if (m_file) {
                 //Either memory-mapping is disabled, or the item is not in the existing memory-map,
                 //so we have to load it the classical way.
+                QMutexLocker fileLock(concurrent ? &m_fileLoadMutex : nullptr);
                 bool res = m_file->open(QFile::ReadOnly);
 
                 if (offset + BucketStartOffset < m_file->size()) {
@@ -2229,34 +2549,136 @@ private:
                     m_file->seek(offset);
                     ///FIXME: use the data here instead of copying it again in prepareChange
                     QByteArray data = m_file->read((1 + monsterBucketExtent) * MyBucket::DataSize);
-                    m_buckets[bucketNumber]->initializeFromMap(data.data());
-                    m_buckets[bucketNumber]->prepareChange();
+                    bucketPtr->initializeFromMap(data.data());
+                    bucketPtr->prepareChange();
                 } else {
-                    m_buckets[bucketNumber]->initialize(0);
+                    bucketPtr->initialize(0);
                 }
 
                 m_file->close();
             } else {
-                m_buckets[bucketNumber]->initialize(0);
+                bucketPtr->initialize(0);
             }
+
+            m_buckets[bucketNumber] = bucketPtr;
+            publishBucketData(bucketNumber);
         } else {
             m_buckets[bucketNumber]->initialize(0);
         }
     }
 
+    ///Whether the given bucket is a monster-bucket that can be used directly from the file storage mapping
+    bool mappedMonsterBucket(int bucketNumber) const
+    {
+        if (!m_fileStorage.isOpen())
+            return false;
+        const size_t offset = static_cast<size_t>(bucketNumber - 1) * MyBucket::DataSize;
+        const uint extent = *reinterpret_cast<uint*>(m_fileMap + offset);
+        return extent < static_cast<uint>(ItemRepositoryBucketLimit - bucketNumber) &&
+               offset + (1 + extent) * static_cast<size_t>(MyBucket::DataSize) <= m_fileMapSize;
+    }
+
     ///Can only be called on empty buckets
     void deleteBucket(int bucketNumber)
     {
         Q_ASSERT(bucketForIndex(bucketNumber)->isEmpty());
         Q_ASSERT(bucketForIndex(bucketNumber)->noNextBuckets());
+        unpublishBucketData(bucketNumber);
         delete m_buckets[bucketNumber];
         m_buckets[bucketNumber] = nullptr;
     }
 
+    ///Makes the current data address of the given loaded bucket visible to itemFromIndexLockFree()
+    inline void publishBucketData(int bucketNumber) const
+    {
+        if (concurrent)
+            m_publishedBucketData[bucketNumber].storeRelease(m_buckets[bucketNumber]->data());
+    }
+
+    inline void unpublishBucketData(int bucketNumber) const
+    {
+        if (concurrent)
+            m_publishedBucketData[bucketNumber].storeRelease(nullptr);
+    }
+
+    ///Unloads the given bucket if it was not used for a while. Else the private copy of its data is dropped
+    ///if it matches the data on disk.
+    void unloadOrTick(int bucketNumber)
+    {
+        if (!m_unloadingEnabled)
+            return;
+
+        MyBucket* bucketPtr = m_buckets[bucketNumber];
+        if (m_pendingBuckets.contains(bucketNumber)) {
+            //The data on disk is outdated until the pending snapshot is written
+            bucketPtr->tick();
+            return;
+        }
+
+        const int unloadAfterTicks = 2;
+        if (bucketPtr->lastUsed() > unloadAfterTicks) {
+            unpublishBucketData(bucketNumber);
+            delete bucketPtr;
+            m_buckets[bucketNumber] = nullptr;
+        } else {
+            bucketPtr->tick();
+            if (m_fileStorage.isOpen() && !bucketPtr->changed()) {
+                //The stored data is in the mapping now, so the private copy is not needed any more
+                bucketPtr->dropPrivateData(m_fileStorage.data() + (bucketNumber - 1) * MyBucket::DataSize);
+                publishBucketData(bucketNumber);
+            }
+        }
+    }
+
+    ///The header of m_file, BucketStartOffset bytes
+    QByteArray metaData() const
+    {
+        QByteArray ret;
+        ret.reserve(BucketStartOffset);
+        auto append = [&ret](const void* data, size_t size) {
+                          ret.append(static_cast<const char*>(data), static_cast<int>(size));
+                      };
+
+        append(&m_repositoryVersion, sizeof(uint));
+        const uint hashSize = bucketHashSize;
+        append(&hashSize, sizeof(uint));
+        const uint itemRepositoryVersion = staticItemRepositoryVersion();
+        append(&itemRepositoryVersion, sizeof(uint));
+        append(&m_statBucketHashClashes, sizeof(uint));
+        append(&m_statItemCount, sizeof(uint));
+        const uint bucketCount = static_cast<uint>(m_buckets.size());
+        append(&bucketCount, sizeof(uint));
+        append(&m_currentBucket, sizeof(uint));
+        append(m_firstBucketForHash, sizeof(short unsigned int) * bucketHashSize);
+        Q_ASSERT(ret.size() == BucketStartOffset);
+        return ret;
+    }
+
+    ///The contents of m_dynamicFile
+    QByteArray dynamicData() const
+    {
+        const uint freeSpaceBucketsSize = static_cast<uint>(m_freeSpaceBuckets.size());
+        QByteArray ret(reinterpret_cast<const char*>(&freeSpaceBucketsSize), sizeof(uint));
+        ret.append(reinterpret_cast<const char*>(m_freeSpaceBuckets.data()), sizeof(uint) * freeSpaceBucketsSize);
+        return ret;
+    }
+
     //m_file must be opened
     void storeBucket(int bucketNumber) const
     {
-        if (m_file && m_buckets[bucketNumber]) {
+        if (m_fileStorage.isOpen() && m_buckets[bucketNumber]) {
+            MyBucket* bucketPtr = m_buckets[bucketNumber];
+            const size_t offset = static_cast<size_t>(bucketNumber - 1) * MyBucket::DataSize;
+            const size_t size = bucketPtr->storedSize();
+            if (!m_fileStorage.reserve(offset + size)) {
+                KMessageBox::error(nullptr, i18n("Failed writing to %1, probably the disk is full", m_file->fileName()));
+                abort();
+            }
+            m_fileMapSize = m_fileStorage.size();
+
+            bucketPtr->store(m_fileStorage.beginWrite(offset, size));
+            m_fileStorage.endWrite(offset, size);
+        } else if (m_file && m_buckets[bucketNumber]) {
             m_buckets[bucketNumber]->store(m_file, BucketStartOffset + (bucketNumber - 1) * MyBucket::DataSize);
         }
     }
@@ -2344,11 +2766,19 @@ private:
     bool m_metaDataChanged;
     mutable QMutex m_ownMutex;
     mutable QMutex* m_mutex;
+    //Only used in concurrent mode. m_exclusiveOwner and m_exclusiveRecursion are protected by m_concurrentLock
+    mutable QReadWriteLock m_concurrentLock;
+    mutable QAtomicPointer<QThread> m_exclusiveOwner;
+    mutable int m_exclusiveRecursion = 0;
+    mutable QMutex m_bucketLoadStripes[BucketLoadStripes];
+    mutable QMutex m_fileLoadMutex;
+    //Data addresses of the loaded buckets, for itemFromIndexLockFree(). Only used in concurrent mode
+    mutable QAtomicPointer<char> m_publishedBucketData[PublishedBucketSlots];
     QString m_repositoryName;
     mutable int m_currentBucket;
     //List of buckets that have free space available that can be assigned. Sorted by size: Smallest space first. Second order sorting: Bucket index
     QVector<uint> m_freeSpaceBuckets;
-    mutable QVector<MyBucket*> m_buckets;
+    mutable QVector<BucketPointer<MyBucket>> m_buckets;
     uint m_statBucketHashClashes, m_statItemCount;
     //Maps hash-values modulo 1<<bucketHashSizeBits to the first bucket such a hash-value appears in
     short unsigned int m_firstBucketForHash[bucketHashSize];
@@ -2356,8 +2786,13 @@ private:
     ItemRepositoryRegistry* m_registry;
     //File that contains the buckets
     QFile* m_file;
+    //Either points into m_fileStorage, or is a read-only mapping of m_file
     uchar* m_fileMap;
-    uint m_fileMapSize;
+    mutable size_t m_fileMapSize;
+    //Shared mapping of m_file that buckets are stored into, if ITEMREPOSITORY_USE_MMAP_STORAGE is enabled and mapping worked
+    mutable ItemRepositoryFileMap m_fileStorage;
+    //Maps buckets that are recorded in a journal which is not written yet to the journal generation
+    QHash<int, uint> m_pendingBuckets;
     //File that contains more dynamic data, like the list of buckets with deleted items
     QFile* m_dynamicFile;
     uint m_repositoryVersion;
@@ -0,0 +1,191 @@
+/* This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#include "itemrepositoryfilemap.h"
+
+#include "debug.h"
+
+#include <QFile>
+
+#include <algorithm>
+
+#if defined(Q_OS_UNIX) && QT_POINTER_SIZE == 8
+#define ITEMREPOSITORYFILEMAP_SUPPORTED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace KDevelop {
+namespace {
+size_t pageSize()
+{
+#ifdef ITEMREPOSITORYFILEMAP_SUPPORTED
+    static const size_t size = sysconf(_SC_PAGESIZE);
+    return size;
+#else
+    return 4096;
+#endif
+}
+}
+
+ItemRepositoryFileMap::ItemRepositoryFileMap()
+{
+}
+
+ItemRepositoryFileMap::~ItemRepositoryFileMap()
+{
+    close();
+}
+
+bool ItemRepositoryFileMap::open(const QString& fileName, size_t headerSize, size_t reservedSize)
+{
+    close();
+#ifdef ITEMREPOSITORYFILEMAP_SUPPORTED
+    m_fd = ::open(QFile::encodeName(fileName).constData(), O_RDWR | O_CLOEXEC);
+    if (m_fd == -1) {
+        qCWarning(SERIALIZATION) << "failed to open" << fileName << "for mapping";
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(m_fd, &fileStat) != 0) {
+        close();
+        return false;
+    }
+
+    // Mapping more than the file size is fine, the pages behind the end of the file
+    // become accessible as soon as the file is grown far enough.
+    m_mappedSize = headerSize + reservedSize;
+    void* base = mmap(nullptr, m_mappedSize, PROT_READ, MAP_SHARED, m_fd, 0);
+    if (base == MAP_FAILED) {
+        qCWarning(SERIALIZATION) << "mapping" << fileName << "FAILED!";
+        close();
+        return false;
+    }
+
+    m_base = static_cast<char*>(base);
+    m_headerSize = headerSize;
+    m_size = static_cast<size_t>(fileStat.st_size) > headerSize ? fileStat.st_size - headerSize : 0;
+    return true;
+#else
+    Q_UNUSED(fileName);
+    Q_UNUSED(headerSize);
+    Q_UNUSED(reservedSize);
+    return false;
+#endif
+}
+
+void ItemRepositoryFileMap::close()
+{
+#ifdef ITEMREPOSITORYFILEMAP_SUPPORTED
+    if (m_base) {
+        munmap(m_base, m_mappedSize);
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+    }
+#endif
+    m_fd = -1;
+    m_base = nullptr;
+    m_headerSize = 0;
+    m_mappedSize = 0;
+    m_size = 0;
+    m_dirtyRanges.clear();
+}
+
+bool ItemRepositoryFileMap::reserve(size_t size)
+{
+    Q_ASSERT(isOpen());
+    if (size <= m_size) {
+        return true;
+    }
+    Q_ASSERT(m_headerSize + size <= m_mappedSize);
+
+#ifdef ITEMREPOSITORYFILEMAP_SUPPORTED
+    if (ftruncate(m_fd, m_headerSize + size) != 0) {
+        return false;
+    }
+#endif
+    m_size = size;
+    return true;
+}
+
+QPair<size_t, size_t> ItemRepositoryFileMap::pageRange(size_t offset, size_t length) const
+{
+    const size_t mask = pageSize() - 1;
+    const size_t start = (m_headerSize + offset) & ~mask;
+    const size_t end = (m_headerSize + offset + length + mask) & ~mask;
+    return qMakePair(start, std::min(end, m_mappedSize));
+}
+
+char* ItemRepositoryFileMap::beginWrite(size_t offset, size_t length)
+{
+    Q_ASSERT(isOpen());
+    Q_ASSERT(offset + length <= m_size);
+#ifdef ITEMREPOSITORYFILEMAP_SUPPORTED
+    const auto range = pageRange(offset, length);
+    if (mprotect(m_base + range.first, range.second - range.first, PROT_READ | PROT_WRITE) != 0) {
+        qFatal("cannot make the item repository mapping writable");
+    }
+#endif
+    return data() + offset;
+}
+
+void ItemRepositoryFileMap::endWrite(size_t offset, size_t length)
+{
+    const auto range = pageRange(offset, length);
+#ifdef ITEMREPOSITORYFILEMAP_SUPPORTED
+    mprotect(m_base + range.first, range.second - range.first, PROT_READ);
+#endif
+    m_dirtyRanges.append(range);
+}
+
+bool ItemRepositoryFileMap::sync()
+{
+    if (m_dirtyRanges.isEmpty()) {
+        return true;
+    }
+
+    // Merge adjacent and overlapping ranges, so neighboring buckets are flushed with one call
+    std::sort(m_dirtyRanges.begin(), m_dirtyRanges.end());
+    bool success = true;
+    auto current = m_dirtyRanges.first();
+    auto flush = [&](const QPair<size_t, size_t>& range) {
+#ifdef ITEMREPOSITORYFILEMAP_SUPPORTED
+        if (msync(m_base + range.first, range.second - range.first, MS_SYNC) != 0) {
+            success = false;
+        }
+#else
+        Q_UNUSED(range);
+#endif
+    };
+    for (const auto& range : m_dirtyRanges) {
+        if (range.first <= current.second) {
+            current.second = std::max(current.second, range.second);
+        } else {
+            flush(current);
+            current = range;
+        }
+    }
+    flush(current);
+
+    m_dirtyRanges.clear();
+    return success;
+}
+}
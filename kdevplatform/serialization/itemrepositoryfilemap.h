@@ -0,0 +1,99 @@
+/* This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KDEVPLATFORM_ITEMREPOSITORYFILEMAP_H
+#define KDEVPLATFORM_ITEMREPOSITORYFILEMAP_H
+
+#include <QPair>
+#include <QVector>
+
+#include "serializationexport.h"
+
+class QString;
+
+namespace KDevelop {
+/**
+ * A shared memory-mapping of an item repository file, used as its storage.
+ *
+ * The whole address range the file may ever grow to is reserved when opening, so the mapping
+ * never moves and pointers into it stay valid while the file grows.
+ *
+ * The mapping is read-only. Writing is done between beginWrite() and endWrite(), which
+ * temporarily make the affected pages writable and remember them, so sync() only
+ * flushes the pages that were actually written.
+ *
+ * Only available on 64-bit unix systems, elsewhere open() always fails.
+ */
+class KDEVPLATFORMSERIALIZATION_EXPORT ItemRepositoryFileMap
+{
+public:
+    ItemRepositoryFileMap();
+    ~ItemRepositoryFileMap();
+
+    /// Maps the file @p fileName, which must exist already.
+    /// @param headerSize Count of bytes at the start of the file that are not part of the mapped data.
+    /// @param reservedSize Count of data bytes behind the header that the file may grow to.
+    /// @returns Whether the file was mapped. If not, the caller has to fall back to plain file access.
+    bool open(const QString& fileName, size_t headerSize, size_t reservedSize);
+    /// Unmaps the file. Pending changes that were not synced are left to the operating system.
+    void close();
+
+    bool isOpen() const
+    {
+        return m_base;
+    }
+
+    /// Returns the start of the data behind the header
+    char* data() const
+    {
+        return m_base + m_headerSize;
+    }
+
+    /// Returns the count of data bytes that are currently backed by the file
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /// Grows the file so that at least @p size data bytes are backed by it.
+    bool reserve(size_t size);
+
+    /// Makes the given range of data writable, it must be backed by the file. Returns the start of the range.
+    char* beginWrite(size_t offset, size_t length);
+    /// Makes the range given to beginWrite read-only again, and marks it for the next sync().
+    void endWrite(size_t offset, size_t length);
+
+    /// Writes all ranges that were changed since the last sync back to disk.
+    bool sync();
+
+private:
+    /// Expands the range to page boundaries, relative to the start of the mapping
+    QPair<size_t, size_t> pageRange(size_t offset, size_t length) const;
+
+    Q_DISABLE_COPY(ItemRepositoryFileMap)
+
+    int m_fd = -1;
+    char* m_base = nullptr;
+    size_t m_headerSize = 0;
+    size_t m_mappedSize = 0;
+    size_t m_size = 0;
+    /// Page ranges that were written since the last sync, as start and end offset in the mapping
+    QVector<QPair<size_t, size_t>> m_dirtyRanges;
+};
+}
+
+#endif // KDEVPLATFORM_ITEMREPOSITORYFILEMAP_H
@@ -0,0 +1,161 @@
+/* This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#include "itemrepositoryjournal.h"
+
+#include "debug.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QSharedPointer>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+using namespace KDevelop;
+
+namespace {
+const quint32 journalMagic = 0x4b444a52; // "KDJR"
+const quint32 journalVersion = 1;
+
+bool syncToDisk(QFile& file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_UNIX
+    return fsync(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
+}
+
+ItemRepositoryJournal::ItemRepositoryJournal(const QString& directory, uint generation, uint completedGeneration)
+    : m_directory(directory)
+    , m_generation(generation)
+    , m_completedGeneration(completedGeneration)
+{
+}
+
+void ItemRepositoryJournal::addWrite(const QString& fileName, qint64 offset, const QByteArray& data, bool truncate)
+{
+    m_writes.append({fileName, offset, data, truncate});
+}
+
+qint64 ItemRepositoryJournal::size() const
+{
+    qint64 ret = 0;
+    for (const auto& write : m_writes) {
+        ret += write.data.size();
+    }
+
+    return ret;
+}
+
+bool ItemRepositoryJournal::commit(const QString& journalFile) const
+{
+    // QSaveFile only replaces the target once everything is written and synced, so a journal
+    // that exists on disk is always complete
+    QSaveFile file(QDir(m_directory).filePath(journalFile));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream << journalMagic << journalVersion << static_cast<quint32>(m_writes.size());
+    for (const auto& write : m_writes) {
+        stream << write.fileName << write.offset << write.truncate << write.data;
+    }
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool ItemRepositoryJournal::apply() const
+{
+    bool success = true;
+    QHash<QString, QSharedPointer<QFile>> files;
+
+    for (const auto& write : m_writes) {
+        auto& file = files[write.fileName];
+        if (!file) {
+            file.reset(new QFile(QDir(m_directory).filePath(write.fileName)));
+            if (!file->open(QIODevice::ReadWrite)) {
+                qCWarning(SERIALIZATION) << "cannot open" << file->fileName() << "to apply the store journal";
+                success = false;
+                continue;
+            }
+        }
+        if (!file->isOpen()) {
+            continue;
+        }
+
+        const qint64 end = write.offset + write.data.size();
+        if (file->size() < end || write.truncate) {
+            file->resize(end);
+        }
+        if (!file->seek(write.offset) || file->write(write.data) != write.data.size()) {
+            qCWarning(SERIALIZATION) << "failed writing to" << file->fileName() << ", probably the disk is full";
+            success = false;
+        }
+    }
+
+    for (const auto& file : qAsConst(files)) {
+        if (file->isOpen() && !syncToDisk(*file)) {
+            success = false;
+        }
+    }
+
+    return success;
+}
+
+bool ItemRepositoryJournal::replay(const QString& directory, const QString& journalFile)
+{
+    QFile file(QDir(directory).filePath(journalFile));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return true;
+    }
+
+    qCDebug(SERIALIZATION) << "replaying store journal" << file.fileName();
+
+    QDataStream stream(&file);
+    quint32 magic = 0, version = 0, count = 0;
+    stream >> magic >> version >> count;
+
+    bool success = false;
+    if (magic == journalMagic && version == journalVersion) {
+        ItemRepositoryJournal journal(directory, 0, 0);
+        for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+            Write write;
+            stream >> write.fileName >> write.offset >> write.truncate >> write.data;
+            journal.m_writes.append(write);
+        }
+        success = stream.status() == QDataStream::Ok && journal.apply();
+    }
+
+    if (!success) {
+        qCWarning(SERIALIZATION) << "failed to replay the store journal" << file.fileName();
+        return false;
+    }
+
+    file.remove();
+    return true;
+}
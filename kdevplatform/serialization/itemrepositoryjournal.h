@@ -0,0 +1,98 @@
+/* This file is part of KDevelop
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License version 2 as published by the Free Software Foundation.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.LIB.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+ */
+
+#ifndef KDEVPLATFORM_ITEMREPOSITORYJOURNAL_H
+#define KDEVPLATFORM_ITEMREPOSITORYJOURNAL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+#include "serializationexport.h"
+
+namespace KDevelop {
+/**
+ * A snapshot of the changes of the item repositories in one directory, that is written to disk
+ * later, usually by the background thread of the ItemRepositoryRegistry.
+ *
+ * The changes are first written into a journal file, which is synced to disk before the
+ * actual files are touched. If the application crashes while writing the files, the next
+ * start replays the journal, so the repositories are still consistent.
+ */
+class KDEVPLATFORMSERIALIZATION_EXPORT ItemRepositoryJournal
+{
+public:
+    /// @param directory The directory that contains the repository files
+    /// @param generation Identifies this snapshot. Greater than the generation of all earlier snapshots
+    /// @param completedGeneration Generation of the last snapshot that is completely written to disk
+    ItemRepositoryJournal(const QString& directory, uint generation, uint completedGeneration);
+
+    QString directory() const
+    {
+        return m_directory;
+    }
+
+    uint generation() const
+    {
+        return m_generation;
+    }
+
+    /// Changes recorded by snapshots up to this generation are on disk already
+    uint completedGeneration() const
+    {
+        return m_completedGeneration;
+    }
+
+    /// Records that @p data has to be written to @p offset of the file @p fileName in the directory.
+    /// If @p truncate is true, the file is cut off behind the data.
+    void addWrite(const QString& fileName, qint64 offset, const QByteArray& data, bool truncate = false);
+
+    bool isEmpty() const
+    {
+        return m_writes.isEmpty();
+    }
+
+    /// Count of bytes that will be written
+    qint64 size() const;
+
+    /// Writes the journal to the file @p journalFile in the directory, and syncs it to disk.
+    bool commit(const QString& journalFile) const;
+
+    /// Does the recorded writes, and syncs the written files to disk.
+    bool apply() const;
+
+    /// Applies a journal that was committed, but was not completely applied, and removes it.
+    /// Does nothing if there is no such journal.
+    static bool replay(const QString& directory, const QString& journalFile);
+
+private:
+    struct Write
+    {
+        QString fileName;
+        qint64 offset;
+        QByteArray data;
+        bool truncate;
+    };
+
+    QString m_directory;
+    uint m_generation;
+    uint m_completedGeneration;
+    QVector<Write> m_writes;
+};
+}
+
+#endif // KDEVPLATFORM_ITEMREPOSITORYJOURNAL_H
@@ -19,7 +19,11 @@
 #include "itemrepositoryregistry.h"
 
 #include <QDir>
+#include <QList>
 #include <QProcessEnvironment>
+#include <QSharedPointer>
+#include <QThread>
+#include <QWaitCondition>
 #include <QCoreApplication>
 #include <QDataStream>
 #include <QStandardPaths>
@@ -29,6 +33,7 @@
 #include <util/shellutils.h>
 
 #include "abstractitemrepository.h"
+#include "itemrepositoryjournal.h"
 #include "debug.h"
 
 using namespace KDevelop;
@@ -37,6 +42,19 @@ namespace {
 //If KDevelop crashed this many times consecutively, clean up the repository
 const int crashesBeforeCleanup = 1;
 
+//storeInBackground() blocks while this many snapshots are not written yet, to bound the memory they use
+const int maxPendingSnapshots = 2;
+
+QString storeJournalFileName()
+{
+    return QStringLiteral("store_journal");
+}
+
+QString isWritingFileName()
+{
+    return QStringLiteral("is_writing");
+}
+
 void setCrashCounter(QFile& crashesFile, int count)
 {
     crashesFile.close();
@@ -58,7 +76,7 @@ bool shouldClear(const QString& path)
         return true;
     }
 
-    if (dir.exists(QStringLiteral("is_writing"))) {
+    if (dir.exists(isWritingFileName())) {
         qCWarning(SERIALIZATION) << "repository" << path << "was write-locked, it probably is inconsistent";
         return true;
     }
@@ -109,6 +127,24 @@ namespace KDevelop {
 class ItemRepositoryRegistryPrivate
 {
 public:
+    ///Writes the snapshots taken by storeInBackground()
+    class StoreThread
+        : public QThread
+    {
+public:
+        explicit StoreThread(ItemRepositoryRegistryPrivate* data)
+            : m_data(data)
+        {
+        }
+
+private:
+        void run() override
+        {
+            m_data->writeSnapshots();
+        }
+        ItemRepositoryRegistryPrivate* m_data;
+    };
+
     ItemRepositoryRegistry* m_owner;
     bool m_shallDelete;
     QString m_path;
@@ -116,6 +152,24 @@ public:
     QMap<QString, QAtomicInt*> m_customCounters;
     mutable QMutex m_mutex;
 
+    ///Generation of the last snapshot taken, protected by m_mutex
+    uint m_snapshotGeneration = 0;
+    ///Generation of the last snapshot that is completely written
+    QAtomicInt m_completedGeneration;
+    StoreThread* m_storeThread = nullptr;
+    ///Incremented whenever the data directory is deleted
+    QAtomicInt m_dataDirectoryGeneration;
+
+    ///Protects the members below, and is used with m_storeCondition
+    QMutex m_storeMutex;
+    ///Signalled when a snapshot is added or written, or when the store thread should stop
+    QWaitCondition m_storeCondition;
+    ///Snapshots that are not completely written yet, in the order they were taken
+    QList<QSharedPointer<ItemRepositoryJournal>> m_pendingSnapshots;
+    ///Whether the is_writing mark is to be removed once the journal of the last pending snapshot is on disk
+    bool m_unlockWhenJournaled = false;
+    bool m_stopStoreThread = false;
+
     explicit ItemRepositoryRegistryPrivate(ItemRepositoryRegistry* owner)
         : m_owner(owner)
         , m_shallDelete(false)
@@ -125,6 +179,14 @@ public:
 
     void lockForWriting();
     void unlockForWriting();
+
+    QByteArray customCountersData() const;
+
+    void enqueueSnapshot(const QSharedPointer<ItemRepositoryJournal>& journal);
+    void waitForPendingStore();
+    void stopStoreThread();
+    ///The loop of the store thread
+    void writeSnapshots();
     void deleteDataDirectory(const QString& path, bool recreate = true);
 
     /// @param path  A shared directory-path that the item-repositories are to be loaded from.
@@ -218,11 +280,21 @@ QString ItemRepositoryRegistry::path() const
     return d->m_path;
 }
 
+int ItemRepositoryRegistry::dataDirectoryGeneration() const
+{
+    return d->m_dataDirectoryGeneration.load();
+}
+
 void ItemRepositoryRegistryPrivate::lockForWriting()
 {
     QMutexLocker lock(&m_mutex);
+    {
+        //A pending unlock must not remove the new mark
+        QMutexLocker storeLock(&m_storeMutex);
+        m_unlockWhenJournaled = false;
+    }
     //Create is_writing
-    QFile f(m_path + QLatin1String("/is_writing"));
+    QFile f(m_path + QLatin1Char('/') + isWritingFileName());
     f.open(QIODevice::WriteOnly);
     f.close();
 }
@@ -235,8 +307,17 @@ void ItemRepositoryRegistry::lockForWriting()
 void ItemRepositoryRegistryPrivate::unlockForWriting()
 {
     QMutexLocker lock(&m_mutex);
+    {
+        QMutexLocker storeLock(&m_storeMutex);
+        if (!m_pendingSnapshots.isEmpty()) {
+            //The repositories are only consistent on disk once the journal of the last snapshot is written,
+            //the store thread removes is_writing then
+            m_unlockWhenJournaled = true;
+            return;
+        }
+    }
     //Delete is_writing
-    QFile::remove(m_path + QLatin1String("/is_writing"));
+    QFile::remove(m_path + QLatin1Char('/') + isWritingFileName());
 }
 
 void ItemRepositoryRegistry::unlockForWriting()
@@ -248,6 +329,7 @@ void ItemRepositoryRegistry::unRegisterRepository(AbstractItemRepository* reposi
 {
     QMutexLocker lock(&d->m_mutex);
     Q_ASSERT(d->m_repositories.contains(repository));
+    d->waitForPendingStore();
     repository->close();
     d->m_repositories.remove(repository);
 }
@@ -256,12 +338,14 @@ void ItemRepositoryRegistry::unRegisterRepository(AbstractItemRepository* reposi
 void ItemRepositoryRegistryPrivate::deleteDataDirectory(const QString& path, bool recreate)
 {
     QMutexLocker lock(&m_mutex);
+    waitForPendingStore();
 
     //lockForWriting creates a file, that prevents any other KDevelop instance from using the directory as it is.
     //Instead, the other instance will try to delete the directory as well.
     lockForWriting();
 
     bool result = QDir(path).removeRecursively();
+    m_dataDirectoryGeneration.ref();
     Q_ASSERT(result);
     Q_UNUSED(result);
     // Just recreate the directory then; leave old path (as it is dependent on appname and session only).
@@ -285,6 +369,11 @@ bool ItemRepositoryRegistryPrivate::open(const QString& path)
 
     QDir().mkpath(path);
 
+    //Finish writing the snapshot that was being written when the application exited the last time
+    if (!ItemRepositoryJournal::replay(path, storeJournalFileName())) {
+        deleteDataDirectory(path);
+    }
+
     foreach (AbstractItemRepository* repository, m_repositories.keys()) {
         if (!repository->open(path)) {
             deleteDataDirectory(path);
@@ -312,9 +401,24 @@ bool ItemRepositoryRegistryPrivate::open(const QString& path)
     return true;
 }
 
+QByteArray ItemRepositoryRegistryPrivate::customCountersData() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    for (QMap<QString, QAtomicInt*>::const_iterator it = m_customCounters.constBegin();
+         it != m_customCounters.constEnd();
+         ++it) {
+        stream << it.key();
+        stream << it.value()->fetchAndAddRelaxed(0);
+    }
+
+    return data;
+}
+
 void ItemRepositoryRegistry::store()
 {
     QMutexLocker lock(&d->m_mutex);
+    d->waitForPendingStore();
     foreach (AbstractItemRepository* repository, d->m_repositories.keys()) {
         repository->store();
     }
@@ -330,18 +434,122 @@ void ItemRepositoryRegistry::store()
     QFile f(d->m_path + QLatin1String("/Counters"));
     if (f.open(QIODevice::WriteOnly)) {
         f.resize(0);
-        QDataStream stream(&f);
-        for (QMap<QString, QAtomicInt*>::const_iterator it = d->m_customCounters.constBegin();
-             it != d->m_customCounters.constEnd();
-             ++it) {
-            stream << it.key();
-            stream << it.value()->fetchAndAddRelaxed(0);
-        }
+        f.write(d->customCountersData());
     } else {
         qCWarning(SERIALIZATION) << "Could not open counter file for writing";
     }
 }
 
+void ItemRepositoryRegistry::storeInBackground()
+{
+    QMutexLocker lock(&d->m_mutex);
+    {
+        QMutexLocker storeLock(&d->m_storeMutex);
+        while (d->m_pendingSnapshots.size() >= maxPendingSnapshots) {
+            d->m_storeCondition.wait(&d->m_storeMutex);
+        }
+    }
+
+    QSharedPointer<ItemRepositoryJournal> journal(new ItemRepositoryJournal(d->m_path, ++d->m_snapshotGeneration,
+                                                                            d->m_completedGeneration.loadAcquire()));
+    foreach (AbstractItemRepository* repository, d->m_repositories.keys()) {
+        repository->snapshot(*journal);
+    }
+
+    journal->addWrite(QStringLiteral("version_%1").arg(staticItemRepositoryVersion()), 0, QByteArray(), true);
+    journal->addWrite(QStringLiteral("Counters"), 0, d->customCountersData(), true);
+
+    d->enqueueSnapshot(journal);
+}
+
+void ItemRepositoryRegistry::waitForPendingStore()
+{
+    d->waitForPendingStore();
+}
+
+void ItemRepositoryRegistryPrivate::enqueueSnapshot(const QSharedPointer<ItemRepositoryJournal>& journal)
+{
+    QMutexLocker lock(&m_storeMutex);
+    m_pendingSnapshots.append(journal);
+    if (!m_storeThread) {
+        m_stopStoreThread = false;
+        m_storeThread = new StoreThread(this);
+        m_storeThread->start(QThread::LowPriority);
+    }
+    m_storeCondition.wakeAll();
+}
+
+void ItemRepositoryRegistryPrivate::waitForPendingStore()
+{
+    QMutexLocker lock(&m_storeMutex);
+    while (!m_pendingSnapshots.isEmpty()) {
+        m_storeCondition.wait(&m_storeMutex);
+    }
+}
+
+void ItemRepositoryRegistryPrivate::stopStoreThread()
+{
+    {
+        QMutexLocker lock(&m_storeMutex);
+        if (!m_storeThread) {
+            return;
+        }
+        m_stopStoreThread = true;
+        m_storeCondition.wakeAll();
+    }
+
+    //Pending snapshots are written before the thread exits
+    m_storeThread->wait();
+    delete m_storeThread;
+    m_storeThread = nullptr;
+}
+
+void ItemRepositoryRegistryPrivate::writeSnapshots()
+{
+    QMutexLocker lock(&m_storeMutex);
+    while (true) {
+        while (m_pendingSnapshots.isEmpty() && !m_stopStoreThread) {
+            m_storeCondition.wait(&m_storeMutex);
+        }
+        if (m_pendingSnapshots.isEmpty()) {
+            return;
+        }
+
+        const QSharedPointer<ItemRepositoryJournal> journal = m_pendingSnapshots.first();
+        const QDir dir(journal->directory());
+        lock.unlock();
+
+        //Once the journal is on disk, a crash while writing the repositories can be recovered from
+        const bool journaled = journal->commit(storeJournalFileName());
+        if (!journaled) {
+            qCWarning(SERIALIZATION) << "could not write the store journal in" << dir.path();
+        }
+
+        lock.relock();
+        if (journaled && m_unlockWhenJournaled && m_pendingSnapshots.size() == 1) {
+            QFile::remove(dir.filePath(isWritingFileName()));
+            m_unlockWhenJournaled = false;
+        }
+        lock.unlock();
+
+        if (!journal->apply()) {
+            qCWarning(SERIALIZATION) << "failed to write the item repositories in" << dir.path();
+        }
+        if (journaled) {
+            QFile::remove(dir.filePath(storeJournalFileName()));
+        }
+
+        lock.relock();
+        m_pendingSnapshots.removeFirst();
+        m_completedGeneration.storeRelease(journal->generation());
+        if (m_pendingSnapshots.isEmpty() && m_unlockWhenJournaled) {
+            QFile::remove(dir.filePath(isWritingFileName()));
+            m_unlockWhenJournaled = false;
+        }
+        m_storeCondition.wakeAll();
+    }
+}
+
 void ItemRepositoryRegistry::printAllStatistics() const
 {
     QMutexLocker lock(&d->m_mutex);
@@ -367,6 +575,7 @@ int ItemRepositoryRegistry::finalCleanup()
 void ItemRepositoryRegistryPrivate::close()
 {
     QMutexLocker lock(&m_mutex);
+    waitForPendingStore();
 
     foreach (AbstractItemRepository* repository, m_repositories.keys()) {
         repository->close();
@@ -379,6 +588,7 @@ ItemRepositoryRegistry::~ItemRepositoryRegistry()
 {
     QMutexLocker lock(&d->m_mutex);
     d->close();
+    d->stopStoreThread();
     foreach (QAtomicInt* counter, d->m_customCounters) {
         delete counter;
     }
@@ -387,6 +597,7 @@ ItemRepositoryRegistry::~ItemRepositoryRegistry()
 void ItemRepositoryRegistry::shutdown()
 {
     QMutexLocker lock(&d->m_mutex);
+    d->stopStoreThread();
     QString path = d->m_path;
 
     // FIXME: we don't close since this can trigger crashes at shutdown
@@ -64,10 +64,22 @@ public:
     /// @returns The path to item-repositories.
     QString path() const;
 
+    /// @returns A number that changes whenever the directory at path() is deleted, so data that is
+    ///          stored there outside of the registered repositories can be reset.
+    int dataDirectoryGeneration() const;
+
     /// Stores all repositories to disk, eventually unloading unused data to save memory.
     /// @note Should be called on a regular basis.
     void store();
 
+    /// Like store(), but only takes a snapshot of the changed data while the caller waits.
+    /// The snapshot is written to disk by a background thread, through a journal that is
+    /// replayed on the next start if the application crashes while writing the repositories.
+    void storeInBackground();
+
+    /// Blocks until all snapshots taken by storeInBackground() are written to disk.
+    void waitForPendingStore();
+
     /// Indicates that the application has been closed gracefully.
     /// @note Must be called somewhere at the end of the shutdown sequence.
     void shutdown();
@@ -84,6 +96,8 @@ public:
     void lockForWriting();
 
     /// Removes the inconsistency mark set by @ref lockForWriting().
+    /// If snapshots are still being written, the mark is removed as soon as the journal of the
+    /// last one is on disk, since from then on the repositories can be recovered.
     void unlockForWriting();
 
     /// Returns a custom counter persistently stored as part of item-repositories in the
@@ -26,6 +26,8 @@
 
 #include <algorithm>
 #include <QTest>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 QTEST_GUILESS_MAIN(BenchItemRepository)
 
@@ -104,6 +106,8 @@ struct TestDataRepositoryItemRequest
 };
 
 using TestDataRepository = ItemRepository<TestData, TestDataRepositoryItemRequest, false, true>;
+using ConcurrentTestDataRepository = ItemRepository<TestData, TestDataRepositoryItemRequest, false, true, 0,
+                                                    524288 * 2, true>;
 
 void BenchItemRepository::initTestCase()
 {
@@ -127,7 +131,8 @@ static QVector<QString> generateData()
     return data;
 }
 
-static QVector<uint> insertData(const QVector<QString>& data, TestDataRepository& repo)
+template <typename Repository>
+static QVector<uint> insertData(const QVector<QString>& data, Repository& repo)
 {
     QVector<uint> indices;
     indices.reserve(data.size());
@@ -219,3 +224,113 @@ void BenchItemRepository::lookupValue()
         }
     }
 }
+
+/// Runs @p work on @p threads threads at once, each thread gets its own slice of @p data
+template <typename Work>
+static void runThreaded(int threads, const QVector<QByteArray>& data, const Work& work)
+{
+    QVector<QFuture<void>> futures;
+    futures.reserve(threads);
+    const int sliceSize = data.size() / threads;
+    for (int i = 0; i < threads; ++i) {
+        const int begin = i * sliceSize;
+        const int end = (i == threads - 1) ? data.size() : begin + sliceSize;
+        futures << QtConcurrent::run([&data, &work, begin, end]() {
+            for (int j = begin; j < end; ++j) {
+                work(data[j]);
+            }
+        });
+    }
+    for (auto& future : futures) {
+        future.waitForFinished();
+    }
+}
+
+static QVector<QByteArray> generateUtf8Data()
+{
+    const QVector<QString> data = generateData();
+    QVector<QByteArray> ret;
+    ret.reserve(data.size());
+    for (const QString& item : data) {
+        ret << item.toUtf8();
+    }
+    return ret;
+}
+
+static void addThreadingColumns()
+{
+    QTest::addColumn<int>("threads");
+    QTest::addColumn<bool>("concurrent");
+
+    for (int threads : {1, 2, 4, 8, 16, 32}) {
+        QTest::newRow(qPrintable(QStringLiteral("mutex-%1").arg(threads))) << threads << false;
+        QTest::newRow(qPrintable(QStringLiteral("concurrent-%1").arg(threads))) << threads << true;
+    }
+}
+
+template <typename Repository>
+static void benchThreadedInsert(int threads)
+{
+    Repository repo(QStringLiteral("TestDataRepositoryThreadedInsert"));
+    const QVector<QByteArray> data = generateUtf8Data();
+    QThreadPool::globalInstance()->setMaxThreadCount(qMax(threads, QThread::idealThreadCount()));
+    QBENCHMARK_ONCE {
+        // each item is requested twice, as happens when parse threads intern the same identifiers
+        runThreaded(threads, data, [&repo](const QByteArray& item) {
+            repo.index(TestDataRepositoryItemRequest(item.constData(), item.length()));
+            repo.index(TestDataRepositoryItemRequest(item.constData(), item.length()));
+        });
+    }
+    QCOMPARE(repo.statistics().totalItems, uint(data.size()));
+}
+
+void BenchItemRepository::threadedInsert_data()
+{
+    addThreadingColumns();
+}
+
+void BenchItemRepository::threadedInsert()
+{
+    QFETCH(int, threads);
+    QFETCH(bool, concurrent);
+
+    if (concurrent) {
+        benchThreadedInsert<ConcurrentTestDataRepository>(threads);
+    } else {
+        benchThreadedInsert<TestDataRepository>(threads);
+    }
+}
+
+template <typename Repository>
+static void benchThreadedLookup(int threads)
+{
+    Repository repo(QStringLiteral("TestDataRepositoryThreadedLookup"));
+    const QVector<QByteArray> data = generateUtf8Data();
+    for (const QByteArray& item : data) {
+        repo.index(TestDataRepositoryItemRequest(item.constData(), item.length()));
+    }
+    QThreadPool::globalInstance()->setMaxThreadCount(qMax(threads, QThread::idealThreadCount()));
+    QBENCHMARK {
+        runThreaded(threads, data, [&repo](const QByteArray& item) {
+            const uint index = repo.findIndex(TestDataRepositoryItemRequest(item.constData(), item.length()));
+            repo.itemFromIndex(index);
+        });
+    }
+}
+
+void BenchItemRepository::threadedLookup_data()
+{
+    addThreadingColumns();
+}
+
+void BenchItemRepository::threadedLookup()
+{
+    QFETCH(int, threads);
+    QFETCH(bool, concurrent);
+
+    if (concurrent) {
+        benchThreadedLookup<ConcurrentTestDataRepository>(threads);
+    } else {
+        benchThreadedLookup<TestDataRepository>(threads);
+    }
+}
@@ -39,6 +39,10 @@ private Q_SLOTS:
     void removeDisk();
     void lookupKey();
     void lookupValue();
+    void threadedInsert_data();
+    void threadedInsert();
+    void threadedLookup_data();
+    void threadedLookup();
 
 private:
     QString m_repositoryPath = QDir::tempPath() + QStringLiteral("/bench_itemrepository");
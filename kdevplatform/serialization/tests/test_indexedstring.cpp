@@ -25,6 +25,7 @@
 #include <serialization/itemrepositoryregistry.h>
 #include <serialization/indexedstring.h>
 #include <QTest>
+#include <QtConcurrentRun>
 
 #include <utility>
 
@@ -249,3 +250,35 @@ void TestIndexedString::testCString()
     QCOMPARE(str.index(), 0u);
     QVERIFY(str.isEmpty());
 }
+
+void TestIndexedString::testConcurrentReadWrite()
+{
+    // strings are read without locking, make sure they stay intact while other threads add new ones
+    const QVector<uint> indices = setupTest();
+    const QVector<QString> data = generateData();
+
+    auto writer = QtConcurrent::run([]() {
+        for (int i = 0; i < 100000; ++i) {
+            IndexedString str(QStringLiteral("/concurrent/%1").arg(i));
+            Q_UNUSED(str);
+        }
+    });
+
+    QVector<QFuture<bool>> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers << QtConcurrent::run([&indices, &data]() {
+            for (int j = 0; j < indices.size(); ++j) {
+                const IndexedString str = IndexedString::fromIndex(indices[j]);
+                if (str.length() != data[j].length() || str.str() != data[j]) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    writer.waitForFinished();
+    for (auto& reader : readers) {
+        QVERIFY(reader.result());
+    }
+}
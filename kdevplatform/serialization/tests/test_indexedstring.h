@@ -51,6 +51,7 @@ private Q_SLOTS:
     void test_data();
 
     void testCString();
+    void testConcurrentReadWrite();
 
 private:
     QString m_repositoryPath = QDir::tempPath() + QStringLiteral("/test_indexedstring");
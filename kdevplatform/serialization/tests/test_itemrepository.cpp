@@ -1,7 +1,10 @@
 #include <QObject>
+#include <QSharedPointer>
+#include <QTemporaryDir>
 #include <QTest>
 #include <serialization/itemrepository.h>
 #include <serialization/indexedstring.h>
+#include <serialization/itemrepositoryjournal.h>
 #include <stdlib.h>
 #include <time.h>
 
@@ -273,6 +276,117 @@ private Q_SLOTS:
         QVERIFY(!repository.findIndex(TestItemRequest(*monsterItem, true)));
         repository.deleteItem(smallIndex);
     }
+    void storeAndReopen()
+    {
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("StoreAndReopen"));
+
+        QVector<QSharedPointer<TestItem>> items;
+        QVector<uint> indices;
+        for (uint id = 1; id <= 200; ++id) {
+            // every 50th item is big enough to need a monster-bucket
+            const uint size = (id % 50) ? (id * 37) % 1000 + sizeof(TestItem) : ItemRepositoryBucketSize + id;
+            items.append(QSharedPointer<TestItem>(createItem(id, size), [](TestItem* item) { delete[] item; }));
+            indices.append(repository.index(TestItemRequest(*items.last(), true)));
+        }
+
+        auto verifyItems = [&]() {
+            for (int i = 0; i < items.size(); ++i) {
+                QCOMPARE(repository.findIndex(TestItemRequest(*items[i], true)), indices[i]);
+                QVERIFY(items[i]->equals(repository.itemFromIndex(indices[i])));
+            }
+        };
+
+        // storing repeatedly drops the private copies of the buckets, and eventually unloads them
+        for (int i = 0; i < 4; ++i) {
+            repository.store();
+            verifyItems();
+        }
+
+        repository.close(true);
+        QVERIFY(repository.open(globalItemRepositoryRegistry().path()));
+        verifyItems();
+
+        // changing the loaded data, and storing it again
+        repository.deleteItem(indices.takeFirst());
+        const QSharedPointer<TestItem> deletedItem = items.takeFirst();
+        QSharedPointer<TestItem> newItem(createItem(1000, 100), [](TestItem* item) { delete[] item; });
+        items.append(newItem);
+        indices.append(repository.index(TestItemRequest(*newItem, true)));
+        repository.store();
+        verifyItems();
+
+        repository.close(true);
+        QVERIFY(repository.open(globalItemRepositoryRegistry().path()));
+        verifyItems();
+        QVERIFY(!repository.findIndex(TestItemRequest(*deletedItem, true)));
+    }
+    void storeInBackground()
+    {
+        ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("StoreInBackground"));
+
+        QVector<QSharedPointer<TestItem>> items;
+        QVector<uint> indices;
+        for (uint id = 1; id <= 100; ++id) {
+            items.append(QSharedPointer<TestItem>(createItem(id, id * 11 + sizeof(TestItem)),
+                                                  [](TestItem* item) { delete[] item; }));
+            indices.append(repository.index(TestItemRequest(*items.last(), true)));
+        }
+
+        auto verifyItems = [&]() {
+            for (int i = 0; i < items.size(); ++i) {
+                QCOMPARE(repository.findIndex(TestItemRequest(*items[i], true)), indices[i]);
+                QVERIFY(items[i]->equals(repository.itemFromIndex(indices[i])));
+            }
+        };
+
+        // the changed buckets stay loaded while the snapshot is written
+        for (int i = 0; i < 4; ++i) {
+            globalItemRepositoryRegistry().storeInBackground();
+            verifyItems();
+        }
+        globalItemRepositoryRegistry().waitForPendingStore();
+        QVERIFY(!QFile::exists(globalItemRepositoryRegistry().path() + QStringLiteral("/store_journal")));
+
+        repository.close();
+        QVERIFY(repository.open(globalItemRepositoryRegistry().path()));
+        verifyItems();
+    }
+    void replayJournal()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+
+        QFile file(dir.filePath(QStringLiteral("data")));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("0123456789");
+        file.close();
+
+        ItemRepositoryJournal journal(dir.path(), 1, 0);
+        journal.addWrite(QStringLiteral("data"), 2, "ab");
+        journal.addWrite(QStringLiteral("data"), 12, "cd");
+        journal.addWrite(QStringLiteral("other"), 0, "xyz", true);
+        QCOMPARE(journal.size(), qint64(7));
+        QVERIFY(journal.commit(QStringLiteral("journal")));
+
+        // the journal is only applied when replaying it
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), QByteArray("0123456789"));
+        file.close();
+
+        QVERIFY(ItemRepositoryJournal::replay(dir.path(), QStringLiteral("journal")));
+        QVERIFY(!QFile::exists(dir.filePath(QStringLiteral("journal"))));
+
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readAll(), QByteArray("01ab456789\0\0cd", 14));
+        file.close();
+
+        QFile other(dir.filePath(QStringLiteral("other")));
+        QVERIFY(other.open(QIODevice::ReadOnly));
+        QCOMPARE(other.readAll(), QByteArray("xyz"));
+
+        // nothing to do without a journal
+        QVERIFY(ItemRepositoryJournal::replay(dir.path(), QStringLiteral("journal")));
+    }
     void usePermissiveModuloWhenRemovingClashLinks()
     {
         ItemRepository<TestItem, TestItemRequest> repository(QStringLiteral("PermissiveModulo"));
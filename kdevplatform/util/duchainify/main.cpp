@@ -25,11 +25,13 @@
 #include <language/backgroundparser/backgroundparser.h>
 #include <language/duchain/definitions.h>
 #include <language/duchain/duchain.h>
+#include <language/duchain/duchaincachearchive.h>
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/duchaindumper.h>
 #include <language/duchain/dumpdotgraph.h>
 #include <language/duchain/problem.h>
 #include <language/duchain/persistentsymboltable.h>
+#include <serialization/itemrepositoryregistry.h>
 
 #include <interfaces/ilanguagecontroller.h>
 #include <tests/autotestshell.h>
@@ -40,6 +42,7 @@
 #include <QCommandLineOption>
 #include <QDebug>
 #include <QDirIterator>
+#include <QFileInfo>
 #include <QStringList>
 #include <QTimer>
 
@@ -141,6 +144,7 @@ void Manager::init()
     m_allFilesAdded = 1;
 
     if (m_total) {
+        m_timer.start();
         std::cerr << "Added " << m_total << " files to the background parser" << std::endl;
         const int threads = ICore::self()->languageController()->backgroundParser()->threadCount();
         std::cerr << "parsing with " << threads << " threads" << std::endl;
@@ -250,7 +254,7 @@ QSet<QUrl> Manager::waiting()
 
 void Manager::finish()
 {
-    std::cerr << "ready" << std::endl;
+    std::cerr << "ready after " << m_timer.elapsed() << " ms" << std::endl;
     QApplication::quit();
 }
 
@@ -287,6 +291,11 @@ int main(int argc, char** argv)
                                             "Features to build. Options: empty, simplified-visible-declarations, visible-declarations (default), all-declarations, all-declarations-and-uses, all-declarations-and-uses-and-AST"),
                                         QStringLiteral("features")});
 
+    parser.addOption(QCommandLineOption{QStringList{QStringLiteral("export-cache")},
+                                        i18n(
+                                            "Parse into an empty DUChain cache and write it to the given archive afterwards. New sessions use it instead of parsing when KDEV_DUCHAIN_CACHE_ARCHIVE is set to the archive."),
+                                        QStringLiteral("archive")});
+
     parser.addOption(QCommandLineOption{QStringList{QStringLiteral("dump-context")},
                                         i18n("Print complete Definition-Use Chain on successful parse")});
     parser.addOption(QCommandLineOption{QStringList{QStringLiteral("dump-definitions")},
@@ -313,8 +322,15 @@ int main(int argc, char** argv)
     warnings = parser.isSet(QStringLiteral("warnings"));
     qInstallMessageHandler(messageOutput);
 
+    const QString cacheArchive = parser.value(QStringLiteral("export-cache"));
+    if (!cacheArchive.isEmpty()) {
+        // the archive shall only contain the given paths
+        qputenv("CLEAR_DUCHAIN_DIR", "1");
+    }
+
     AutoTestShell::init();
     TestCore::initialize(Core::NoUi, QStringLiteral("duchainify"));
+    const QString repositoryPath = globalItemRepositoryRegistry().path();
     Manager manager(&parser);
 
     QTimer::singleShot(0, &manager, &Manager::init);
@@ -322,5 +338,21 @@ int main(int argc, char** argv)
 
     TestCore::shutdown();
 
+    if (ret == 0 && !cacheArchive.isEmpty()) {
+        QStringList sourceDirectories;
+        foreach (const auto& path, parser.positionalArguments()) {
+            const QFileInfo info(path);
+            sourceDirectories << (info.isDir() ? info.canonicalFilePath() : info.canonicalPath());
+        }
+
+        QString errorMessage;
+        if (DUChainCacheArchive::write(cacheArchive, repositoryPath, sourceDirectories, &errorMessage)) {
+            std::cerr << "wrote the DUChain cache to " << qPrintable(cacheArchive) << std::endl;
+        } else {
+            std::cerr << "failed to export the DUChain cache: " << qPrintable(errorMessage) << std::endl;
+            ret = 4;
+        }
+    }
+
     return ret;
 }
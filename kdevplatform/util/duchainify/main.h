@@ -22,6 +22,7 @@
 
 #include <QObject>
 #include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QUrl>
 
 #include <language/duchain/topducontext.h>
@@ -43,6 +44,7 @@ private:
     uint m_total;
     QCommandLineParser* m_args;
     QAtomicInt m_allFilesAdded;
+    QElapsedTimer m_timer;
 
 public Q_SLOTS:
     // delay init into event loop so the DUChain can always shutdown gracefully
@@ -23,8 +23,6 @@
 #include "clangparsejob.h"
 
 #include <interfaces/icore.h>
-#include <interfaces/iprojectcontroller.h>
-#include <interfaces/iproject.h>
 #include <interfaces/ilanguagecontroller.h>
 #include <interfaces/idocumentcontroller.h>
 
@@ -38,12 +36,6 @@
 #include <language/duchain/duchain.h>
 #include <language/duchain/parsingenvironment.h>
 
-#include <custom-definesandincludes/idefinesandincludesmanager.h>
-
-#include <project/projectmodel.h>
-#include <project/interfaces/ibuildsystemmanager.h>
-
-#include "clangsettings/clangsettingsmanager.h"
 #include "duchain/clanghelpers.h"
 #include "duchain/clangpch.h"
 #include "duchain/duchainutils.h"
@@ -55,6 +47,7 @@
 #include "util/clangutils.h"
 
 #include "clangsupport.h"
+#include "clangparsingenvironmentcache.h"
 #include "duchain/documentfinderhelpers.h"
 
 #include <QFile>
@@ -67,87 +60,28 @@ using namespace KDevelop;
 
 namespace {
 
-QString findConfigFile(const QString& forFile, const QString& configFileName)
-{
-    QDir dir = QFileInfo(forFile).dir();
-    while (dir.exists()) {
-        const QFileInfo customIncludePaths(dir, configFileName);
-        if (customIncludePaths.exists()) {
-            return customIncludePaths.absoluteFilePath();
-        }
-
-        if (!dir.cdUp()) {
-            break;
-        }
-    }
-
-    return {};
-}
-
-Path::List readPathListFile(const QString& filepath)
-{
-    if (filepath.isEmpty()) {
-        return {};
-    }
-
-    QFile f(filepath);
-    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        return {};
-    }
-
-    const QString text = QString::fromLocal8Bit(f.readAll());
-    const QStringList lines = text.split(QLatin1Char('\n'), QString::SkipEmptyParts);
-    Path::List paths;
-    paths.reserve(lines.length());
-    for (const auto& line : lines) {
-        paths << Path(line);
-    }
-    return paths;
-}
-
 /**
- * File should contain the header to precompile and use while parsing
- * @returns the first path in the file
+ * @returns the beginning of the translation unit @p tuUrl, which is enough to find its leading includes
+ *
+ * Prefers the unsaved editor contents over the contents on disk.
  */
-Path userDefinedPchIncludeForFile(const QString& sourcefile)
-{
-    const QString pchIncludeFilename = QStringLiteral(".kdev_pch_include");
-    const auto paths = readPathListFile(findConfigFile(sourcefile, pchIncludeFilename));
-    return paths.isEmpty() ? Path() : paths.first();
-}
-
-ProjectFileItem* findProjectFileItem(const IndexedString& url, bool* hasBuildSystemInfo)
+QByteArray translationUnitHead(const QString& tuUrl, const QVector<UnsavedFile>& unsavedFiles)
 {
-    ProjectFileItem* file = nullptr;
+    const int headSize = 64 * 1024;
 
-    *hasBuildSystemInfo = false;
-    const auto& projects = ICore::self()->projectController()->projects();
-    for (auto project : projects) {
-        auto files = project->filesForPath(url);
-        if (files.isEmpty()) {
-            continue;
-        }
-
-        file = files.last();
-
-        // A file might be defined in different targets.
-        // Prefer file items defined inside a target with non-empty includes.
-        for (auto f: files) {
-            if (!dynamic_cast<ProjectTargetItem*>(f->parent())) {
-                continue;
-            }
-            file = f;
-            if (!IDefinesAndIncludesManager::manager()->includes(f, IDefinesAndIncludesManager::ProjectSpecific).isEmpty()) {
-                break;
-            }
+    const QByteArray fileName = tuUrl.toUtf8();
+    for (const auto& unsavedFile : unsavedFiles) {
+        const auto file = unsavedFile.toClangApi();
+        if (fileName == file.Filename) {
+            return QByteArray(file.Contents, qMin<int>(file.Length, headSize));
         }
     }
-    if (file && file->project()) {
-        if (auto bsm = file->project()->buildSystemManager()) {
-            *hasBuildSystemInfo = bsm->hasBuildInfo(file);
-        }
+
+    QFile file(tuUrl);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
     }
-    return file;
+    return file.read(headSize);
 }
 
 ClangParsingEnvironmentFile* parsingEnvironmentFile(const TopDUContext* context)
@@ -166,32 +100,7 @@ ClangParseJob::ClangParseJob(const IndexedString& url, ILanguageSupport* languag
     : ParseJob(url, languageSupport)
 {
     const auto tuUrl = clang()->index()->translationUnitForUrl(url);
-    bool hasBuildSystemInfo;
-    if (auto file = findProjectFileItem(tuUrl, &hasBuildSystemInfo)) {
-        m_environment.addIncludes(IDefinesAndIncludesManager::manager()->includes(file));
-        m_environment.addFrameworkDirectories(IDefinesAndIncludesManager::manager()->frameworkDirectories(file));
-        m_environment.addDefines(IDefinesAndIncludesManager::manager()->defines(file));
-        m_environment.setParserSettings(ClangSettingsManager::self()->parserSettings(file));
-    } else {
-        m_environment.addIncludes(IDefinesAndIncludesManager::manager()->includes(tuUrl.str()));
-        m_environment.addFrameworkDirectories(IDefinesAndIncludesManager::manager()->frameworkDirectories(tuUrl.str()));
-        m_environment.addDefines(IDefinesAndIncludesManager::manager()->defines(tuUrl.str()));
-        m_environment.setParserSettings(ClangSettingsManager::self()->parserSettings(tuUrl.str()));
-    }
-    const bool isSource = ClangHelpers::isSource(tuUrl.str());
-    m_environment.setQuality(
-        isSource ? (hasBuildSystemInfo ? ClangParsingEnvironment::BuildSystem : ClangParsingEnvironment::Source)
-        : ClangParsingEnvironment::Unknown
-    );
-    m_environment.setTranslationUnitUrl(tuUrl);
-
-    Path::List projectPaths;
-    const auto& projects = ICore::self()->projectController()->projects();
-    projectPaths.reserve(projects.size());
-    for (auto project : projects) {
-        projectPaths.append(project->path());
-    }
-    m_environment.setProjectPaths(projectPaths);
+    m_environment = clang()->environmentCache()->environment(tuUrl);
 
     m_unsavedFiles = ClangUtils::unsavedFiles();
 
@@ -234,22 +143,34 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
             return;
         }
 
-        m_environment.addIncludes(IDefinesAndIncludesManager::manager()->includesInBackground(tuUrlStr));
-        m_environment.addFrameworkDirectories(IDefinesAndIncludesManager::manager()->frameworkDirectoriesInBackground(tuUrlStr));
-        m_environment.addDefines(IDefinesAndIncludesManager::manager()->definesInBackground(tuUrlStr));
-        m_environment.addParserArguments(IDefinesAndIncludesManager::manager()->parserArgumentsInBackground(tuUrlStr));
-        m_environment.setPchInclude(userDefinedPchIncludeForFile(tuUrlStr));
+        const bool forceUpdate = minimumFeatures() & TopDUContext::ForceUpdate;
+        clang()->environmentCache()->resolveInBackground(&m_environment, forceUpdate);
+
+        // translation units starting with the same system includes share their precompiled preamble
+        if (!m_environment.pchInclude().isValid() && m_environment.quality() != ClangParsingEnvironment::Unknown) {
+            const auto head = translationUnitHead(tuUrlStr, m_unsavedFiles);
+            m_environment.setPchInclude(clang()->index()->sharedPreamble(m_environment, head));
+        }
     }
 
     if (abortRequested()) {
         return;
     }
 
+    // Translation units that are not opened in the editor and of which nobody needs more than the visible
+    // declarations are parsed without function bodies, which is a lot faster. The features of the
+    // contexts record that, so they are parsed again completely once they get opened or their uses
+    // are searched.
     // NOTE: we must have all declarations, contexts and uses available for files that are opened in the editor
-    //       it is very hard to check this for all included files of this TU, and previously lead to problems
-    //       when we tried to skip function bodies as an optimization for files that where not open in the editor.
-    //       now, we always build everything, which is correct but a tad bit slower. we can try to optimize later.
-    setMinimumFeatures(static_cast<TopDUContext::Features>(minimumFeatures() | TopDUContext::AllDeclarationsContextsAndUses));
+    //       the included files that are opened in the editor are thus parsed again completely, see below
+    const bool skipFunctionBodies = (minimumFeatures() & TopDUContext::AllDeclarationsAndContexts) != TopDUContext::AllDeclarationsAndContexts
+        && !(minimumFeatures() & AttachASTWithoutUpdating)
+        && !trackerForUrl(document()) && !trackerForUrl(m_environment.translationUnitUrl());
+    if (skipFunctionBodies) {
+        setMinimumFeatures(static_cast<TopDUContext::Features>(minimumFeatures() | TopDUContext::VisibleDeclarationsAndContexts));
+    } else {
+        setMinimumFeatures(static_cast<TopDUContext::Features>(minimumFeatures() | TopDUContext::AllDeclarationsContextsAndUses));
+    }
 
     if (minimumFeatures() & AttachASTWithoutUpdating) {
         // The context doesn't need to be updated, but has no AST attached (restored from disk),
@@ -284,7 +205,7 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
     }
 
     if (!session.data() || !session.reparse(m_unsavedFiles, m_environment)) {
-        session.setData(createSessionData());
+        session.setData(createSessionData(skipFunctionBodies));
     }
 
     if (!session.unit()) {
@@ -361,6 +282,12 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
             }
         }
         if (trackerForUrl(context->url())) {
+            if (skipFunctionBodies) {
+                // the editor needs the uses and an AST that contains the function bodies
+                ICore::self()->languageController()->backgroundParser()->addDocument(context->url(),
+                    TopDUContext::AllDeclarationsContextsAndUses, priority());
+                continue;
+            }
             if (clang()->index()->translationUnitForUrl(context->url()) == m_environment.translationUnitUrl()) {
                 // cache the parse session and the contained translation unit for this chain
                 // this then allows us to quickly reparse the document if it is changed by
@@ -376,9 +303,10 @@ void ClangParseJob::run(ThreadWeaver::JobPointer /*self*/, ThreadWeaver::Thread*
     }
 }
 
-ParseSessionData::Ptr ClangParseJob::createSessionData() const
+ParseSessionData::Ptr ClangParseJob::createSessionData(bool skipFunctionBodies) const
 {
-    return ParseSessionData::Ptr(new ParseSessionData(m_unsavedFiles, clang()->index(), m_environment, ParseSessionData::NoOption));
+    const auto options = skipFunctionBodies ? ParseSessionData::SkipFunctionBodies : ParseSessionData::NoOption;
+    return ParseSessionData::Ptr(new ParseSessionData(m_unsavedFiles, clang()->index(), m_environment, options));
 }
 
 const ParsingEnvironment* ClangParseJob::environment() const
@@ -53,7 +53,7 @@ protected:
     const KDevelop::ParsingEnvironment* environment() const override;
 
 private:
-    QExplicitlySharedDataPointer<ParseSessionData> createSessionData() const;
+    QExplicitlySharedDataPointer<ParseSessionData> createSessionData(bool skipFunctionBodies = false) const;
 
     ClangParsingEnvironment m_environment;
     QVector<UnsavedFile> m_unsavedFiles;
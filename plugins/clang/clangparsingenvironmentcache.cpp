@@ -0,0 +1,286 @@
+/*
+    This file is part of KDevelop
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "clangparsingenvironmentcache.h"
+
+#include <interfaces/icore.h>
+#include <interfaces/iproject.h>
+#include <interfaces/iprojectcontroller.h>
+#include <interfaces/iruntimecontroller.h>
+
+#include <custom-definesandincludes/idefinesandincludesmanager.h>
+
+#include <project/projectmodel.h>
+#include <project/interfaces/ibuildsystemmanager.h>
+
+#include "clangsettings/clangsettingsmanager.h"
+#include "duchain/clanghelpers.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+using namespace KDevelop;
+
+namespace {
+
+QString findConfigFile(const QString& forFile, const QString& configFileName)
+{
+    QDir dir = QFileInfo(forFile).dir();
+    while (dir.exists()) {
+        const QFileInfo customIncludePaths(dir, configFileName);
+        if (customIncludePaths.exists()) {
+            return customIncludePaths.absoluteFilePath();
+        }
+
+        if (!dir.cdUp()) {
+            break;
+        }
+    }
+
+    return {};
+}
+
+Path::List readPathListFile(const QString& filepath)
+{
+    if (filepath.isEmpty()) {
+        return {};
+    }
+
+    QFile f(filepath);
+    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return {};
+    }
+
+    const QString text = QString::fromLocal8Bit(f.readAll());
+    const QStringList lines = text.split(QLatin1Char('\n'), QString::SkipEmptyParts);
+    Path::List paths;
+    paths.reserve(lines.length());
+    for (const auto& line : lines) {
+        paths << Path(line);
+    }
+    return paths;
+}
+
+/**
+ * File should contain the header to precompile and use while parsing
+ * @returns the first path in the file
+ */
+Path userDefinedPchIncludeForFile(const QString& sourcefile)
+{
+    const QString pchIncludeFilename = QStringLiteral(".kdev_pch_include");
+    const auto paths = readPathListFile(findConfigFile(sourcefile, pchIncludeFilename));
+    return paths.isEmpty() ? Path() : paths.first();
+}
+
+ProjectFileItem* findProjectFileItem(const IndexedString& url, bool* hasBuildSystemInfo)
+{
+    ProjectFileItem* file = nullptr;
+
+    *hasBuildSystemInfo = false;
+    const auto& projects = ICore::self()->projectController()->projects();
+    for (auto project : projects) {
+        auto files = project->filesForPath(url);
+        if (files.isEmpty()) {
+            continue;
+        }
+
+        file = files.last();
+
+        // A file might be defined in different targets.
+        // Prefer file items defined inside a target with non-empty includes.
+        for (auto f: files) {
+            if (!dynamic_cast<ProjectTargetItem*>(f->parent())) {
+                continue;
+            }
+            file = f;
+            if (!IDefinesAndIncludesManager::manager()->includes(f, IDefinesAndIncludesManager::ProjectSpecific).isEmpty()) {
+                break;
+            }
+        }
+    }
+    if (file && file->project()) {
+        if (auto bsm = file->project()->buildSystemManager()) {
+            *hasBuildSystemInfo = bsm->hasBuildInfo(file);
+        }
+    }
+    return file;
+}
+
+}
+
+ClangParsingEnvironmentCache::ClangParsingEnvironmentCache()
+{
+    auto projectController = ICore::self()->projectController();
+    connect(projectController, &IProjectController::projectOpened,
+            this, &ClangParsingEnvironmentCache::projectOpened);
+    connect(projectController, &IProjectController::projectClosed,
+            this, &ClangParsingEnvironmentCache::invalidateAll);
+    connect(projectController, &IProjectController::projectConfigurationChanged,
+            this, &ClangParsingEnvironmentCache::invalidate);
+    connect(ICore::self()->runtimeController(), &IRuntimeController::currentRuntimeChanged,
+            this, &ClangParsingEnvironmentCache::invalidateAll);
+
+    const auto projects = projectController->projects();
+    for (auto project : projects) {
+        projectOpened(project);
+    }
+}
+
+ClangParsingEnvironmentCache::~ClangParsingEnvironmentCache() = default;
+
+void ClangParsingEnvironmentCache::projectOpened(IProject* project)
+{
+    // files moving between targets change their include paths and defines
+    connect(project, &IProject::fileAddedToSet, this, [this, project]() {
+        invalidate(project);
+    });
+    connect(project, &IProject::fileRemovedFromSet, this, [this, project]() {
+        invalidate(project);
+    });
+
+    // the project paths of all environments change
+    invalidateAll();
+}
+
+void ClangParsingEnvironmentCache::invalidate(IProject* project)
+{
+    QMutexLocker lock(&m_mutex);
+    // the entries are not removed right away, as this happens for every file while a project is reloaded
+    m_projectGenerations[project] = ++m_generation;
+}
+
+void ClangParsingEnvironmentCache::invalidateAll()
+{
+    QMutexLocker lock(&m_mutex);
+    m_allGeneration = ++m_generation;
+    m_entries.clear();
+    m_projectGenerations.clear();
+}
+
+quint64 ClangParsingEnvironmentCache::generation(IProject* project) const
+{
+    return qMax(m_allGeneration, project ? m_projectGenerations.value(project) : 0);
+}
+
+bool ClangParsingEnvironmentCache::isCurrent(IProject* project, quint64 generation) const
+{
+    return generation >= this->generation(project);
+}
+
+ClangParsingEnvironment ClangParsingEnvironmentCache::environment(const IndexedString& tuUrl)
+{
+    quint64 generation;
+    {
+        QMutexLocker lock(&m_mutex);
+        const auto it = m_entries.constFind(tuUrl);
+        if (it != m_entries.constEnd() && isCurrent(it->project, it->generation)) {
+            ++m_hits;
+            return it->environment;
+        }
+        ++m_misses;
+        generation = m_generation;
+    }
+
+    ClangParsingEnvironment environment;
+    bool hasBuildSystemInfo;
+    IProject* project = nullptr;
+    if (auto file = findProjectFileItem(tuUrl, &hasBuildSystemInfo)) {
+        project = file->project();
+        environment.addIncludes(IDefinesAndIncludesManager::manager()->includes(file));
+        environment.addFrameworkDirectories(IDefinesAndIncludesManager::manager()->frameworkDirectories(file));
+        environment.addDefines(IDefinesAndIncludesManager::manager()->defines(file));
+        environment.setParserSettings(ClangSettingsManager::self()->parserSettings(file));
+    } else {
+        environment.addIncludes(IDefinesAndIncludesManager::manager()->includes(tuUrl.str()));
+        environment.addFrameworkDirectories(IDefinesAndIncludesManager::manager()->frameworkDirectories(tuUrl.str()));
+        environment.addDefines(IDefinesAndIncludesManager::manager()->defines(tuUrl.str()));
+        environment.setParserSettings(ClangSettingsManager::self()->parserSettings(tuUrl.str()));
+    }
+    const bool isSource = ClangHelpers::isSource(tuUrl.str());
+    environment.setQuality(
+        isSource ? (hasBuildSystemInfo ? ClangParsingEnvironment::BuildSystem : ClangParsingEnvironment::Source)
+        : ClangParsingEnvironment::Unknown
+    );
+    environment.setTranslationUnitUrl(tuUrl);
+
+    Path::List projectPaths;
+    const auto& projects = ICore::self()->projectController()->projects();
+    projectPaths.reserve(projects.size());
+    for (auto project : projects) {
+        projectPaths.append(project->path());
+    }
+    environment.setProjectPaths(projectPaths);
+    const uint hash = environment.hash();
+
+    QMutexLocker lock(&m_mutex);
+    // don't cache what was resolved while the project changed
+    if (isCurrent(project, generation)) {
+        auto& entry = m_entries[tuUrl];
+        entry.project = project;
+        entry.generation = generation;
+        entry.environment = environment;
+        entry.hash = hash;
+        entry.backgroundHash = 0;
+    }
+    return environment;
+}
+
+ClangParsingEnvironmentCache::Statistics ClangParsingEnvironmentCache::statistics() const
+{
+    QMutexLocker lock(&m_mutex);
+    Statistics ret;
+    ret.hits = m_hits;
+    ret.misses = m_misses;
+    ret.entries = m_entries.size();
+    return ret;
+}
+
+void ClangParsingEnvironmentCache::resolveInBackground(ClangParsingEnvironment* environment, bool forceUpdate)
+{
+    const auto tuUrl = environment->translationUnitUrl();
+    const uint hash = environment->hash();
+
+    quint64 generation;
+    {
+        QMutexLocker lock(&m_mutex);
+        const auto it = m_entries.constFind(tuUrl);
+        if (!forceUpdate && it != m_entries.constEnd() && it->backgroundHash == hash
+            && isCurrent(it->project, it->generation)) {
+            *environment = it->backgroundEnvironment;
+            return;
+        }
+        generation = m_generation;
+    }
+
+    const auto tuUrlStr = tuUrl.str();
+    environment->addIncludes(IDefinesAndIncludesManager::manager()->includesInBackground(tuUrlStr));
+    environment->addFrameworkDirectories(IDefinesAndIncludesManager::manager()->frameworkDirectoriesInBackground(tuUrlStr));
+    environment->addDefines(IDefinesAndIncludesManager::manager()->definesInBackground(tuUrlStr));
+    environment->addParserArguments(IDefinesAndIncludesManager::manager()->parserArgumentsInBackground(tuUrlStr));
+    environment->setPchInclude(userDefinedPchIncludeForFile(tuUrlStr));
+
+    QMutexLocker lock(&m_mutex);
+    const auto it = m_entries.find(tuUrl);
+    // only cache the background environment next to the project environment it was resolved from
+    if (it != m_entries.end() && it->hash == hash && isCurrent(it->project, generation)) {
+        it->backgroundHash = hash;
+        it->backgroundEnvironment = *environment;
+    }
+}
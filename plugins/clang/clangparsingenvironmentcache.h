@@ -0,0 +1,111 @@
+/*
+    This file is part of KDevelop
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CLANGPARSINGENVIRONMENTCACHE_H
+#define CLANGPARSINGENVIRONMENTCACHE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+
+#include "clangprivateexport.h"
+#include "duchain/clangparsingenvironment.h"
+
+namespace KDevelop {
+class IProject;
+}
+
+/**
+ * Caches the include paths, defines and parser arguments of translation units.
+ *
+ * Resolving them asks the build system manager and all defines and includes providers, which
+ * is too expensive to do for every parse job. The cached environments of a project are
+ * invalidated when the project is reconfigured or its files change, and all of them when
+ * a project is opened or closed or the runtime changes.
+ *
+ * This class is thread safe.
+ */
+class KDEVCLANGPRIVATE_EXPORT ClangParsingEnvironmentCache : public QObject
+{
+    Q_OBJECT
+public:
+    ClangParsingEnvironmentCache();
+    ~ClangParsingEnvironmentCache() override;
+
+    /**
+     * @returns the environment of the translation unit @p tuUrl as known to its project
+     *
+     * This function must be called from the main thread.
+     */
+    ClangParsingEnvironment environment(const KDevelop::IndexedString& tuUrl);
+
+    /**
+     * Adds the include paths, defines and arguments to @p environment that are resolved in the background,
+     * e.g. by querying the compiler, as well as the user-defined PCH include.
+     *
+     * @p environment must be one returned by environment(). Background providers do not announce
+     * changes, pass @p forceUpdate to resolve the environment again instead of using the cached one.
+     */
+    void resolveInBackground(ClangParsingEnvironment* environment, bool forceUpdate = false);
+
+    struct Statistics
+    {
+        /// How often environment() returned a cached environment
+        int hits = 0;
+        /// How often environment() had to resolve the environment
+        int misses = 0;
+        /// Count of cached environments
+        int entries = 0;
+    };
+
+    Statistics statistics() const;
+
+public Q_SLOTS:
+    void invalidate(KDevelop::IProject* project);
+    void invalidateAll();
+
+private:
+    void projectOpened(KDevelop::IProject* project);
+    bool isCurrent(KDevelop::IProject* project, quint64 generation) const;
+    quint64 generation(KDevelop::IProject* project) const;
+
+    struct Entry
+    {
+        // nullptr for files outside of all projects
+        KDevelop::IProject* project = nullptr;
+        quint64 generation = 0;
+        ClangParsingEnvironment environment;
+        uint hash = 0;
+        // hash of the environment resolveInBackground() was called with, 0 if it was not yet
+        uint backgroundHash = 0;
+        ClangParsingEnvironment backgroundEnvironment;
+    };
+
+    mutable QMutex m_mutex;
+    QHash<KDevelop::IndexedString, Entry> m_entries;
+    // Increased whenever the cached environments become outdated
+    quint64 m_generation = 0;
+    // The generation of the last invalidateAll()
+    quint64 m_allGeneration = 0;
+    QHash<KDevelop::IProject*, quint64> m_projectGenerations;
+    int m_hits = 0;
+    int m_misses = 0;
+};
+
+#endif // CLANGPARSINGENVIRONMENTCACHE_H
@@ -24,6 +24,7 @@
 #include "clangsupport.h"
 
 #include "clangparsejob.h"
+#include "clangparsingenvironmentcache.h"
 
 #include "util/clangdebug.h"
 #include "util/clangtypes.h"
@@ -196,6 +197,7 @@ ClangSupport::ClangSupport(QObject* parent, const QVariantList& )
     m_highlighting = new ClangHighlighting(this);
     m_refactoring = new ClangRefactoring(this);
     m_index.reset(new ClangIndex);
+    m_environmentCache.reset(new ClangParsingEnvironmentCache);
 
     auto model = new KDevelop::CodeCompletion( this, new ClangCodeCompletionModel(m_index.data(), this), name() );
     connect(model, &CodeCompletion::registeredToView,
@@ -269,6 +271,11 @@ ClangIndex* ClangSupport::index()
     return m_index.data();
 }
 
+ClangParsingEnvironmentCache* ClangSupport::environmentCache()
+{
+    return m_environmentCache.data();
+}
+
 bool ClangSupport::areBuddies(const QUrl &url1, const QUrl& url2)
 {
     return DocumentFinderHelpers::areBuddies(url1, url2);
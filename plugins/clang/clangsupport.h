@@ -31,6 +31,7 @@
 #include <QVariantList>
 
 class ClangIndex;
+class ClangParsingEnvironmentCache;
 class ClangRefactoring;
 namespace KDevelop
 {
@@ -73,6 +74,8 @@ public:
 
     ClangIndex* index();
 
+    ClangParsingEnvironmentCache* environmentCache();
+
     KDevelop::TopDUContext* standardContext(const QUrl &url, bool proxyContext = false) override;
 
     KDevelop::ConfigPage* configPage(int number, QWidget *parent) override;
@@ -99,6 +102,7 @@ private:
     KDevelop::ICodeHighlighting *m_highlighting;
     ClangRefactoring *m_refactoring;
     QScopedPointer<ClangIndex> m_index;
+    QScopedPointer<ClangParsingEnvironmentCache> m_environmentCache;
 };
 
 #endif
@@ -22,8 +22,11 @@
 
 #include "context.h"
 
+#include <QFuture>
 #include <QRegularExpression>
 #include <QStandardPaths>
+#include <QThread>
+#include <QtConcurrentRun>
 
 #include <interfaces/icore.h>
 #include <interfaces/idocumentcontroller.h>
@@ -409,11 +412,7 @@ public:
 class ArgumentHintItem : public DeclarationItem
 {
 public:
-    struct CurrentArgumentRange
-    {
-        int start;
-        int end;
-    };
+    using CurrentArgumentRange = ClangCompletionResult::ArgumentRange;
 
     ArgumentHintItem(Declaration* decl,  const QString& prefix, const QString& name, const QString& arguments, const CurrentArgumentRange& range)
         : DeclarationItem(decl, name, prefix, {})
@@ -865,15 +864,231 @@ static MemberAccessReplacer s_memberAccessReplacer;
 
 Q_DECLARE_METATYPE(MemberAccessReplacer::Type)
 
+namespace {
+
+/// Minimum count of results that are decoded concurrently
+const uint MIN_CONCURRENTLY_DECODED_RESULTS = 1000;
+
+ClangCompletionResult decodeResult(const CXCompletionResult& result)
+{
+    ClangCompletionResult decoded;
+    decoded.kind = result.CursorKind;
+    #if CINDEX_VERSION_MINOR >= 30
+    decoded.isOverloadCandidate = result.CursorKind == CXCursor_OverloadCandidate;
+    #endif
+    decoded.availability = clang_getCompletionAvailability(result.CompletionString);
+    decoded.priority = clang_getCompletionPriority(result.CompletionString);
+
+    const bool isOverloadCandidate = decoded.isOverloadCandidate;
+    const bool isDeclaration = result.CursorKind != CXCursor_MacroDefinition && result.CursorKind != CXCursor_NotImplemented;
+
+    QString& typed = decoded.typed;
+    QString& resultType = decoded.resultType;
+    QString& replacement = decoded.replacement;
+    QString& arguments = decoded.arguments;
+    auto& argumentRange = decoded.argumentRange;
+
+    //BEGIN function signature parsing
+    // nesting depth of parentheses
+    int parenDepth = 0;
+    enum FunctionSignatureState {
+        // not yet inside the function signature
+        Before,
+        // any token is part of the function signature now
+        Inside,
+        // finished parsing the function signature
+        After
+    };
+    // current state
+    FunctionSignatureState signatureState = Before;
+    //END function signature parsing
+
+    std::function<void (CXCompletionString)> processChunks = [&] (CXCompletionString completionString) {
+        const uint chunks = clang_getNumCompletionChunks(completionString);
+        for (uint j = 0; j < chunks; ++j) {
+            const auto kind = clang_getCompletionChunkKind(completionString, j);
+            if (kind == CXCompletionChunk_Optional) {
+                completionString = clang_getCompletionChunkCompletionString(completionString, j);
+                if (completionString) {
+                    processChunks(completionString);
+                }
+                continue;
+            }
+
+            // We don't need function signature for declaration items, we can get it directly from the declaration. Also adding the function signature to the "display" would break the "Detailed completion" option.
+            if (isDeclaration && !typed.isEmpty()) {
+                // TODO: When parent context for CXCursor_OverloadCandidate is fixed remove this check
+                if (!isOverloadCandidate) {
+                    break;
+                }
+            }
+
+            const QString string = ClangString(clang_getCompletionChunkText(completionString, j)).toString();
+
+            switch (kind) {
+            case CXCompletionChunk_TypedText:
+                typed = string;
+                replacement += string;
+                break;
+            case CXCompletionChunk_ResultType:
+                resultType = string;
+                continue;
+            case CXCompletionChunk_Placeholder:
+                if (signatureState == Inside) {
+                    arguments += string;
+                }
+                continue;
+            case CXCompletionChunk_LeftParen:
+                if (signatureState == Before && !parenDepth) {
+                    signatureState = Inside;
+                }
+                parenDepth++;
+                break;
+            case CXCompletionChunk_RightParen:
+                --parenDepth;
+                if (signatureState == Inside && !parenDepth) {
+                    arguments += QLatin1Char(')');
+                    signatureState = After;
+                }
+                break;
+            case CXCompletionChunk_Text:
+                if (isOverloadCandidate) {
+                    typed += string;
+                }
+                else if (result.CursorKind == CXCursor_EnumConstantDecl) {
+                    replacement += string;
+                }
+                break;
+            case CXCompletionChunk_CurrentParameter:
+                argumentRange.start = arguments.size();
+                argumentRange.end = string.size();
+                break;
+            default:
+                break;
+            }
+            if (signatureState == Inside) {
+                arguments += string;
+            }
+        }
+    };
+
+    processChunks(result.CompletionString);
+
+    // TODO: No closing paren if default parameters present
+    if (isOverloadCandidate && !arguments.endsWith(QLatin1Char(')'))) {
+        arguments += QLatin1Char(')');
+    }
+    // ellide text to the right for overly long result types (templates especially)
+    elideStringRight(resultType, MAX_RETURN_TYPE_STRING_LENGTH);
+
+    if (isDeclaration) {
+        ClangString parent(clang_getCompletionParent(result.CompletionString, nullptr));
+        decoded.hasParent = parent.c_str() != nullptr;
+        decoded.parent = parent.toString();
+    }
+
+    return decoded;
+}
+
+/**
+ * Decodes all completion @p results.
+ *
+ * Global completion in a file that includes the STL or Qt yields tens of thousands of results.
+ * Their completion strings are only read here, so large result sets are decoded concurrently.
+ */
+QVector<ClangCompletionResult> decodeResults(CXCodeCompleteResults* results)
+{
+    const uint numResults = results->NumResults;
+    QVector<ClangCompletionResult> decoded(numResults);
+    auto* data = decoded.data();
+
+    const auto decodeRange = [results, data](uint begin, uint end) {
+        for (uint i = begin; i < end; ++i) {
+            data[i] = decodeResult(results->Results[i]);
+        }
+    };
+
+    const uint numChunks = std::min(numResults / MIN_CONCURRENTLY_DECODED_RESULTS + 1,
+                                    static_cast<uint>(std::max(QThread::idealThreadCount(), 1)));
+    const uint chunkSize = (numResults + numChunks - 1) / numChunks;
+
+    QVector<QFuture<void>> futures;
+    futures.reserve(numChunks - 1);
+    for (uint begin = chunkSize; begin < numResults; begin += chunkSize) {
+        const uint end = std::min(begin + chunkSize, numResults);
+        futures << QtConcurrent::run([decodeRange, begin, end]() {
+            decodeRange(begin, end);
+        });
+    }
+    // the first chunk is decoded by this thread
+    decodeRange(0, std::min(chunkSize, numResults));
+
+    for (auto& future : futures) {
+        future.waitForFinished();
+    }
+    return decoded;
+}
+
+/// @return @p followingText without the identifier it starts with
+QString textAfterWord(const QString& followingText)
+{
+    const auto wordEnd = std::find_if(followingText.begin(), followingText.end(), [](const QChar c) {
+        return !c.isLetterOrNumber() && c != QLatin1Char('_');
+    });
+    return followingText.mid(wordEnd - followingText.begin());
+}
+
+/// @return a hash of the unsaved contents of all files but @p file
+uint otherUnsavedFilesHash(const QVector<UnsavedFile>& unsavedFiles, const QByteArray& file)
+{
+    uint hash = 0;
+    for (const auto& unsavedFile : unsavedFiles) {
+        const auto unsaved = unsavedFile.toClangApi();
+        if (file == unsaved.Filename) {
+            continue;
+        }
+        hash = qHash(QByteArray::fromRawData(unsaved.Filename, qstrlen(unsaved.Filename)), hash);
+        hash = qHash(QByteArray::fromRawData(unsaved.Contents, unsaved.Length), hash);
+    }
+    return hash;
+}
+
+/**
+ * @return whether the completion widget could show @p result for the typed @p prefix
+ *
+ * The characters of the prefix have to appear in order in the typed text of the result, ignoring case.
+ * That keeps everything the widget matches itself, including abbreviations like "qsv" for "QStringView".
+ */
+bool canMatchPrefix(const ClangCompletionResult& result, const QString& prefix)
+{
+    if (result.isOverloadCandidate) {
+        // argument hints are shown for the call, not filtered by the word
+        return true;
+    }
+
+    int from = 0;
+    for (const QChar c : prefix) {
+        from = result.typed.indexOf(c, from, Qt::CaseInsensitive);
+        if (from == -1) {
+            return false;
+        }
+        ++from;
+    }
+    return true;
+}
+
+}
+
 ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& context,
                                                        const ParseSessionData::Ptr& sessionData,
                                                        const QUrl& url,
                                                        const KTextEditor::Cursor& position,
                                                        const QString& text,
-                                                       const QString& followingText
+                                                       const QString& followingText,
+                                                       const QString& prefix,
+                                                       const ResultCache& previousResults
                                                       )
     : CodeCompletionContext(context, text + followingText, CursorInRevision::castFromSimpleCursor(position), 0)
-    , m_results(nullptr, clang_disposeCodeCompleteResults)
     , m_parseSessionData(sessionData)
 {
     qRegisterMetaType<MemberAccessReplacer::Type>();
@@ -887,7 +1102,18 @@ ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& c
     }
     QVector<CXUnsavedFile> allUnsaved;
 
-    {
+    ResultCache::Key resultKey;
+    resultKey.file = file;
+    resultKey.revision = session.revision();
+    resultKey.position = position;
+    resultKey.text = text;
+    resultKey.textAfterWord = textAfterWord(followingText);
+    resultKey.otherUnsavedFilesHash = otherUnsavedFilesHash(otherUnsavedFiles, file);
+
+    const bool reuseResults = previousResults.isValid() && previousResults.key == resultKey;
+    if (reuseResults) {
+        m_results = previousResults.results;
+    } else {
         const unsigned int completeOptions = clang_defaultCodeCompleteOptions();
 
         CXUnsavedFile unsaved;
@@ -902,19 +1128,22 @@ ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& c
         }
         allUnsaved.append(unsaved);
 
-        m_results.reset(clang_codeCompleteAt(session.unit(), file.constData(),
-                        position.line() + 1, position.column() + 1,
-                        allUnsaved.data(), allUnsaved.size(),
-                        completeOptions));
+        std::unique_ptr<CXCodeCompleteResults, void(*)(CXCodeCompleteResults*)> results(
+            clang_codeCompleteAt(session.unit(), file.constData(),
+                                 position.line() + 1, position.column() + 1,
+                                 allUnsaved.data(), allUnsaved.size(),
+                                 completeOptions),
+            clang_disposeCodeCompleteResults);
 
-        if (!m_results) {
+        if (!results) {
             qCWarning(KDEV_CLANG) << "Something went wrong during 'clang_codeCompleteAt' for file" << file;
+            m_valid = false;
             return;
         }
 
-        auto numDiagnostics = clang_codeCompleteGetNumDiagnostics(m_results.get());
+        auto numDiagnostics = clang_codeCompleteGetNumDiagnostics(results.get());
         for (uint i = 0; i < numDiagnostics; i++) {
-            auto diagnostic = clang_codeCompleteGetDiagnostic(m_results.get(), i);
+            auto diagnostic = clang_codeCompleteGetDiagnostic(results.get(), i);
             auto diagnosticType = ClangDiagnosticEvaluator::diagnosticType(diagnostic);
             clang_disposeDiagnostic(diagnostic);
             if (diagnosticType == ClangDiagnosticEvaluator::ReplaceWithArrowProblem || diagnosticType == ClangDiagnosticEvaluator::ReplaceWithDotProblem) {
@@ -933,13 +1162,15 @@ ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& c
             }
         }
 
-        auto addMacros = ClangSettingsManager::self()->codeCompletionSettings().macros;
-        if (!addMacros) {
-            m_filters |= NoMacros;
-        }
+        m_results = decodeResults(results.get());
+    }
+
+    auto addMacros = ClangSettingsManager::self()->codeCompletionSettings().macros;
+    if (!addMacros) {
+        m_filters |= NoMacros;
     }
 
-    if (!m_results->NumResults) {
+    if (!reuseResults && m_results.isEmpty()) {
         const auto trimmedText = text.trimmed();
         if (trimmedText.endsWith(QLatin1Char('.'))) {
             // TODO: This shouldn't be needed if Clang provided diagnostic.
@@ -953,12 +1184,14 @@ ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& c
             unsaved.Length = content.size();
             allUnsaved[allUnsaved.size() - 1] = unsaved;
 
-            m_results.reset(clang_codeCompleteAt(session.unit(), file.constData(),
-                                                 position.line() + 1, position.column() + 1 + 1,
-                                                 allUnsaved.data(), allUnsaved.size(),
-                                                 clang_defaultCodeCompleteOptions()));
+            std::unique_ptr<CXCodeCompleteResults, void(*)(CXCodeCompleteResults*)> results(
+                clang_codeCompleteAt(session.unit(), file.constData(),
+                                     position.line() + 1, position.column() + 1 + 1,
+                                     allUnsaved.data(), allUnsaved.size(),
+                                     clang_defaultCodeCompleteOptions()),
+                clang_disposeCodeCompleteResults);
 
-            if (m_results && m_results->NumResults) {
+            if (results && results->NumResults) {
                 QMetaObject::invokeMethod(&s_memberAccessReplacer, "replaceCurrentAccess", Qt::QueuedConnection,
                                           Q_ARG(MemberAccessReplacer::Type, MemberAccessReplacer::DotToArrow));
             }
@@ -976,6 +1209,25 @@ ClangCodeCompletionContext::ClangCodeCompletionContext(const DUContextPointer& c
     }
 
     m_completionHelper.computeCompletions(session, clangFile, position);
+
+    m_prefix = prefix;
+    if (reuseResults && prefix.startsWith(previousResults.prefix)) {
+        // typing on can only drop matches
+        for (const int index : previousResults.matches) {
+            if (canMatchPrefix(m_results.at(index), prefix)) {
+                m_matches.append(index);
+            }
+        }
+    } else {
+        m_matches.reserve(m_results.size());
+        for (int index = 0; index < m_results.size(); ++index) {
+            if (canMatchPrefix(m_results.at(index), prefix)) {
+                m_matches.append(index);
+            }
+        }
+    }
+
+    m_resultKey = resultKey;
 }
 
 ClangCodeCompletionContext::~ClangCodeCompletionContext()
@@ -993,7 +1245,7 @@ bool ClangCodeCompletionContext::isValidPosition(CXTranslationUnit unit, CXFile
 
 QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(bool& abort, bool /*fullCompletion*/)
 {
-    if (!m_valid || !m_duContext || !m_results) {
+    if (!m_valid || !m_duContext) {
         return {};
     }
 
@@ -1019,31 +1271,29 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
     // If ctx is/inside the Class context, this represents that context.
     const auto currentClassContext = classDeclarationForContext(ctx, m_position);
 
-    clangDebug() << "Clang found" << m_results->NumResults << "completion results";
+    clangDebug() << "Clang found" << m_results.size() << "completion results," << m_matches.size() << "can match" << m_prefix;
 
-    for (uint i = 0; i < m_results->NumResults; ++i) {
+    // only the results that can match the typed prefix are looked up, the completion widget hides all others
+    for (const int index : qAsConst(m_matches)) {
         if (abort) {
             return {};
         }
 
-        auto result = m_results->Results[i];
-        #if CINDEX_VERSION_MINOR >= 30
-        const bool isOverloadCandidate = result.CursorKind == CXCursor_OverloadCandidate;
-        #else
-        const bool isOverloadCandidate = false;
-        #endif
+        const auto& result = m_results.at(index);
 
-        const auto availability = clang_getCompletionAvailability(result.CompletionString);
+        const bool isOverloadCandidate = result.isOverloadCandidate;
+
+        const auto availability = result.availability;
         if (availability == CXAvailability_NotAvailable) {
             continue;
         }
 
-        const bool isMacroDefinition = result.CursorKind == CXCursor_MacroDefinition;
+        const bool isMacroDefinition = result.kind == CXCursor_MacroDefinition;
         if (isMacroDefinition && m_filters & NoMacros) {
             continue;
         }
 
-        const bool isBuiltin = (result.CursorKind == CXCursor_NotImplemented);
+        const bool isBuiltin = (result.kind == CXCursor_NotImplemented);
         if (isBuiltin && m_filters & NoBuiltins) {
             continue;
         }
@@ -1057,111 +1307,11 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
             continue;
         }
 
-        // the string that would be needed to type, usually the identifier of something. Also we use it as name for code completion declaration items.
-        QString typed;
-        // the return type of a function e.g.
-        QString resultType;
-        // the replacement text when an item gets executed
-        QString replacement;
-
-        QString arguments;
-
-        ArgumentHintItem::CurrentArgumentRange argumentRange;
-        //BEGIN function signature parsing
-        // nesting depth of parentheses
-        int parenDepth = 0;
-        enum FunctionSignatureState {
-            // not yet inside the function signature
-            Before,
-            // any token is part of the function signature now
-            Inside,
-            // finished parsing the function signature
-            After
-        };
-        // current state
-        FunctionSignatureState signatureState = Before;
-        //END function signature parsing
-
-        std::function<void (CXCompletionString)> processChunks = [&] (CXCompletionString completionString) {
-            const uint chunks = clang_getNumCompletionChunks(completionString);
-            for (uint j = 0; j < chunks; ++j) {
-                const auto kind = clang_getCompletionChunkKind(completionString, j);
-                if (kind == CXCompletionChunk_Optional) {
-                    completionString = clang_getCompletionChunkCompletionString(completionString, j);
-                    if (completionString) {
-                        processChunks(completionString);
-                    }
-                    continue;
-                }
-
-                // We don't need function signature for declaration items, we can get it directly from the declaration. Also adding the function signature to the "display" would break the "Detailed completion" option.
-                if (isDeclaration && !typed.isEmpty()) {
-                    // TODO: When parent context for CXCursor_OverloadCandidate is fixed remove this check
-                    if (!isOverloadCandidate) {
-                        break;
-                    }
-                }
-
-                const QString string = ClangString(clang_getCompletionChunkText(completionString, j)).toString();
-
-                switch (kind) {
-                case CXCompletionChunk_TypedText:
-                    typed = string;
-                    replacement += string;
-                    break;
-                case CXCompletionChunk_ResultType:
-                    resultType = string;
-                    continue;
-                case CXCompletionChunk_Placeholder:
-                    if (signatureState == Inside) {
-                        arguments += string;
-                    }
-                    continue;
-                case CXCompletionChunk_LeftParen:
-                    if (signatureState == Before && !parenDepth) {
-                        signatureState = Inside;
-                    }
-                    parenDepth++;
-                    break;
-                case CXCompletionChunk_RightParen:
-                    --parenDepth;
-                    if (signatureState == Inside && !parenDepth) {
-                        arguments += QLatin1Char(')');
-                        signatureState = After;
-                    }
-                    break;
-                case CXCompletionChunk_Text:
-                    if (isOverloadCandidate) {
-                        typed += string;
-                    }
-                    else if (result.CursorKind == CXCursor_EnumConstantDecl) {
-                        replacement += string;
-                    }
-                    else if (result.CursorKind == CXCursor_EnumConstantDecl) {
-                        replacement += string;
-                    }
-                    break;
-                case CXCompletionChunk_CurrentParameter:
-                    argumentRange.start = arguments.size();
-                    argumentRange.end = string.size();
-                    break;
-                default:
-                    break;
-                }
-                if (signatureState == Inside) {
-                    arguments += string;
-                }
-            }
-        };
-
-        processChunks(result.CompletionString);
-
-        // TODO: No closing paren if default parameters present
-        if (isOverloadCandidate && !arguments.endsWith(QLatin1Char(')'))) {
-            arguments += QLatin1Char(')');
-        }
-        // ellide text to the right for overly long result types (templates especially)
-        elideStringRight(resultType, MAX_RETURN_TYPE_STRING_LENGTH);
+        const QString& typed = result.typed;
+        const QString& resultType = result.resultType;
+        const QString& replacement = result.replacement;
+        const QString& arguments = result.arguments;
+        const auto& argumentRange = result.argumentRange;
 
         static const auto noIcon = QIcon(QStandardPaths::locate(QStandardPaths::GenericDataLocation,
                                                                 QStringLiteral("kdevelop/pics/namespace.png")));
@@ -1169,9 +1319,8 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
         if (isDeclaration) {
             const Identifier id(typed);
             QualifiedIdentifier qid;
-            ClangString parent(clang_getCompletionParent(result.CompletionString, nullptr));
-            if (parent.c_str() != nullptr) {
-                qid = QualifiedIdentifier(parent.toString());
+            if (result.hasParent) {
+                qid = QualifiedIdentifier(result.parent);
             }
             qid.push(id);
 
@@ -1179,7 +1328,7 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
                 continue;
             }
 
-            if (isOverloadCandidate && resultType.isEmpty() && parent.isEmpty()) {
+            if (isOverloadCandidate && resultType.isEmpty() && result.parent.isEmpty()) {
                 // workaround: find constructor calls for non-namespaced classes
                 // TODO: return the namespaced class as parent in libclang
                 qid.push(id);
@@ -1216,7 +1365,7 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
                     declarationItem = new DeclarationItem(found, typed, resultType, replacement);
                 }
 
-                const unsigned int completionPriority = adjustPriorityForDeclaration(found, clang_getCompletionPriority(result.CompletionString));
+                const unsigned int completionPriority = adjustPriorityForDeclaration(found, result.priority);
                 const bool bestMatch = completionPriority <= CCP_SuperCompletion;
 
                 //don't set best match property for internal identifiers, also prefer declarations from current file
@@ -1264,7 +1413,7 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
             continue;
         }
 
-        if (result.CursorKind == CXCursor_MacroDefinition) {
+        if (result.kind == CXCursor_MacroDefinition) {
             // TODO: grouping of macros and built-in stuff
             const auto text = QString(typed + arguments);
             auto instance = new SimpleItem(text, resultType, replacement, noIcon);
@@ -1273,7 +1422,7 @@ QList<CompletionTreeItemPointer> ClangCodeCompletionContext::completionItems(boo
                 instance->markAsUnimportant();
             }
             macros.append(item);
-        } else if (result.CursorKind == CXCursor_NotImplemented) {
+        } else if (result.kind == CXCursor_NotImplemented) {
             auto instance = new SimpleItem(typed, resultType, replacement, noIcon);
             auto item = CompletionTreeItemPointer(instance);
             builtin.append(item);
@@ -1368,4 +1517,16 @@ void ClangCodeCompletionContext::setFilters(const ClangCodeCompletionContext::Co
     m_filters = filters;
 }
 
+ClangCodeCompletionContext::ResultCache ClangCodeCompletionContext::resultCache() const
+{
+    ResultCache cache;
+    if (m_valid) {
+        cache.key = m_resultKey;
+        cache.results = m_results;
+        cache.prefix = m_prefix;
+        cache.matches = m_matches;
+    }
+    return cache;
+}
+
 #include "context.moc"
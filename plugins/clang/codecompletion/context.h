@@ -28,11 +28,43 @@
 
 #include <clang-c/Index.h>
 
-#include <memory>
+#include <KTextEditor/Cursor>
 
 #include "completionhelper.h"
 #include "clangprivateexport.h"
 
+/**
+ * A clang completion result, decoded from its completion string.
+ *
+ * Unlike CXCompletionResult, it stays valid after the CXCodeCompleteResults were disposed.
+ */
+struct ClangCompletionResult
+{
+    struct ArgumentRange
+    {
+        int start;
+        int end;
+    };
+
+    CXCursorKind kind = CXCursor_NotImplemented;
+    CXAvailabilityKind availability = CXAvailability_Available;
+    unsigned int priority = 0;
+    bool isOverloadCandidate = false;
+    // the string that would be needed to type, usually the identifier of something. Also we use it as name for code completion declaration items.
+    QString typed;
+    // the return type of a function e.g.
+    QString resultType;
+    // the replacement text when an item gets executed
+    QString replacement;
+    QString arguments;
+    ArgumentRange argumentRange = {0, 0};
+    // the scope of a declaration
+    QString parent;
+    bool hasParent = false;
+};
+
+Q_DECLARE_TYPEINFO(ClangCompletionResult, Q_MOVABLE_TYPE);
+
 class KDEVCLANGPRIVATE_EXPORT ClangCodeCompletionContext : public KDevelop::CodeCompletionContext
 {
 public:
@@ -46,12 +78,56 @@ public:
     };
     Q_DECLARE_FLAGS(ContextFilters, ContextFilter)
 
+    /**
+     * The clang results of a completion, kept by the caller to complete from them again while a word is typed.
+     *
+     * Clang completes at the start of the word, so the results stay the same as long as
+     * the translation unit and the text around the word do not change.
+     */
+    struct ResultCache
+    {
+        struct Key
+        {
+            QByteArray file;
+            quint64 revision = 0;
+            KTextEditor::Cursor position = KTextEditor::Cursor::invalid();
+            QString text;
+            QString textAfterWord;
+            uint otherUnsavedFilesHash = 0;
+
+            bool operator==(const Key& other) const
+            {
+                return revision == other.revision && position == other.position
+                    && otherUnsavedFilesHash == other.otherUnsavedFilesHash
+                    && file == other.file && text == other.text && textAfterWord == other.textAfterWord;
+            }
+        };
+
+        bool isValid() const
+        {
+            return key.revision != 0;
+        }
+
+        Key key;
+        QVector<ClangCompletionResult> results;
+        /// The typed prefix of the word
+        QString prefix;
+        /// Indices of the results that can match @c prefix
+        QVector<int> matches;
+    };
+
+    /**
+     * @param prefix The part of the word at @p position that was typed already
+     * @param previousResults The result cache of an earlier context, reused instead of asking clang if it still applies
+     */
     ClangCodeCompletionContext(const KDevelop::DUContextPointer& context,
                                const ParseSessionData::Ptr& sessionData,
                                const QUrl& url,
                                const KTextEditor::Cursor& position,
                                const QString& text,
-                               const QString& followingText = {});
+                               const QString& followingText = {},
+                               const QString& prefix = {},
+                               const ResultCache& previousResults = {});
     ~ClangCodeCompletionContext() override;
 
     QList<KDevelop::CompletionTreeItemPointer> completionItems(bool& abort, bool fullCompletion = true) override;
@@ -61,6 +137,9 @@ public:
     ContextFilters filters() const;
     void setFilters(const ContextFilters& filters);
 
+    /// @return the clang results of this context, invalid if there are none
+    ResultCache resultCache() const;
+
 private:
     void addOverwritableItems();
     void addImplementationHelperItems();
@@ -71,7 +150,11 @@ private:
     /// Returns whether the we are at a valid completion-position
     bool isValidPosition(CXTranslationUnit unit, CXFile file) const;
 
-    std::unique_ptr<CXCodeCompleteResults, void(*)(CXCodeCompleteResults*)> m_results;
+    ResultCache::Key m_resultKey;
+    QVector<ClangCompletionResult> m_results;
+    QString m_prefix;
+    /// Indices of the results that can match m_prefix, only these are turned into completion items
+    QVector<int> m_matches;
     QList<KDevelop::CompletionTreeElementPointer> m_ungrouped;
     CompletionHelper m_completionHelper;
     ParseSessionData::Ptr m_parseSessionData;
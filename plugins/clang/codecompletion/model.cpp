@@ -59,12 +59,15 @@ QSharedPointer<CodeCompletionContext> createCompletionContext(const DUContextPoi
                                                               const QUrl& url,
                                                               const KTextEditor::Cursor& position,
                                                               const QString& text,
-                                                              const QString& followingText)
+                                                              const QString& followingText,
+                                                              const QString& prefix,
+                                                              const ClangCodeCompletionContext::ResultCache& previousResults)
 {
     if (includePathCompletionRequired(text)) {
         return QSharedPointer<IncludePathCompletionContext>::create(context, session, url, position, text);
     } else {
-        return QSharedPointer<ClangCodeCompletionContext>::create(context, session, url, position, text, followingText);
+        return QSharedPointer<ClangCodeCompletionContext>::create(context, session, url, position, text, followingText,
+                                                                  prefix, previousResults);
     }
 }
 
@@ -79,13 +82,16 @@ public:
     ~ClangCodeCompletionWorker() override = default;
 
 public Q_SLOTS:
-    void completionRequested(const QUrl &url, const KTextEditor::Cursor& position, const QString& text, const QString& followingText)
+    void completionRequested(const QUrl &url, const KTextEditor::Cursor& position, const QString& text, const QString& followingText,
+                             const QString& prefix, bool reuseResults)
     {
         // group requests and only handle the latest one
         m_url = url;
         m_position = position;
         m_text = text;
         m_followingText = followingText;
+        m_prefix = prefix;
+        m_reuseResults = reuseResults;
 
         if (!m_timer) {
             // lazy-load the timer to initialize it in the background thread
@@ -131,7 +137,11 @@ private:
         lock.unlock();
 
         auto completionContext = ::createCompletionContext(DUContextPointer(top), sessionData, m_url,
-                                                           m_position, m_text, m_followingText);
+                                                           m_position, m_text, m_followingText, m_prefix,
+                                                           m_reuseResults ? m_resultCache : ClangCodeCompletionContext::ResultCache());
+        // keep the clang results to complete from them again while the user types on
+        const auto clangContext = completionContext.dynamicCast<ClangCodeCompletionContext>();
+        m_resultCache = clangContext ? clangContext->resultCache() : ClangCodeCompletionContext::ResultCache();
 
         lock.lock();
         if (aborting()) {
@@ -168,6 +178,9 @@ private:
     KTextEditor::Cursor m_position;
     QString m_text;
     QString m_followingText;
+    QString m_prefix;
+    bool m_reuseResults = false;
+    ClangCodeCompletionContext::ResultCache m_resultCache;
 };
 }
 
@@ -224,10 +237,16 @@ KTextEditor::Range ClangCodeCompletionModel::completionRange(KTextEditor::View*
 bool ClangCodeCompletionModel::shouldAbortCompletion(KTextEditor::View* view, const KTextEditor::Range& range, const QString& currentCompletion)
 {
     const auto shouldAbort = KDevelop::CodeCompletionModel::shouldAbortCompletion(view, range, currentCompletion);
-    if (shouldAbort && includePathCompletionRequired(view->document()->line(range.end().line()))) {
+    const auto isIncludePathCompletion = includePathCompletionRequired(view->document()->line(range.end().line()));
+    if (shouldAbort && isIncludePathCompletion) {
         // don't abort include path completion which can contain dashes
         return false;
     }
+    if (!shouldAbort && !isIncludePathCompletion && !currentCompletion.startsWith(m_prefix)) {
+        // only results that can match the prefix of the last invocation became items,
+        // they are not enough to show after removing some of it
+        return true;
+    }
     return shouldAbort;
 }
 
@@ -240,11 +259,14 @@ CodeCompletionWorker* ClangCodeCompletionModel::createCompletionWorker()
 }
 
 void ClangCodeCompletionModel::completionInvokedInternal(KTextEditor::View* view, const KTextEditor::Range& range,
-                                                         CodeCompletionModel::InvocationType /*invocationType*/, const QUrl &url)
+                                                         CodeCompletionModel::InvocationType invocationType, const QUrl &url)
 {
     auto text = view->document()->text({0, 0, range.start().line(), range.start().column()});
     auto followingText = view->document()->text({{range.start().line(), range.start().column()}, view->document()->documentEnd()});
-    emit requestCompletion(url, KTextEditor::Cursor(range.start()), text, followingText);
+    m_prefix = view->document()->text(range);
+    // an explicit invocation always asks clang again
+    const bool reuseResults = invocationType == AutomaticInvocation;
+    emit requestCompletion(url, KTextEditor::Cursor(range.start()), text, followingText, m_prefix, reuseResults);
 }
 
 #include "model.moc"
@@ -44,7 +44,8 @@ public:
     bool shouldAbortCompletion(KTextEditor::View* view, const KTextEditor::Range& range, const QString& currentCompletion) override;
 
 Q_SIGNALS:
-    void requestCompletion(const QUrl &url, const KTextEditor::Cursor& cursor, const QString& text, const QString& followingText);
+    void requestCompletion(const QUrl &url, const KTextEditor::Cursor& cursor, const QString& text, const QString& followingText,
+                           const QString& prefix, bool reuseResults);
 
 protected:
     KDevelop::CodeCompletionWorker* createCompletionWorker() override;
@@ -54,6 +55,8 @@ protected:
 
 private:
     ClangIndex* m_index;
+    /// The typed prefix of the word the completion was last invoked for
+    QString m_prefix;
 };
 
 #endif // CLANGCODECOMPLETIONMODEL_H
@@ -52,6 +52,7 @@
 
 #include <clang-c/Documentation.h>
 
+#include <algorithm>
 #include <unordered_map>
 #include <typeinfo>
 
@@ -63,6 +64,9 @@ using namespace KDevelop;
 
 namespace {
 
+// The uses are committed in batches of this size, so other threads can lock the DUChain in between
+const int useCommitBatchSize = 1000;
+
 #if CINDEX_VERSION_MINOR >= 100
 // TODO: this is ugly, can we find a better alternative?
 bool jsonTestRun()
@@ -320,6 +324,16 @@ struct CurrentContext
 };
 //END CurrentContext
 
+//BEGIN ResolvedUse
+/// A use whose declaration and range were looked up, but which is not part of the DUChain yet
+struct ResolvedUse
+{
+    DUContext* context;
+    DeclarationPointer declaration;
+    RangeInRevision range;
+};
+//END ResolvedUse
+
 //BEGIN Visitor
 struct Visitor
 {
@@ -855,6 +869,10 @@ struct Visitor
     template<CXTypeKind TK>
     void setTypeModifiers(CXType type, AbstractType* kdevType) const;
 
+    /// Looks up the declarations of all visited uses, only taking the DUChain read lock
+    std::vector<ResolvedUse> resolveUses() const;
+    void commitUses(TopDUContext* top, const std::vector<ResolvedUse>& uses) const;
+
     const CXFile m_file;
     const IncludeFileContexts &m_includes;
 
@@ -1447,10 +1465,12 @@ Visitor::Visitor(CXTranslationUnit tu, CXFile file,
     m_parentContext = &parent;
     clang_visitChildren(tuCursor, &visitCursor, this);
 
-    if (m_update) {
-        DUChainWriteLocker lock;
-        top->deleteUsesRecursively();
-    }
+    commitUses(top, resolveUses());
+}
+
+std::vector<ResolvedUse> Visitor::resolveUses() const
+{
+    std::vector<ResolvedUse> ret;
     for (const auto &contextUses : m_uses) {
         for (const auto &cursor : contextUses.second) {
             auto referenced = referencedCursor(cursor);
@@ -1491,9 +1511,32 @@ Visitor::Visitor(CXTranslationUnit tu, CXFile file,
             const auto useRange = clang_getCursorReferenceNameRange(cursor, 0, 0);
             const auto range = rangeInRevisionForUse(cursor, referenced.kind, useRange, m_macroExpansionLocations);
 
-            DUChainWriteLocker lock;
-            auto usedIndex = top->indexForUsedDeclaration(used.data());
-            contextUses.first->createUse(usedIndex, range);
+            ret.push_back({contextUses.first, used, range});
+        }
+    }
+    return ret;
+}
+
+void Visitor::commitUses(TopDUContext* top, const std::vector<ResolvedUse>& uses) const
+{
+    auto it = uses.begin();
+    bool deleteOldUses = m_update;
+    while (deleteOldUses || it != uses.end()) {
+        DUChainWriteLocker lock;
+        if (deleteOldUses) {
+            top->deleteUsesRecursively();
+            deleteOldUses = false;
+        }
+
+        const auto batchEnd = it + std::min<std::ptrdiff_t>(useCommitBatchSize, uses.end() - it);
+        for (; it != batchEnd; ++it) {
+            // the declaration may have been deleted while the lock was not held
+            auto used = it->declaration.data();
+            if (!used) {
+                continue;
+            }
+            auto usedIndex = top->indexForUsedDeclaration(used);
+            it->context->createUse(usedIndex, it->range);
         }
     }
 }
@@ -24,6 +24,7 @@
 #include "clangpch.h"
 #include "clangparsingenvironment.h"
 #include "documentfinderhelpers.h"
+#include "livetranslationunits.h"
 
 #include <util/path.h>
 #include <util/clangtypes.h>
@@ -31,12 +32,141 @@
 #include <language/backgroundparser/urlparselock.h>
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/duchain.h>
+#include <language/duchain/parsingenvironment.h>
+#include <interfaces/icore.h>
+#include <interfaces/isession.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QVector>
 
 #include <clang-c/Index.h>
 
+#include <algorithm>
+
 using namespace KDevelop;
 
-ClangIndex::ClangIndex()
+namespace {
+
+// Translation units need at least this many leading system includes to share a preamble
+const int minimumSharedIncludes = 2;
+// Default maximum size of all shared preambles on disk, in megabytes
+const int defaultPreambleCacheSize = 1024;
+// Default maximum memory of all live translation units, in megabytes
+const int defaultTranslationUnitMemoryBudget = 2048;
+
+/**
+ * @returns the system includes at the very beginning of @p contents, normalized to one per line
+ *
+ * Only comments and empty lines may come before and in between them. A quoted include ends
+ * the block, as it is looked up relative to the including file.
+ */
+QByteArray leadingSystemIncludes(const QByteArray& contents, int* count)
+{
+    QByteArray ret;
+    *count = 0;
+
+    bool inComment = false;
+    int lineStart = 0;
+    while (lineStart < contents.size()) {
+        int lineEnd = contents.indexOf('\n', lineStart);
+        if (lineEnd == -1) {
+            lineEnd = contents.size();
+        }
+        QByteArray line = contents.mid(lineStart, lineEnd - lineStart).trimmed();
+        lineStart = lineEnd + 1;
+
+        if (inComment) {
+            const int commentEnd = line.indexOf("*/");
+            if (commentEnd == -1) {
+                continue;
+            }
+            inComment = false;
+            line = line.mid(commentEnd + 2).trimmed();
+        }
+
+        if (line.startsWith("/*")) {
+            const int commentEnd = line.indexOf("*/", 2);
+            if (commentEnd == -1) {
+                inComment = true;
+                continue;
+            }
+            line = line.mid(commentEnd + 2).trimmed();
+        }
+
+        if (line.isEmpty() || line.startsWith("//")) {
+            continue;
+        }
+
+        if (!line.startsWith('#')) {
+            break;
+        }
+        const QByteArray directive = line.mid(1).trimmed();
+        if (!directive.startsWith("include")) {
+            break;
+        }
+        const QByteArray file = directive.mid(7).trimmed();
+        const int fileEnd = file.indexOf('>');
+        if (!file.startsWith('<') || fileEnd == -1) {
+            break;
+        }
+
+        ret += "#include " + file.left(fileEnd + 1) + '\n';
+        ++*count;
+    }
+
+    return ret;
+}
+
+/// @returns a key for everything that influences the preamble of @p includes parsed in @p environment
+QString preambleKey(const ClangParsingEnvironment& environment, const QByteArray& includes)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    const auto addPaths = [&hash](const Path::List& paths) {
+        for (const auto& path : paths) {
+            hash.addData(path.pathOrUrl().toUtf8());
+            hash.addData("\0", 1);
+        }
+        hash.addData("\n", 1);
+    };
+
+    const auto& includePaths = environment.includes();
+    addPaths(includePaths.system);
+    addPaths(includePaths.project);
+    const auto& frameworkDirectories = environment.frameworkDirectories();
+    addPaths(frameworkDirectories.system);
+    addPaths(frameworkDirectories.project);
+
+    // the iteration order of equal hashes may differ
+    const auto& defines = environment.defines();
+    auto defineNames = defines.keys();
+    std::sort(defineNames.begin(), defineNames.end());
+    for (const auto& name : qAsConst(defineNames)) {
+        hash.addData(name.toUtf8());
+        hash.addData("=", 1);
+        hash.addData(defines.value(name).toUtf8());
+        hash.addData("\0", 1);
+    }
+
+    hash.addData(environment.parserSettings().parserOptions.toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(includes);
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+/// @returns whether the file at @p path contains exactly @p contents
+bool hasContents(const QString& path, const QByteArray& contents)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) && file.size() == contents.size() && file.readAll() == contents;
+}
+
+}
+
+ClangIndex::ClangIndex(const QString& preambleDirectory)
     // NOTE: We don't exclude PCH declarations. That way we could retrieve imports manually, as clang_getInclusions returns nothing on reparse with CXTranslationUnit_PrecompiledPreamble flag.
     : m_index(clang_createIndex(0 /*Exclude PCH Decls*/, qEnvironmentVariableIsSet("KDEV_CLANG_DISPLAY_DIAGS") /*Display diags*/))
 {
@@ -45,6 +175,31 @@ ClangIndex::ClangIndex()
     // the results as quickly as possible
     clang_CXIndex_setGlobalOptions(m_index, clang_CXIndex_getGlobalOptions(m_index)
         | CXGlobalOpt_ThreadBackgroundPriorityForIndexing);
+
+    m_preambleDirectory = preambleDirectory;
+    if (m_preambleDirectory.isEmpty()) {
+        QString sessionId = QStringLiteral("default");
+        if (ICore::self() && ICore::self()->activeSession()) {
+            sessionId = ICore::self()->activeSession()->id().toString();
+        }
+        m_preambleDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+            + QLatin1String("/kdevclangsupport/preambles/") + sessionId;
+    }
+
+    // the preambles of earlier sessions count towards the cache size, so they get evicted eventually
+    const auto headers = QDir(m_preambleDirectory).entryInfoList({QStringLiteral("*.h")}, QDir::Files);
+    for (const auto& header : headers) {
+        const QFileInfo pchFile(header.filePath() + QLatin1String(".pch"));
+        m_preambles[Path(header.filePath())].size = pchFile.exists() ? pchFile.size() : 0;
+    }
+
+    const int cacheSize = qEnvironmentVariableIsSet("KDEV_CLANG_PREAMBLE_CACHE_SIZE")
+        ? qEnvironmentVariableIntValue("KDEV_CLANG_PREAMBLE_CACHE_SIZE") : defaultPreambleCacheSize;
+    m_preambleCacheSize = qint64(cacheSize) * 1024 * 1024;
+
+    const int memoryBudget = qEnvironmentVariableIsSet("KDEV_CLANG_TU_MEMORY_BUDGET")
+        ? qEnvironmentVariableIntValue("KDEV_CLANG_TU_MEMORY_BUDGET") : defaultTranslationUnitMemoryBudget;
+    m_liveUnits.reset(new LiveTranslationUnits(qint64(memoryBudget) * 1024 * 1024));
 }
 
 CXIndex ClangIndex::index() const
@@ -52,6 +207,11 @@ CXIndex ClangIndex::index() const
     return m_index;
 }
 
+QSharedPointer<LiveTranslationUnits> ClangIndex::liveTranslationUnits() const
+{
+    return m_liveUnits;
+}
+
 QSharedPointer<const ClangPCH> ClangIndex::pch(const ClangParsingEnvironment& environment)
 {
     const auto& pchInclude = environment.pchInclude();
@@ -63,20 +223,193 @@ QSharedPointer<const ClangPCH> ClangIndex::pch(const ClangParsingEnvironment& en
 
     static const QString pchExt = QStringLiteral(".pch");
 
+    const bool shared = isSharedPreamble(pchInclude);
+
     if (QFile::exists(pchInclude.toLocalFile() + pchExt)) {
         QReadLocker lock(&m_pchLock);
         auto pch = m_pch.constFind(pchInclude);
         if (pch != m_pch.constEnd()) {
+            if (shared) {
+                QMutexLocker preambleLock(&m_preambleMutex);
+                ++m_preambleHits;
+            }
             return pch.value();
         }
     }
 
-    auto pch = QSharedPointer<ClangPCH>::create(environment, this);
-    QWriteLocker lock(&m_pchLock);
-    m_pch.insert(pchInclude, pch);
+    auto pch = QSharedPointer<ClangPCH>::create(environment, this,
+                                                shared ? ClangPCH::TranslationUnitEnvironment : ClangPCH::BareEnvironment);
+    {
+        QWriteLocker lock(&m_pchLock);
+        m_pch.insert(pchInclude, pch);
+    }
+    if (shared) {
+        sharedPreambleBuilt(pchInclude);
+    }
     return pch;
 }
 
+Path ClangIndex::sharedPreamble(const ClangParsingEnvironment& environment, const QByteArray& contents)
+{
+    if (m_preambleCacheSize <= 0) {
+        return {};
+    }
+
+    int count = 0;
+    const auto includes = leadingSystemIncludes(contents, &count);
+    if (count < minimumSharedIncludes) {
+        return {};
+    }
+
+    const Path path(m_preambleDirectory + QLatin1Char('/') + preambleKey(environment, includes) + QLatin1String(".h"));
+
+    QMutexLocker lock(&m_preambleMutex);
+    const auto it = m_preambles.constFind(path);
+    if (it != m_preambles.constEnd() && it->failed) {
+        return {};
+    }
+    // Rewriting the header would change its modification time, which makes all translation units using it
+    // outdated. The key covers the includes, so only a missing or partially written header is rewritten.
+    if ((it == m_preambles.constEnd() || !QFile::exists(path.toLocalFile()))
+        && !hasContents(path.toLocalFile(), includes)) {
+        QDir().mkpath(m_preambleDirectory);
+        QSaveFile file(path.toLocalFile());
+        if (!file.open(QIODevice::WriteOnly) || file.write(includes) != includes.size() || !file.commit()) {
+            qCWarning(KDEV_CLANG) << "failed to write shared preamble" << path << file.errorString();
+            m_preambles.remove(path);
+            return {};
+        }
+    }
+
+    m_preambles[path].lastUse = ++m_preambleUses;
+    return path;
+}
+
+bool ClangIndex::isSharedPreamble(const Path& pchInclude) const
+{
+    QMutexLocker lock(&m_preambleMutex);
+    return m_preambles.contains(pchInclude);
+}
+
+bool ClangIndex::isPreambleReferenced(const Path& pchInclude) const
+{
+    if (m_liveUnits->usesPchInclude(pchInclude)) {
+        return true;
+    }
+
+    // the stored translation units import the preamble, and would have to be parsed again without it
+    DUChainReadLocker lock;
+    const auto files = DUChain::self()->allEnvironmentFiles(IndexedString(pchInclude.pathOrUrl()));
+    return std::any_of(files.constBegin(), files.constEnd(), [](const ParsingEnvironmentFilePointer& file) {
+        return !file->importers().isEmpty();
+    });
+}
+
+void ClangIndex::sharedPreambleBuilt(const Path& pchInclude)
+{
+    static const QString pchExt = QStringLiteral(".pch");
+
+    struct Candidate
+    {
+        Path path;
+        qint64 size;
+        quint64 lastUse;
+    };
+    QVector<Candidate> candidates;
+    qint64 excess = 0;
+    {
+        QMutexLocker lock(&m_preambleMutex);
+        ++m_preambleMisses;
+
+        auto it = m_preambles.find(pchInclude);
+        if (it == m_preambles.end()) {
+            return;
+        }
+        const QFileInfo pchFile(pchInclude.toLocalFile() + pchExt);
+        if (!pchFile.exists()) {
+            // don't try again for every translation unit with this preamble
+            qCWarning(KDEV_CLANG) << "failed to build shared preamble" << pchInclude;
+            it->failed = true;
+            return;
+        }
+        it->size = pchFile.size();
+
+        qint64 totalSize = 0;
+        for (auto candidate = m_preambles.constBegin(); candidate != m_preambles.constEnd(); ++candidate) {
+            totalSize += candidate->size;
+            if (candidate.key() != pchInclude) {
+                candidates.append({candidate.key(), candidate->size, candidate->lastUse});
+            }
+        }
+        excess = totalSize - m_preambleCacheSize;
+    }
+
+    if (excess <= 0) {
+        return;
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& lhs, const Candidate& rhs) {
+        return lhs.lastUse < rhs.lastUse;
+    });
+
+    // looking up the references locks the DUChain, so it is done without holding the preamble mutex
+    Path::List unreferenced;
+    for (const auto& candidate : qAsConst(candidates)) {
+        if (excess <= 0) {
+            break;
+        }
+        if (!isPreambleReferenced(candidate.path)) {
+            unreferenced << candidate.path;
+            excess -= candidate.size;
+        }
+    }
+
+    Path::List evicted;
+    {
+        QMutexLocker lock(&m_preambleMutex);
+        for (const auto& candidate : qAsConst(candidates)) {
+            const auto it = m_preambles.find(candidate.path);
+            // it may have been used again in the meantime
+            if (unreferenced.contains(candidate.path) && it != m_preambles.end() && it->lastUse == candidate.lastUse) {
+                evicted << candidate.path;
+                m_preambles.erase(it);
+            }
+        }
+    }
+
+    if (excess > 0) {
+        clangDebug() << "shared preambles exceed the cache size, but the remaining ones are still used";
+    }
+    if (evicted.isEmpty()) {
+        return;
+    }
+
+    clangDebug() << "evicting shared preambles:" << evicted;
+    {
+        QWriteLocker lock(&m_pchLock);
+        for (const auto& path : qAsConst(evicted)) {
+            m_pch.remove(path);
+        }
+    }
+    for (const auto& path : qAsConst(evicted)) {
+        QFile::remove(path.toLocalFile() + pchExt);
+        QFile::remove(path.toLocalFile());
+    }
+}
+
+ClangIndex::PreambleCacheStatistics ClangIndex::preambleCacheStatistics() const
+{
+    QMutexLocker lock(&m_preambleMutex);
+    PreambleCacheStatistics ret;
+    ret.hits = m_preambleHits;
+    ret.misses = m_preambleMisses;
+    ret.preambles = m_preambles.size();
+    for (const auto& preamble : m_preambles) {
+        ret.size += preamble.size;
+    }
+    return ret;
+}
+
 ClangIndex::~ClangIndex()
 {
     clang_disposeIndex(m_index);
@@ -29,6 +29,7 @@
 
 #include <util/path.h>
 
+#include <QMutex>
 #include <QReadWriteLock>
 #include <QSharedPointer>
 
@@ -36,11 +37,16 @@
 
 class ClangParsingEnvironment;
 class ClangPCH;
+class LiveTranslationUnits;
 
 class KDEVCLANGPRIVATE_EXPORT ClangIndex
 {
 public:
-    ClangIndex();
+    /**
+     * @p preambleDirectory Where the shared preambles are cached, by default in the cache location
+     *                      of the active session. They are kept across sessions.
+     */
+    explicit ClangIndex(const QString& preambleDirectory = QString());
     ~ClangIndex();
 
     CXIndex index() const;
@@ -53,6 +59,40 @@ public:
      */
     QSharedPointer<const ClangPCH> pch(const ClangParsingEnvironment& environment);
 
+    /**
+     * @returns the shared preamble header for a translation unit that starts with @p contents
+     *
+     * Translation units that start with the same system includes and are parsed with the same
+     * arguments share one precompiled header, which is built by pch() on first use. An invalid
+     * path is returned if @p contents does not start with enough system includes to be worth it.
+     *
+     * Set this as the PCH include of @p environment to use the shared preamble.
+     * This function is thread safe.
+     */
+    KDevelop::Path sharedPreamble(const ClangParsingEnvironment& environment, const QByteArray& contents);
+
+    struct PreambleCacheStatistics
+    {
+        /// How often an already built shared preamble was reused
+        int hits = 0;
+        /// How often a shared preamble had to be built
+        int misses = 0;
+        /// Count of shared preambles that are currently cached
+        int preambles = 0;
+        /// Size of all cached shared preambles on disk, in bytes
+        qint64 size = 0;
+    };
+
+    PreambleCacheStatistics preambleCacheStatistics() const;
+
+    /**
+     * @returns the live translation units of all parse sessions created with this index
+     *
+     * Their memory is bounded by a budget of 2 GiB by default, which can be changed with the
+     * KDEV_CLANG_TU_MEMORY_BUDGET environment variable, in MiB.
+     */
+    QSharedPointer<LiveTranslationUnits> liveTranslationUnits() const;
+
     /**
      * Gets the currently pinned TU for @p url
      *
@@ -71,11 +111,37 @@ public:
     void unpinTranslationUnitForUrl(const KDevelop::IndexedString& url);
 
 private:
+    bool isSharedPreamble(const KDevelop::Path& pchInclude) const;
+    /// @returns whether a parse session or a translation unit stored in the DUChain uses @p pchInclude
+    bool isPreambleReferenced(const KDevelop::Path& pchInclude) const;
+    /// Accounts for the freshly built @p pchInclude and evicts the least recently used unreferenced preambles
+    void sharedPreambleBuilt(const KDevelop::Path& pchInclude);
+
     CXIndex m_index;
 
     QReadWriteLock m_pchLock;
     QHash<KDevelop::Path, QSharedPointer<const ClangPCH>> m_pch;
 
+    struct Preamble
+    {
+        // Size of the precompiled header on disk, zero while it is not built yet
+        qint64 size = 0;
+        quint64 lastUse = 0;
+        // Whether building the precompiled header failed, e.g. due to missing includes
+        bool failed = false;
+    };
+
+    mutable QMutex m_preambleMutex;
+    QString m_preambleDirectory;
+    // Maximum size of all shared preambles on disk, in bytes
+    qint64 m_preambleCacheSize;
+    QHash<KDevelop::Path, Preamble> m_preambles;
+    quint64 m_preambleUses = 0;
+    int m_preambleHits = 0;
+    int m_preambleMisses = 0;
+
+    QSharedPointer<LiveTranslationUnits> m_liveUnits;
+
     QMutex m_mappingMutex;
     QHash<KDevelop::IndexedString, KDevelop::IndexedString> m_tuForUrl;
 };
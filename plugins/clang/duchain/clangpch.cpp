@@ -30,16 +30,14 @@ using namespace KDevelop;
 
 namespace {
 
-//Map a file from one translation unit to another
-inline CXFile mapFile(CXFile file, CXTranslationUnit tu)
+QByteArray fileName(CXFile file)
 {
-    return clang_getFile(tu, ClangString(clang_getFileName(file)).c_str());
+    return ClangString(clang_getFileName(file)).toByteArray();
 }
 
 }
 
-ClangPCH::ClangPCH(const ClangParsingEnvironment& environment, ClangIndex* index)
-    : m_session({})
+ClangPCH::ClangPCH(const ClangParsingEnvironment& environment, ClangIndex* index, EnvironmentMode mode)
 {
     const auto& pchInclude = environment.pchInclude();
     Q_ASSERT(pchInclude.isValid());
@@ -47,32 +45,40 @@ ClangPCH::ClangPCH(const ClangParsingEnvironment& environment, ClangIndex* index
     const TopDUContext::Features pchFeatures = TopDUContext::AllDeclarationsContextsUsesAndAST;
     const IndexedString doc(pchInclude.pathOrUrl());
 
-    ClangParsingEnvironment pchEnv;
+    ClangParsingEnvironment pchEnv = mode == TranslationUnitEnvironment ? environment : ClangParsingEnvironment();
     pchEnv.setPchInclude(Path());
     pchEnv.setTranslationUnitUrl(doc);
-    m_session.setData(ParseSessionData::Ptr(new ParseSessionData({}, index, pchEnv, ParseSessionData::PrecompiledHeader)));
+    // translation units using the PCH only need the .pch file, not this one
+    ParseSession session(ParseSessionData::Ptr(new ParseSessionData({}, index, pchEnv, ParseSessionData::PrecompiledHeader)));
 
-    if (!m_session.unit()) {
+    if (!session.unit()) {
         return;
     }
 
-    auto imports = ClangHelpers::tuImports(m_session.unit());
-    m_context = ClangHelpers::buildDUChain(m_session.mainFile(), imports, m_session, pchFeatures, m_includes);
+    auto imports = ClangHelpers::tuImports(session.unit());
+    IncludeFileContexts includes;
+    m_context = ClangHelpers::buildDUChain(session.mainFile(), imports, session, pchFeatures, includes);
+
+    m_mainFile = fileName(session.mainFile());
+    m_includes.reserve(includes.size());
+    for (auto it = includes.constBegin(); it != includes.constEnd(); ++it) {
+        m_includes.append(qMakePair(fileName(it.key()), it.value()));
+    }
 }
 
 IncludeFileContexts ClangPCH::mapIncludes(CXTranslationUnit tu) const
 {
     IncludeFileContexts mapped;
     mapped.reserve(m_includes.size());
-    for (auto it = m_includes.constBegin(); it != m_includes.constEnd(); ++it) {
-        mapped.insert(::mapFile(it.key(), tu), it.value());
+    for (const auto& include : m_includes) {
+        mapped.insert(clang_getFile(tu, include.first.constData()), include.second);
     }
     return mapped;
 }
 
 CXFile ClangPCH::mapFile(CXTranslationUnit tu) const
 {
-    return ::mapFile(m_session.mainFile(), tu);
+    return m_mainFile.isEmpty() ? nullptr : clang_getFile(tu, m_mainFile.constData());
 }
 
 ReferencedTopDUContext ClangPCH::context() const
@@ -32,7 +32,15 @@ class ClangParsingEnvironment;
 class KDEVCLANGPRIVATE_EXPORT ClangPCH
 {
 public:
-    ClangPCH(const ClangParsingEnvironment& environment, ClangIndex* index);
+    enum EnvironmentMode {
+        /// Build the PCH without the include paths and defines of @p environment, for user-defined PCH includes
+        BareEnvironment,
+        /// Build the PCH with the include paths, defines and arguments of @p environment, for shared preambles
+        TranslationUnitEnvironment
+    };
+
+    ClangPCH(const ClangParsingEnvironment& environment, ClangIndex* index,
+             EnvironmentMode mode = BareEnvironment);
 
     IncludeFileContexts mapIncludes(CXTranslationUnit tu) const;
 
@@ -43,9 +51,10 @@ public:
 private:
     Q_DISABLE_COPY(ClangPCH)
 
-    IncludeFileContexts m_includes;
+    // the translation unit of the PCH is disposed once its DUChain is built, so the files are kept by name
+    QVector<QPair<QByteArray, KDevelop::ReferencedTopDUContext>> m_includes;
+    QByteArray m_mainFile;
     KDevelop::ReferencedTopDUContext m_context;
-    ParseSession m_session;
 };
 
 #endif //CLANGPCH_H
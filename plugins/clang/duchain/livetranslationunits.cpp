@@ -0,0 +1,128 @@
+/*
+    This file is part of KDevelop
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#include "livetranslationunits.h"
+
+#include "parsesession.h"
+#include "util/clangdebug.h"
+
+#include <QSet>
+
+LiveTranslationUnits::LiveTranslationUnits(qint64 budget)
+    : m_budget(budget)
+{
+}
+
+void LiveTranslationUnits::setBudget(qint64 budget)
+{
+    QMutexLocker lock(&m_mutex);
+    m_budget = budget;
+    enforceBudget(nullptr);
+}
+
+LiveTranslationUnits::Statistics LiveTranslationUnits::statistics() const
+{
+    QMutexLocker lock(&m_mutex);
+
+    Statistics ret;
+    for (const auto& unit : m_units) {
+        if (unit.suspended) {
+            ++ret.suspendedUnits;
+        } else {
+            ++ret.liveUnits;
+        }
+    }
+    ret.memory = m_memory;
+    ret.budget = m_budget;
+    return ret;
+}
+
+void LiveTranslationUnits::used(ParseSessionData* session, qint64 memory)
+{
+    QMutexLocker lock(&m_mutex);
+
+    auto& unit = m_units[session];
+    unit.lastUse = ++m_uses;
+    if (memory < 0) {
+        return;
+    }
+
+    m_memory += memory - unit.memory;
+    unit.memory = memory;
+    unit.suspended = false;
+    enforceBudget(session);
+}
+
+void LiveTranslationUnits::remove(ParseSessionData* session)
+{
+    QMutexLocker lock(&m_mutex);
+
+    const auto it = m_units.constFind(session);
+    if (it != m_units.constEnd()) {
+        m_memory -= it->memory;
+        m_units.erase(it);
+    }
+}
+
+bool LiveTranslationUnits::usesPchInclude(const KDevelop::Path& pchInclude) const
+{
+    QMutexLocker lock(&m_mutex);
+
+    for (auto it = m_units.constBegin(); it != m_units.constEnd(); ++it) {
+        if (it.key()->m_environment.pchInclude() == pchInclude) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LiveTranslationUnits::enforceBudget(ParseSessionData* current)
+{
+    // sessions that are in use right now cannot be suspended
+    QSet<ParseSessionData*> busy;
+
+    while (m_memory > m_budget) {
+        auto victim = m_units.end();
+        for (auto it = m_units.begin(); it != m_units.end(); ++it) {
+            if (it.key() == current || it->suspended || busy.contains(it.key())) {
+                continue;
+            }
+            if (victim == m_units.end() || it->lastUse < victim->lastUse) {
+                victim = it;
+            }
+        }
+
+        if (victim == m_units.end()) {
+            clangDebug() << "live translation units exceed the memory budget:" << m_memory << m_budget;
+            return;
+        }
+
+        // NOTE: this only try-locks the session, so it cannot dead-lock with sessions waiting for m_mutex
+        if (!victim.key()->trySuspend()) {
+            busy.insert(victim.key());
+            continue;
+        }
+
+        clangDebug() << "suspended translation unit using" << victim->memory << "bytes, live translation units now use"
+                     << (m_memory - victim->memory) << "of" << m_budget << "bytes";
+        m_memory -= victim->memory;
+        victim->memory = 0;
+        victim->suspended = true;
+    }
+}
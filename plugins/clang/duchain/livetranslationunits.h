@@ -0,0 +1,93 @@
+/*
+    This file is part of KDevelop
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Library General Public
+    License as published by the Free Software Foundation; either
+    version 2 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Library General Public License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to
+    the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+    Boston, MA 02110-1301, USA.
+*/
+
+#ifndef LIVETRANSLATIONUNITS_H
+#define LIVETRANSLATIONUNITS_H
+
+#include <QHash>
+#include <QMutex>
+
+#include "clangprivateexport.h"
+
+namespace KDevelop {
+class Path;
+}
+
+class ParseSessionData;
+
+/**
+ * Keeps the memory used by the translation units of all parse sessions within a budget.
+ *
+ * When the budget is exceeded, the translation units of the least recently used sessions
+ * are suspended, i.e. disposed. They are parsed again when a ParseSession uses them the next time.
+ *
+ * This class is thread safe.
+ */
+class KDEVCLANGPRIVATE_EXPORT LiveTranslationUnits
+{
+public:
+    /// @p budget The maximum memory used by all live translation units, in bytes
+    explicit LiveTranslationUnits(qint64 budget);
+
+    void setBudget(qint64 budget);
+
+    struct Statistics
+    {
+        /// Count of translation units that are parsed and in memory
+        int liveUnits = 0;
+        /// Count of translation units that were disposed to stay within the budget
+        int suspendedUnits = 0;
+        /// Memory used by all live translation units in bytes, as reported by clang
+        qint64 memory = 0;
+        qint64 budget = 0;
+    };
+
+    Statistics statistics() const;
+
+    /**
+     * Marks @p session as used most recently.
+     *
+     * Pass the memory used by its translation unit as @p memory whenever it was (re)parsed. Then
+     * the least recently used other sessions are suspended until all fit into the budget.
+     */
+    void used(ParseSessionData* session, qint64 memory = -1);
+
+    void remove(ParseSessionData* session);
+
+    /// @returns whether one of the sessions is parsed with @p pchInclude, even if it is suspended right now
+    bool usesPchInclude(const KDevelop::Path& pchInclude) const;
+
+private:
+    void enforceBudget(ParseSessionData* current);
+
+    struct Unit
+    {
+        qint64 memory = 0;
+        quint64 lastUse = 0;
+        bool suspended = false;
+    };
+
+    mutable QMutex m_mutex;
+    qint64 m_budget;
+    qint64 m_memory = 0;
+    quint64 m_uses = 0;
+    QHash<ParseSessionData*, Unit> m_units;
+};
+
+#endif // LIVETRANSLATIONUNITS_H
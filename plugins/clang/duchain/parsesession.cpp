@@ -32,6 +32,7 @@
 #include "util/clangtypes.h"
 #include "util/clangutils.h"
 #include "headerguardassistant.h"
+#include "livetranslationunits.h"
 
 #include <language/duchain/duchainlock.h>
 #include <language/duchain/duchain.h>
@@ -39,6 +40,7 @@
 
 #include <KShell>
 
+#include <QAtomicInteger>
 #include <QDir>
 #include <QFileInfo>
 #include <QMimeDatabase>
@@ -219,11 +221,14 @@ ParseSessionData::ParseSessionData(const QVector<UnsavedFile>& unsavedFiles, Cla
     if (options.testFlag(PrecompiledHeader)) {
         flags |= CXTranslationUnit_ForSerialization;
     } else {
-        flags |= CXTranslationUnit_CacheCompletionResults
+        // sessions without function bodies are neither reparsed nor used for code completion
+        if (!options.testFlag(SkipFunctionBodies)) {
+            flags |= CXTranslationUnit_CacheCompletionResults
 #if CINDEX_VERSION_MINOR >= 32
-              |  CXTranslationUnit_CreatePreambleOnFirstParse
+                  |  CXTranslationUnit_CreatePreambleOnFirstParse
 #endif
-              |  CXTranslationUnit_PrecompiledPreamble;
+                  |  CXTranslationUnit_PrecompiledPreamble;
+        }
         if (environment.quality() == ClangParsingEnvironment::Unknown) {
             flags |= CXTranslationUnit_Incomplete;
         }
@@ -325,6 +330,16 @@ ParseSessionData::ParseSessionData(const QVector<UnsavedFile>& unsavedFiles, Cla
 
         if (options.testFlag(PrecompiledHeader)) {
             clang_saveTranslationUnit(m_unit, QByteArray(tuUrl.byteArray() + ".pch").constData(), CXSaveTranslationUnit_None);
+        } else {
+            m_liveUnits = index->liveTranslationUnits();
+            m_index = index->index();
+            m_flags = flags;
+            m_unsavedFiles = unsavedFiles;
+            m_arguments.reserve(clangArguments.size());
+            for (const char* argument : qAsConst(clangArguments)) {
+                m_arguments << QByteArray(argument);
+            }
+            updateMemoryUsage();
         }
     } else {
         qCWarning(KDEV_CLANG) << "Failed to parse translation unit:" << tuUrl;
@@ -333,7 +348,78 @@ ParseSessionData::ParseSessionData(const QVector<UnsavedFile>& unsavedFiles, Cla
 
 ParseSessionData::~ParseSessionData()
 {
+    if (m_liveUnits) {
+        m_liveUnits->remove(this);
+    }
+    clang_disposeTranslationUnit(m_unit);
+}
+
+void ParseSessionData::updateMemoryUsage()
+{
+    if (!m_liveUnits) {
+        return;
+    }
+
+    qint64 memory = 0;
+    if (m_unit) {
+        const CXTUResourceUsage usage = clang_getCXTUResourceUsage(m_unit);
+        for (unsigned int i = 0; i < usage.numEntries; ++i) {
+            memory += usage.entries[i].amount;
+        }
+        clang_disposeCXTUResourceUsage(usage);
+    }
+    m_liveUnits->used(this, memory);
+}
+
+bool ParseSessionData::trySuspend()
+{
+    if (!m_mutex.tryLock()) {
+        return false;
+    }
+
     clang_disposeTranslationUnit(m_unit);
+    setUnit(nullptr);
+    m_suspended = true;
+
+    m_mutex.unlock();
+    return true;
+}
+
+void ParseSessionData::markUsed()
+{
+    if (!m_liveUnits) {
+        return;
+    }
+
+    if (!m_suspended) {
+        m_liveUnits->used(this);
+        return;
+    }
+
+    m_suspended = false;
+
+    QVector<const char*> arguments;
+    arguments.reserve(m_arguments.size());
+    for (const auto& argument : qAsConst(m_arguments)) {
+        arguments << argument.constData();
+    }
+    auto unsaved = toClangApi(m_unsavedFiles);
+
+    const auto tuUrl = m_environment.translationUnitUrl();
+    CXTranslationUnit unit = nullptr;
+    const CXErrorCode code = clang_parseTranslationUnit2(
+        m_index, tuUrl.byteArray().constData(),
+        arguments.constData(), arguments.size(),
+        unsaved.data(), unsaved.size(),
+        m_flags,
+        &unit
+    );
+    if (code != CXError_Success) {
+        qCWarning(KDEV_CLANG) << "clang_parseTranslationUnit2 return with error code" << code << "when resuming" << tuUrl;
+    }
+
+    setUnit(unit);
+    updateMemoryUsage();
 }
 
 QByteArray ParseSessionData::writeDefinesFile(const QMap<QString, QString>& defines)
@@ -371,7 +457,10 @@ QByteArray ParseSessionData::writeDefinesFile(const QMap<QString, QString>& defi
 
 void ParseSessionData::setUnit(CXTranslationUnit unit)
 {
+    static QAtomicInteger<quint64> revisions;
+
     m_unit = unit;
+    m_revision = ++revisions;
     m_diagnosticsCache.clear();
     if (m_unit) {
         const ClangString unitFile(clang_getTranslationUnitSpelling(unit));
@@ -392,6 +481,7 @@ ParseSession::ParseSession(const ParseSessionData::Ptr& data)
     if (d) {
         ENSURE_CHAIN_NOT_LOCKED
         d->m_mutex.lock();
+        d->markUsed();
     }
 }
 
@@ -417,6 +507,7 @@ void ParseSession::setData(const ParseSessionData::Ptr& data)
     if (d) {
         ENSURE_CHAIN_NOT_LOCKED
         d->m_mutex.lock();
+        d->markUsed();
     }
 }
 
@@ -574,6 +665,11 @@ CXTranslationUnit ParseSession::unit() const
     return d ? d->m_unit : nullptr;
 }
 
+quint64 ParseSession::revision() const
+{
+    return d ? d->m_revision : 0;
+}
+
 CXFile ParseSession::file(const QByteArray& path) const
 {
     return clang_getFile(unit(), path.constData());
@@ -599,11 +695,14 @@ bool ParseSession::reparse(const QVector<UnsavedFile>& unsavedFiles, const Clang
         // if error code != 0 => clang_reparseTranslationUnit invalidates the old translation unit => clean up
         clang_disposeTranslationUnit(d->m_unit);
         d->setUnit(nullptr);
+        d->updateMemoryUsage();
         return false;
     }
 
     // update state
     d->setUnit(d->m_unit);
+    d->m_unsavedFiles = unsavedFiles;
+    d->updateMemoryUsage();
     return true;
 }
 
@@ -24,6 +24,7 @@
 #define PARSESESSION_H
 
 #include <QList>
+#include <QSharedPointer>
 #include <QTemporaryFile>
 
 #include <clang-c/Index.h>
@@ -41,6 +42,7 @@
 #include "unsavedfile.h"
 
 class ClangIndex;
+class LiveTranslationUnits;
 
 class KDEVCLANGPRIVATE_EXPORT ParseSessionData : public KDevelop::IAstContainer
 {
@@ -49,7 +51,7 @@ public:
 
     enum Option {
         NoOption,                     ///< No special options
-        SkipFunctionBodies,           ///< Pass CXTranslationUnit_SkipFunctionBodies (likely unwanted)
+        SkipFunctionBodies,           ///< Pass CXTranslationUnit_SkipFunctionBodies, when only the visible declarations are needed
         PrecompiledHeader             ///< Pass CXTranslationUnit_PrecompiledPreamble and others to cache precompiled headers
     };
     Q_DECLARE_FLAGS(Options, Option)
@@ -68,14 +70,30 @@ public:
 
 private:
     friend class ParseSession;
+    friend class LiveTranslationUnits;
     void setUnit(CXTranslationUnit unit);
     QByteArray writeDefinesFile(const QMap<QString, QString>& defines);
+    /// Reports the memory used by the translation unit to the live translation units of the index
+    void updateMemoryUsage();
+    /// Disposes the translation unit, unless a ParseSession currently uses it
+    bool trySuspend();
+    /// Marks the translation unit as used, parses it again if it was suspended
+    void markUsed();
 
     QMutex m_mutex;
 
     CXFile m_file = nullptr;
     CXTranslationUnit m_unit = nullptr;
     ClangParsingEnvironment m_environment;
+    // Everything needed to parse the translation unit again when it was suspended
+    QSharedPointer<LiveTranslationUnits> m_liveUnits;
+    CXIndex m_index = nullptr;
+    QVector<QByteArray> m_arguments;
+    QVector<UnsavedFile> m_unsavedFiles;
+    unsigned int m_flags = 0;
+    bool m_suspended = false;
+    // changes whenever m_unit is (re)parsed, unique across all sessions
+    quint64 m_revision = 0;
     /// TODO: share this file for all TUs that use the same defines (probably most in a project)
     ///       best would be a PCH, if possible
     QTemporaryFile m_definesFile;
@@ -126,6 +144,13 @@ public:
 
     CXTranslationUnit unit() const;
 
+    /**
+     * @return an identifier for the current state of the translation unit
+     *
+     * It changes whenever the translation unit is parsed again and is never shared by two sessions.
+     */
+    quint64 revision() const;
+
     bool reparse(const QVector<UnsavedFile>& unsavedFiles, const ClangParsingEnvironment& environment);
 
     ClangParsingEnvironment environment() const;
@@ -26,30 +26,25 @@
 #include <algorithm>
 
 UnsavedFile::UnsavedFile(const QString& fileName, const QStringList& contents)
-    : m_fileName(fileName)
-    , m_contents(contents)
+    : m_fileNameUtf8(fileName.toUtf8())
 {
+    for (const QString& line : contents) {
+        m_contentsUtf8 += line.toUtf8() + '\n';
+    }
 }
 
-CXUnsavedFile UnsavedFile::toClangApi() const
+UnsavedFile::UnsavedFile(const QString& fileName, const QByteArray& contents)
+    : m_fileNameUtf8(fileName.toUtf8())
+    , m_contentsUtf8(contents)
 {
-    if (m_fileNameUtf8.isEmpty()) {
-        const_cast<UnsavedFile*>(this)->convertToUtf8();
-    }
+}
 
+CXUnsavedFile UnsavedFile::toClangApi() const
+{
     CXUnsavedFile file;
-    file.Contents = m_contentsUtf8.data();
+    file.Contents = m_contentsUtf8.constData();
     file.Length = m_contentsUtf8.size();
-    file.Filename = m_fileNameUtf8.data();
+    file.Filename = m_fileNameUtf8.constData();
 
     return file;
 }
-
-void UnsavedFile::convertToUtf8()
-{
-    m_fileNameUtf8 = m_fileName.toUtf8();
-    m_contentsUtf8.clear();
-    foreach(const QString& line, m_contents) {
-        m_contentsUtf8 += line.toUtf8() + '\n';
-    }
-}
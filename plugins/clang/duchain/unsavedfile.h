@@ -30,19 +30,19 @@ struct CXUnsavedFile;
 
 /**
  * Wrapper API to map unsaved editor contents to the CXUnsavedFile API for clang.
+ *
+ * The contents are kept UTF-8 encoded and implicitly shared, so copies are cheap.
  */
 class KDEVCLANGPRIVATE_EXPORT UnsavedFile
 {
 public:
     explicit UnsavedFile(const QString& fileName = {}, const QStringList& contents = {});
+    /// @p contents The UTF-8 encoded contents of the file
+    UnsavedFile(const QString& fileName, const QByteArray& contents);
 
     CXUnsavedFile toClangApi() const;
 
 private:
-    QString m_fileName;
-    QStringList m_contents;
-    // lazy-loaded byte arrays for usage in clang API
-    void convertToUtf8();
     QByteArray m_fileNameUtf8;
     QByteArray m_contentsUtf8;
 };
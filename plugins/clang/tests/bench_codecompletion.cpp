@@ -24,6 +24,8 @@
 #include <QSignalSpy>
 
 #include <KTextEditor/Cursor>
+#include <KTextEditor/Document>
+#include <KTextEditor/View>
 
 #include <tests/testfile.h>
 
@@ -95,3 +97,65 @@ void BenchCodeCompletion::benchCodeCompletion()
         } while (!m_model->rowCount());
     }
 }
+
+void BenchCodeCompletion::benchCodeCompletionWhileTyping_data()
+{
+    QTest::addColumn<QString>("code");
+    QTest::addColumn<KTextEditor::Cursor>("position");
+
+    QTest::newRow("stl") << R"(
+    #include <vector>
+    #include <unordered_map>
+    #include <unordered_set>
+
+    int main()
+    {
+        unordered_multimap
+        return 0;
+    }
+    )" << KTextEditor::Cursor(7, 8);
+
+    QTest::newRow("clib") << R"(
+    #include <cstring>
+    #include <cstdio>
+    #include <cmath>
+
+    int main()
+    {
+        strncmp
+        return 0;
+    }
+    )" << KTextEditor::Cursor(7, 8);
+}
+
+void BenchCodeCompletion::benchCodeCompletionWhileTyping()
+{
+    QFETCH(QString, code);
+    QFETCH(KTextEditor::Cursor, position);
+
+    TestFile file(code, "cpp");
+    QVERIFY(file.parseAndWait(TopDUContext::AllDeclarationsContextsUsesAndAST, 1, 5000));
+
+    auto view = createView(file.url().toUrl());
+    const auto wordLength = view->document()->wordAt(position).size();
+    QVERIFY(wordLength > 1);
+
+    QSignalSpy spy(m_model, &QAbstractItemModel::modelReset);
+    const auto invoke = [&](int typed) {
+        m_model->completionInvoked(view.get(), {position, {position.line(), position.column() + typed}},
+                                   KTextEditor::CodeCompletionModel::AutomaticInvocation);
+        do {
+            spy.wait();
+        } while (!m_model->rowCount());
+    };
+
+    // the first keystroke of the word asks clang for the results
+    invoke(1);
+
+    // the latency of every further keystroke
+    int typed = 1;
+    QBENCHMARK {
+        typed = typed % wordLength + 1;
+        invoke(typed);
+    }
+}
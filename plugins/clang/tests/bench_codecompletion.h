@@ -37,6 +37,8 @@ public:
 private Q_SLOTS:
     void benchCodeCompletion_data();
     void benchCodeCompletion();
+    void benchCodeCompletionWhileTyping_data();
+    void benchCodeCompletionWhileTyping();
 
 private:
     QScopedPointer<ClangIndex> m_index;
@@ -20,8 +20,10 @@
 
 #include "bench_duchain.h"
 
+#include <QElapsedTimer>
 #include <QLoggingCategory>
 #include <QTest>
+#include <QThread>
 
 #include <tests/autotestshell.h>
 #include <tests/testcore.h>
@@ -31,6 +33,42 @@
 
 using namespace KDevelop;
 
+namespace {
+/**
+ * Repeatedly acquires the DUChain read lock, to measure how long the parse threads hold the write lock.
+ */
+class ReadLockProbe : public QThread
+{
+public:
+    void run() override
+    {
+        while (!m_stop.load()) {
+            QElapsedTimer timer;
+            timer.start();
+            {
+                DUChainReadLocker lock;
+            }
+            const qint64 wait = timer.nsecsElapsed();
+            maximumWait = qMax(maximumWait, wait);
+            ++probes;
+            usleep(100);
+        }
+    }
+
+    void stop()
+    {
+        m_stop.store(1);
+        wait();
+    }
+
+    qint64 maximumWait = 0;
+    int probes = 0;
+
+private:
+    QAtomicInt m_stop;
+};
+}
+
 BenchDUChain::BenchDUChain()
 {
 }
@@ -67,8 +105,16 @@ void BenchDUChain::benchDUChainBuilder()
             "#include <iostream>\n"
             "#include <string>\n"
             "#include <mutex>\n", QStringLiteral("cpp"));
+        ReadLockProbe probe;
+        probe.start();
         file.parse(TopDUContext::AllDeclarationsContextsAndUses);
         QVERIFY(file.waitForParsed(60000));
+        probe.stop();
+
+        // the builder releases the write lock regularly, readers never wait for a whole file
+        QVERIFY(probe.probes > 0);
+        QVERIFY2(probe.maximumWait < 1000 * 1000 * 1000,
+                 qPrintable(QStringLiteral("maximum read lock wait: %1 ms").arg(probe.maximumWait / 1000 / 1000)));
 
         DUChainReadLocker lock;
         auto top = file.topContext();
@@ -1501,3 +1501,49 @@ void TestCodeCompletion::testIgnoreGccBuiltins()
         executeCompletionTest(file.topContext(), {});
     }
 }
+
+void TestCodeCompletion::testCompletionWhileTyping()
+{
+    const QString text = QStringLiteral("int foobar; int foobaz; int other;\nint main() {\n ");
+    TestFile file(text + QStringLiteral("\n}\n"), QStringLiteral("cpp"));
+    QVERIFY(file.parseAndWait(TopDUContext::AllDeclarationsContextsUsesAndAST));
+    DUChainReadLocker lock;
+    auto top = file.topContext();
+    QVERIFY(top);
+    const ParseSessionData::Ptr sessionData(dynamic_cast<ParseSessionData*>(top->ast().data()));
+    QVERIFY(sessionData);
+
+    lock.unlock();
+
+    const auto complete = [&](const QString& prefix, const QString& textAfterWord,
+                              const ClangCodeCompletionContext::ResultCache& previousResults) {
+        QExplicitlySharedDataPointer<ClangCodeCompletionContext> context{
+            new ClangCodeCompletionContext(DUContextPointer(top), sessionData, top->url().toUrl(), {2, 1}, text,
+                                           prefix + textAfterWord, prefix, previousResults)};
+        context->setFilters(NoMacroOrBuiltin);
+        return context;
+    };
+    const auto sortedNames = [](const QExplicitlySharedDataPointer<ClangCodeCompletionContext>& context) {
+        auto names = ClangCodeCompletionItemTester(context).names;
+        names.sort();
+        return names;
+    };
+
+    const auto first = complete(QStringLiteral("fo"), QStringLiteral("\n}\n"), {});
+    const auto firstResults = first->resultCache();
+    QVERIFY(firstResults.isValid());
+    lock.lock();
+    QCOMPARE(sortedNames(first), (QStringList{QStringLiteral("foobar"), QStringLiteral("foobaz")}));
+    lock.unlock();
+
+    // typing on refilters the results of the first completion
+    const auto second = complete(QStringLiteral("foobaz"), QStringLiteral("\n}\n"), firstResults);
+    QCOMPARE(second->resultCache().results.constData(), firstResults.results.constData());
+    lock.lock();
+    QCOMPARE(sortedNames(second), QStringList{QStringLiteral("foobaz")});
+    lock.unlock();
+
+    // a change next to the word asks clang again
+    const auto third = complete(QStringLiteral("fo"), QStringLiteral(" + 1;\n}\n"), firstResults);
+    QVERIFY(third->resultCache().results.constData() != firstResults.results.constData());
+}
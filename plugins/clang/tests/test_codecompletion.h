@@ -60,6 +60,8 @@ private Q_SLOTS:
     void testCompleteFunction();
 
     void testIgnoreGccBuiltins();
+
+    void testCompletionWhileTyping();
 };
 
 #endif // TESTCODECOMPLETION_H
@@ -48,13 +48,19 @@
 #include <interfaces/idocumentcontroller.h>
 #include <util/kdevstringhandler.h>
 
+#include "duchain/clangindex.h"
 #include "duchain/clangparsingenvironmentfile.h"
 #include "duchain/clangparsingenvironment.h"
+#include "duchain/clangpch.h"
+#include "duchain/livetranslationunits.h"
 #include "duchain/parsesession.h"
+#include "clangparsingenvironmentcache.h"
+#include "util/clangutils.h"
 
 #include "testprovider.h"
 
 #include <KConfigGroup>
+#include <KTextEditor/Document>
 
 #include <QTest>
 #include <QSignalSpy>
@@ -2223,3 +2229,232 @@ void TestDUChain::testSameFunctionDefinition()
 
     m_projectController->closeAllProjects();
 }
+
+void TestDUChain::testSharedPreamble()
+{
+    QTemporaryDir includeDir;
+    for (const auto& name : {QStringLiteral("a.h"), QStringLiteral("b.h")}) {
+        QFile header(includeDir.path() + QLatin1Char('/') + name);
+        QVERIFY(header.open(QIODevice::WriteOnly));
+        header.write("struct " + name.left(1).toUpper().toUtf8() + " {};\n");
+    }
+
+    // keep out of the preambles of the plugin's own index
+    QTemporaryDir preambleDir;
+    ClangIndex index(preambleDir.path());
+    ClangParsingEnvironment environment;
+    environment.addIncludes({Path(includeDir.path())});
+    environment.setTranslationUnitUrl(IndexedString(includeDir.path() + QLatin1String("/tu.cpp")));
+
+    const QByteArray leadingIncludes = "// license\n#include <a.h>\n/* comment */\n#  include <b.h> // b\n";
+    const auto preamble = index.sharedPreamble(environment, leadingIncludes + "int a;\n");
+    QVERIFY(preamble.isValid());
+
+    QFile header(preamble.toLocalFile());
+    QVERIFY(header.open(QIODevice::ReadOnly));
+    QCOMPARE(header.readAll(), QByteArray("#include <a.h>\n#include <b.h>\n"));
+
+    // only the includes before the first code matter
+    QCOMPARE(index.sharedPreamble(environment, leadingIncludes + "int b;\n#include <c.h>\n"), preamble);
+    QVERIFY(index.sharedPreamble(environment, leadingIncludes + "#include <c.h>\n") != preamble);
+    // quoted includes are looked up relative to the translation unit and are never shared
+    QVERIFY(!index.sharedPreamble(environment, "#include \"a.h\"\n" + leadingIncludes).isValid());
+    // a single include is not worth it
+    QVERIFY(!index.sharedPreamble(environment, "#include <a.h>\n").isValid());
+
+    auto otherEnvironment = environment;
+    otherEnvironment.addDefines({{QStringLiteral("FOO"), QStringLiteral("1")}});
+    QVERIFY(index.sharedPreamble(otherEnvironment, leadingIncludes) != preamble);
+
+    environment.setPchInclude(preamble);
+    QVERIFY(index.pch(environment));
+    QVERIFY(index.pch(environment));
+    QVERIFY(QFile::exists(preamble.toLocalFile() + QLatin1String(".pch")));
+
+    const auto statistics = index.preambleCacheStatistics();
+    QCOMPARE(statistics.misses, 1);
+    QCOMPARE(statistics.hits, 1);
+    QVERIFY(statistics.size > 0);
+
+    // the preambles are kept for the next session, without touching the header
+    const auto modified = QFileInfo(preamble.toLocalFile()).lastModified();
+    QTest::qWait(1100);
+    ClangIndex nextIndex(preambleDir.path());
+    QCOMPARE(nextIndex.preambleCacheStatistics().preambles, 3);
+    QCOMPARE(nextIndex.sharedPreamble(environment, leadingIncludes), preamble);
+    QCOMPARE(QFileInfo(preamble.toLocalFile()).lastModified(), modified);
+}
+
+void TestDUChain::testTranslationUnitMemoryBudget()
+{
+    ClangIndex index;
+    auto liveUnits = index.liveTranslationUnits();
+    // no translation unit fits, so only the one used last stays alive
+    liveUnits->setBudget(1);
+
+    const auto createSession = [&index](const QString& fileName) {
+        ClangParsingEnvironment environment;
+        environment.setTranslationUnitUrl(IndexedString(fileName));
+        return ParseSessionData::Ptr(new ParseSessionData({UnsavedFile(fileName, {QStringLiteral("int foo();")})},
+                                                          &index, environment));
+    };
+    const auto first = createSession(QStringLiteral("/tmp/first.cpp"));
+    QCOMPARE(liveUnits->statistics().liveUnits, 1);
+    QVERIFY(liveUnits->statistics().memory > 0);
+
+    const auto second = createSession(QStringLiteral("/tmp/second.cpp"));
+    auto statistics = liveUnits->statistics();
+    QCOMPARE(statistics.liveUnits, 1);
+    QCOMPARE(statistics.suspendedUnits, 1);
+
+    {
+        // the suspended translation unit is parsed again when it is used
+        ParseSession session(first);
+        QVERIFY(session.unit());
+        QVERIFY(session.mainFile());
+    }
+    statistics = liveUnits->statistics();
+    QCOMPARE(statistics.liveUnits, 1);
+    QCOMPARE(statistics.suspendedUnits, 1);
+
+    {
+        // sessions in use are never suspended
+        ParseSession session(second);
+        QVERIFY(session.unit());
+        liveUnits->setBudget(0);
+        QVERIFY(session.unit());
+    }
+
+    liveUnits->setBudget(qint64(1) << 40);
+    ParseSession session(first);
+    QVERIFY(session.unit());
+    QCOMPARE(liveUnits->statistics().liveUnits, 2);
+}
+
+void TestDUChain::testParsingEnvironmentCache()
+{
+    ClangParsingEnvironmentCache cache;
+
+    QTemporaryDir dir;
+    auto project = new TestProject(Path(dir.path()), this);
+    m_projectController->addProject(project);
+    TestFile file(QStringLiteral("int i;"), QStringLiteral("cpp"), project);
+
+    const auto environment = cache.environment(file.url());
+    QCOMPARE(environment.translationUnitUrl(), file.url());
+    auto statistics = cache.statistics();
+    QCOMPARE(statistics.hits, 0);
+    QCOMPARE(statistics.misses, 1);
+    QCOMPARE(statistics.entries, 1);
+
+    QCOMPARE(cache.environment(file.url()), environment);
+    QCOMPARE(cache.statistics().hits, 1);
+
+    // a new generation of the project outdates the cached environment, which is replaced
+    cache.invalidate(project);
+    QCOMPARE(cache.environment(file.url()), environment);
+    statistics = cache.statistics();
+    QCOMPARE(statistics.hits, 1);
+    QCOMPARE(statistics.misses, 2);
+    QCOMPARE(statistics.entries, 1);
+    QCOMPARE(cache.environment(file.url()), environment);
+    QCOMPARE(cache.statistics().hits, 2);
+
+    // closing a project evicts all environments
+    m_projectController->closeAllProjects();
+    QCOMPARE(cache.statistics().entries, 0);
+}
+
+void TestDUChain::testSkipFunctionBodies()
+{
+    TestFile file(QStringLiteral("int main() { int i = 42; return i; }"), QStringLiteral("cpp"));
+    file.parse(TopDUContext::VisibleDeclarationsAndContexts);
+    QVERIFY(file.waitForParsed(1000));
+
+    const auto findLocal = [&file]() -> Declaration* {
+        DUContext* mainContext = file.topContext()->childContexts().value(0);
+        if (!mainContext) {
+            return nullptr;
+        }
+        for (auto context : mainContext->childContexts()) {
+            if (!context->localDeclarations().isEmpty()) {
+                return context->localDeclarations().first();
+            }
+        }
+        return nullptr;
+    };
+
+    {
+        DUChainReadLocker lock;
+        QVERIFY(file.topContext());
+        QCOMPARE(file.topContext()->localDeclarations().size(), 1);
+        QVERIFY(!findLocal());
+        auto envFile = file.topContext()->parsingEnvironmentFile();
+        QVERIFY(envFile->featuresSatisfied(TopDUContext::VisibleDeclarationsAndContexts));
+        QVERIFY(!envFile->featuresSatisfied(TopDUContext::AllDeclarationsContextsAndUses));
+    }
+    // the complete parse only happens when somebody needs it
+    QVERIFY(!ICore::self()->languageController()->backgroundParser()->isQueued(file.url()));
+
+    file.parse(TopDUContext::AllDeclarationsContextsAndUses);
+    QVERIFY(file.waitForParsed(1000));
+
+    DUChainReadLocker lock;
+    QVERIFY(file.topContext());
+    QVERIFY(file.topContext()->parsingEnvironmentFile()->featuresSatisfied(TopDUContext::AllDeclarationsContextsAndUses));
+    auto local = findLocal();
+    QVERIFY(local);
+    QCOMPARE(local->identifier().toString(), QStringLiteral("i"));
+    QCOMPARE(local->uses().size(), 1);
+}
+
+void TestDUChain::testUnsavedFileContents()
+{
+    TestFile file(QStringLiteral("int a;\nint b;\nint c;\n"), QStringLiteral("cpp"));
+    const QByteArray fileName = file.url().toUrl().toLocalFile().toUtf8();
+
+    auto document = ICore::self()->documentController()->openDocument(file.url().toUrl(), KTextEditor::Range::invalid(),
+                                                                       IDocumentController::DoNotActivate);
+    QVERIFY(document);
+    auto textDocument = document->textDocument();
+    QVERIFY(textDocument);
+
+    const auto findContents = [&fileName](const QVector<UnsavedFile>& unsavedFiles) -> const char* {
+        for (const auto& unsavedFile : unsavedFiles) {
+            const auto clangFile = unsavedFile.toClangApi();
+            if (fileName == clangFile.Filename) {
+                return clangFile.Contents;
+            }
+        }
+        return nullptr;
+    };
+    const auto verifyContents = [&]() {
+        const auto unsavedFiles = ClangUtils::unsavedFiles();
+        const auto contents = findContents(unsavedFiles);
+        QVERIFY(contents);
+        QCOMPARE(QByteArray(contents), QString(textDocument->text() + QLatin1Char('\n')).toUtf8());
+    };
+
+    // documents without modifications are read from disk
+    QVERIFY(!findContents(ClangUtils::unsavedFiles()));
+
+    textDocument->insertText({1, 0}, QStringLiteral("long "));
+    verifyContents();
+
+    // the contents are shared until the document changes
+    const auto unsavedFiles = ClangUtils::unsavedFiles();
+    QVERIFY(findContents(ClangUtils::unsavedFiles()) == findContents(unsavedFiles));
+
+    textDocument->insertText({0, 0}, QStringLiteral("int z;\n"));
+    verifyContents();
+    textDocument->removeLine(2);
+    verifyContents();
+    textDocument->insertText({1, 0}, QStringLiteral("// \u00e4\u00df\n// \u00f6\n"));
+    verifyContents();
+    textDocument->removeText({0, 0, 2, 0});
+    verifyContents();
+    textDocument->insertText(textDocument->documentEnd(), QStringLiteral("int d;"));
+    verifyContents();
+
+    document->close(IDocument::Discard);
+}
@@ -107,6 +107,12 @@ private Q_SLOTS:
 
     void testSameFunctionDefinition();
 
+    void testSharedPreamble();
+    void testTranslationUnitMemoryBudget();
+    void testParsingEnvironmentCache();
+    void testSkipFunctionBodies();
+    void testUnsavedFileContents();
+
 private:
     QScopedPointer<TestEnvironmentProvider> m_provider;
     KDevelop::TestProjectController* m_projectController;
@@ -32,6 +32,11 @@
 
 #include <clang-c/Index.h>
 
+#include <KTextEditor/Document>
+#include <KTextEditor/MovingInterface>
+
+#include <QHash>
+#include <QMutex>
 #include <QTextStream>
 #include <QRegularExpression>
 
@@ -58,13 +63,126 @@ CXCursor ClangUtils::getCXCursor(int line, int column, const CXTranslationUnit&
     return clang_getCursor(unit, location);
 }
 
+namespace {
+
+/**
+ * The UTF-8 encoded contents of an open document at a given revision
+ */
+struct DocumentContents
+{
+    qint64 revision = -1;
+    QStringList lines;
+    /// The offset of the end of each line in utf8, including its newline
+    QVector<int> lineEnds;
+    QByteArray utf8;
+};
+
+class DocumentContentsCache
+{
+public:
+    /**
+     * @returns the UTF-8 encoded contents of @p document
+     *
+     * The contents are encoded again only when the revision of the document changed,
+     * and then only the lines between the unchanged lines at its start and end.
+     */
+    QByteArray utf8Contents(KTextEditor::Document* document)
+    {
+        auto moving = qobject_cast<KTextEditor::MovingInterface*>(document);
+        const qint64 revision = moving ? moving->revision() : -1;
+
+        QMutexLocker lock(&m_mutex);
+        auto it = m_contents.find(document);
+        if (it == m_contents.end()) {
+            it = m_contents.insert(document, {});
+            // the revision starts over when the document is reloaded
+            QObject::connect(document, &KTextEditor::Document::aboutToReload, document, [document]() {
+                removeDocument(document);
+            });
+            QObject::connect(document, &QObject::destroyed, [document]() {
+                removeDocument(document);
+            });
+        } else if (moving && it->revision == revision) {
+            return it->utf8;
+        }
+
+        update(&(*it), document->textLines(document->documentRange()));
+        it->revision = revision;
+        return it->utf8;
+    }
+
+    void remove(KTextEditor::Document* document)
+    {
+        QMutexLocker lock(&m_mutex);
+        m_contents.remove(document);
+    }
+
+private:
+    static void removeDocument(KTextEditor::Document* document);
+
+    static void update(DocumentContents* contents, const QStringList& lines)
+    {
+        const int oldCount = contents->lines.size();
+        const int newCount = lines.size();
+
+        // unchanged lines share their data with the ones of the previous revision, so comparing them is cheap
+        int prefix = 0;
+        while (prefix < oldCount && prefix < newCount && lines[prefix] == contents->lines[prefix]) {
+            ++prefix;
+        }
+        int suffix = 0;
+        while (suffix < oldCount - prefix && suffix < newCount - prefix
+               && lines[newCount - 1 - suffix] == contents->lines[oldCount - 1 - suffix]) {
+            ++suffix;
+        }
+
+        const int prefixEnd = prefix ? contents->lineEnds[prefix - 1] : 0;
+        const int suffixBegin = (oldCount - suffix) ? contents->lineEnds[oldCount - suffix - 1] : 0;
+
+        QByteArray utf8;
+        utf8.reserve(contents->utf8.size() + 1024);
+        utf8.append(contents->utf8.constData(), prefixEnd);
+
+        QVector<int> lineEnds;
+        lineEnds.reserve(newCount);
+        lineEnds.append(contents->lineEnds.constData(), prefix);
+        for (int i = prefix; i < newCount - suffix; ++i) {
+            utf8 += lines[i].toUtf8();
+            utf8 += '\n';
+            lineEnds.append(utf8.size());
+        }
+
+        const int shift = utf8.size() - suffixBegin;
+        utf8.append(contents->utf8.constData() + suffixBegin, contents->utf8.size() - suffixBegin);
+        for (int i = oldCount - suffix; i < oldCount; ++i) {
+            lineEnds.append(contents->lineEnds[i] + shift);
+        }
+
+        contents->lines = lines;
+        contents->lineEnds = lineEnds;
+        contents->utf8 = utf8;
+    }
+
+    QMutex m_mutex;
+    QHash<KTextEditor::Document*, DocumentContents> m_contents;
+};
+
+Q_GLOBAL_STATIC(DocumentContentsCache, s_documentContents)
+
+void DocumentContentsCache::removeDocument(KTextEditor::Document* document)
+{
+    if (!s_documentContents.isDestroyed()) {
+        s_documentContents->remove(document);
+    }
+}
+
+}
+
 QVector<UnsavedFile> ClangUtils::unsavedFiles()
 {
     QVector<UnsavedFile> ret;
     foreach(auto document, ICore::self()->documentController()->openDocuments()) {
         auto textDocument = document->textDocument();
-        // TODO: Introduce a cache so we don't have to re-read all the open documents
-        // which were not changed since the last run
         if (!textDocument || !textDocument->url().isLocalFile()
             || !DocumentFinderHelpers::mimeTypesList().contains(textDocument->mimeType()))
         {
@@ -73,8 +191,7 @@ QVector<UnsavedFile> ClangUtils::unsavedFiles()
         if (!textDocument->isModified()) {
             continue;
         }
-        ret << UnsavedFile(textDocument->url().toLocalFile(),
-                           textDocument->textLines(textDocument->documentRange()));
+        ret << UnsavedFile(textDocument->url().toLocalFile(), s_documentContents->utf8Contents(textDocument));
     }
     return ret;
 }
@@ -76,6 +76,9 @@ namespace ClangUtils
      * @note Since this reads text from the editor widget, it must be called from the
      *       GUI thread or with the foreground lock held.
      *
+     * The UTF-8 encoded contents of the documents are cached until they are edited, so
+     * repeated calls for reparsing and code completion share them.
+     *
      * @return vector of all unsaved files and their current contents
      */
     KDEVCLANGPRIVATE_EXPORT QVector<UnsavedFile> unsavedFiles();
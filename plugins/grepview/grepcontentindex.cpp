@@ -0,0 +1,563 @@
+/***************************************************************************
+ *   This file is part of KDevelop                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "grepcontentindex.h"
+#include "debug.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+
+#include <KDirWatch>
+
+#include <interfaces/icore.h>
+#include <interfaces/idocument.h>
+#include <interfaces/idocumentcontroller.h>
+#include <interfaces/iproject.h>
+#include <interfaces/iprojectcontroller.h>
+#include <project/abstractfilemanagerplugin.h>
+#include <project/projectmodel.h>
+#include <serialization/indexedstring.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace KDevelop;
+
+namespace {
+
+const quint32 IndexMagic = 0x4b444749; // "KDGI"
+const quint32 IndexVersion = 1;
+
+char toAsciiLower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+void appendVarInt(QByteArray* data, quint32 value)
+{
+    while (value >= 0x80) {
+        data->append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    data->append(static_cast<char>(value));
+}
+
+QVector<quint32> decodeIds(const QByteArray& deltas)
+{
+    QVector<quint32> ids;
+    quint32 id = 0;
+    quint32 delta = 0;
+    int shift = 0;
+    for (const char c : deltas) {
+        delta |= static_cast<quint32>(static_cast<uchar>(c) & 0x7f) << shift;
+        if (static_cast<uchar>(c) & 0x80) {
+            shift += 7;
+            continue;
+        }
+        id += delta;
+        ids.append(id);
+        delta = 0;
+        shift = 0;
+    }
+    return ids;
+}
+
+}
+
+GrepContentIndex::Stamp GrepContentIndex::stamp(const QString& path)
+{
+    const QFileInfo info(path);
+    Stamp ret;
+    if (info.isFile()) {
+        ret.lastModified = info.lastModified().toMSecsSinceEpoch();
+        ret.size = info.size();
+    }
+    return ret;
+}
+
+QVector<quint32> GrepContentIndex::trigrams(const QByteArray& text)
+{
+    QVector<quint32> ret;
+    if (text.size() < 3) {
+        return ret;
+    }
+
+    ret.reserve(text.size() - 2);
+    quint32 trigram = (static_cast<uchar>(toAsciiLower(text[0])) << 8) | static_cast<uchar>(toAsciiLower(text[1]));
+    for (int i = 2; i < text.size(); ++i) {
+        trigram = ((trigram << 8) | static_cast<uchar>(toAsciiLower(text[i]))) & 0xffffff;
+        ret.append(trigram);
+    }
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+void GrepContentIndex::addFile(const QString& path, const Stamp& stamp, const QByteArray& contents)
+{
+    quint8 flags = NoFlags;
+    if (contents.contains('\0')) {
+        flags |= MaybeWideEncoding;
+    }
+    if (std::any_of(contents.constBegin(), contents.constEnd(), [](char c) { return static_cast<uchar>(c) >= 0x80; })) {
+        flags |= NonAscii;
+    }
+    // such files are always searched, their trigrams are of no use
+    const QVector<quint32> fileTrigrams = (flags & MaybeWideEncoding) ? QVector<quint32>() : trigrams(contents);
+
+    QMutexLocker lock(&m_mutex);
+
+    const auto it = m_ids.constFind(path);
+    if (it != m_ids.constEnd()) {
+        m_files[*it].removed = true;
+        ++m_removedCount;
+    }
+
+    const quint32 id = m_files.size();
+    File file;
+    file.path = path;
+    file.stamp = stamp;
+    file.flags = flags;
+    m_files.append(file);
+    m_ids.insert(path, id);
+
+    // the ids only grow, so the posting lists stay sorted
+    for (const quint32 trigram : fileTrigrams) {
+        auto& postings = m_postings[trigram];
+        appendVarInt(&postings.deltas, id - postings.lastId);
+        postings.lastId = id;
+    }
+
+    if (m_removedCount > 1024 && m_removedCount > m_files.size() / 2) {
+        compact();
+    }
+}
+
+void GrepContentIndex::removeFile(const QString& path)
+{
+    QMutexLocker lock(&m_mutex);
+
+    const auto it = m_ids.find(path);
+    if (it == m_ids.end()) {
+        return;
+    }
+    m_files[*it].removed = true;
+    ++m_removedCount;
+    m_ids.erase(it);
+}
+
+GrepContentIndex::Stamp GrepContentIndex::indexedStamp(const QString& path) const
+{
+    QMutexLocker lock(&m_mutex);
+
+    const auto it = m_ids.constFind(path);
+    return it == m_ids.constEnd() ? Stamp() : m_files[*it].stamp;
+}
+
+QStringList GrepContentIndex::files() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_ids.keys();
+}
+
+GrepContentIndex::Query GrepContentIndex::query(const QString& literal, Qt::CaseSensitivity caseSensitivity) const
+{
+    Query ret;
+    const bool ascii = std::all_of(literal.begin(), literal.end(), [](QChar c) { return c.unicode() < 0x80; });
+    if (!ascii) {
+        return ret;
+    }
+    const QVector<quint32> literalTrigrams = trigrams(literal.toLatin1());
+    if (literalTrigrams.isEmpty()) {
+        return ret;
+    }
+
+    QMutexLocker lock(&m_mutex);
+
+    // intersect the shortest posting lists first
+    QVector<const Postings*> postings;
+    postings.reserve(literalTrigrams.size());
+    for (const quint32 trigram : literalTrigrams) {
+        const auto it = m_postings.constFind(trigram);
+        if (it == m_postings.constEnd()) {
+            postings.clear();
+            break;
+        }
+        postings.append(&it.value());
+    }
+    std::sort(postings.begin(), postings.end(), [](const Postings* lhs, const Postings* rhs) {
+        return lhs->deltas.size() < rhs->deltas.size();
+    });
+
+    QVector<quint32> candidates;
+    for (int i = 0; i < postings.size(); ++i) {
+        const QVector<quint32> ids = decodeIds(postings[i]->deltas);
+        if (i == 0) {
+            candidates = ids;
+        } else {
+            QVector<quint32> intersection;
+            std::set_intersection(candidates.constBegin(), candidates.constEnd(), ids.constBegin(), ids.constEnd(),
+                                  std::back_inserter(intersection));
+            candidates = intersection;
+        }
+        if (candidates.isEmpty()) {
+            break;
+        }
+    }
+
+    ret.generation = m_generation;
+    ret.fileCount = m_files.size();
+    ret.caseSensitivity = caseSensitivity;
+    ret.candidates = candidates;
+    return ret;
+}
+
+bool GrepContentIndex::excludes(const QString& path, const Query& query, Stamp* stamp) const
+{
+    QMutexLocker lock(&m_mutex);
+
+    if (query.generation != m_generation) {
+        return false;
+    }
+    const auto it = m_ids.constFind(path);
+    if (it == m_ids.constEnd() || *it >= query.fileCount) {
+        return false;
+    }
+    const File& file = m_files[*it];
+    if ((file.flags & MaybeWideEncoding) || (query.caseSensitivity == Qt::CaseInsensitive && (file.flags & NonAscii))) {
+        return false;
+    }
+    if (std::binary_search(query.candidates.constBegin(), query.candidates.constEnd(), *it)) {
+        return false;
+    }
+    *stamp = file.stamp;
+    return true;
+}
+
+void GrepContentIndex::compact()
+{
+    QVector<quint32> newIds(m_files.size(), std::numeric_limits<quint32>::max());
+    QVector<File> files;
+    files.reserve(m_files.size() - m_removedCount);
+    m_ids.clear();
+    for (int id = 0; id < m_files.size(); ++id) {
+        if (m_files[id].removed) {
+            continue;
+        }
+        newIds[id] = files.size();
+        m_ids.insert(m_files[id].path, files.size());
+        files.append(m_files[id]);
+    }
+    m_files = files;
+    m_removedCount = 0;
+
+    for (auto it = m_postings.begin(); it != m_postings.end();) {
+        Postings postings;
+        for (const quint32 id : decodeIds(it->deltas)) {
+            const quint32 newId = newIds[id];
+            if (newId != std::numeric_limits<quint32>::max()) {
+                appendVarInt(&postings.deltas, newId - postings.lastId);
+                postings.lastId = newId;
+            }
+        }
+        if (postings.deltas.isEmpty()) {
+            it = m_postings.erase(it);
+        } else {
+            *it = postings;
+            ++it;
+        }
+    }
+
+    ++m_generation;
+}
+
+bool GrepContentIndex::save(const QString& fileName)
+{
+    QMutexLocker lock(&m_mutex);
+
+    if (m_removedCount) {
+        compact();
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(PLUGIN_GREPVIEW) << "failed to write the content index" << fileName << file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << IndexMagic << IndexVersion;
+    stream << static_cast<quint32>(m_files.size());
+    for (const File& indexedFile : qAsConst(m_files)) {
+        stream << indexedFile.path << indexedFile.stamp.lastModified << indexedFile.stamp.size << indexedFile.flags;
+    }
+    stream << static_cast<quint32>(m_postings.size());
+    for (auto it = m_postings.constBegin(); it != m_postings.constEnd(); ++it) {
+        stream << it.key() << it->lastId << it->deltas;
+    }
+    return file.commit();
+}
+
+bool GrepContentIndex::load(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0;
+    quint32 version = 0;
+    stream >> magic >> version;
+    if (magic != IndexMagic || version != IndexVersion) {
+        qCDebug(PLUGIN_GREPVIEW) << "ignoring content index of another version" << fileName;
+        return false;
+    }
+
+    QVector<File> files;
+    QHash<QString, quint32> ids;
+    quint32 fileCount = 0;
+    stream >> fileCount;
+    files.reserve(fileCount);
+    for (quint32 id = 0; id < fileCount && stream.status() == QDataStream::Ok; ++id) {
+        File indexedFile;
+        stream >> indexedFile.path >> indexedFile.stamp.lastModified >> indexedFile.stamp.size >> indexedFile.flags;
+        ids.insert(indexedFile.path, id);
+        files.append(indexedFile);
+    }
+
+    QHash<quint32, Postings> allPostings;
+    quint32 postingsCount = 0;
+    stream >> postingsCount;
+    allPostings.reserve(postingsCount);
+    for (quint32 i = 0; i < postingsCount && stream.status() == QDataStream::Ok; ++i) {
+        quint32 trigram = 0;
+        Postings postings;
+        stream >> trigram >> postings.lastId >> postings.deltas;
+        allPostings.insert(trigram, postings);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qCWarning(PLUGIN_GREPVIEW) << "failed to read the content index" << fileName;
+        return false;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_files = files;
+    m_ids = ids;
+    m_postings = allPostings;
+    m_removedCount = 0;
+    ++m_generation;
+    return true;
+}
+
+GrepContentIndexer::GrepContentIndexer(const QString& storageDirectory, QObject* parent)
+    : QObject(parent)
+    , m_storageDirectory(storageDirectory)
+{
+    m_pool.setMaxThreadCount(1);
+    QDir().mkpath(m_storageDirectory);
+
+    auto projectController = ICore::self()->projectController();
+    connect(projectController, &IProjectController::projectOpened,
+            this, &GrepContentIndexer::projectOpened);
+    connect(projectController, &IProjectController::projectClosing,
+            this, &GrepContentIndexer::projectClosing);
+    connect(ICore::self()->documentController(), &IDocumentController::documentSaved,
+            this, &GrepContentIndexer::documentSaved);
+
+    const auto projects = projectController->projects();
+    for (auto project : projects) {
+        projectOpened(project);
+    }
+}
+
+GrepContentIndexer::~GrepContentIndexer()
+{
+    m_aborting.store(1);
+    m_pool.waitForDone();
+
+    for (const auto& projectIndex : qAsConst(m_indexes)) {
+        projectIndex.index->save(projectIndex.storageFile);
+    }
+}
+
+QVector<QSharedPointer<const GrepContentIndex>> GrepContentIndexer::indexes() const
+{
+    QVector<QSharedPointer<const GrepContentIndex>> ret;
+    ret.reserve(m_indexes.size());
+    for (const auto& projectIndex : m_indexes) {
+        ret.append(projectIndex.index);
+    }
+    return ret;
+}
+
+void GrepContentIndexer::projectOpened(IProject* project)
+{
+    if (!project->path().isLocalFile() || m_indexes.contains(project)) {
+        return;
+    }
+
+    ProjectIndex projectIndex;
+    projectIndex.index = QSharedPointer<GrepContentIndex>::create();
+    // the project file is unique, unlike the project name
+    const QByteArray projectFile = project->projectFile().toLocalFile().toUtf8();
+    projectIndex.storageFile = m_storageDirectory + QLatin1Char('/') + QString::number(qHash(projectFile), 16)
+                             + QLatin1String(".index");
+    m_indexes.insert(project, projectIndex);
+
+    QSet<QString> paths;
+    const auto fileSet = project->fileSet();
+    paths.reserve(fileSet.size());
+    for (const IndexedString& file : fileSet) {
+        paths.insert(file.str());
+    }
+    schedule(projectIndex.index, paths, projectIndex.storageFile);
+
+    connect(project, &IProject::fileAddedToSet, this, [this, project](ProjectFileItem* item) {
+        fileChanged(project, item->path().toLocalFile());
+    });
+    connect(project, &IProject::fileRemovedFromSet, this, [this, project](ProjectFileItem* item) {
+        fileRemoved(project, item->path().toLocalFile());
+    });
+    // the project manager watches the project for added and removed files, this adds the modified ones
+    if (auto manager = qobject_cast<AbstractFileManagerPlugin*>(project->managerPlugin())) {
+        if (auto watcher = manager->projectWatcher(project)) {
+            connect(watcher, &KDirWatch::dirty, this, [this, project](const QString& path) {
+                fileChanged(project, path);
+            });
+        }
+    }
+}
+
+void GrepContentIndexer::projectClosing(IProject* project)
+{
+    const ProjectIndex projectIndex = m_indexes.take(project);
+    if (!projectIndex.index) {
+        return;
+    }
+
+    disconnect(project, nullptr, this, nullptr);
+    {
+        QMutexLocker lock(&m_mutex);
+        m_pending.remove(projectIndex.index);
+    }
+    QtConcurrent::run(&m_pool, [projectIndex]() {
+        projectIndex.index->save(projectIndex.storageFile);
+    });
+}
+
+void GrepContentIndexer::documentSaved(IDocument* document)
+{
+    const QString path = document->url().toLocalFile();
+    const auto projects = m_indexes.keys();
+    for (auto project : projects) {
+        fileChanged(project, path);
+    }
+}
+
+void GrepContentIndexer::fileChanged(IProject* project, const QString& path)
+{
+    const auto it = m_indexes.constFind(project);
+    if (it == m_indexes.constEnd() || !project->inProject(IndexedString(path))) {
+        return;
+    }
+    schedule(it->index, {path});
+}
+
+void GrepContentIndexer::fileRemoved(IProject* project, const QString& path)
+{
+    const auto it = m_indexes.constFind(project);
+    if (it == m_indexes.constEnd()) {
+        return;
+    }
+
+    {
+        QMutexLocker lock(&m_mutex);
+        const auto pending = m_pending.find(it->index);
+        if (pending != m_pending.end()) {
+            pending->paths.remove(path);
+        }
+    }
+    it->index->removeFile(path);
+}
+
+void GrepContentIndexer::schedule(const QSharedPointer<GrepContentIndex>& index, const QSet<QString>& paths,
+                                  const QString& loadFrom)
+{
+    QMutexLocker lock(&m_mutex);
+
+    auto& pending = m_pending[index];
+    pending.paths += paths;
+    if (!loadFrom.isEmpty()) {
+        pending.loadFrom = loadFrom;
+    }
+
+    if (!m_working) {
+        m_working = true;
+        QtConcurrent::run(&m_pool, [this]() { work(); });
+    }
+}
+
+void GrepContentIndexer::work()
+{
+    forever {
+        QSharedPointer<GrepContentIndex> index;
+        PendingWork pending;
+        {
+            QMutexLocker lock(&m_mutex);
+            if (m_pending.isEmpty() || m_aborting.load()) {
+                m_working = false;
+                return;
+            }
+            const auto it = m_pending.begin();
+            index = it.key();
+            pending = it.value();
+            m_pending.erase(it);
+        }
+
+        if (!pending.loadFrom.isEmpty() && index->load(pending.loadFrom)) {
+            // drop the files that were removed from the project while it was closed
+            const auto indexedFiles = index->files();
+            for (const QString& path : indexedFiles) {
+                if (!pending.paths.contains(path)) {
+                    index->removeFile(path);
+                }
+            }
+        }
+
+        int indexed = 0;
+        for (const QString& path : qAsConst(pending.paths)) {
+            if (m_aborting.load()) {
+                break;
+            }
+
+            const auto stamp = GrepContentIndex::stamp(path);
+            if (stamp == index->indexedStamp(path)) {
+                continue;
+            }
+            QFile file(path);
+            if (stamp.size < 0 || stamp.size > GrepContentIndex::MaxFileSize || !file.open(QIODevice::ReadOnly)) {
+                index->removeFile(path);
+                continue;
+            }
+            index->addFile(path, stamp, file.readAll());
+            ++indexed;
+        }
+        qCDebug(PLUGIN_GREPVIEW) << "indexed the contents of" << indexed << "files";
+    }
+}
@@ -0,0 +1,198 @@
+/***************************************************************************
+ *   This file is part of KDevelop                                         *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef KDEVPLATFORM_PLUGIN_GREPCONTENTINDEX_H
+#define KDEVPLATFORM_PLUGIN_GREPCONTENTINDEX_H
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSharedPointer>
+#include <QSet>
+#include <QThreadPool>
+#include <QVector>
+
+namespace KDevelop {
+class IDocument;
+class IProject;
+}
+
+/**
+ * A trigram index of the contents of the files of one project.
+ *
+ * It knows which files cannot contain a given ASCII literal of at least three characters,
+ * as long as they were not modified since they were indexed. The index is kept up to date
+ * by the GrepContentIndexer, searches still have to check the modification time of the files.
+ *
+ * This class is thread safe.
+ */
+class GrepContentIndex
+{
+public:
+    /// Identifies the indexed contents of a file
+    struct Stamp
+    {
+        qint64 lastModified = -1;
+        qint64 size = -1;
+
+        bool operator==(const Stamp& other) const
+        {
+            return lastModified == other.lastModified && size == other.size;
+        }
+        bool operator!=(const Stamp& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    /// @returns the current stamp of the file @p path, an invalid one if it cannot be read
+    static Stamp stamp(const QString& path);
+
+    /// @returns the trigrams of @p text with ASCII letters folded to lower case, sorted and without duplicates
+    static QVector<quint32> trigrams(const QByteArray& text);
+
+    /// Files bigger than this are not indexed and are always searched
+    enum { MaxFileSize = 4 * 1024 * 1024 };
+
+    /**
+     * The files that may contain a literal, as determined by query()
+     */
+    struct Query
+    {
+        bool isValid() const
+        {
+            return generation != 0;
+        }
+
+        quint64 generation = 0;
+        // the files added to the index later on have greater ids and are not covered by the candidates
+        quint32 fileCount = 0;
+        Qt::CaseSensitivity caseSensitivity = Qt::CaseSensitive;
+        // sorted
+        QVector<quint32> candidates;
+    };
+
+    /// Adds the file @p path with @p contents, or replaces the contents indexed for it before
+    void addFile(const QString& path, const Stamp& stamp, const QByteArray& contents);
+    void removeFile(const QString& path);
+
+    /// @returns the stamp of the indexed contents of @p path, an invalid one if it is not indexed
+    Stamp indexedStamp(const QString& path) const;
+    QStringList files() const;
+
+    /**
+     * @returns the files that may contain @p literal
+     *
+     * The query is invalid if the index cannot answer it, e.g. because the literal is too short.
+     */
+    Query query(const QString& literal, Qt::CaseSensitivity caseSensitivity) const;
+
+    /**
+     * @returns whether @p path did not contain the literal of @p query when it was indexed
+     *
+     * @p stamp is set to the stamp of the indexed contents then. Check that the file was not
+     * modified since before relying on the result.
+     */
+    bool excludes(const QString& path, const Query& query, Stamp* stamp) const;
+
+    /// Writes the index to @p fileName, which drops the removed files from it
+    bool save(const QString& fileName);
+    bool load(const QString& fileName);
+
+private:
+    enum Flag {
+        NoFlags = 0,
+        // ignoring the case, non-ASCII characters may match ASCII letters
+        NonAscii = 1,
+        // UTF-16 or UTF-32 encoded text does not contain the ASCII bytes of the literal
+        MaybeWideEncoding = 2,
+    };
+
+    struct File
+    {
+        QString path;
+        Stamp stamp;
+        quint8 flags = NoFlags;
+        bool removed = false;
+    };
+
+    struct Postings
+    {
+        quint32 lastId = 0;
+        // the ids of the files containing the trigram, delta encoded as variable length integers
+        QByteArray deltas;
+    };
+
+    void compact();
+
+    mutable QMutex m_mutex;
+    // indexed by the id of the file
+    QVector<File> m_files;
+    QHash<QString, quint32> m_ids;
+    QHash<quint32, Postings> m_postings;
+    int m_removedCount = 0;
+    // changes whenever the ids of the files change, i.e. queries become outdated
+    quint64 m_generation = 1;
+};
+
+/**
+ * Maintains the content indexes of all open projects, stored in the session.
+ *
+ * The files are indexed in the background when a project is opened and whenever the
+ * project file manager or the editor reports changes to them.
+ */
+class GrepContentIndexer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit GrepContentIndexer(const QString& storageDirectory, QObject* parent = nullptr);
+    ~GrepContentIndexer() override;
+
+    /// @returns the indexes of all open projects
+    QVector<QSharedPointer<const GrepContentIndex>> indexes() const;
+
+private:
+    void projectOpened(KDevelop::IProject* project);
+    void projectClosing(KDevelop::IProject* project);
+    void documentSaved(KDevelop::IDocument* document);
+    void fileChanged(KDevelop::IProject* project, const QString& path);
+    void fileRemoved(KDevelop::IProject* project, const QString& path);
+
+    void schedule(const QSharedPointer<GrepContentIndex>& index, const QSet<QString>& paths,
+                  const QString& loadFrom = QString());
+    void work();
+
+    struct ProjectIndex
+    {
+        QSharedPointer<GrepContentIndex> index;
+        QString storageFile;
+    };
+
+    struct PendingWork
+    {
+        // when set, the index is loaded from this file first, dropping the files not in paths
+        QString loadFrom;
+        // files to (re)index, the ones that do not exist anymore are removed from the index
+        QSet<QString> paths;
+    };
+
+    const QString m_storageDirectory;
+    QHash<KDevelop::IProject*, ProjectIndex> m_indexes;
+
+    QMutex m_mutex;
+    QHash<QSharedPointer<GrepContentIndex>, PendingWork> m_pending;
+    bool m_working = false;
+    QAtomicInt m_aborting;
+    // a single thread, indexing must not compete with parsing and searching
+    QThreadPool m_pool;
+};
+
+#endif
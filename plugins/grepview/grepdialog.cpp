@@ -237,6 +237,7 @@ GrepDialog::GrepDialog(GrepViewPlugin *plugin, QWidget *parent, bool show)
 
     depthSpin->setValue(cg.readEntry("depth", -1));
     limitToProjectCheck->setChecked(cg.readEntry("search_project_files", true));
+    projectFiltersCheck->setChecked(cg.readEntry("apply_project_filters", false));
 
     filesCombo->addItems(cg.readEntry("file_patterns", filepatterns()));
     excludeCombo->addItems(cg.readEntry("exclude_patterns", excludepatterns()) );
@@ -357,6 +358,7 @@ void GrepDialog::closeEvent(QCloseEvent* closeEvent)
     cg.writeEntry("regexp", regexCheck->isChecked());
     cg.writeEntry("depth", depthSpin->value());
     cg.writeEntry("search_project_files", limitToProjectCheck->isChecked());
+    cg.writeEntry("apply_project_filters", projectFiltersCheck->isChecked());
     cg.writeEntry("case_sens", caseSensitiveCheck->isChecked());
     cg.writeEntry("exclude_patterns", qCombo2StringList(excludeCombo));
     cg.writeEntry("file_patterns", qCombo2StringList(filesCombo));
@@ -566,6 +568,8 @@ void GrepDialog::updateSettings()
     if (limitToProjectCheck->isEnabled())
         m_settings.projectFilesOnly = limitToProjectCheck->isChecked();
 
+    m_settings.applyProjectFilters = projectFiltersCheck->isChecked();
+
     m_settings.caseSensitive = caseSensitiveCheck->isChecked();
     m_settings.regexp = regexCheck->isChecked();
 
@@ -2,17 +2,27 @@
 #include "debug.h"
 
 #include <QDir>
+#include <QDirIterator>
+#include <QMutex>
 #include <QSet>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <functional>
 
 #include <project/projectmodel.h>
 #include <interfaces/iproject.h>
 #include <interfaces/iprojectcontroller.h>
 #include <interfaces/icore.h>
+#include <project/interfaces/iprojectfilter.h>
 
 #include <serialization/indexedstring.h>
 
 
 using KDevelop::IndexedString;
+using KDevelop::Path;
 
 /**
  * @return Return true in case @p url is in @p dir within a maximum depth of @p maxDepth
@@ -73,40 +83,200 @@ static QList<QUrl> thread_getProjectFiles(const QUrl& dir, int depth, const QStr
     return res;
 }
 
-static QList<QUrl> thread_findFiles(const QDir& dir, int depth, const QStringList& include,
-                                   const QStringList& exclude, volatile bool &abort)
+namespace {
+
+/**
+ * Lists folders concurrently and reports the files in them right away, folder by folder.
+ */
+class DirectoryWalker
 {
-    QFileInfoList infos = dir.entryInfoList(include, QDir::NoDotAndDotDot|QDir::Files|QDir::Readable);
+public:
+    using Report = std::function<void(const QList<QUrl>& files)>;
 
-    if(!QFileInfo(dir.path()).isDir())
-        infos << QFileInfo(dir.path());
+    DirectoryWalker(const QStringList& include, const QStringList& exclude,
+                    const QVector<QPair<Path, GrepFindFilesThread::ProjectFilters>>& projectFilters,
+                    volatile bool& abort, const Report& report)
+        : m_include(include)
+        , m_exclude(exclude)
+        , m_projectFilters(projectFilters)
+        , m_abort(abort)
+        , m_report(report)
+    {
+    }
 
-    QList<QUrl> dirFiles;
-    foreach(const QFileInfo &currFile, infos)
+    void addStartPath(const QString& path, int depth)
     {
-        QString currName = currFile.canonicalFilePath();
-        if(!QDir::match(exclude, currName))
-            dirFiles << QUrl::fromLocalFile(currName);
+        const QFileInfo info(path);
+        const QString canonical = info.canonicalFilePath();
+        if (canonical.isEmpty()) {
+            return;
+        }
+        if (info.isDir()) {
+            m_pending.append({canonical, depth});
+        } else if (!matchesAny(compile(m_exclude), canonical)) {
+            reportFiles({canonical});
+        }
     }
-    if(depth != 0)
+
+    void run()
     {
-        static const QDir::Filters dirFilter = QDir::NoDotAndDotDot|QDir::AllDirs|QDir::Readable|QDir::NoSymLinks;
-        foreach(const QFileInfo &currDir, dir.entryInfoList(QStringList(), dirFilter))
-        {
-            if(abort)
-                break;
-            QString canonical = currDir.canonicalFilePath();
-            if (!canonical.startsWith(dir.canonicalPath()))
+        QThreadPool pool;
+        const int threadCount = qMax(1, QThread::idealThreadCount());
+        pool.setMaxThreadCount(threadCount);
+        for (int i = 0; i < threadCount; ++i) {
+            QtConcurrent::run(&pool, [this]() { work(); });
+        }
+        pool.waitForDone();
+    }
+
+private:
+    struct PendingDirectory
+    {
+        QString path;
+        // same meaning as the depth of GrepFindFilesThread
+        int depth;
+    };
+
+    static QVector<QRegExp> compile(const QStringList& patterns)
+    {
+        QVector<QRegExp> ret;
+        ret.reserve(patterns.size());
+        for (const QString& pattern : patterns) {
+            // same as QDir::match
+            ret.append(QRegExp(pattern, Qt::CaseInsensitive, QRegExp::Wildcard));
+        }
+        return ret;
+    }
+
+    static bool matchesAny(const QVector<QRegExp>& patterns, const QString& path)
+    {
+        return std::any_of(patterns.begin(), patterns.end(), [&path](const QRegExp& pattern) {
+            return pattern.exactMatch(path);
+        });
+    }
+
+    bool isFiltered(const QString& path, bool isFolder) const
+    {
+        for (const auto& projectFilters : m_projectFilters) {
+            const QString projectPath = projectFilters.first.toLocalFile();
+            if (path.size() <= projectPath.size() || !path.startsWith(projectPath)
+                || path.at(projectPath.size()) != QLatin1Char('/')) {
                 continue;
+            }
+            const Path filePath(path);
+            for (const auto& filter : projectFilters.second) {
+                if (!filter->isValid(filePath, isFolder)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void work()
+    {
+        // each thread needs its own instances, matching changes the state of a QRegExp
+        const QVector<QRegExp> exclude = compile(m_exclude);
+
+        forever {
+            PendingDirectory dir;
+            {
+                QMutexLocker lock(&m_mutex);
+                while (m_pending.isEmpty() && m_busy > 0 && !m_abort) {
+                    m_wait.wait(&m_mutex);
+                }
+                if (m_pending.isEmpty() || m_abort) {
+                    m_wait.wakeAll();
+                    return;
+                }
+                // depth first keeps the count of pending folders low
+                dir = m_pending.takeLast();
+                ++m_busy;
+            }
 
-            if ( depth > 0 ) {
-                depth--;
+            QStringList files;
+            QVector<PendingDirectory> subDirs;
+            listDirectory(dir, exclude, &files, &subDirs);
+
+            {
+                QMutexLocker lock(&m_mutex);
+                m_pending += subDirs;
+                --m_busy;
+                m_wait.wakeAll();
             }
 
-            dirFiles << thread_findFiles(canonical, depth, include, exclude, abort);
+            reportFiles(files);
+        }
+    }
+
+    void listDirectory(const PendingDirectory& dir, const QVector<QRegExp>& exclude,
+                       QStringList* files, QVector<PendingDirectory>* subDirs) const
+    {
+        // the name filters do not apply to folders with QDir::AllDirs
+        QDirIterator it(dir.path, m_include, QDir::NoDotAndDotDot | QDir::Files | QDir::AllDirs | QDir::Readable);
+        while (it.hasNext() && !m_abort) {
+            it.next();
+            const QFileInfo info = it.fileInfo();
+            const QString path = it.filePath();
+            if (info.isDir()) {
+                // Symbolic links may lead out of the searched folder or into loops. The exclusions
+                // match anywhere in the path, so no file inside an excluded folder can be searched.
+                if (dir.depth == 0 || info.isSymLink() || matchesAny(exclude, path + QLatin1Char('/'))
+                    || isFiltered(path, true)) {
+                    continue;
+                }
+                subDirs->append({path, dir.depth > 0 ? dir.depth - 1 : -1});
+            } else {
+                const QString file = info.isSymLink() ? info.canonicalFilePath() : path;
+                if (file.isEmpty() || matchesAny(exclude, file) || isFiltered(path, false)) {
+                    continue;
+                }
+                files->append(file);
+            }
+        }
+    }
+
+    void reportFiles(QStringList files)
+    {
+        {
+            // files may be found more than once, e.g. when the start paths overlap
+            QMutexLocker lock(&m_mutex);
+            auto it = std::remove_if(files.begin(), files.end(), [this](const QString& file) {
+                if (m_reported.contains(file)) {
+                    return true;
+                }
+                m_reported.insert(file);
+                return false;
+            });
+            files.erase(it, files.end());
+        }
+        if (files.isEmpty()) {
+            return;
+        }
+
+        std::sort(files.begin(), files.end());
+        QList<QUrl> urls;
+        urls.reserve(files.size());
+        for (const QString& file : qAsConst(files)) {
+            urls << QUrl::fromLocalFile(file);
         }
+        m_report(urls);
     }
-    return dirFiles;
+
+    const QStringList m_include;
+    const QStringList m_exclude;
+    const QVector<QPair<Path, GrepFindFilesThread::ProjectFilters>> m_projectFilters;
+    volatile bool& m_abort;
+    const Report m_report;
+
+    QMutex m_mutex;
+    QWaitCondition m_wait;
+    QVector<PendingDirectory> m_pending;
+    // count of folders that are listed right now
+    int m_busy = 0;
+    QSet<QString> m_reported;
+};
+
 }
 
 GrepFindFilesThread::GrepFindFilesThread(QObject* parent,
@@ -125,6 +295,12 @@ GrepFindFilesThread::GrepFindFilesThread(QObject* parent,
     setTerminationEnabled(false);
 }
 
+void GrepFindFilesThread::addProjectFilters(const Path& projectPath, const ProjectFilters& filters)
+{
+    Q_ASSERT(!isRunning());
+    m_projectFilters.append(qMakePair(projectPath, filters));
+}
+
 void GrepFindFilesThread::tryAbort()
 {
     m_tryAbort = true;
@@ -142,21 +318,38 @@ void GrepFindFilesThread::run()
 
     qCDebug(PLUGIN_GREPVIEW) << "running with start dir" << m_startDirs;
 
-    foreach(const QUrl& directory, m_startDirs)
+    if(m_project)
     {
-        if(m_project)
-            m_files += thread_getProjectFiles(directory, m_depth, include, exclude, m_tryAbort);
-        else
+        QSet<QUrl> reported;
+        foreach(const QUrl& directory, m_startDirs)
         {
-            m_files += thread_findFiles(directory.toLocalFile(), m_depth, include, exclude, m_tryAbort);
+            QList<QUrl> files;
+            foreach(const QUrl& file, thread_getProjectFiles(directory, m_depth, include, exclude, m_tryAbort))
+            {
+                if(!reported.contains(file))
+                {
+                    reported.insert(file);
+                    files << file;
+                }
+            }
+            if(!files.isEmpty())
+            {
+                std::sort(files.begin(), files.end());
+                emit foundFiles(files);
+            }
         }
     }
-}
-
-QList<QUrl> GrepFindFilesThread::files() const {
-    auto tmpList = QList<QUrl>::fromSet(m_files.toSet());
-    std::sort(tmpList.begin(), tmpList.end());
-    return tmpList;
+    else
+    {
+        DirectoryWalker walker(include, exclude, m_projectFilters, m_tryAbort, [this](const QList<QUrl>& files) {
+            emit foundFiles(files);
+        });
+        foreach(const QUrl& directory, m_startDirs)
+        {
+            walker.addStartPath(directory.toLocalFile(), m_depth);
+        }
+        walker.run();
+    }
 }
 
 QStringList GrepFindFilesThread::parseExclude(const QString& excl)
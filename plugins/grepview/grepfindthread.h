@@ -1,8 +1,17 @@
 #ifndef KDEVPLATFORM_PLUGIN_GREPFINDTHREAD_H
 #define KDEVPLATFORM_PLUGIN_GREPFINDTHREAD_H
 
+#include <QPair>
+#include <QSharedPointer>
 #include <QThread>
 #include <QUrl>
+#include <QVector>
+
+#include <util/path.h>
+
+namespace KDevelop {
+class IProjectFilter;
+}
 
 class GrepFindFilesThread : public QThread
 {
@@ -21,11 +30,12 @@ public:
     GrepFindFilesThread(QObject *parent, const QList<QUrl> &startDirs, int depth,
                     const QString &patterns, const QString &exclusions,
                     bool onlyProject);
+    using ProjectFilters = QVector<QSharedPointer<KDevelop::IProjectFilter>>;
     /**
-     * @brief Returns the list of found files
-     * @return List of found files
+     * @brief Hides the files and folders inside the project @p projectPath that @p filters reject
+     * @note Must be called before the thread is started.
      */
-    QList<QUrl> files() const;
+    void addProjectFilters(const KDevelop::Path& projectPath, const ProjectFilters& filters);
     /**
      * @brief Sets the internal m_tryAbort flag to @c true
      * @note It is not guaranteed that the thread stops its work immediately.
@@ -47,7 +57,14 @@ public:
      * @brief Parses exclude string to a list suitable for QDir::match
      */
     static QStringList parseExclude(const QString& excl);
-    
+
+Q_SIGNALS:
+    /**
+     * @brief Emitted for the found files while the search is still running
+     * Each file is reported once, in no particular order.
+     */
+    void foundFiles(const QList<QUrl>& files);
+
 protected:
     void run() override;
 private:
@@ -56,7 +73,7 @@ private:
     QString m_exclString;
     int m_depth;
     bool m_project;
-    QList<QUrl> m_files;
+    QVector<QPair<KDevelop::Path, ProjectFilters>> m_projectFilters;
     volatile bool m_tryAbort;
     // creating with no parameters would be bad
     GrepFindFilesThread();
@@ -15,33 +15,143 @@
 ***************************************************************************/
 
 #include "grepjob.h"
+#include "grepcontentindex.h"
 #include "grepoutputmodel.h"
 #include "greputil.h"
 
 #include <QFile>
+#include <QFutureWatcher>
 #include <QList>
 #include <QRegExp>
+#include <QTextCodec>
 #include <QTextStream>
+#include <QThread>
+#include <QtConcurrentRun>
+
+#include <algorithm>
 
 #include <KEncodingProber>
 #include <KLocalizedString>
 
 #include <serialization/indexedstring.h>
 #include <interfaces/icore.h>
+#include <interfaces/iplugin.h>
+#include <interfaces/iplugincontroller.h>
+#include <interfaces/iproject.h>
+#include <interfaces/iprojectcontroller.h>
 #include <interfaces/iuicontroller.h>
+#include <project/interfaces/iprojectfilterprovider.h>
 
 using namespace KDevelop;
 
 
-GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re)
+namespace {
+
+// count of files searched by one task of the thread pool
+const int GrepBatchSize = 32;
+
+// larger files are read line by line instead of being decoded as a whole
+const qint64 MaxDecodedFileSize = 16 * 1024 * 1024;
+
+char toAsciiLower(char c)
 {
-    GrepOutputItem::List res;
-    QFile file(filename);
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
 
-    if(!file.open(QIODevice::ReadOnly))
-        return res;
-    int lineno = 0;
+bool containsLiteral(const QByteArray& data, const QByteArray& literal, Qt::CaseSensitivity cs)
+{
+    if (cs == Qt::CaseSensitive) {
+        return data.indexOf(literal) != -1;
+    }
+    return std::search(data.constBegin(), data.constEnd(), literal.constBegin(), literal.constEnd(),
+                       [](char a, char b) { return toAsciiLower(a) == toAsciiLower(b); }) != data.constEnd();
+}
+
+bool isAscii(const QByteArray& data)
+{
+    return std::all_of(data.constBegin(), data.constEnd(), [](char c) {
+        return c != 0 && static_cast<uchar>(c) < 0x80;
+    });
+}
+
+QString decode(const QByteArray& data, bool ascii)
+{
+    if (ascii) {
+        return QString::fromLatin1(data);
+    }
+
+    // detect encoding (unicode files can be feed forever, stops when confidence reachs 99%
+    KEncodingProber prober;
+    for (int pos = 0; pos < data.size() && prober.state() == KEncodingProber::Probing && prober.confidence() < 0.99; pos += 0xFF) {
+        prober.feed(data.constData() + pos, qMin(0xFF, data.size() - pos));
+    }
+
+    QTextCodec* codec = nullptr;
+    if (prober.confidence() > 0.7) {
+        codec = QTextCodec::codecForName(prober.encoding());
+    }
+    if (!codec) {
+        codec = QTextCodec::codecForLocale();
+    }
+    // byte order marks take precedence, as they did when reading through QTextStream
+    return QTextCodec::codecForUtfText(data, codec)->toUnicode(data);
+}
+
+/**
+ * @return Whether the pattern substituted into the search template @p tmpl is part of every match
+ */
+bool templateRequiresPattern(const QString& tmpl)
+{
+    const int pos = tmpl.indexOf(QLatin1String("%s"));
+    if (pos == -1 || tmpl.contains(QLatin1String("%%")) || tmpl.contains(QLatin1Char('|'))) {
+        return false;
+    }
+    // a group may be optional, a character class matches a single character of the pattern
+    // and a backslash escapes its first character
+    const QStringRef before = tmpl.leftRef(pos);
+    if (before.contains(QLatin1Char('(')) || before.contains(QLatin1Char('['))
+        || before.endsWith(QLatin1Char('\\'))) {
+        return false;
+    }
+    const QStringRef after = tmpl.midRef(pos + 2, 1);
+    return after != QLatin1String("?") && after != QLatin1String("*") && after != QLatin1String("{");
+}
+
+}
 
+struct GrepBatchResult
+{
+    int fileCount = 0;
+    QVector<QPair<QString, GrepOutputItem::List>> matches;
+};
+
+static void grepLine(GrepOutputItem::List& res, const QString& filename, QString data, int lineno, const QRegExp& re)
+{
+    // remove line terminators (in order to not match them)
+    for (int pos = data.length()-1; pos >= 0 && (data[pos] == QLatin1Char('\r') || data[pos] == QLatin1Char('\n')); pos--) {
+        data.chop(1);
+    }
+
+    int offset = 0;
+    // allow empty string matching result in an infinite loop !
+    while( re.indexIn(data, offset)!=-1 && re.cap(0).length() > 0 )
+    {
+        int start = re.pos(0);
+        int end = start + re.cap(0).length();
+
+        DocumentChangePointer change = DocumentChangePointer(new DocumentChange(
+            IndexedString(filename),
+            KTextEditor::Range(lineno, start, lineno, end),
+            re.cap(0), QString()));
+
+        res << GrepOutputItem(change, data, false);
+        offset = end;
+    }
+}
+
+static GrepOutputItem::List grepFileStreamed(QFile& file, const QString& filename, const QRegExp& re)
+{
+    GrepOutputItem::List res;
 
     // detect encoding (unicode files can be feed forever, stops when confidence reachs 99%
     KEncodingProber prober;
@@ -54,40 +164,113 @@ GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re)
     QTextStream stream(&file);
     if(prober.confidence()>0.7)
         stream.setCodec(prober.encoding().constData());
+    int lineno = 0;
     while( !stream.atEnd() )
     {
-        QString data = stream.readLine();
+        grepLine(res, filename, stream.readLine(), lineno, re);
+        lineno++;
+    }
+    return res;
+}
 
-        // remove line terminators (in order to not match them)
-        for (int pos = data.length()-1; pos >= 0 && (data[pos] == QLatin1Char('\r') || data[pos] == QLatin1Char('\n')); pos--) {
-            data.chop(1);
-        }
+GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re, const QString &literal)
+{
+    GrepOutputItem::List res;
+    QFile file(filename);
+
+    if(!file.open(QIODevice::ReadOnly))
+        return res;
+
+    const qint64 size = file.size();
+    if (size > MaxDecodedFileSize) {
+        return grepFileStreamed(file, filename, re);
+    }
+    const uchar* mapped = size > 0 ? file.map(0, size) : nullptr;
+    const QByteArray bytes = mapped ? QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), size)
+                                    : file.readAll();
+
+    // The ASCII literal has the same bytes in all ASCII compatible encodings. Without NUL bytes, the file
+    // is not UTF-16 or UTF-32. Other characters may fold to ASCII letters when ignoring the case though.
+    const bool asciiLiteral = !literal.isEmpty() && std::all_of(literal.begin(), literal.end(), [](QChar c) {
+        return c.unicode() < 0x80;
+    });
+    const bool ascii = isAscii(bytes);
+    if (asciiLiteral && !containsLiteral(bytes, literal.toLatin1(), re.caseSensitivity())
+        && (re.caseSensitivity() == Qt::CaseSensitive ? !bytes.contains('\0') : ascii)) {
+        return res;
+    }
+
+    const QString text = decode(bytes, ascii);
+    file.close();
 
-        int offset = 0;
-        // allow empty string matching result in an infinite loop !
-        while( re.indexIn(data, offset)!=-1 && re.cap(0).length() > 0 )
-        {
-            int start = re.pos(0);
-            int end = start + re.cap(0).length();
+    // lines without the literal can be skipped without matching the regular expression
+    const bool skipToLiteral = !literal.isEmpty() && re.caseSensitivity() == Qt::CaseSensitive;
 
-            DocumentChangePointer change = DocumentChangePointer(new DocumentChange(
-                IndexedString(filename),
-                KTextEditor::Range(lineno, start, lineno, end),
-                re.cap(0), QString()));
+    int lineno = 0;
+    int lineStart = 0;
+    while (lineStart < text.size())
+    {
+        if (skipToLiteral) {
+            const int next = text.indexOf(literal, lineStart);
+            if (next == -1) {
+                break;
+            }
+            const int skipTo = text.lastIndexOf(QLatin1Char('\n'), next) + 1;
+            if (skipTo > lineStart) {
+                lineno += text.midRef(lineStart, skipTo - lineStart).count(QLatin1Char('\n'));
+                lineStart = skipTo;
+            }
+        }
 
-            res << GrepOutputItem(change, data, false);
-            offset = end;
+        int lineEnd = text.indexOf(QLatin1Char('\n'), lineStart);
+        if (lineEnd == -1) {
+            lineEnd = text.size();
         }
+        grepLine(res, filename, text.mid(lineStart, lineEnd - lineStart), lineno, re);
+        lineStart = lineEnd + 1;
         lineno++;
     }
-    file.close();
     return res;
 }
 
+static bool isExcludedByIndex(const QString& file, const GrepJob::IndexQueries& indexQueries)
+{
+    for (const auto& indexQuery : indexQueries) {
+        GrepContentIndex::Stamp stamp;
+        if (indexQuery.first->excludes(file, indexQuery.second, &stamp)) {
+            // the index may not have caught up with the latest changes yet
+            return GrepContentIndex::stamp(file) == stamp;
+        }
+    }
+    return false;
+}
+
+static GrepBatchResult grepFiles(const QStringList& files, const QRegExp& re, const QString& literal,
+                                 const GrepJob::IndexQueries& indexQueries, const QSharedPointer<QAtomicInt>& cancelled)
+{
+    GrepBatchResult result;
+    for (const QString& file : files) {
+        if (cancelled->load()) {
+            break;
+        }
+        if (isExcludedByIndex(file, indexQueries)) {
+            ++result.fileCount;
+            continue;
+        }
+        const GrepOutputItem::List items = grepFile(file, re, literal);
+        if (!items.isEmpty()) {
+            result.matches.append(qMakePair(file, items));
+        }
+        ++result.fileCount;
+    }
+    return result;
+}
+
 GrepJob::GrepJob( QObject* parent )
     : KJob( parent )
     , m_workState(WorkIdle)
     , m_fileIndex(0)
+    , m_filesGrepped(0)
     , m_findSomething(false)
 {
     qRegisterMetaType<GrepOutputItem::List>();
@@ -98,36 +281,26 @@ GrepJob::GrepJob( QObject* parent )
     connect(this, &GrepJob::result, this, &GrepJob::testFinishState);
 }
 
+GrepJob::~GrepJob()
+{
+    if (m_grepCancelled) {
+        m_grepCancelled->store(1);
+    }
+}
+
 QString GrepJob::statusName() const
 {
     return i18n("Find in Files");
 }
 
-void GrepJob::slotFindFinished()
+bool GrepJob::prepareRegExp()
 {
-    if(m_findThread && !m_findThread->triesToAbort())
-    {
-        m_fileList = m_findThread->files();
-        delete m_findThread;
-    }
-    else
+    // text that is part of every match lets the search skip files and lines without matching them
+    m_literal.clear();
+    if ((!m_settings.regexp || m_settings.pattern == QRegExp::escape(m_settings.pattern))
+        && templateRequiresPattern(m_settings.searchTemplate))
     {
-        m_fileList.clear();
-        emit hideProgress(this);
-        emit clearMessage(this);
-        m_errorMessage = i18n("Search aborted");
-        emitResult();
-        return;
-    }
-    if(m_fileList.isEmpty())
-    {
-        m_workState = WorkIdle;
-        emit hideProgress(this);
-        emit clearMessage(this);
-        m_errorMessage = i18n("No files found matching the wildcard patterns");
-        //model()->slotFailed();
-        emitResult();
-        return;
+        m_literal = m_settings.pattern;
     }
 
     if(!m_settings.regexp)
@@ -144,7 +317,7 @@ void GrepJob::slotFindFinished()
                                     "see https://doc.qt.io/qt-5/qregexp.html#capturedTexts",
                                     "Captures are not allowed in pattern string");
         emitResult();
-        return;
+        return false;
     }
 
     QString pattern = substitudePattern(m_settings.searchTemplate, m_settings.pattern);
@@ -161,14 +334,63 @@ void GrepJob::slotFindFinished()
     m_outputModel->setRegExp(m_regExp);
     m_outputModel->setReplacementTemplate(m_settings.replacementTemplate);
 
+    // the content indexes rule out the files that cannot contain the literal
+    m_indexQueries.clear();
+    if (!m_literal.isEmpty()) {
+        for (const auto& index : qAsConst(m_contentIndexes)) {
+            const auto query = index->query(m_literal, m_regExp.caseSensitivity());
+            if (query.isValid()) {
+                m_indexQueries.append(qMakePair(index, query));
+            }
+        }
+    }
+    return true;
+}
+
+void GrepJob::slotFoundFiles(const QList<QUrl>& files)
+{
+    if(m_workState != WorkGrep)
+        return;
+
+    // the files are searched while more of them are collected
+    m_fileList += files;
+    startGrepBatches();
+    emit showProgress(this, 0, m_fileList.length(), m_filesGrepped);
+}
+
+void GrepJob::slotFindFinished()
+{
+    if(m_findThread && !m_findThread->triesToAbort())
+    {
+        delete m_findThread;
+    }
+    else
+    {
+        m_fileList.clear();
+        emit hideProgress(this);
+        emit clearMessage(this);
+        m_errorMessage = i18n("Search aborted");
+        emitResult();
+        return;
+    }
+    if(m_fileList.isEmpty())
+    {
+        m_workState = WorkIdle;
+        emit hideProgress(this);
+        emit clearMessage(this);
+        m_errorMessage = i18n("No files found matching the wildcard patterns");
+        //model()->slotFailed();
+        emitResult();
+        return;
+    }
 
     emit showMessage(this, i18np("Searching for <b>%2</b> in one file",
                                  "Searching for <b>%2</b> in %1 files",
                                  m_fileList.length(),
                                  m_regExp.pattern().toHtmlEscaped()));
 
-    m_workState = WorkGrep;
-    QMetaObject::invokeMethod( this, "slotWork", Qt::QueuedConnection);
+    // all files might have been searched already
+    slotGrepBatchFinished();
 }
 
 void GrepJob::slotWork()
@@ -182,37 +404,21 @@ void GrepJob::slotWork()
             QMetaObject::invokeMethod(this, "slotWork", Qt::QueuedConnection);
             break;
         case WorkCollectFiles:
+            if(!prepareRegExp())
+                break;
             m_findThread = new GrepFindFilesThread(this, m_directoryChoice, m_settings.depth, m_settings.files, m_settings.exclude, m_settings.projectFilesOnly);
+            if(!m_settings.projectFilesOnly && m_settings.applyProjectFilters)
+                addProjectFilters();
             emit showMessage(this, i18n("Collecting files..."));
+            connect(m_findThread.data(), &GrepFindFilesThread::foundFiles, this, &GrepJob::slotFoundFiles);
             connect(m_findThread.data(), &GrepFindFilesThread::finished, this, &GrepJob::slotFindFinished);
+            m_workState = WorkGrep;
+            m_filesGrepped = 0;
+            m_grepCancelled.reset(new QAtomicInt(0));
             m_findThread->start();
             break;
         case WorkGrep:
-            if(m_fileIndex < m_fileList.length())
-            {
-                emit showProgress(this, 0, m_fileList.length(), m_fileIndex);
-                if(m_fileIndex < m_fileList.length()) {
-                    QString file = m_fileList[m_fileIndex].toLocalFile();
-                    GrepOutputItem::List items = grepFile(file, m_regExp);
-
-                    if(!items.isEmpty())
-                    {
-                        m_findSomething = true;
-                        emit foundMatches(file, items);
-                    }
-
-                    m_fileIndex++;
-                }
-                QMetaObject::invokeMethod(this, "slotWork", Qt::QueuedConnection);
-            }
-            else
-            {
-                emit hideProgress(this);
-                emit clearMessage(this);
-                m_workState = WorkIdle;
-                //model()->slotCompleted();
-                emitResult();
-            }
+            startGrepBatches();
             break;
         case WorkCancelled:
             emit hideProgress(this);
@@ -223,6 +429,101 @@ void GrepJob::slotWork()
     }
 }
 
+void GrepJob::addProjectFilters()
+{
+    // project filters are thread safe, the plugins providing them are not
+    QVector<IProjectFilterProvider*> providers;
+    const auto plugins = ICore::self()->pluginController()->loadedPlugins();
+    for (IPlugin* plugin : plugins) {
+        if (auto* provider = plugin->extension<IProjectFilterProvider>()) {
+            providers << provider;
+        }
+    }
+    if (providers.isEmpty()) {
+        return;
+    }
+
+    const auto projects = ICore::self()->projectController()->projects();
+    for (IProject* project : projects) {
+        // the searched folders may contain the project or be inside of it
+        const Path projectPath = project->path();
+        const bool related = std::any_of(m_directoryChoice.constBegin(), m_directoryChoice.constEnd(),
+                                         [&projectPath](const QUrl& dir) {
+            const Path dirPath(dir);
+            return dirPath == projectPath || dirPath.isParentOf(projectPath) || projectPath.isParentOf(dirPath);
+        });
+        if (!related) {
+            continue;
+        }
+
+        GrepFindFilesThread::ProjectFilters filters;
+        filters.reserve(providers.size());
+        for (auto* provider : qAsConst(providers)) {
+            filters << provider->createFilter(project);
+        }
+        m_findThread->addProjectFilters(projectPath, filters);
+    }
+}
+
+void GrepJob::startGrepBatches()
+{
+    // enough batches to keep all threads busy while the results of the oldest one are reported
+    const int maxBatches = QThread::idealThreadCount() * 2;
+    while (m_grepBatches.size() < maxBatches && m_fileIndex < m_fileList.length()) {
+        QStringList files;
+        const int end = qMin(m_fileIndex + GrepBatchSize, m_fileList.length());
+        files.reserve(end - m_fileIndex);
+        for (; m_fileIndex < end; ++m_fileIndex) {
+            files << m_fileList[m_fileIndex].toLocalFile();
+        }
+
+        // each batch gets its own copy of the regular expression, one instance cannot be used concurrently
+        const QRegExp re = m_regExp;
+        const QString literal = m_literal;
+        const auto indexQueries = m_indexQueries;
+        const auto cancelled = m_grepCancelled;
+        auto* watcher = new QFutureWatcher<GrepBatchResult>(this);
+        connect(watcher, &QFutureWatcher<GrepBatchResult>::finished, this, &GrepJob::slotGrepBatchFinished);
+        watcher->setFuture(QtConcurrent::run([files, re, literal, indexQueries, cancelled]() {
+            return grepFiles(files, re, literal, indexQueries, cancelled);
+        }));
+        m_grepBatches.append(watcher);
+    }
+}
+
+void GrepJob::slotGrepBatchFinished()
+{
+    if (m_workState != WorkGrep) {
+        return;
+    }
+
+    // report the matches in the order of the files, batches may finish in any order
+    while (!m_grepBatches.isEmpty() && m_grepBatches.first()->isFinished()) {
+        auto* watcher = m_grepBatches.takeFirst();
+        const GrepBatchResult result = watcher->result();
+        watcher->deleteLater();
+
+        m_filesGrepped += result.fileCount;
+        for (const auto& matches : result.matches) {
+            m_findSomething = true;
+            emit foundMatches(matches.first, matches.second);
+        }
+    }
+
+    startGrepBatches();
+
+    // the files are still being collected as long as the find thread exists
+    if (m_grepBatches.isEmpty() && !m_findThread) {
+        emit hideProgress(this);
+        emit clearMessage(this);
+        m_workState = WorkIdle;
+        //model()->slotCompleted();
+        emitResult();
+    } else {
+        emit showProgress(this, 0, m_fileList.length(), m_filesGrepped);
+    }
+}
+
 void GrepJob::start()
 {
     if(m_workState!=WorkIdle)
@@ -245,12 +546,20 @@ bool GrepJob::doKill()
 {
     if(m_workState!=WorkIdle && !m_findThread.isNull())
     {
+        if (m_grepCancelled) {
+            m_grepCancelled->store(1);
+        }
         m_workState = WorkIdle;
         m_findThread->tryAbort();
         return false;
     }
     else
     {
+        if (m_workState == WorkGrep) {
+            // the running batches stop after their current file, their results are dropped
+            m_grepCancelled->store(1);
+            QMetaObject::invokeMethod(this, "slotWork", Qt::QueuedConnection);
+        }
         m_workState = WorkCancelled;
     }
     return true;
@@ -286,6 +595,11 @@ void GrepJob::setSettings(const GrepJobSettings& settings)
     setObjectName(i18n("Grep: %1", m_settings.pattern));
 }
 
+void GrepJob::setContentIndexes(const QVector<QSharedPointer<const GrepContentIndex>>& indexes)
+{
+    m_contentIndexes = indexes;
+}
+
 GrepJobSettings GrepJob::settings() const
 {
     return m_settings;
@@ -16,13 +16,16 @@
 #ifndef KDEVPLATFORM_PLUGIN_GREPJOB_H
 #define KDEVPLATFORM_PLUGIN_GREPJOB_H
 
+#include <QAtomicInt>
 #include <QPointer>
+#include <QSharedPointer>
 #include <QUrl>
 
 #include <KJob>
 
 #include <interfaces/istatus.h>
 
+#include "grepcontentindex.h"
 #include "grepfindthread.h"
 #include "grepoutputmodel.h"
 
@@ -32,6 +35,7 @@ namespace KDevelop
 }
 
 class QRegExp;
+template <typename T> class QFutureWatcher;
 class GrepViewPlugin;
 class FindReplaceTest; //FIXME: this is useful only for tests
 
@@ -40,6 +44,7 @@ struct GrepJobSettings
     bool fromHistory = false;
 
     bool projectFilesOnly = false;
+    bool applyProjectFilters = false;
     bool caseSensitive = true;
     bool regexp = true;
 
@@ -55,6 +60,8 @@ struct GrepJobSettings
 
 Q_DECLARE_TYPEINFO(GrepJobSettings, Q_MOVABLE_TYPE);
 
+struct GrepBatchResult;
+
 
 class GrepJob : public KJob, public KDevelop::IStatus
 {
@@ -69,11 +76,17 @@ private:
     explicit GrepJob( QObject *parent = nullptr );
 
 public:
+    ~GrepJob() override;
+
     void setSettings(const GrepJobSettings& settings);
     GrepJobSettings settings() const;
 
     void setOutputModel(GrepOutputModel * model);
     void setDirectoryChoice(const QList<QUrl> &choice);
+    /// The indexes are used to skip files that cannot match, if the search is for a literal
+    void setContentIndexes(const QVector<QSharedPointer<const GrepContentIndex>>& indexes);
+
+    using IndexQueries = QVector<QPair<QSharedPointer<const GrepContentIndex>, GrepContentIndex::Query>>;
 
     void start() override;
 
@@ -84,7 +97,9 @@ protected:
 //    GrepOutputModel* model() const;
 
 private Q_SLOTS:
+    void slotFoundFiles(const QList<QUrl>& files);
     void slotFindFinished();
+    void slotGrepBatchFinished();
     void testFinishState(KJob *job);
 
 Q_SIGNALS:
@@ -97,12 +112,19 @@ Q_SIGNALS:
 
 private:
     Q_INVOKABLE void slotWork();
+    /// Sets up m_regExp from the settings, @returns false and emits the result if they are invalid
+    bool prepareRegExp();
+    /// Lets the find thread skip what the filters of the searched projects hide
+    void addProjectFilters();
+    /// Searches the next files on the global thread pool
+    void startGrepBatches();
 
     QList<QUrl> m_directoryChoice;
     QString m_errorMessage;
 
     QRegExp m_regExp;
     QString m_regExpSimple;
+    QString m_literal;
     GrepOutputModel *m_outputModel;
 
     enum {
@@ -114,6 +136,12 @@ private:
 
     QList<QUrl> m_fileList;
     int m_fileIndex;
+    int m_filesGrepped;
+    // in the order of their files
+    QList<QFutureWatcher<GrepBatchResult>*> m_grepBatches;
+    QSharedPointer<QAtomicInt> m_grepCancelled;
+    QVector<QSharedPointer<const GrepContentIndex>> m_contentIndexes;
+    IndexQueries m_indexQueries;
     QPointer<GrepFindFilesThread> m_findThread;
 
     GrepJobSettings m_settings;
@@ -123,6 +151,10 @@ private:
 
 //FIXME: this function is used externally only for tests, find a way to keep it
 //       static for a regular compilation
-GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re);
+/**
+ * @p literal is a text that is part of every match of @p re, if known. Files and lines without it are
+ * skipped without matching them against @p re.
+ */
+GrepOutputItem::List grepFile(const QString &filename, const QRegExp &re, const QString &literal = QString());
 
 #endif
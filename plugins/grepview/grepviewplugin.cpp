@@ -12,6 +12,7 @@
 ***************************************************************************/
 
 #include "grepviewplugin.h"
+#include "grepcontentindex.h"
 #include "grepdialog.h"
 #include "grepoutputmodel.h"
 #include "grepoutputdelegate.h"
@@ -25,6 +26,7 @@
 #include <QMimeDatabase>
 
 #include <KActionCollection>
+#include <KConfigGroup>
 #include <KLocalizedString>
 #include <KParts/MainWindow>
 #include <KTextEditor/Document>
@@ -35,6 +37,7 @@
 #include <interfaces/idocument.h>
 #include <interfaces/idocumentcontroller.h>
 #include <interfaces/iproject.h>
+#include <interfaces/isession.h>
 #include <interfaces/contextmenuextension.h>
 #include <project/projectmodel.h>
 #include <util/path.h>
@@ -92,6 +95,13 @@ GrepViewPlugin::GrepViewPlugin( QObject *parent, const QVariantList & )
     new GrepOutputDelegate(this);
     m_factory = new GrepOutputViewFactory(this);
     core()->uiController()->addToolView(i18n("Find/Replace in Files"), m_factory);
+
+    // indexing the contents of all project files costs memory and disk space, so it is opt-in
+    const KConfigGroup cg = core()->activeSession()->config()->group("GrepDialog");
+    if (cg.readEntry("ContentIndex", false)) {
+        const QString storageDirectory = core()->activeSession()->pluginDataArea(this).toLocalFile();
+        m_contentIndexer = new GrepContentIndexer(storageDirectory + QLatin1String("/contentindex"), this);
+    }
 }
 
 GrepOutputViewFactory* GrepViewPlugin::toolViewFactory() const
@@ -113,6 +123,10 @@ void GrepViewPlugin::unload()
     }
 
     core()->uiController()->removeToolView(m_factory);
+
+    // waits for the indexing to stop and stores the indexes
+    delete m_contentIndexer;
+    m_contentIndexer = nullptr;
 }
 
 void GrepViewPlugin::startSearch(const QString& pattern, const QString& directory, bool show)
@@ -223,6 +237,9 @@ GrepJob* GrepViewPlugin::newGrepJob()
         m_currentJob->kill();
     }
     m_currentJob = new GrepJob();
+    if (m_contentIndexer) {
+        m_currentJob->setContentIndexes(m_contentIndexer->indexes());
+    }
     connect(m_currentJob, &GrepJob::finished, this, &GrepViewPlugin::jobFinished);
     return m_currentJob;
 }
@@ -21,6 +21,7 @@
 
 class KJob;
 class GrepDialog;
+class GrepContentIndexer;
 class GrepJob;
 class GrepOutputViewFactory;
 
@@ -67,6 +68,7 @@ private:
     QString m_directory;
     QString m_contextMenuDirectory;
     GrepOutputViewFactory* m_factory;
+    GrepContentIndexer* m_contentIndexer = nullptr;
 };
 
 #endif
@@ -21,6 +21,8 @@
 #include <tests/testcore.h>
 #include <tests/autotestshell.h>
 
+#include "../grepcontentindex.h"
+#include "../grepfindthread.h"
 #include "../grepjob.h"
 #include "../grepviewplugin.h"
 #include "../grepoutputmodel.h"
@@ -65,6 +67,10 @@ void FindReplaceTest::testFind_data()
                            << (MatchList() << Match(0, 0, 6));
     QTest::newRow("Matching empty string anywhere") << "foobar\n" << QRegExp("")
                            << (MatchList());
+    QTest::newRow("Non-ASCII text") << QStringLiteral("f\u00e4\u00e4\nbar\nfoo") << QRegExp("foo")
+                           << (MatchList() << Match(2, 0, 3));
+    QTest::newRow("Case insensitive") << "fOo\nbar\nFOO" << QRegExp("foo", Qt::CaseInsensitive)
+                           << (MatchList() << Match(0, 0, 3) << Match(2, 0, 3));
 }
 
 void FindReplaceTest::testFind()
@@ -78,15 +84,23 @@ void FindReplaceTest::testFind()
     file.write(subject.toUtf8());
     file.close();
 
-    GrepOutputItem::List actualMatches = grepFile(file.fileName(), search);
-
-    QCOMPARE(actualMatches.length(), matches.length());
+    QList<GrepOutputItem::List> results;
+    results << grepFile(file.fileName(), search);
+    if (search.pattern() == QRegExp::escape(search.pattern())) {
+        // skipping the files and lines without the literal must not change the matches
+        results << grepFile(file.fileName(), search, search.pattern());
+    }
 
-    for(int i=0; i<matches.length(); i++)
+    foreach(const GrepOutputItem::List& actualMatches, results)
     {
-        QCOMPARE(actualMatches[i].change()->m_range.start().line(),   matches[i].line);
-        QCOMPARE(actualMatches[i].change()->m_range.start().column(), matches[i].start);
-        QCOMPARE(actualMatches[i].change()->m_range.end().column(),   matches[i].end);
+        QCOMPARE(actualMatches.length(), matches.length());
+
+        for(int i=0; i<matches.length(); i++)
+        {
+            QCOMPARE(actualMatches[i].change()->m_range.start().line(),   matches[i].line);
+            QCOMPARE(actualMatches[i].change()->m_range.start().column(), matches[i].start);
+            QCOMPARE(actualMatches[i].change()->m_range.end().column(),   matches[i].end);
+        }
     }
 
     // check that file has not been altered by grepFile
@@ -94,6 +108,155 @@ void FindReplaceTest::testFind()
     QCOMPARE(QString(file.readAll()), subject);
 }
 
+void FindReplaceTest::testFindFiles_data()
+{
+    QTest::addColumn<int>("depth");
+    QTest::addColumn<QString>("exclude");
+    QTest::addColumn<QStringList>("files");
+
+    QTest::newRow("Recursive") << -1 << QString()
+        << QStringList{"a.txt", "excluded/d.txt", "sub/b.txt", "sub/deeper/c.txt"};
+    QTest::newRow("No recursion") << 0 << QString()
+        << QStringList{"a.txt"};
+    QTest::newRow("One level") << 1 << QString()
+        << QStringList{"a.txt", "excluded/d.txt", "sub/b.txt"};
+    QTest::newRow("Excluded folder") << -1 << "excluded"
+        << QStringList{"a.txt", "sub/b.txt", "sub/deeper/c.txt"};
+    QTest::newRow("Excluded file") << -1 << "c.txt"
+        << QStringList{"a.txt", "excluded/d.txt", "sub/b.txt"};
+}
+
+void FindReplaceTest::testFindFiles()
+{
+    QFETCH(int,         depth);
+    QFETCH(QString,     exclude);
+    QFETCH(QStringList, files);
+
+    QTemporaryDir tempDir;
+    QDir dir(tempDir.path());
+    for (const QString& file : {"a.txt", "a.cpp", "sub/b.txt", "sub/deeper/c.txt", "excluded/d.txt"}) {
+        QVERIFY(dir.mkpath(QFileInfo(dir.filePath(file)).path()));
+        QFile f(dir.filePath(file));
+        QVERIFY(f.open(QIODevice::WriteOnly));
+    }
+
+    GrepFindFilesThread thread(nullptr, {QUrl::fromLocalFile(dir.path())}, depth, QStringLiteral("*.txt"), exclude, false);
+    QStringList found;
+    connect(&thread, &GrepFindFilesThread::foundFiles, this, [&](const QList<QUrl>& urls) {
+        for (const QUrl& url : urls) {
+            found << QDir(QFileInfo(dir.path()).canonicalFilePath()).relativeFilePath(url.toLocalFile());
+        }
+    });
+    thread.start();
+    QVERIFY(thread.wait());
+    // deliver the queued results
+    QCoreApplication::sendPostedEvents();
+
+    std::sort(found.begin(), found.end());
+    QCOMPARE(found, files);
+}
+
+void FindReplaceTest::testContentIndex()
+{
+    QTemporaryDir tempDir;
+    QDir dir(tempDir.path());
+    const FileList files = FileList()
+        << File(QStringLiteral("foo.txt"), QStringLiteral("void setFoo(int foo);"))
+        << File(QStringLiteral("bar.txt"), QStringLiteral("void setBar(int bar);"))
+        << File(QStringLiteral("umlaut.txt"), QStringLiteral("void setB\u00e4r();"));
+
+    GrepContentIndex index;
+    foreach(const File& fileData, files)
+    {
+        const QString path = dir.filePath(fileData.first);
+        const QByteArray contents = fileData.second.toUtf8();
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(contents), qint64(contents.size()));
+        file.close();
+        index.addFile(path, GrepContentIndex::stamp(path), contents);
+    }
+
+    const auto check = [&](const GrepContentIndex& index) {
+        const auto query = index.query(QStringLiteral("setFoo"), Qt::CaseSensitive);
+        QVERIFY(query.isValid());
+        GrepContentIndex::Stamp stamp;
+        QVERIFY(!index.excludes(dir.filePath(QStringLiteral("foo.txt")), query, &stamp));
+        QVERIFY(index.excludes(dir.filePath(QStringLiteral("bar.txt")), query, &stamp));
+        QCOMPARE(stamp, GrepContentIndex::stamp(dir.filePath(QStringLiteral("bar.txt"))));
+        QVERIFY(index.excludes(dir.filePath(QStringLiteral("umlaut.txt")), query, &stamp));
+
+        // non-ASCII characters may match ASCII ones when ignoring the case
+        const auto insensitiveQuery = index.query(QStringLiteral("SETFOO"), Qt::CaseInsensitive);
+        QVERIFY(!index.excludes(dir.filePath(QStringLiteral("foo.txt")), insensitiveQuery, &stamp));
+        QVERIFY(index.excludes(dir.filePath(QStringLiteral("bar.txt")), insensitiveQuery, &stamp));
+        QVERIFY(!index.excludes(dir.filePath(QStringLiteral("umlaut.txt")), insensitiveQuery, &stamp));
+
+        // too short for trigrams
+        QVERIFY(!index.query(QStringLiteral("se"), Qt::CaseSensitive).isValid());
+    };
+    check(index);
+
+    const QString storage = dir.filePath(QStringLiteral("index"));
+    QVERIFY(index.save(storage));
+    GrepContentIndex loaded;
+    QVERIFY(loaded.load(storage));
+    check(loaded);
+
+    // queries of a previous generation of the index are not used
+    const auto query = loaded.query(QStringLiteral("setFoo"), Qt::CaseSensitive);
+    loaded.removeFile(dir.filePath(QStringLiteral("umlaut.txt")));
+    QVERIFY(loaded.save(storage));
+    GrepContentIndex::Stamp stamp;
+    QVERIFY(!loaded.excludes(dir.filePath(QStringLiteral("bar.txt")), query, &stamp));
+    QCOMPARE(loaded.files().size(), 2);
+
+    // files added or indexed again after a query are searched
+    const auto laterQuery = loaded.query(QStringLiteral("setFoo"), Qt::CaseSensitive);
+    const QString added = dir.filePath(QStringLiteral("added.txt"));
+    loaded.addFile(added, GrepContentIndex::Stamp(), "setFoo(1);");
+    QVERIFY(!loaded.excludes(added, laterQuery, &stamp));
+    const QString bar = dir.filePath(QStringLiteral("bar.txt"));
+    loaded.addFile(bar, GrepContentIndex::Stamp(), "void setBar(int bar) { setFoo(bar); }");
+    QVERIFY(!loaded.excludes(bar, laterQuery, &stamp));
+    QVERIFY(!loaded.excludes(dir.filePath(QStringLiteral("foo.txt")), laterQuery, &stamp));
+}
+
+void FindReplaceTest::testContentIndexOutdated()
+{
+    QTemporaryDir tempDir;
+    QDir dir(tempDir.path());
+    const QString path = dir.filePath(QStringLiteral("file.txt"));
+
+    auto index = QSharedPointer<GrepContentIndex>::create();
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("nothing here\n");
+    file.close();
+    index->addFile(path, GrepContentIndex::stamp(path), "nothing here\n");
+
+    // the file changes without the index knowing about it
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    file.write("setFoo(1);\n");
+    file.close();
+    QVERIFY(GrepContentIndex::stamp(path) != index->indexedStamp(path));
+
+    auto *job = new GrepJob(this);
+    auto *model = new GrepOutputModel(job);
+    GrepJobSettings settings;
+    job->setOutputModel(model);
+    job->setDirectoryChoice(QList<QUrl>() << QUrl::fromLocalFile(dir.path()));
+    job->setContentIndexes({index});
+
+    settings.regexp = false;
+    settings.pattern = QStringLiteral("setFoo");
+    settings.searchTemplate = QStringLiteral("%s");
+    settings.files = QStringLiteral("*");
+    job->setSettings(settings);
+
+    QVERIFY(job->exec());
+    QVERIFY(model->hasResults());
+}
 
 void FindReplaceTest::testReplace_data()
 {
@@ -138,6 +301,12 @@ void FindReplaceTest::testReplace_data()
         << "f\\w*o" << "%s"
         << "FOO" << "%s"
         << (FileList() << File(QStringLiteral("somefile.txt"), QStringLiteral("FOObar\n FOObar\n fake")));
+
+    QTest::newRow("Template with character class")
+        << (FileList() << File(QStringLiteral("somefile.txt"), QStringLiteral("a\n b\n c")))
+        << "ab" << "[%s]"
+        << "x" << "%s"
+        << (FileList() << File(QStringLiteral("somefile.txt"), QStringLiteral("x\n x\n c")));
 }
 
 
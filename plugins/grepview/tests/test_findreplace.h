@@ -51,6 +51,12 @@ private Q_SLOTS:
     void testFind();
     void testFind_data();
 
+    void testFindFiles();
+    void testFindFiles_data();
+
+    void testContentIndex();
+    void testContentIndexOutdated();
+
     void testReplace();
     void testReplace_data();
 };
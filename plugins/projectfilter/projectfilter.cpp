@@ -25,10 +25,66 @@
 
 #include <QFile>
 
+#include <algorithm>
+
 using namespace KDevelop;
 
+namespace {
+
+bool isLiteralName(const QString& text)
+{
+    return !text.contains(QLatin1Char('*')) && !text.contains(QLatin1Char('/'));
+}
+
+bool isGlob(const QRegExp& pattern)
+{
+    if (pattern.patternSyntax() != QRegExp::WildcardUnix || pattern.caseSensitivity() != Qt::CaseSensitive) {
+        return false;
+    }
+    const QString& text = pattern.pattern();
+    return std::none_of(text.begin(), text.end(), [](QChar c) {
+        return c == QLatin1Char('?') || c == QLatin1Char('[') || c == QLatin1Char(']') || c == QLatin1Char('\\');
+    });
+}
+
+}
+
+ProjectFilter::Glob::Glob(const QString& pattern)
+    : pieces(pattern.split(QLatin1Char('*')))
+{
+}
+
+bool ProjectFilter::Glob::exactMatch(const QString& string) const
+{
+    const QString& first = pieces.first();
+    if (pieces.size() == 1) {
+        return string == first;
+    }
+    const QString& last = pieces.last();
+    if (string.size() < first.size() + last.size() || !string.startsWith(first) || !string.endsWith(last)) {
+        return false;
+    }
+
+    // matching the pieces in between as early as possible leaves the most room for the following ones
+    int from = first.size();
+    const int end = string.size() - last.size();
+    for (int i = 1; i < pieces.size() - 1; ++i) {
+        const QString& piece = pieces.at(i);
+        if (piece.isEmpty()) {
+            continue;
+        }
+        const int pos = string.indexOf(piece, from);
+        if (pos == -1 || pos + piece.size() > end) {
+            return false;
+        }
+        from = pos + piece.size();
+    }
+    return true;
+}
+
 ProjectFilter::ProjectFilter( const IProject* const project, const QVector<Filter>& filters )
-    : m_filters( filters )
+    : m_fileGroups( compile(filters, Filter::Files) )
+    , m_folderGroups( compile(filters, Filter::Folders) )
     , m_projectFile( project->projectFile() )
     , m_project( project->path() )
 {
@@ -40,6 +96,40 @@ ProjectFilter::~ProjectFilter()
 
 }
 
+ProjectFilter::Groups ProjectFilter::compile(const Filters& filters, Filter::Target target)
+{
+    Groups groups;
+    for (const Filter& filter : filters) {
+        if (!(filter.targets & target)) {
+            continue;
+        }
+        if (groups.isEmpty() || groups.last().type != filter.type) {
+            groups.append(Group());
+            groups.last().type = filter.type;
+        }
+        Group& group = groups.last();
+
+        if (!isGlob(filter.pattern)) {
+            group.regExps.append(filter.pattern);
+            continue;
+        }
+
+        // The relative paths start with a slash, so the patterns "*/name", "*suffix" and "*/*suffix"
+        // match exactly when the file name does, given the literals contain no slash.
+        const QString& pattern = filter.pattern.pattern();
+        const QString name = pattern.mid(2);
+        const QString suffix = pattern.mid(pattern.startsWith(QLatin1String("*/*")) ? 3 : 1);
+        if (pattern.startsWith(QLatin1String("*/")) && !name.isEmpty() && isLiteralName(name)) {
+            group.names.insert(name);
+        } else if (pattern.startsWith(QLatin1Char('*')) && isLiteralName(suffix)) {
+            group.nameSuffixes.append(suffix);
+        } else {
+            group.globs.append(Glob(pattern));
+        }
+    }
+    return groups;
+}
+
 bool ProjectFilter::isValid( const Path &path, const bool isFolder ) const
 {
     if (!isFolder && path == m_projectFile) {
@@ -59,27 +149,46 @@ bool ProjectFilter::isValid( const Path &path, const bool isFolder ) const
 
     // we operate on the path relative to the project base
     // by prepending a slash we can filter hidden files with the pattern "*/.*"
+    // it is only built when a pattern needs more than the file name though
+
+    QString relativePath;
+    QString name;
+    if (m_project.isParentOf(path)) {
+        name = path.lastPathSegment();
+    } else {
+        relativePath = makeRelative(path);
+        name = relativePath.mid(relativePath.lastIndexOf(QLatin1Char('/')) + 1);
+    }
+    const auto relative = [&]() -> const QString& {
+        if (relativePath.isEmpty()) {
+            relativePath = makeRelative(path);
+        }
+        return relativePath;
+    };
 
-    const QString relativePath = makeRelative(path);
-
-    if (isFolder && relativePath.endsWith(QLatin1String("/.kdev4"))) {
+    if (isFolder && name == QLatin1String(".kdev4")) {
         return false;
     }
 
     bool isValid = true;
-    foreach( const Filter& filter, m_filters ) {
-        if (isFolder && !(filter.targets & Filter::Folders)) {
-            continue;
-        } else if (!isFolder && !(filter.targets & Filter::Files)) {
+    for (const Group& group : isFolder ? m_folderGroups : m_fileGroups) {
+        // an exclusive filter only applies to valid items, an inclusive one only to invalid ones
+        if (isValid != (group.type == Filter::Exclusive)) {
             continue;
         }
-        if ((!isValid && filter.type == Filter::Inclusive) || (isValid && filter.type == Filter::Exclusive)) {
-            const bool match = filter.pattern.exactMatch( relativePath );
-            if (filter.type == Filter::Inclusive) {
-                isValid = match;
-            } else {
-                isValid = !match;
-            }
+        const bool match = group.names.contains(name)
+            || std::any_of(group.nameSuffixes.begin(), group.nameSuffixes.end(), [&name](const QString& suffix) {
+                return name.endsWith(suffix);
+            })
+            || std::any_of(group.globs.begin(), group.globs.end(), [&relative](const Glob& glob) {
+                return glob.exactMatch(relative());
+            })
+            || std::any_of(group.regExps.begin(), group.regExps.end(), [&relative](QRegExp pattern) {
+                // matching changes the state of a QRegExp, a copy keeps this filter thread safe
+                return pattern.exactMatch(relative());
+            });
+        if (match) {
+            isValid = !isValid;
         }
     }
     return isValid;
@@ -25,6 +25,8 @@
 #include <project/interfaces/iprojectfilter.h>
 #include <util/path.h>
 
+#include <QSet>
+
 #include "filter.h"
 
 namespace KDevelop {
@@ -42,7 +44,41 @@ public:
 private:
     QString makeRelative(const Path& path) const;
 
-    Filters m_filters;
+    /**
+     * A pattern that only contains literal text and '*', matched without QRegExp.
+     */
+    struct Glob
+    {
+        explicit Glob(const QString& pattern);
+        bool exactMatch(const QString& string) const;
+
+        // the literal text between the wildcards
+        QStringList pieces;
+    };
+
+    /**
+     * Consecutive filters of the same type, which apply when any of them matches.
+     *
+     * The patterns are sorted by how cheap they are to match. Most patterns only look at the
+     * file name, these do not need the relative path of an item.
+     */
+    struct Group
+    {
+        Filter::Type type;
+        // patterns "*/name"
+        QSet<QString> names;
+        // patterns "*suffix"
+        QStringList nameSuffixes;
+        // matched against the path relative to the project
+        QVector<Glob> globs;
+        QVector<QRegExp> regExps;
+    };
+    using Groups = QVector<Group>;
+
+    static Groups compile(const Filters& filters, Filter::Target target);
+
+    Groups m_fileGroups;
+    Groups m_folderGroups;
     Path m_projectFile;
     Path m_project;
 };
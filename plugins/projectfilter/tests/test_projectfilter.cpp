@@ -338,6 +338,57 @@ void TestProjectFilter::match_data()
     }
 }
 
+void TestProjectFilter::matchRegExp()
+{
+    QFETCH(QString, pattern);
+
+    const TestProject project;
+    for (Filter::Type type : {Filter::Exclusive, Filter::Inclusive}) {
+        Filters filters;
+        if (type == Filter::Inclusive) {
+            filters << Filter(SerializedFilter(QStringLiteral("*"), Filter::Targets(Filter::Files | Filter::Folders)));
+        }
+        const Filter filter(SerializedFilter(pattern, Filter::Targets(Filter::Files | Filter::Folders), type));
+        filters << filter;
+        const ProjectFilter projectFilter(&project, filters);
+
+        const QStringList paths = {
+            QStringLiteral("foo"), QStringLiteral("foo.o"), QStringLiteral(".o"), QStringLiteral("bar/foo.o"),
+            QStringLiteral("foo.o/bar"), QStringLiteral("libfoo.so.1"), QStringLiteral("libfoo.so.d/bar"),
+            QStringLiteral(".hidden"), QStringLiteral(".hidden/foo"), QStringLiteral("foo/.hidden"),
+            QStringLiteral("moc_foo.cpp"), QStringLiteral("bar/moc_foo.cpp"), QStringLiteral("moc_foo.cpp/bar"),
+            QStringLiteral("build"), QStringLiteral("foo/build"), QStringLiteral("build/foo"),
+            QStringLiteral("foo/bar/baz"), QStringLiteral("foobar"), QStringLiteral("foo*bar")
+        };
+        for (const QString& relativePath : paths) {
+            const Path path(project.path(), relativePath);
+            // what the filter did before it was compiled
+            const bool match = filter.pattern.exactMatch(QLatin1Char('/') + relativePath);
+            const bool expectedIsValid = type == Filter::Inclusive ? match : !match;
+            QVERIFY2(projectFilter.isValid(path, false) == expectedIsValid, qPrintable(relativePath));
+            if (!relativePath.endsWith(QLatin1String(".kdev4"))) {
+                QVERIFY2(projectFilter.isValid(path, true) == expectedIsValid, qPrintable(relativePath));
+            }
+        }
+    }
+}
+
+void TestProjectFilter::matchRegExp_data()
+{
+    QTest::addColumn<QString>("pattern");
+
+    const QStringList patterns = {
+        QStringLiteral("*"), QStringLiteral("*/*"), QStringLiteral("foo"), QStringLiteral("*.o"),
+        QStringLiteral(".o"), QStringLiteral("*.so.*"), QStringLiteral(".*"), QStringLiteral("moc_*.cpp"),
+        QStringLiteral("/build"), QStringLiteral("/build/*"), QStringLiteral("/foo/*/baz"), QStringLiteral("*/bar"),
+        QStringLiteral("*bar"), QStringLiteral("foo*bar"), QStringLiteral("foo\\*bar"), QStringLiteral("fo?"),
+        QStringLiteral("[fb]oo*")
+    };
+    for (const QString& pattern : patterns) {
+        QTest::newRow(qPrintable(pattern)) << pattern;
+    }
+}
+
 static QVector<BenchData> createBenchData(const Path& base, int folderDepth, int foldersPerFolder, int filesPerFolder)
 {
     QVector<BenchData> data;
@@ -394,5 +445,20 @@ void TestProjectFilter::bench_data()
             QTest::newRow(QByteArray("defaults-" + QByteArray::number(data.size()))) << filter << data;
         }
     }
+
+    {
+        // a long list of user-defined filters, as e.g. imported from a .gitignore
+        SerializedFilters serializedFilters = defaultFilters();
+        for (int i = 0; i < 50; ++i) {
+            serializedFilters << SerializedFilter(QStringLiteral("*.ext%1").arg(i), Filter::Files)
+                              << SerializedFilter(QStringLiteral("build%1").arg(i), Filter::Folders)
+                              << SerializedFilter(QStringLiteral("/generated%1/*.h").arg(i), Filter::Files);
+        }
+        serializedFilters << SerializedFilter(QStringLiteral("file?.cpp"), Filter::Files);
+        TestFilter filter(new ProjectFilter(&project, deserialize(serializedFilters)));
+        for (const QVector<BenchData>& data : dataSets) {
+            QTest::newRow(QByteArray("many-" + QByteArray::number(data.size()))) << filter << data;
+        }
+    }
 }
 
@@ -34,6 +34,9 @@ private Q_SLOTS:
     void match();
     void match_data();
 
+    void matchRegExp();
+    void matchRegExp_data();
+
     void bench();
     void bench_data();
 };
@@ -27,6 +27,7 @@
 #include <language/duchain/types/structuretype.h>
 #include <language/duchain/duchainutils.h>
 #include <language/duchain/codemodel.h>
+#include <language/duchain/symbolnameindex.h>
 #include <language/interfaces/iquickopen.h>
 #include <language/interfaces/abbreviations.h>
 
@@ -169,7 +170,19 @@ void ProjectItemDataProvider::setFilterText(const QString& text)
 
     m_currentFilter = text;
 
-    const QVector<CodeModelViewItem> oldFiltered = m_filteredItems;
+    //Only match the items whose identifier the name index has as candidate against the whole search.
+    //Every match of the search is among them, unless it is an abbreviation. So when no item is a candidate,
+    //either because nothing matches or because an abbreviation is searched, all items are matched instead.
+    const QString longestPart = *std::max_element(search.constBegin(), search.constEnd(),
+                                                  [](const QString& lhs, const QString& rhs) {
+        return lhs.size() < rhs.size();
+    });
+    QVector<CodeModelViewItem> candidates;
+    if (SymbolNameIndex::canFind(longestPart)) {
+        candidates = indexedItems(longestPart);
+    }
+
+    const QVector<CodeModelViewItem> oldFiltered = candidates.isEmpty() ? m_filteredItems : candidates;
     QHash<int, int> heights;
 
     m_filteredItems.clear();
@@ -212,6 +225,29 @@ void ProjectItemDataProvider::setFilterText(const QString& text)
 }
 
 
+QVector<CodeModelViewItem> ProjectItemDataProvider::indexedItems(const QString& text) const
+{
+    QVector<int> positions;
+    const auto ids = SymbolNameIndex::self().findCandidates(text);
+    for (const IndexedQualifiedIdentifier& id : ids) {
+        const auto it = m_itemPositions.constFind(id.index());
+        if (it != m_itemPositions.constEnd()) {
+            positions += *it;
+        }
+    }
+
+    //Keep the order of the items, the ones with the same distance to the search stay in it
+    std::sort(positions.begin(), positions.end());
+
+    QVector<CodeModelViewItem> ret;
+    ret.reserve(positions.size());
+    for (int position : qAsConst(positions)) {
+        ret << m_currentItems.at(position);
+    }
+
+    return ret;
+}
+
 KDevelop::QuickOpenDataPointer ProjectItemDataProvider::data(uint pos) const
 {
     //Check whether this position falls into an appended item-list, else apply the offset
@@ -305,6 +341,7 @@ void ProjectItemDataProvider::reset()
 {
     m_files = m_quickopen->fileSet();
     m_currentItems.clear();
+    m_itemPositions.clear();
     m_addedItems.clear();
     m_addedItemsCountCache.markDirty();
 
@@ -330,6 +367,7 @@ void ProjectItemDataProvider::reset()
                     // expressions
                     continue;
                 }
+                m_itemPositions[items[a].id.index()].append(m_currentItems.size());
                 m_currentItems << CodeModelViewItem(u, id);
             }
         }
@@ -106,10 +106,15 @@ public:
 private:
     KDevelop::QuickOpenDataPointer data(uint pos) const override;
 
+    ///Returns the items whose identifier may contain @p text, as found in the SymbolNameIndex
+    QVector<CodeModelViewItem> indexedItems(const QString& text) const;
+
     ItemTypes m_itemTypes;
     KDevelop::IQuickOpen* m_quickopen;
     QSet<KDevelop::IndexedString> m_files;
     QVector<CodeModelViewItem> m_currentItems;
+    //Maps qualified identifier indices to the positions of their items in m_currentItems
+    QHash<uint, QVector<int>> m_itemPositions;
     QString m_currentFilter;
     QVector<CodeModelViewItem> m_filteredItems;
 